@@ -0,0 +1,946 @@
+/**
+ @file bench.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief benchmarks for the expression parser, see expression_parser.h for more information and license terms.
+ */
+#include<math.h>
+#include<time.h>
+#include<stdio.h>
+#include<stdlib.h>
+#include<string.h>
+
+#include"expression_parser.h"
+
+/**
+ @brief number of rows used by the batch evaluation benchmarks
+*/
+#define BENCH_NUM_ROWS (1<<20)
+
+/**
+ @brief minimum run time of each benchmark in seconds, benchmarks are repeated until it is reached
+*/
+#define BENCH_MIN_SECONDS 0.25
+
+/**
+ @brief returns the wall clock time in seconds where available, so that parallel evaluation is timed correctly, and the processor time otherwise
+*/
+double bench_seconds(){
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+	return (double)clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ @brief variable callback reading the variables 'x' and 'y' from a two element array passed as the user data
+*/
+int bench_var_cb( void *user_data, const char *name, double *value ){
+	const double *xy = (const double*)user_data;
+	if( strcmp( name, "x" ) == 0 ){
+		*value = xy[0];
+		return PARSER_TRUE;
+	} else if( strcmp( name, "y" ) == 0 ){
+		*value = xy[1];
+		return PARSER_TRUE;
+	}
+	return PARSER_FALSE;
+}
+
+/**
+ @brief times batch evaluation of a program over the benchmark columns
+ @return rows per second
+*/
+double bench_batch( const parser_program *prog, parser_binding *bindings, double *out, int simd ){
+	parser_batch pb;
+	double start, elapsed;
+	long rows = 0;
+
+	parser_batch_init( &pb, prog, bindings, 2, NULL );
+	pb.simd = simd;
+	start = bench_seconds();
+	do {
+		parser_batch_eval( &pb, BENCH_NUM_ROWS, out );
+		rows += BENCH_NUM_ROWS;
+		elapsed = bench_seconds() - start;
+	} while( elapsed < BENCH_MIN_SECONDS );
+	return rows/elapsed;
+}
+
+/**
+ @brief times row by row evaluation of a program with parser_program_eval()
+ @return rows per second
+*/
+double bench_rows( const parser_program *prog, const double *x, const double *y ){
+	double xy[2], start, elapsed, sum = 0.0;
+	const char *error;
+	long rows = 0;
+	int i;
+
+	start = bench_seconds();
+	do {
+		for( i=0; i<BENCH_NUM_ROWS/16; i++ ){
+			xy[0] = x[i];
+			xy[1] = y[i];
+			sum += parser_program_eval( prog, xy, &error );
+		}
+		rows += BENCH_NUM_ROWS/16;
+		elapsed = bench_seconds() - start;
+	} while( elapsed < BENCH_MIN_SECONDS );
+	if( sum != sum )
+		printf( "  (nan encountered)\n" );
+	return rows/elapsed;
+}
+
+/**
+ @brief times row by row evaluation of a program with parser_program_eval_slots(), assumes the program variables are x and y in that order
+ @return rows per second
+*/
+double bench_rows_slots( const parser_program *prog, const double *x, const double *y ){
+	double xy[2], start, elapsed, sum = 0.0;
+	const char *error;
+	long rows = 0;
+	int i;
+
+	start = bench_seconds();
+	do {
+		for( i=0; i<BENCH_NUM_ROWS/16; i++ ){
+			xy[0] = x[i];
+			xy[1] = y[i];
+			sum += parser_program_eval_slots( prog, xy, NULL, &error );
+		}
+		rows += BENCH_NUM_ROWS/16;
+		elapsed = bench_seconds() - start;
+	} while( elapsed < BENCH_MIN_SECONDS );
+	if( sum != sum )
+		printf( "  (nan encountered)\n" );
+	return rows/elapsed;
+}
+
+/**
+ @brief compares batch evaluation using the SIMD kernels against the scalar batch loops and against row by row evaluation
+*/
+void bench_batch_kernels( const double *x, const double *y, double *out ){
+	const char *exprs[] = {
+		"x*y + (x - y)/(x + 1.5) - x*x*0.5",
+		"x < y && y >= 0.5 || !(x == y) && x != 0.25",
+		"sqrt( fabs( x ) )*y - fabs( y - x )",
+		"(x > y)*x + (x <= y)*y",
+		NULL
+	};
+	parser_binding bindings[2];
+	parser_data pd;
+	parser_program *prog;
+	double simd, scalar, rows, slots;
+	int i;
+
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = y;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+
+	printf( "Batch evaluation, rows/second:\n" );
+	printf( "  %-48s %14s %14s %14s %14s %8s\n", "expression", "simd", "scalar", "row-by-row", "slots", "speedup" );
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], bench_var_cb, NULL, NULL );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf( "  %-48s failed to compile: %s\n", exprs[i], pd.error );
+			continue;
+		}
+		simd   = bench_batch( prog, bindings, out, PARSER_TRUE );
+		scalar = bench_batch( prog, bindings, out, PARSER_FALSE );
+		rows   = bench_rows( prog, x, y );
+		slots  = bench_rows_slots( prog, x, y );
+		printf( "  %-48s %14.4g %14.4g %14.4g %14.4g %7.2fx\n", exprs[i], simd, scalar, rows, slots, simd/scalar );
+		parser_program_free( prog );
+	}
+	printf( "\n" );
+}
+
+/**
+ @brief times parsing and evaluation of expressions dominated by built-in function calls, which exercises the built-in function name lookup of parser_read_builtin()
+*/
+void bench_builtin_dispatch( const double *x, const double *y ){
+	const char *exprs[] = {
+		"atan2( y, x ) + round( x*10.0 )/10.0 + floor( y*4.0 )",
+		"round( atan2( x, y ) ) + floor( x ) + ceil( y ) + fabs( x - y ) + round( y )",
+		"sqrt( x ) + pow( y, 2.0 ) + exp( x ) + log( y + 1.0 ) + sin( x ) + cos( y )",
+		NULL
+	};
+	double xy[2], start, elapsed, sum = 0.0;
+	long evals;
+	int i, j;
+
+	printf( "Parsing function-heavy expressions with parse_expression_with_callbacks(), evals/second:\n" );
+	for( i=0; exprs[i]; i++ ){
+		evals = 0;
+		start = bench_seconds();
+		do {
+			for( j=0; j<1000; j++ ){
+				xy[0] = x[j];
+				xy[1] = y[j];
+				sum += parse_expression_with_callbacks( exprs[i], bench_var_cb, NULL, xy );
+			}
+			evals += 1000;
+			elapsed = bench_seconds() - start;
+		} while( elapsed < BENCH_MIN_SECONDS );
+		printf( "  %-80s %14.4g\n", exprs[i], evals/elapsed );
+	}
+	if( sum != sum )
+		printf( "  (nan encountered)\n" );
+	printf( "\n" );
+}
+
+/**
+ @brief size in bytes of the machine-generated expressions of the parsing benchmarks
+*/
+#define BENCH_EXPRESSION_SIZE (1<<16)
+
+/**
+ @brief generates a long expression as a sum of random terms, roughly what code generators produce. style 0 uses mostly numeric literals, style 1 mostly variables and function calls, style 2 is the same as style 1 with generous whitespace and line breaks and style 3 only uses literals, from short integers to 17 digits with exponents
+ @param[out] buffer receives the nul-terminated expression
+ @param[in] size size of buffer in bytes
+ @param[in] style kind of expression to generate
+*/
+void bench_generate_expression( char *buffer, size_t size, int style ){
+	const char *literal_terms[] = { "%.17g*%.6g", "(%.9g - %.4g)/%.6g", "%.3e", "%.17g^2*%.2g" };
+	const char *call_terms[] = { "sin(x*%.4g)*y", "sqrt(x*x + y*y)/%.3g", "atan2(y, x - %.5g)", "exp(-x*%.3g)*(y - x)", "pow(x, %.3g) + y" };
+	const char *number_terms[] = { "%.0f", "%.17g", "%.6e", "%.17e", "%.3f" };
+	const char *spaced_terms[] = { "sin( x * %.4g ) * y", "sqrt( x * x + y * y ) / %.3g", "atan2( y,\n\t x - %.5g )", "exp( -x * %.3g ) * ( y - x )", "pow( x, %.3g ) + y" };
+	const char *ops[] = { " + ", " - ", " + ", " - " }, *spaced_ops[] = { "\n  + ", "\n  - ", "  +  ", "  -  " };
+	char term[256];
+	size_t len = 0, n;
+	int i;
+
+	buffer[0] = '\0';
+	for( i=0; ; i++ ){
+		if( style == 0 )
+			sprintf( term, literal_terms[rand()%4], rand()/(double)RAND_MAX*1e3, rand()/(double)RAND_MAX, rand()/(double)RAND_MAX + 1.0 );
+		else if( style == 3 )
+			sprintf( term, number_terms[rand()%5], rand()/(double)RAND_MAX*pow( 10.0, rand()%40 - 20 ) );
+		else if( style == 1 )
+			sprintf( term, call_terms[rand()%5], rand()/(double)RAND_MAX + 0.5 );
+		else
+			sprintf( term, spaced_terms[rand()%5], rand()/(double)RAND_MAX + 0.5 );
+		n = strlen( term ) + 4;
+		if( len + n >= size )
+			break;
+		if( i > 0 ){
+			strcpy( buffer+len, style == 2 ? spaced_ops[rand()%4] : ops[rand()%4] );
+			len += strlen( buffer+len );
+		}
+		strcpy( buffer+len, term );
+		len += strlen( term );
+	}
+}
+
+/**
+ @brief times parsing with parse_expression_with_callbacks() and unoptimized compilation with parser_compile() of long machine-generated expressions
+*/
+void bench_parse_throughput( void ){
+	const char *styles[] = { "numeric literals", "variables and calls", "whitespace and line breaks", "literals only" };
+	parser_data pd;
+	parser_program *prog;
+	char *expr;
+	double xy[2] = { 0.5, 0.25 }, start, elapsed, bytes, sum = 0.0, parse, compile;
+	int style;
+
+	expr = malloc( BENCH_EXPRESSION_SIZE );
+	if( !expr )
+		return;
+	srand( 2 );
+	printf( "Parsing %d byte machine-generated expressions, MB/second:\n", BENCH_EXPRESSION_SIZE );
+	printf( "  %-32s %14s %14s\n", "expression", "parse", "compile" );
+	for( style=0; style<4; style++ ){
+		bench_generate_expression( expr, BENCH_EXPRESSION_SIZE, style );
+
+		bytes = 0.0;
+		start = bench_seconds();
+		do {
+			sum += parse_expression_with_callbacks( expr, bench_var_cb, NULL, xy );
+			bytes += strlen( expr );
+			elapsed = bench_seconds() - start;
+		} while( elapsed < BENCH_MIN_SECONDS );
+		parse = bytes/elapsed/1e6;
+
+		bytes = 0.0;
+		start = bench_seconds();
+		do {
+			parser_data_init( &pd, expr, bench_var_cb, NULL, NULL );
+			pd.optimize = PARSER_FALSE;
+			prog = parser_compile( &pd );
+			if( !prog ){
+				printf( "  %-32s failed to compile: %s\n", styles[style], pd.error );
+				break;
+			}
+			parser_program_free( prog );
+			bytes += strlen( expr );
+			elapsed = bench_seconds() - start;
+		} while( elapsed < BENCH_MIN_SECONDS );
+		compile = bytes/elapsed/1e6;
+		printf( "  %-32s %14.4g %14.4g\n", styles[style], parse, compile );
+	}
+	if( sum != sum )
+		printf( "  (nan encountered)\n" );
+	free( expr );
+	printf( "\n" );
+}
+
+/**
+ @brief times parallel batch evaluation on thread pools of increasing size
+*/
+void bench_parallel( const double *x, const double *y, double *out ){
+	const char *expr = "sqrt( x*x + y*y ) + atan2( y, x )*exp( -x ) - pow( y, 1.5 )";
+	const int threads[] = { 1, 2, 4, 8, 16, 32, 0 };
+	parser_binding bindings[2];
+	parser_data pd;
+	parser_program *prog;
+	parser_batch pb;
+	parser_pool *pool;
+	double start, elapsed, base = 0.0;
+	long rows;
+	int i;
+
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = y;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+
+	parser_data_init( &pd, expr, bench_var_cb, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf( "  %s failed to compile: %s\n", expr, pd.error );
+		return;
+	}
+	parser_batch_init( &pb, prog, bindings, 2, NULL );
+
+	printf( "Parallel batch evaluation of %s, rows/second:\n", expr );
+	printf( "  %8s %14s %8s\n", "threads", "rows/second", "scaling" );
+	for( i=0; threads[i]; i++ ){
+		pool = parser_pool_new( threads[i] );
+		if( !pool )
+			continue;
+		rows = 0;
+		start = bench_seconds();
+		do {
+			parser_batch_eval_parallel( &pb, pool, BENCH_NUM_ROWS, out );
+			rows += BENCH_NUM_ROWS;
+			elapsed = bench_seconds() - start;
+		} while( elapsed < BENCH_MIN_SECONDS );
+		base = i == 0 ? rows/elapsed : base;
+		printf( "  %8d %14.4g %7.2fx\n", threads[i], rows/elapsed, rows/elapsed/base );
+		parser_pool_free( pool );
+	}
+	parser_program_free( prog );
+	printf( "\n" );
+}
+
+/**
+ @brief compares row by row evaluation with parser_program_eval_slots() of interpreted programs and of programs translated to machine code with parser_program_jit()
+*/
+void bench_jit( const double *x, const double *y ){
+	const char *exprs[] = {
+		"x*y + (x - y)/(x + 1.5) - x*x*0.5",
+		"x < y && y >= 0.5 || !(x == y) && x != 0.25",
+		"sqrt( x*x + y*y ) + atan2( y, x )*exp( -x )",
+		"(x+1)*(x+2)*(x+3)*(x+4)*(x+5)*(y+1)*(y+2)*(y+3)*(y+4)*(y+5)",
+		NULL
+	};
+	parser_data pd;
+	parser_program *prog;
+	double interp, jit;
+	int i;
+
+	printf( "Row by row evaluation, rows/second:\n" );
+	printf( "  %-64s %14s %14s %8s\n", "expression", "interpreter", "jit", "speedup" );
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], bench_var_cb, NULL, NULL );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf( "  %-64s failed to compile: %s\n", exprs[i], pd.error );
+			continue;
+		}
+		interp = bench_rows_slots( prog, x, y );
+		if( !parser_program_jit( prog ) ){
+			printf( "  %-64s %14.4g %14s\n", exprs[i], interp, "unavailable" );
+		} else {
+			jit = bench_rows_slots( prog, x, y );
+			printf( "  %-64s %14.4g %14.4g %7.2fx\n", exprs[i], interp, jit, jit/interp );
+		}
+		parser_program_free( prog );
+	}
+	printf( "\n" );
+}
+
+/**
+ @brief reports the effect of common subexpression elimination on expressions with repeated subterms, as found in e.g. gaussian mixtures
+*/
+void bench_common_subexpressions( const double *x, const double *y, double *out ){
+	const char *exprs[] = {
+		"exp( -(x-y)^2/(2*0.3^2) ) + 0.5*exp( -(x-y)^2/(2*0.3^2) )*(x-y)^2/(2*0.3^2)",
+		"sqrt( x*x + y*y ) + atan2( y, x )*sqrt( x*x + y*y ) - (x*x + y*y)",
+		NULL
+	};
+	parser_binding bindings[2];
+	parser_data pd;
+	parser_program *prog;
+	int i;
+
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = y;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+
+	printf( "Common subexpression elimination:\n" );
+	printf( "  %-80s %6s %10s %14s\n", "expression", "nodes", "eliminated", "rows/second" );
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], bench_var_cb, NULL, NULL );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf( "  %-80s failed to compile: %s\n", exprs[i], pd.error );
+			continue;
+		}
+		printf( "  %-80s %6d %10d %14.4g\n", exprs[i], parser_program_num_nodes( prog ), parser_program_num_eliminated( prog ), bench_batch( prog, bindings, out, PARSER_TRUE ) );
+		parser_program_free( prog );
+	}
+	printf( "\n" );
+}
+
+/**
+ @brief total size in bytes and number of the allocations made by the library, counted by bench_malloc(), bench_calloc() and bench_realloc(). The bench target is built with PARSER_MALLOC, PARSER_CALLOC, PARSER_REALLOC and PARSER_FREE defined to these functions, the counts stay zero otherwise.
+*/
+static size_t bench_allocated_bytes = 0;
+static size_t bench_allocations = 0;
+
+void *bench_malloc( size_t size ){
+	bench_allocated_bytes += size;
+	bench_allocations++;
+	return malloc( size );
+}
+
+void *bench_calloc( size_t count, size_t size ){
+	bench_allocated_bytes += count*size;
+	bench_allocations++;
+	return calloc( count, size );
+}
+
+void *bench_realloc( void *ptr, size_t size ){
+	bench_allocated_bytes += size;
+	bench_allocations++;
+	return realloc( ptr, size );
+}
+
+void bench_free( void *ptr ){
+	free( ptr );
+}
+
+/**
+ @brief number of expressions in each generated corpus
+*/
+#define BENCH_CORPUS_SIZE 64
+
+/**
+ @brief number of rows evaluated for each expression of a corpus in every pass of the evaluation benchmarks, and by the batch benchmark
+*/
+#define BENCH_CORPUS_ROWS 64
+#define BENCH_CORPUS_BATCH_ROWS 4096
+
+/**
+ @brief maximum size in bytes of a generated corpus expression
+*/
+#define BENCH_CORPUS_EXPRESSION_SIZE 8192
+
+/**
+ @brief expressions of the unit tests in test.c that evaluate successfully for x and y in [0,1], the first corpus of the benchmarks
+*/
+const char *bench_test_corpus[] = {
+	"2.0 + 3.0*4.0 - 6.0/3.0",
+	"-(3.0 - 4.0)/2.0",
+	"pow( 2.0, 3.0 )",
+	"log( 2.0 ) + exp( 0.5 )",
+	"sin( 0.3 ) + cos( 0.3 ) + tan( 0.3 )",
+	"asin( 0.3 ) + acos( 0.3 ) + atan( 0.3 )",
+	"floor( 2.5 ) + floor( -2.5 ) + ceil( 2.5 ) + round( -2.4 )",
+	"3.0 < 2.0 || 1.0 != 1.0 && 2.0 <= 3.0 || !1.0",
+	"(3.0<2.0)*5.0 + (3.0>=2.0)*6.0",
+	"2^3^2",
+	"2^-1^2",
+	"1 + 2*3^2 - 4/x",
+	"3*-x^2",
+	"!x^2 + 1",
+	"1 < 2 == x > 3",
+	"x == 1 && 2 != 3 || 0",
+	"x*x + 2*x - sqrt( x )",
+	"x*2 + 2*x",
+	"exp( -(x-1)^2/(2*0.3^2) ) + 0.25*exp( -(x-1)^2/(2*0.3^2) )*(1-x)",
+	"(x-1)^2 + x",
+	"x > 0 ? sqrt( x ) : 0",
+	"x < 0 || sqrt( x ) > 1",
+	"(x > 1 ? x*x : 0) + x*x",
+	"(x > 1 ? 0 : sqrt( x + 1 )) + (x > 1 ? sqrt( x + 1 ) : 0)",
+	"(x > 0 && fabs( x - 1 ) > 0.5) + fabs( x - 1 )",
+	"x*y + (x - y)/(x + 1.5) - x*x*0.5",
+	"sqrt( x*x + y*y ) + atan2( y, x )*exp( -x )",
+	NULL
+};
+
+/**
+ @brief parameters of a generated corpus
+*/
+typedef struct {
+	/** @brief name of the corpus in the output */
+	const char *name;
+
+	/** @brief depth of the expression trees, leaves are at depth zero */
+	int         depth;
+
+	/** @brief number of operands of the operator chains */
+	int         width;
+
+	/** @brief probability that a leaf is a numeric literal rather than a variable */
+	double      literal_density;
+
+	/** @brief probability that an inner node is a call of a built-in function rather than an operator chain */
+	double      function_density;
+} bench_corpus_params;
+
+/**
+ @brief returns a pseudo-random number in [0,1)
+*/
+double bench_random(){
+	return rand()/((double)RAND_MAX+1.0);
+}
+
+/**
+ @brief appends a randomly generated subexpression of the given depth to an expression, only calling functions and operators without domain errors
+ @param[out] buffer expression, nul-terminated
+ @param[in,out] len length of the expression in buffer
+ @param[in] params parameters of the corpus
+ @param[in] depth depth of the subexpression
+*/
+void bench_random_subexpression( char *buffer, size_t *len, const bench_corpus_params *params, int depth ){
+	const char *unary[] = { "sin", "cos", "atan", "fabs", "floor", "exp" };
+	const char *ops[] = { " + ", " - ", " * ", " / ", " + ", " * " };
+	int i;
+
+	if( depth == 0 ){
+		if( bench_random() < params->literal_density )
+			*len += sprintf( buffer+*len, "%.6g", bench_random()*10.0 );
+		else
+			*len += sprintf( buffer+*len, "%s", rand()%2 ? "x" : "y" );
+	} else if( bench_random() < params->function_density ){
+		if( rand()%4 == 0 ){
+			*len += sprintf( buffer+*len, "atan2( " );
+			bench_random_subexpression( buffer, len, params, depth-1 );
+			*len += sprintf( buffer+*len, ", " );
+			bench_random_subexpression( buffer, len, params, depth-1 );
+		} else {
+			*len += sprintf( buffer+*len, "%s( ", unary[rand()%6] );
+			bench_random_subexpression( buffer, len, params, depth-1 );
+		}
+		*len += sprintf( buffer+*len, " )" );
+	} else {
+		*len += sprintf( buffer+*len, "(" );
+		for( i=0; i<params->width; i++ ){
+			if( i > 0 )
+				*len += sprintf( buffer+*len, "%s", ops[rand()%6] );
+			bench_random_subexpression( buffer, len, params, depth-1 );
+		}
+		*len += sprintf( buffer+*len, ")" );
+	}
+}
+
+/**
+ @brief a corpus of expressions in the variables x and y
+*/
+typedef struct {
+	const char *name;
+	char      **exprs;
+	int         num_exprs;
+	size_t      bytes;
+} bench_corpus;
+
+/**
+ @brief generates a corpus of BENCH_CORPUS_SIZE random expressions, or copies the test corpus if params is NULL
+ @return PARSER_TRUE on success, PARSER_FALSE if out of memory or if an expression would not fit BENCH_CORPUS_EXPRESSION_SIZE
+*/
+int bench_corpus_init( bench_corpus *corpus, const bench_corpus_params *params ){
+	char *buffer;
+	size_t len;
+	int i;
+
+	corpus->name      = params ? params->name : "test";
+	corpus->num_exprs = 0;
+	corpus->bytes     = 0;
+	if( params ){
+		// every leaf takes at most a dozen bytes, every call or chain a dozen more
+		for( len=1, i=0; i<params->depth; i++ )
+			len *= params->width > 2 ? params->width : 2;
+		if( 24*len >= BENCH_CORPUS_EXPRESSION_SIZE )
+			return PARSER_FALSE;
+		corpus->exprs = malloc( BENCH_CORPUS_SIZE*sizeof(char*) );
+	} else {
+		for( i=0; bench_test_corpus[i]; i++ );
+		corpus->exprs = malloc( i*sizeof(char*) );
+	}
+	if( !corpus->exprs )
+		return PARSER_FALSE;
+
+	srand( 3 );
+	for( i=0; params ? i < BENCH_CORPUS_SIZE : bench_test_corpus[i] != NULL; i++ ){
+		buffer = malloc( BENCH_CORPUS_EXPRESSION_SIZE );
+		if( !buffer )
+			return PARSER_FALSE;
+		if( params ){
+			len = 0;
+			bench_random_subexpression( buffer, &len, params, params->depth );
+		} else {
+			strcpy( buffer, bench_test_corpus[i] );
+		}
+		corpus->exprs[corpus->num_exprs++] = buffer;
+		corpus->bytes += strlen( buffer );
+	}
+	return PARSER_TRUE;
+}
+
+void bench_corpus_free( bench_corpus *corpus ){
+	int i;
+	for( i=0; i<corpus->num_exprs; i++ )
+		free( corpus->exprs[i] );
+	free( corpus->exprs );
+}
+
+/**
+ @brief ways of processing a corpus timed by bench_corpus_run(): parsing only, i.e. compiling without optimization, parsing and evaluating with parse_expression_with_callbacks(), the same through a parser_cache with parse_expression_with_cache(), compiling with optimization, the same into a parser_arena that is reset after every pass, loading the compiled programs from a mapped image file, evaluating compiled programs row by row with the interpreter and with the JIT, and batch evaluation
+*/
+enum {
+	BENCH_MODE_PARSE,
+	BENCH_MODE_PARSE_EVAL,
+	BENCH_MODE_CACHED,
+	BENCH_MODE_COMPILE,
+	BENCH_MODE_ARENA,
+	BENCH_MODE_LOAD,
+	BENCH_MODE_EVAL,
+	BENCH_MODE_JIT,
+	BENCH_MODE_BATCH,
+	BENCH_NUM_MODES
+};
+
+const char *bench_mode_names[BENCH_NUM_MODES] = { "parse", "parse_eval", "cached", "compile", "arena", "load", "eval", "jit", "batch" };
+
+/**
+ @brief result of a benchmark, evaluations are parses for the parsing, compilation and loading modes and rows otherwise
+*/
+typedef struct {
+	double ns_per_eval;
+	double evals_per_second;
+	double bytes_per_eval;
+	double allocations_per_eval;
+} bench_result;
+
+/**
+ @brief processes every expression of a corpus once, evaluating compiled programs for BENCH_CORPUS_ROWS values of x and y. the programs read the variables from xy through pointers. images holds the image of each program at image_offsets for the loading mode
+ @return number of evaluations
+*/
+long bench_corpus_pass( const bench_corpus *corpus, parser_program **progs, const double **pointers, parser_cache *cache, parser_arena *arena, const unsigned char *images, const size_t *image_offsets, int mode, const double *x, const double *y, double *xy, double *out, double *sum ){
+	parser_binding bindings[2];
+	parser_data pd;
+	parser_program *prog;
+	parser_batch pb;
+	const char *error;
+	long evals = 0;
+	int i, j;
+
+	for( i=0; i<corpus->num_exprs; i++ ){
+		switch( mode ){
+			case BENCH_MODE_PARSE:
+			case BENCH_MODE_COMPILE:
+			case BENCH_MODE_ARENA:
+				parser_data_init( &pd, corpus->exprs[i], bench_var_cb, NULL, NULL );
+				pd.optimize = mode != BENCH_MODE_PARSE;
+				pd.arena    = mode == BENCH_MODE_ARENA ? arena : NULL;
+				prog = parser_compile( &pd );
+				parser_program_free( prog );
+				evals++;
+				break;
+			case BENCH_MODE_LOAD:
+				prog = parser_program_load( images+image_offsets[i], image_offsets[i+1]-image_offsets[i], bench_var_cb, NULL, NULL, &error );
+				parser_program_free( prog );
+				evals++;
+				break;
+			case BENCH_MODE_PARSE_EVAL:
+				xy[0] = x[i];
+				xy[1] = y[i];
+				*sum += parse_expression_with_callbacks( corpus->exprs[i], bench_var_cb, NULL, xy );
+				evals++;
+				break;
+			case BENCH_MODE_CACHED:
+				xy[0] = x[i];
+				xy[1] = y[i];
+				*sum += parse_expression_with_cache( cache, corpus->exprs[i], bench_var_cb, NULL, xy );
+				evals++;
+				break;
+			case BENCH_MODE_EVAL:
+			case BENCH_MODE_JIT:
+				for( j=0; j<BENCH_CORPUS_ROWS; j++ ){
+					xy[0] = x[j];
+					xy[1] = y[j];
+					*sum += parser_program_eval_pointers( progs[i], pointers+2*i, NULL, &error );
+				}
+				evals += BENCH_CORPUS_ROWS;
+				break;
+			case BENCH_MODE_BATCH:
+				bindings[0].name = "x";
+				bindings[0].data = x;
+				bindings[0].stride = 0;
+				bindings[0].type = PARSER_TYPE_DOUBLE;
+				bindings[1].name = "y";
+				bindings[1].data = y;
+				bindings[1].stride = 0;
+				bindings[1].type = PARSER_TYPE_DOUBLE;
+				parser_batch_init( &pb, progs[i], bindings, 2, NULL );
+				parser_batch_eval( &pb, BENCH_CORPUS_BATCH_ROWS, out );
+				*sum += out[0];
+				evals += BENCH_CORPUS_BATCH_ROWS;
+				break;
+		}
+	}
+	if( mode == BENCH_MODE_ARENA )
+		parser_arena_reset( arena );
+	return evals;
+}
+
+/**
+ @brief times one mode of processing a corpus, repeating passes over the corpus for at least BENCH_MIN_SECONDS. generated expressions may divide by zero, so unlike the other benchmarks nan results are expected
+ @return PARSER_FALSE if the programs could not be compiled
+*/
+int bench_corpus_run( const bench_corpus *corpus, int mode, const double *x, const double *y, double *out, bench_result *result ){
+	parser_program **progs;
+	const double **pointers;
+	parser_cache *cache = NULL;
+	parser_arena arena;
+	parser_data pd;
+	unsigned char *images = NULL, *image;
+	size_t *image_offsets = NULL, image_size = 0;
+	double start, elapsed, sum = 0.0, xy[2];
+	size_t bytes, allocations;
+	FILE *fp;
+	long evals = 0;
+	int i, slot, ok = PARSER_TRUE;
+
+	// the evaluation modes read x and y through pointers to the current row,
+	// in the order of the variable slots of each program
+	progs    = calloc( corpus->num_exprs, sizeof(parser_program*) );
+	pointers = calloc( 2*corpus->num_exprs, sizeof(const double*) );
+	if( !progs || !pointers ){
+		free( progs );
+		free( pointers );
+		return PARSER_FALSE;
+	}
+	for( i=0; i<corpus->num_exprs && mode >= BENCH_MODE_LOAD; i++ ){
+		parser_data_init( &pd, corpus->exprs[i], bench_var_cb, NULL, NULL );
+		progs[i] = parser_compile( &pd );
+		if( !progs[i] || ( mode == BENCH_MODE_JIT && !parser_program_jit( progs[i] ) ) ){
+			ok = PARSER_FALSE;
+			break;
+		}
+		for( slot=0; slot<parser_program_num_variables( progs[i] ); slot++ )
+			pointers[2*i+slot] = strcmp( parser_program_variable_name( progs[i], slot ), "x" ) == 0 ? xy : xy+1;
+	}
+
+	// the programs are saved to a file that is mapped back, as an application
+	// would do at startup instead of parsing its expressions
+	if( ok && mode == BENCH_MODE_LOAD ){
+		image_offsets = calloc( corpus->num_exprs+1, sizeof(size_t) );
+		fp = fopen( "bench_images.bin", "wb" );
+		for( i=0; image_offsets && fp && i<corpus->num_exprs; i++ ){
+			image_offsets[i+1] = image_offsets[i] + parser_program_save( progs[i], NULL, 0 );
+			image = malloc( image_offsets[i+1]-image_offsets[i] );
+			if( !image )
+				break;
+			parser_program_save( progs[i], image, image_offsets[i+1]-image_offsets[i] );
+			fwrite( image, 1, image_offsets[i+1]-image_offsets[i], fp );
+			free( image );
+		}
+		if( fp )
+			fclose( fp );
+		images = parser_image_map( "bench_images.bin", &image_size );
+		ok = images && image_offsets && image_size == image_offsets[corpus->num_exprs];
+	}
+
+	// the arena allocates blocks of 64 KiB as the corpus is compiled
+	parser_arena_init( &arena, NULL, 0, 1<<16 );
+
+	// the cache is large enough for the whole corpus, so only the first pass misses
+	if( mode == BENCH_MODE_CACHED ){
+		cache = parser_cache_new( 1<<26 );
+		ok = cache != NULL;
+	}
+
+	if( ok ){
+		bytes       = bench_allocated_bytes;
+		allocations = bench_allocations;
+		start = bench_seconds();
+		do {
+			evals += bench_corpus_pass( corpus, progs, pointers, cache, &arena, images, image_offsets, mode, x, y, xy, out, &sum );
+			elapsed = bench_seconds() - start;
+		} while( elapsed < BENCH_MIN_SECONDS );
+		result->ns_per_eval          = 1e9*elapsed/evals;
+		result->evals_per_second     = evals/elapsed;
+		result->bytes_per_eval       = (double)(bench_allocated_bytes - bytes)/evals;
+		result->allocations_per_eval = (double)(bench_allocations - allocations)/evals;
+	}
+
+	for( i=0; i<corpus->num_exprs; i++ )
+		parser_program_free( progs[i] );
+	free( progs );
+	free( pointers );
+	parser_cache_free( cache );
+	if( images )
+		parser_image_unmap( images, image_size );
+	free( image_offsets );
+	if( mode == BENCH_MODE_LOAD )
+		remove( "bench_images.bin" );
+	return ok;
+}
+
+/**
+ @brief measures the compiled size of a corpus, compiling it into an arena so that the programs are packed without spare capacity
+ @param[out] nodes total number of nodes of the programs
+ @param[out] bytes total memory used by the programs in bytes
+*/
+void bench_corpus_size( const bench_corpus *corpus, long *nodes, size_t *bytes ){
+	parser_program *prog;
+	parser_arena arena;
+	parser_data pd;
+	int i;
+
+	*nodes = 0;
+	*bytes = 0;
+	parser_arena_init( &arena, NULL, 0, 1<<16 );
+	for( i=0; i<corpus->num_exprs; i++ ){
+		parser_data_init( &pd, corpus->exprs[i], bench_var_cb, NULL, NULL );
+		pd.arena = &arena;
+		prog = parser_compile( &pd );
+		if( prog ){
+			*nodes += parser_program_num_nodes( prog );
+			*bytes += parser_program_size( prog );
+		}
+	}
+	parser_arena_reset( &arena );
+}
+
+/**
+ @brief times every mode of processing the test corpus and generated corpora of increasing depth, width, literal density and function density
+ @param[in] json if true, prints the results as a JSON document rather than a table
+*/
+void bench_corpora( const double *x, const double *y, double *out, int json ){
+	const bench_corpus_params params[] = {
+		{ "shallow",   2, 2, 0.5, 0.25 },
+		{ "deep",      8, 2, 0.5, 0.25 },
+		{ "wide",      2, 8, 0.5, 0.25 },
+		{ "literals",  4, 3, 0.9, 0.1  },
+		{ "variables", 4, 3, 0.1, 0.1  },
+		{ "functions", 4, 3, 0.5, 0.8  }
+	};
+	const int num_corpora = sizeof(params)/sizeof(params[0]) + 1;
+	bench_corpus corpus;
+	bench_result result;
+	size_t bytes;
+	long nodes;
+	int i, mode;
+
+	if( json ){
+		printf( "{\n  \"min_seconds\": %g,\n  \"corpora\": [", BENCH_MIN_SECONDS );
+	} else {
+		printf( "Corpus throughput, ns/eval and bytes allocated/eval, and compiled size in bytes/node:\n" );
+		printf( "  %-10s %5s %7s %7s %6s", "corpus", "exprs", "bytes", "nodes", "B/node" );
+		for( mode=0; mode<BENCH_NUM_MODES; mode++ )
+			printf( " %10s %8s", bench_mode_names[mode], "B/eval" );
+		printf( "\n" );
+	}
+	for( i=0; i<num_corpora; i++ ){
+		if( !bench_corpus_init( &corpus, i == 0 ? NULL : params+i-1 ) ){
+			if( !json )
+				printf( "  %-10s failed to generate\n", i == 0 ? "test" : params[i-1].name );
+			continue;
+		}
+		bench_corpus_size( &corpus, &nodes, &bytes );
+		if( json ){
+			printf( "%s\n    {\n      \"name\": \"%s\",\n      \"expressions\": %d,\n      \"bytes\": %lu,\n", i > 0 ? "," : "", corpus.name, corpus.num_exprs, (unsigned long)corpus.bytes );
+			printf( "      \"nodes\": %ld,\n      \"program_bytes\": %lu,\n      \"bytes_per_node\": %.6g,\n", nodes, (unsigned long)bytes, nodes ? (double)bytes/nodes : 0.0 );
+			if( i > 0 )
+				printf( "      \"depth\": %d,\n      \"width\": %d,\n      \"literal_density\": %g,\n      \"function_density\": %g,\n", params[i-1].depth, params[i-1].width, params[i-1].literal_density, params[i-1].function_density );
+			printf( "      \"modes\": {" );
+		} else {
+			printf( "  %-10s %5d %7lu %7ld %6.1f", corpus.name, corpus.num_exprs, (unsigned long)corpus.bytes, nodes, nodes ? (double)bytes/nodes : 0.0 );
+		}
+		for( mode=0; mode<BENCH_NUM_MODES; mode++ ){
+			if( !bench_corpus_run( &corpus, mode, x, y, out, &result ) ){
+				if( json )
+					printf( "%s\n        \"%s\": null", mode > 0 ? "," : "", bench_mode_names[mode] );
+				else
+					printf( " %10s %8s", "n/a", "" );
+			} else if( json )
+				printf( "%s\n        \"%s\": { \"ns_per_eval\": %.6g, \"evals_per_second\": %.6g, \"bytes_allocated_per_eval\": %.6g, \"allocations_per_eval\": %.6g }", mode > 0 ? "," : "", bench_mode_names[mode], result.ns_per_eval, result.evals_per_second, result.bytes_per_eval, result.allocations_per_eval );
+			else
+				printf( " %10.4g %8.4g", result.ns_per_eval, result.bytes_per_eval );
+		}
+		printf( json ? "\n      }\n    }" : "\n" );
+		bench_corpus_free( &corpus );
+	}
+	printf( json ? "\n  ]\n}\n" : "\n" );
+}
+
+/**
+ @brief runs the benchmarks, printing the results to stdout. with the argument --json, only runs the corpus benchmarks and prints their results as a JSON document
+*/
+int main( int argc, char **argv ){
+	double *x, *y, *out;
+	int i, json = argc > 1 && strcmp( argv[1], "--json" ) == 0;
+
+	x   = malloc( BENCH_NUM_ROWS*sizeof(double) );
+	y   = malloc( BENCH_NUM_ROWS*sizeof(double) );
+	out = malloc( BENCH_NUM_ROWS*sizeof(double) );
+	if( !x || !y || !out ){
+		printf( "Out of memory\n" );
+		return 1;
+	}
+	srand( 1 );
+	for( i=0; i<BENCH_NUM_ROWS; i++ ){
+		x[i] = (double)rand()/RAND_MAX;
+		y[i] = (double)rand()/RAND_MAX;
+	}
+
+	// the JSON document only holds the corpus benchmarks, which track
+	// regressions between releases, the others are for exploration
+	if( !json ){
+		bench_batch_kernels( x, y, out );
+		bench_builtin_dispatch( x, y );
+		bench_parse_throughput();
+		bench_common_subexpressions( x, y, out );
+		bench_jit( x, y );
+		bench_parallel( x, y, out );
+	}
+	bench_corpora( x, y, out, json );
+
+	free( x );
+	free( y );
+	free( out );
+	return 0;
+}
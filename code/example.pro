@@ -7,10 +7,30 @@ CONFIG    += console debug
 TARGET	  = expression_parser_example
 
 # set the source and header directories
-HEADERS	+= expression_parser.h 		 
+HEADERS	+= expression_parser.h \
+           expression_internal.h
 SOURCES	+= expression_parser.c \
+           expression_lexer.c \
+           expression_number.c \
+           expression_program.c \
+           expression_batch.c \
+           expression_simd.c \
+           expression_registry.c \
+           expression_optimize.c \
+           expression_jit.c \
+           expression_pool.c \
+           expression_cache.c \
+           expression_image.c \
+           expression_arena.c \
+           expression_diff.c \
+           expression_interval.c \
+           expression_float.c \
            example.c       
         
+unix {
+  LIBS += -lpthread
+}
+
 mac {
   CONFIG -= app_bundle
 }
\ No newline at end of file
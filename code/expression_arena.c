@@ -0,0 +1,155 @@
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_arena.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief bump allocator for compiled programs, see expression_parser.h for more information and license terms.
+
+ An arena hands out memory from the end of its current block, first the buffer given to parser_arena_init() and then, once that is full, blocks of at least parser_arena::block_size bytes allocated with PARSER_MALLOC.  Blocks are chained so that parser_arena_reset() releases everything at once, however many programs were compiled.  Compilation grows its arrays and runs the optimizer in the arena too, then packs the finished program into one contiguous allocation and moves it back to where compilation started, so the scratch memory is reused by the next program.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief header of a block allocated by an arena, followed by the memory handed out from the block
+*/
+typedef struct parser_arena_block {
+	/** @brief block allocated before this one, NULL for the first */
+	struct parser_arena_block *prev;
+
+	/** @brief usable size of the block in bytes */
+	size_t                     size;
+} parser_arena_block;
+
+/**
+ @brief first usable byte of a block
+*/
+#define PARSER_ARENA_BLOCK_DATA( block ) ( (unsigned char*)(block) + PARSER_ARENA_ROUND( sizeof(parser_arena_block) ) )
+
+/**
+ @brief makes a block, or the caller buffer if block is NULL, the block allocations are made from
+*/
+static void parser_arena_use( parser_arena *arena, parser_arena_block *block, size_t used ){
+	arena->blocks = block;
+	arena->block  = block ? PARSER_ARENA_BLOCK_DATA( block ) : arena->buffer;
+	arena->size   = block ? block->size : arena->buffer_size;
+	arena->used   = used;
+}
+
+void parser_arena_init( parser_arena *arena, void *buffer, size_t size, size_t block_size ){
+	size_t skip = buffer ? ( PARSER_ARENA_ALIGNMENT - (size_t)buffer % PARSER_ARENA_ALIGNMENT ) % PARSER_ARENA_ALIGNMENT : 0;
+
+	// the buffer is trimmed to the alignment of the allocations
+	arena->buffer      = buffer && size > skip ? (unsigned char*)buffer + skip : NULL;
+	arena->buffer_size = arena->buffer ? size - skip : 0;
+	arena->block_size  = block_size;
+	arena->retired     = 0;
+	parser_arena_use( arena, NULL, 0 );
+}
+
+void *parser_arena_alloc( parser_arena *arena, size_t size ){
+	parser_arena_block *block;
+	size_t block_size;
+	void *data;
+
+	size = PARSER_ARENA_ROUND( size );
+	if( size > arena->size - arena->used ){
+		if( arena->block_size == 0 )
+			return NULL;
+		block_size = size > arena->block_size ? size : arena->block_size;
+		block = PARSER_MALLOC( PARSER_ARENA_ROUND( sizeof(parser_arena_block) ) + block_size );
+		if( !block )
+			return NULL;
+		block->prev = arena->blocks;
+		block->size = block_size;
+		arena->retired += arena->used;
+		parser_arena_use( arena, block, 0 );
+	}
+	data = arena->block + arena->used;
+	arena->used += size;
+	return data;
+}
+
+void parser_arena_reset( parser_arena *arena ){
+	parser_arena_block *block, *prev;
+	for( block=arena->blocks; block; block=prev ){
+		prev = block->prev;
+		PARSER_FREE( block );
+	}
+	arena->retired = 0;
+	parser_arena_use( arena, NULL, 0 );
+}
+
+size_t parser_arena_used( const parser_arena *arena ){
+	return arena->retired + arena->used;
+}
+
+void *parser_arena_realloc( parser_arena *arena, void *ptr, size_t old_size, size_t new_size ){
+	unsigned char *data = ptr;
+	void *copy;
+
+	// the most recent allocation grows in place if the block has room
+	if( data && data + PARSER_ARENA_ROUND( old_size ) == arena->block + arena->used && PARSER_ARENA_ROUND( new_size ) - PARSER_ARENA_ROUND( old_size ) <= arena->size - arena->used ){
+		arena->used += PARSER_ARENA_ROUND( new_size ) - PARSER_ARENA_ROUND( old_size );
+		return ptr;
+	}
+	copy = parser_arena_alloc( arena, new_size );
+	if( copy && data )
+		memcpy( copy, data, old_size < new_size ? old_size : new_size );
+	return copy;
+}
+
+void parser_arena_get_mark( const parser_arena *arena, parser_arena_mark *mark ){
+	mark->blocks  = arena->blocks;
+	mark->used    = arena->used;
+	mark->retired = arena->retired;
+}
+
+/**
+ @brief frees the blocks allocated after a block and before another
+ @param[in] newest most recent block to keep, the chain is walked from it
+ @param[in] oldest block to keep, NULL for the caller buffer
+*/
+static void parser_arena_free_between( parser_arena_block *newest, parser_arena_block *oldest ){
+	parser_arena_block *block, *prev;
+	for( block=newest->prev; block != oldest; block=prev ){
+		prev = block->prev;
+		PARSER_FREE( block );
+	}
+	newest->prev = oldest;
+}
+
+void parser_arena_rewind( parser_arena *arena, const parser_arena_mark *mark ){
+	parser_arena_block *block = arena->blocks;
+	if( block != mark->blocks ){
+		parser_arena_free_between( block, mark->blocks );
+		PARSER_FREE( block );
+	}
+	arena->retired = mark->retired;
+	parser_arena_use( arena, mark->blocks, mark->used );
+}
+
+void *parser_arena_keep( parser_arena *arena, const parser_arena_mark *mark, void *data, size_t size ){
+	unsigned char *dest;
+	size_t mark_size;
+
+	size = PARSER_ARENA_ROUND( size );
+	mark_size = mark->blocks ? ((parser_arena_block*)mark->blocks)->size : arena->buffer_size;
+	if( size <= mark_size - mark->used ){
+		// data moves down to the mark, possibly from a later block
+		dest = ( mark->blocks ? PARSER_ARENA_BLOCK_DATA( mark->blocks ) : arena->buffer ) + mark->used;
+		memmove( dest, data, size );
+		parser_arena_rewind( arena, mark );
+		arena->used += size;
+		return dest;
+	}
+
+	// data only fits in the current block, which was allocated since the
+	// mark, the rest of the block of the mark is lost
+	parser_arena_free_between( arena->blocks, mark->blocks );
+	memmove( arena->block, data, size );
+	arena->retired = mark->retired + mark->used;
+	arena->used    = size;
+	return arena->block;
+}
@@ -0,0 +1,1136 @@
+#include<math.h>
+#include<string.h>
+#include<stdlib.h>
+#include<stdint.h>
+
+/**
+ @file expression_batch.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief columnar evaluation of compiled programs over many rows, see expression_parser.h for more information and license terms.
+
+ Rather than running the whole program once per row, the batch evaluator runs each node of the program over a chunk of PARSER_BATCH_CHUNK_SIZE rows at a time.  Every node writes its chunk of values to a register, a PARSER_BATCH_CHUNK_SIZE array of doubles, and registers are reused as soon as the last node reading them has run, so the scratch space stays small enough to remain in cache.
+
+ Jumps are taken row by row: a row that takes a jump is masked off until the evaluation reaches the target, so the nodes of the operands of &&, || and ?: that a row does not need are not evaluated for it, and do not fail for it.  Nodes that no row of the chunk needs are skipped altogether, while nodes that every row needs run at full speed without a mask.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief read-only evaluation plan of the batch evaluator, shared by all threads evaluating the same call
+*/
+typedef struct {
+	/** @brief register holding the chunk of values of each node */
+	int            *regs;
+
+	/** @brief number of registers */
+	int             num_regs;
+
+	/** @brief first row of the bound column of each variable slot, NULL if the variable is looked up through the callback */
+	const char    **columns;
+
+	/** @brief stride in bytes of the bound column of each variable slot */
+	size_t         *strides;
+
+	/** @brief PARSER_TYPE_* element type of the bound column of each variable slot */
+	int            *types;
+
+	/** @brief values of the variables looked up through the callback, indexed by variable slot */
+	double         *constants;
+} parser_batch_plan;
+
+/**
+ @brief per-thread scratch space of the batch evaluator
+*/
+typedef struct {
+	/** @brief register storage, num_regs chunks of PARSER_BATCH_CHUNK_SIZE values */
+	double         *buffers;
+
+	/** @brief per-row error flags for the current chunk */
+	unsigned char  *failed;
+
+	/** @brief per-row flags of the rows that evaluate the current node */
+	unsigned char  *active;
+
+	/** @brief node at which each row that took a jump is evaluated again */
+	int            *resume;
+} parser_batch_scratch;
+
+/**
+ @brief running reduction of one output over a range of rows
+*/
+typedef struct {
+	/** @brief number of rows reduced */
+	size_t          count;
+
+	/** @brief sum of the values and the running compensation of its rounding errors */
+	double          sum;
+	double          compensation;
+
+	/** @brief smallest and largest value */
+	double          min;
+	double          max;
+} parser_batch_partial;
+
+int parser_batch_init( parser_batch *pb, const parser_program *prog, const parser_binding *bindings, int num_bindings, void *user_data ){
+	pb->program      = prog;
+	pb->bindings     = bindings;
+	pb->num_bindings = num_bindings;
+	pb->user_data    = user_data;
+	pb->simd         = PARSER_TRUE;
+	pb->error        = NULL;
+	return PARSER_TRUE;
+}
+
+/**
+ @brief assigns a register to each node of a program in a single forward pass, releasing the registers of operands after their last use so they can be reused by later nodes. Rows that skip a node leave its register untouched, which is safe since the lazy operation after the skipped nodes does not read them for those rows.
+ @param[in] prog program to allocate registers for
+ @param[out] regs register of each node, -1 for the jumps, which have no value
+ @param[in] work scratch space for 2*num_nodes integers
+ @return number of registers used
+*/
+static int parser_batch_allocate_registers( const parser_program *prog, int *regs, int *work ){
+	int *last_use = work, *free_regs = work + prog->num_nodes;
+	int i, j, k, num_free=0, num_regs=0, operands[3];
+	const parser_node *node;
+
+	// find the last node reading each node
+	for( i=0; i<prog->num_nodes; i++ )
+		last_use[i] = i;
+	for( i=0, node=prog->nodes; i<prog->num_nodes; i++, node++ ){
+		if( PARSER_OP_HAS_ARGS( prog->ops[i] ) ){
+			for( j=0; j<node->b; j++ )
+				last_use[prog->args[node->a+j]] = i;
+		} else {
+			if( parser_op_arity( prog->ops[i] ) >= 1 ) last_use[node->a] = i;
+			if( parser_op_arity( prog->ops[i] ) >= 2 ) last_use[node->b] = i;
+			if( parser_op_arity( prog->ops[i] ) >= 3 ) last_use[node->c] = i;
+		}
+	}
+	// outputs are read after the last node
+	for( i=0; i<prog->num_outputs; i++ )
+		last_use[prog->outputs[i]] = prog->num_nodes;
+
+	for( i=0, node=prog->nodes; i<prog->num_nodes; i++, node++ ){
+		// release operands whose last use is this node, kernels are elementwise
+		// so the result may safely overwrite one of its operands
+		if( PARSER_OP_HAS_ARGS( prog->ops[i] ) ){
+			for( j=0; j<node->b; j++ ){
+				k = prog->args[node->a+j];
+				if( last_use[k] == i ){
+					free_regs[num_free++] = regs[k];
+					last_use[k] = -1;
+				}
+			}
+		} else {
+			operands[0] = parser_op_arity( prog->ops[i] ) >= 1 ? node->a : -1;
+			operands[1] = parser_op_arity( prog->ops[i] ) >= 2 ? node->b : -1;
+			operands[2] = parser_op_arity( prog->ops[i] ) >= 3 ? node->c : -1;
+			for( j=0; j<3; j++ ){
+				k = operands[j];
+				if( k >= 0 && last_use[k] == i ){
+					free_regs[num_free++] = regs[k];
+					last_use[k] = -1;
+				}
+			}
+		}
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) )
+			regs[i] = -1;
+		else
+			regs[i] = num_free ? free_regs[--num_free] : num_regs++;
+	}
+	return num_regs;
+}
+
+/**
+ @brief size in bytes of an element of a column of a PARSER_TYPE_* type, zero for unknown types
+*/
+static size_t parser_batch_type_size( int type ){
+	switch( type ){
+		case PARSER_TYPE_DOUBLE: return sizeof(double);
+		case PARSER_TYPE_FLOAT:  return sizeof(float);
+		case PARSER_TYPE_INT32:  return sizeof(int32_t);
+		case PARSER_TYPE_INT64:  return sizeof(int64_t);
+		case PARSER_TYPE_UINT8:  return sizeof(uint8_t);
+	}
+	return 0;
+}
+
+/**
+ @brief reads n values of a column of a PARSER_TYPE_* type, converting them to double
+ @param[in] col first value to read
+ @param[in] stride distance in bytes between consecutive values
+ @param[in] type element type of the column
+ @param[out] v array of n values
+ @param[in] n number of values to read
+*/
+static void parser_batch_load( const char *col, size_t stride, int type, double *v, int n ){
+	int r;
+	// one loop per type keeps the conversion out of the per-row work
+	switch( type ){
+		case PARSER_TYPE_DOUBLE: for( r=0; r<n; r++, col += stride ) v[r] = *(const double*)col;          break;
+		case PARSER_TYPE_FLOAT:  for( r=0; r<n; r++, col += stride ) v[r] = (double)*(const float*)col;   break;
+		case PARSER_TYPE_INT32:  for( r=0; r<n; r++, col += stride ) v[r] = (double)*(const int32_t*)col; break;
+		case PARSER_TYPE_INT64:  for( r=0; r<n; r++, col += stride ) v[r] = (double)*(const int64_t*)col; break;
+		case PARSER_TYPE_UINT8:  for( r=0; r<n; r++, col += stride ) v[r] = (double)*(const uint8_t*)col; break;
+	}
+}
+
+/**
+ @brief reads n values of a column of a PARSER_TYPE_* type like parser_batch_load(), converting them to float
+*/
+static void parser_batch_load_float( const char *col, size_t stride, int type, float *v, int n ){
+	int r;
+	switch( type ){
+		case PARSER_TYPE_DOUBLE: for( r=0; r<n; r++, col += stride ) v[r] = (float)*(const double*)col;  break;
+		case PARSER_TYPE_FLOAT:  for( r=0; r<n; r++, col += stride ) v[r] = *(const float*)col;           break;
+		case PARSER_TYPE_INT32:  for( r=0; r<n; r++, col += stride ) v[r] = (float)*(const int32_t*)col;  break;
+		case PARSER_TYPE_INT64:  for( r=0; r<n; r++, col += stride ) v[r] = (float)*(const int64_t*)col;  break;
+		case PARSER_TYPE_UINT8:  for( r=0; r<n; r++, col += stride ) v[r] = (float)*(const uint8_t*)col;  break;
+	}
+}
+
+/**
+ @brief allocates the evaluation plan for the program of a parser_batch structure, assigning registers and resolving the program variables to bound columns or callback values
+ @return PARSER_TRUE on success, PARSER_FALSE with pb->error set otherwise
+*/
+static int parser_batch_plan_init( parser_batch *pb, parser_batch_plan *plan ){
+	const parser_program *prog = pb->program;
+	int i, j, *work;
+
+	memset( plan, 0, sizeof(parser_batch_plan) );
+	plan->regs      = PARSER_MALLOC( prog->num_nodes*sizeof(int) );
+	plan->columns   = PARSER_MALLOC( (prog->num_variables+1)*sizeof(const char*) );
+	plan->strides   = PARSER_MALLOC( (prog->num_variables+1)*sizeof(size_t) );
+	plan->constants = PARSER_MALLOC( (prog->num_variables+1)*sizeof(double) );
+	plan->types     = PARSER_MALLOC( (prog->num_variables+1)*sizeof(int) );
+	work            = PARSER_MALLOC( 2*prog->num_nodes*sizeof(int) );
+	if( !plan->regs || !plan->columns || !plan->strides || !plan->constants || !plan->types || !work ){
+		PARSER_FREE( work );
+		pb->error = "Out of memory while evaluating expression!";
+		return PARSER_FALSE;
+	}
+	plan->num_regs = parser_batch_allocate_registers( prog, plan->regs, work );
+	PARSER_FREE( work );
+
+	// bind each variable to a column, or look it up once through the callback
+	for( i=0; i<prog->num_variables; i++ ){
+		plan->columns[i] = NULL;
+		for( j=0; j<pb->num_bindings; j++ ){
+			if( strcmp( pb->bindings[j].name, prog->variables[i] ) == 0 ){
+				plan->columns[i] = (const char*)pb->bindings[j].data;
+				plan->types[i]   = pb->bindings[j].type;
+				plan->strides[i] = pb->bindings[j].stride ? pb->bindings[j].stride : parser_batch_type_size( plan->types[i] );
+				break;
+			}
+		}
+		if( plan->columns[i] && !parser_batch_type_size( plan->types[i] ) ){
+			pb->error = "Unknown column type!";
+			return PARSER_FALSE;
+		}
+		if( !plan->columns[i] && ( !prog->variable_cb || !prog->variable_cb( pb->user_data, prog->variables[i], plan->constants+i ) ) ){
+			pb->error = "Could not look up value for variable!";
+			return PARSER_FALSE;
+		}
+	}
+	return PARSER_TRUE;
+}
+
+/**
+ @brief releases the evaluation plan allocated by parser_batch_plan_init()
+*/
+static void parser_batch_plan_free( parser_batch_plan *plan ){
+	PARSER_FREE( plan->regs );
+	PARSER_FREE( plan->columns );
+	PARSER_FREE( plan->strides );
+	PARSER_FREE( plan->constants );
+	PARSER_FREE( plan->types );
+}
+
+/**
+ @brief allocates the scratch space of one thread for an evaluation plan
+ @return PARSER_TRUE on success, PARSER_FALSE if memory could not be allocated
+*/
+static int parser_batch_scratch_init( const parser_batch_plan *plan, parser_batch_scratch *scratch ){
+	// the vectorized kernels run over every row of a chunk, including rows
+	// that skip the node, so the registers are cleared once to be defined
+	scratch->buffers = PARSER_CALLOC( plan->num_regs*PARSER_BATCH_CHUNK_SIZE, sizeof(double) );
+	scratch->failed  = PARSER_MALLOC( PARSER_BATCH_CHUNK_SIZE );
+	scratch->active  = PARSER_MALLOC( PARSER_BATCH_CHUNK_SIZE );
+	scratch->resume  = PARSER_MALLOC( PARSER_BATCH_CHUNK_SIZE*sizeof(int) );
+	return scratch->buffers && scratch->failed && scratch->active && scratch->resume;
+}
+
+/**
+ @brief releases the scratch space allocated by parser_batch_scratch_init()
+*/
+static void parser_batch_scratch_free( parser_batch_scratch *scratch ){
+	PARSER_FREE( scratch->buffers );
+	PARSER_FREE( scratch->failed );
+	PARSER_FREE( scratch->active );
+	PARSER_FREE( scratch->resume );
+}
+
+/**
+ @brief flags the rows of a chunk where a built-in function argument is outside of the function domain
+ @param[in] mask rows to check, NULL to check every row
+ @return error string if any row failed the check, otherwise the error string passed in
+*/
+static const char *parser_batch_check_domain( int op, const double *a, int n, const unsigned char *mask, unsigned char *failed, const char *err ){
+	int r;
+	for( r=0; r<n; r++ ){
+		if( mask && !mask[r] )
+			continue;
+		if( ( op == PARSER_OP_SQRT && a[r] < 0.0 ) ||
+		    ( op == PARSER_OP_LOG  && a[r] <= 0.0 ) ||
+		    ( ( op == PARSER_OP_ASIN || op == PARSER_OP_ACOS ) && fabs(a[r]) > 1.0 ) ){
+			failed[r] = 1;
+			err = err ? err : op == PARSER_OP_SQRT ? "sqrt(x) undefined for x < 0!" :
+			      op == PARSER_OP_LOG  ? "log(x) undefined for x <= 0!" :
+			      op == PARSER_OP_ASIN ? "asin(x) undefined for |x| > 1!" : "acos(x) undefined for |x| > 1!";
+		}
+	}
+	return err;
+}
+
+/**
+ @brief evaluates the program for a chunk of at most PARSER_BATCH_CHUNK_SIZE rows
+ @param[in] pb batch structure
+ @param[in] plan evaluation plan
+ @param[in] scratch scratch space of the calling thread
+ @param[in] first index of the first row of the chunk
+ @param[in] n number of rows in the chunk
+ @param[out] outs one column of results per output, the chunk is written from row first
+ @param[in] num_outs number of outputs to write, one or parser_program::num_outputs, or zero to leave the outputs in their registers
+ @return NULL if every row evaluated successfully, otherwise the first error of the chunk
+*/
+static const char *parser_batch_run_chunk( const parser_batch *pb, const parser_batch_plan *plan, parser_batch_scratch *scratch, size_t first, int n, double * const *outs, int num_outs ){
+	const parser_program *prog = pb->program;
+	const parser_node *node = prog->nodes;
+	double args[PARSER_MAX_ARGUMENT_COUNT], *v, *a, *b, *c, x, y;
+	const char *col, *err = NULL;
+	unsigned char *active = scratch->active, *mask;
+	int *resume = scratch->resume;
+	size_t stride;
+	int i, j, k, r, r0, arity, num_active = n, next = prog->num_nodes;
+
+	memset( scratch->failed, 0, n );
+	memset( active, 1, n );
+
+	// applies an elementwise expression of x = a[r] and y = b[r] to the rows
+	// of the chunk not already handled by a vectorized kernel, skipping the
+	// rows masked off by a jump
+#define PARSER_BATCH_LOOP( expr ) \
+	if( !mask ){ \
+		for( r=r0; r<n; r++ ){ x = a[r]; y = b[r]; v[r] = (expr); } \
+	} else { \
+		for( r=r0; r<n; r++ ){ if( mask[r] ){ x = a[r]; y = b[r]; v[r] = (expr); } } \
+	}
+
+	for( i=0; i<prog->num_nodes; i++, node++ ){
+		// rows that took a jump to this node are evaluated again
+		if( i >= next ){
+			next = prog->num_nodes;
+			for( r=0; r<n; r++ ){
+				if( active[r] )
+					continue;
+				if( resume[r] <= i ){
+					active[r] = 1;
+					num_active++;
+				} else if( resume[r] < next ){
+					next = resume[r];
+				}
+			}
+		}
+		if( num_active == 0 )
+			continue;
+		mask = num_active < n ? active : NULL;
+
+		arity = parser_op_arity( prog->ops[i] );
+		a = arity >= 1 ? scratch->buffers + plan->regs[node->a]*PARSER_BATCH_CHUNK_SIZE : NULL;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+			// mask off the rows that take the jump until its target
+			for( r=0; r<n; r++ ){
+				if( active[r] && ( prog->ops[i] == PARSER_OP_JUMP || PARSER_TRUTH( a[r] ) == ( prog->ops[i] == PARSER_OP_JUMP_TRUE ) ) ){
+					active[r] = 0;
+					resume[r] = node->b;
+					num_active--;
+					next = node->b < next ? node->b : next;
+				}
+			}
+			continue;
+		}
+
+		v = num_outs == 1 && i == prog->num_nodes-1 && i == prog->outputs[0] ? outs[0]+first : scratch->buffers + plan->regs[i]*PARSER_BATCH_CHUNK_SIZE;
+		a = a ? a : v;
+		b = arity >= 2 ? scratch->buffers + plan->regs[node->b]*PARSER_BATCH_CHUNK_SIZE : a;
+		c = arity >= 3 ? scratch->buffers + plan->regs[node->c]*PARSER_BATCH_CHUNK_SIZE : b;
+
+		// domain checks have to run before the result, which may overwrite
+		// the operand, is computed
+		if( prog->ops[i] == PARSER_OP_SQRT || prog->ops[i] == PARSER_OP_LOG || prog->ops[i] == PARSER_OP_ASIN || prog->ops[i] == PARSER_OP_ACOS )
+			err = parser_batch_check_domain( prog->ops[i], a, n, mask, scratch->failed, err );
+
+		r0 = pb->simd && arity >= 1 ? parser_simd_kernel( prog->ops[i], v, a, b, n ) : 0;
+		switch( prog->ops[i] ){
+			case PARSER_OP_CONST:
+				for( r=0; r<n; r++ )
+					v[r] = prog->constants[node->a];
+				break;
+			case PARSER_OP_VAR:
+				col = plan->columns[node->a];
+				if( col ){
+					stride = plan->strides[node->a];
+					parser_batch_load( col + first*stride, stride, plan->types[node->a], v, n );
+				} else {
+					for( r=0; r<n; r++ )
+						v[r] = plan->constants[node->a];
+				}
+				break;
+			case PARSER_OP_NEG:   PARSER_BATCH_LOOP( -x ); break;
+			case PARSER_OP_NOT:   PARSER_BATCH_LOOP( fabs(x) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 0.0 : 1.0 ); break;
+			case PARSER_OP_ADD:   PARSER_BATCH_LOOP( x + y ); break;
+			case PARSER_OP_SUB:   PARSER_BATCH_LOOP( x - y ); break;
+			case PARSER_OP_MUL:   PARSER_BATCH_LOOP( x * y ); break;
+			case PARSER_OP_DIV:   PARSER_BATCH_LOOP( x / y ); break;
+			case PARSER_OP_POW:   PARSER_BATCH_LOOP( pow( x, y ) ); break;
+			case PARSER_OP_LT:    PARSER_BATCH_LOOP( x <  y ? 1.0 : 0.0 ); break;
+			case PARSER_OP_LE:    PARSER_BATCH_LOOP( x <= y ? 1.0 : 0.0 ); break;
+			case PARSER_OP_GT:    PARSER_BATCH_LOOP( x >  y ? 1.0 : 0.0 ); break;
+			case PARSER_OP_GE:    PARSER_BATCH_LOOP( x >= y ? 1.0 : 0.0 ); break;
+			case PARSER_OP_EQ:    PARSER_BATCH_LOOP( fabs(x - y) < PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0 ); break;
+			case PARSER_OP_NE:    PARSER_BATCH_LOOP( fabs(x - y) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0 ); break;
+			case PARSER_OP_AND:   PARSER_BATCH_LOOP( fabs(x) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD && fabs(y) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0 ); break;
+			case PARSER_OP_OR:    PARSER_BATCH_LOOP( fabs(x) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs(y) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0 ); break;
+			case PARSER_OP_SELECT: PARSER_BATCH_LOOP( PARSER_TRUTH( x ) ? y : c[r] ); break;
+			case PARSER_OP_SQRT:  PARSER_BATCH_LOOP( sqrt( x ) ); break;
+			case PARSER_OP_LOG:   PARSER_BATCH_LOOP( log( x ) ); break;
+			case PARSER_OP_EXP:   PARSER_BATCH_LOOP( exp( x ) ); break;
+			case PARSER_OP_SIN:   PARSER_BATCH_LOOP( sin( x ) ); break;
+			case PARSER_OP_ASIN:  PARSER_BATCH_LOOP( asin( x ) ); break;
+			case PARSER_OP_COS:   PARSER_BATCH_LOOP( cos( x ) ); break;
+			case PARSER_OP_ACOS:  PARSER_BATCH_LOOP( acos( x ) ); break;
+			case PARSER_OP_TAN:   PARSER_BATCH_LOOP( tan( x ) ); break;
+			case PARSER_OP_ATAN:  PARSER_BATCH_LOOP( atan( x ) ); break;
+			case PARSER_OP_ATAN2: PARSER_BATCH_LOOP( atan2( x, y ) ); break;
+			case PARSER_OP_ABS:   PARSER_BATCH_LOOP( abs( (int)x ) ); break;
+			case PARSER_OP_FABS:  PARSER_BATCH_LOOP( fabs( x ) ); break;
+			case PARSER_OP_FLOOR: PARSER_BATCH_LOOP( floor( x ) ); break;
+			case PARSER_OP_CEIL:  PARSER_BATCH_LOOP( ceil( x ) ); break;
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+			case PARSER_OP_ROUND: PARSER_BATCH_LOOP( round( x ) ); break;
+#else
+			case PARSER_OP_ROUND: PARSER_BATCH_LOOP( x >= 0.0 ? floor( x + 0.5 ) : ceil( x - 0.5 ) ); break;
+#endif
+			case PARSER_OP_CALL:
+				// user functions are called row by row through the callback, rows
+				// that already failed are not called, as in parser_program_eval()
+				for( r=0; r<n; r++ ){
+					if( ( mask && !mask[r] ) || scratch->failed[r] )
+						continue;
+					for( j=0; j<node->b; j++ )
+						args[j] = scratch->buffers[plan->regs[prog->args[node->a+j]]*PARSER_BATCH_CHUNK_SIZE + r];
+					if( !prog->function_cb || !prog->function_cb( pb->user_data, prog->functions[node->c], node->b, args, v+r ) ){
+						scratch->failed[r] = 1;
+						err = err ? err : "Tried to call unknown built-in function!";
+					}
+				}
+				break;
+			case PARSER_OP_NATIVE:
+				// native functions are called row by row through the function pointer
+				for( r=0; r<n; r++ ){
+					if( ( mask && !mask[r] ) || scratch->failed[r] )
+						continue;
+					for( j=0; j<node->b; j++ )
+						args[j] = scratch->buffers[plan->regs[prog->args[node->a+j]]*PARSER_BATCH_CHUNK_SIZE + r];
+					if( !prog->natives[node->c].fn( pb->user_data, node->b, args, v+r ) ){
+						scratch->failed[r] = 1;
+						err = err ? err : "Function evaluation failed!";
+					}
+				}
+				break;
+			default:
+				for( r=0; r<n; r++ )
+					scratch->failed[r] = 1;
+				err = err ? err : "Unknown operation!";
+				break;
+		}
+	}
+#undef PARSER_BATCH_LOOP
+
+	// the registers of the outputs are kept to the end of the chunk, only
+	// the last node of a single output program is written in place
+	for( k=0; k<num_outs; k++ ){
+		if( num_outs > 1 || prog->outputs[k] != prog->num_nodes-1 )
+			memcpy( outs[k]+first, scratch->buffers + plan->regs[prog->outputs[k]]*PARSER_BATCH_CHUNK_SIZE, n*sizeof(double) );
+	}
+
+	// rows that hit an error produce nan in every output, as parser_parse() does
+	if( err ){
+		for( r=0; r<n; r++ ){
+			for( k=0; k<num_outs && scratch->failed[r]; k++ )
+				outs[k][first+r] = sqrt( -1.0 );
+		}
+	}
+	return err;
+}
+
+/**
+ @brief evaluates the program for a chunk of at most PARSER_BATCH_CHUNK_SIZE rows in single precision, see parser_batch_run_chunk(). Registers hold PARSER_BATCH_CHUNK_SIZE floats, in the first half of their double sized storage.
+ @param[out] out column of results of the first output, the chunk is written from row first
+ @return NULL if every row evaluated successfully, otherwise the first error of the chunk
+*/
+static const char *parser_batch_run_chunk_float( const parser_batch *pb, const parser_batch_plan *plan, parser_batch_scratch *scratch, size_t first, int n, float *out ){
+	const parser_program *prog = pb->program;
+	const parser_node *node = prog->nodes;
+	float *regs = (float*)scratch->buffers, *v, *a, *b, *c, x, y;
+	double args[PARSER_MAX_ARGUMENT_COUNT], result;
+	const char *err = NULL;
+	unsigned char *active = scratch->active, *mask;
+	int *resume = scratch->resume;
+	int i, j, r, r0, arity, num_active = n, next = prog->num_nodes;
+
+	memset( scratch->failed, 0, n );
+	memset( active, 1, n );
+
+#define PARSER_BATCH_LOOP( expr ) \
+	if( !mask ){ \
+		for( r=r0; r<n; r++ ){ x = a[r]; y = b[r]; v[r] = (expr); } \
+	} else { \
+		for( r=r0; r<n; r++ ){ if( mask[r] ){ x = a[r]; y = b[r]; v[r] = (expr); } } \
+	}
+
+	// domain checks of the rows evaluating the node, see parser_batch_check_domain()
+#define PARSER_BATCH_CHECK( cond, message ) \
+	for( r=0; r<n; r++ ){ \
+		if( ( !mask || mask[r] ) && ( cond ) ){ \
+			scratch->failed[r] = 1; \
+			err = err ? err : message; \
+		} \
+	}
+
+	for( i=0; i<prog->num_nodes; i++, node++ ){
+		if( i >= next ){
+			next = prog->num_nodes;
+			for( r=0; r<n; r++ ){
+				if( active[r] )
+					continue;
+				if( resume[r] <= i ){
+					active[r] = 1;
+					num_active++;
+				} else if( resume[r] < next ){
+					next = resume[r];
+				}
+			}
+		}
+		if( num_active == 0 )
+			continue;
+		mask = num_active < n ? active : NULL;
+
+		arity = parser_op_arity( prog->ops[i] );
+		a = arity >= 1 ? regs + plan->regs[node->a]*PARSER_BATCH_CHUNK_SIZE : NULL;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+			for( r=0; r<n; r++ ){
+				if( active[r] && ( prog->ops[i] == PARSER_OP_JUMP || PARSER_TRUTH_FLOAT( a[r] ) == ( prog->ops[i] == PARSER_OP_JUMP_TRUE ) ) ){
+					active[r] = 0;
+					resume[r] = node->b;
+					num_active--;
+					next = node->b < next ? node->b : next;
+				}
+			}
+			continue;
+		}
+
+		v = i == prog->num_nodes-1 && i == prog->outputs[0] ? out+first : regs + plan->regs[i]*PARSER_BATCH_CHUNK_SIZE;
+		a = a ? a : v;
+		b = arity >= 2 ? regs + plan->regs[node->b]*PARSER_BATCH_CHUNK_SIZE : a;
+		c = arity >= 3 ? regs + plan->regs[node->c]*PARSER_BATCH_CHUNK_SIZE : b;
+
+		switch( prog->ops[i] ){
+			case PARSER_OP_SQRT: PARSER_BATCH_CHECK( a[r] < 0.0f, "sqrt(x) undefined for x < 0!" ); break;
+			case PARSER_OP_LOG:  PARSER_BATCH_CHECK( a[r] <= 0.0f, "log(x) undefined for x <= 0!" ); break;
+			case PARSER_OP_ASIN: PARSER_BATCH_CHECK( fabsf(a[r]) > 1.0f, "asin(x) undefined for |x| > 1!" ); break;
+			case PARSER_OP_ACOS: PARSER_BATCH_CHECK( fabsf(a[r]) > 1.0f, "acos(x) undefined for |x| > 1!" ); break;
+			default: break;
+		}
+
+		r0 = pb->simd && arity >= 1 ? parser_simd_kernel_float( prog->ops[i], v, a, b, n ) : 0;
+		switch( prog->ops[i] ){
+			case PARSER_OP_CONST:
+				for( r=0; r<n; r++ )
+					v[r] = (float)prog->constants[node->a];
+				break;
+			case PARSER_OP_VAR:
+				if( plan->columns[node->a] ){
+					parser_batch_load_float( plan->columns[node->a] + first*plan->strides[node->a], plan->strides[node->a], plan->types[node->a], v, n );
+				} else {
+					for( r=0; r<n; r++ )
+						v[r] = (float)plan->constants[node->a];
+				}
+				break;
+			case PARSER_OP_NEG:   PARSER_BATCH_LOOP( -x ); break;
+			case PARSER_OP_NOT:   PARSER_BATCH_LOOP( PARSER_TRUTH_FLOAT( x ) ? 0.0f : 1.0f ); break;
+			case PARSER_OP_ADD:   PARSER_BATCH_LOOP( x + y ); break;
+			case PARSER_OP_SUB:   PARSER_BATCH_LOOP( x - y ); break;
+			case PARSER_OP_MUL:   PARSER_BATCH_LOOP( x * y ); break;
+			case PARSER_OP_DIV:   PARSER_BATCH_LOOP( x / y ); break;
+			case PARSER_OP_POW:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( pow )( x, y ) ); break;
+			case PARSER_OP_LT:    PARSER_BATCH_LOOP( x <  y ? 1.0f : 0.0f ); break;
+			case PARSER_OP_LE:    PARSER_BATCH_LOOP( x <= y ? 1.0f : 0.0f ); break;
+			case PARSER_OP_GT:    PARSER_BATCH_LOOP( x >  y ? 1.0f : 0.0f ); break;
+			case PARSER_OP_GE:    PARSER_BATCH_LOOP( x >= y ? 1.0f : 0.0f ); break;
+			case PARSER_OP_EQ:    PARSER_BATCH_LOOP( fabsf(x - y) < PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT ? 1.0f : 0.0f ); break;
+			case PARSER_OP_NE:    PARSER_BATCH_LOOP( fabsf(x - y) > PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT ? 1.0f : 0.0f ); break;
+			case PARSER_OP_AND:   PARSER_BATCH_LOOP( PARSER_TRUTH_FLOAT( x ) && PARSER_TRUTH_FLOAT( y ) ? 1.0f : 0.0f ); break;
+			case PARSER_OP_OR:    PARSER_BATCH_LOOP( PARSER_TRUTH_FLOAT( x ) || PARSER_TRUTH_FLOAT( y ) ? 1.0f : 0.0f ); break;
+			case PARSER_OP_SELECT: PARSER_BATCH_LOOP( PARSER_TRUTH_FLOAT( x ) ? y : c[r] ); break;
+			case PARSER_OP_SQRT:  PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( sqrt )( x ) ); break;
+			case PARSER_OP_LOG:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( log )( x ) ); break;
+			case PARSER_OP_EXP:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( exp )( x ) ); break;
+			case PARSER_OP_SIN:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( sin )( x ) ); break;
+			case PARSER_OP_ASIN:  PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( asin )( x ) ); break;
+			case PARSER_OP_COS:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( cos )( x ) ); break;
+			case PARSER_OP_ACOS:  PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( acos )( x ) ); break;
+			case PARSER_OP_TAN:   PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( tan )( x ) ); break;
+			case PARSER_OP_ATAN:  PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( atan )( x ) ); break;
+			case PARSER_OP_ATAN2: PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( atan2 )( x, y ) ); break;
+			case PARSER_OP_ABS:   PARSER_BATCH_LOOP( (float)abs( (int)x ) ); break;
+			case PARSER_OP_FABS:  PARSER_BATCH_LOOP( fabsf( x ) ); break;
+			case PARSER_OP_FLOOR: PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( floor )( x ) ); break;
+			case PARSER_OP_CEIL:  PARSER_BATCH_LOOP( PARSER_FLOAT_MATH( ceil )( x ) ); break;
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+			case PARSER_OP_ROUND: PARSER_BATCH_LOOP( roundf( x ) ); break;
+#else
+			case PARSER_OP_ROUND: PARSER_BATCH_LOOP( x >= 0.0f ? (float)floor( x + 0.5 ) : (float)ceil( x - 0.5 ) ); break;
+#endif
+			case PARSER_OP_CALL:
+			case PARSER_OP_NATIVE:
+				// functions take and return doubles, called row by row except
+				// for the rows that already failed
+				for( r=0; r<n; r++ ){
+					if( ( mask && !mask[r] ) || scratch->failed[r] )
+						continue;
+					for( j=0; j<node->b; j++ )
+						args[j] = regs[plan->regs[prog->args[node->a+j]]*PARSER_BATCH_CHUNK_SIZE + r];
+					if( prog->ops[i] == PARSER_OP_CALL && ( !prog->function_cb || !prog->function_cb( pb->user_data, prog->functions[node->c], node->b, args, &result ) ) ){
+						scratch->failed[r] = 1;
+						err = err ? err : "Tried to call unknown built-in function!";
+					} else if( prog->ops[i] == PARSER_OP_NATIVE && !prog->natives[node->c].fn( pb->user_data, node->b, args, &result ) ){
+						scratch->failed[r] = 1;
+						err = err ? err : "Function evaluation failed!";
+					} else {
+						v[r] = (float)result;
+					}
+				}
+				break;
+			default:
+				for( r=0; r<n; r++ )
+					scratch->failed[r] = 1;
+				err = err ? err : "Unknown operation!";
+				break;
+		}
+	}
+#undef PARSER_BATCH_LOOP
+#undef PARSER_BATCH_CHECK
+
+	if( prog->outputs[0] != prog->num_nodes-1 )
+		memcpy( out+first, regs + plan->regs[prog->outputs[0]]*PARSER_BATCH_CHUNK_SIZE, n*sizeof(float) );
+	if( err ){
+		for( r=0; r<n; r++ ){
+			if( scratch->failed[r] )
+				out[first+r] = (float)sqrt( -1.0 );
+		}
+	}
+	return err;
+}
+
+/**
+ @brief sets num_rows rows of each output column to nan
+*/
+static void parser_batch_fail( double * const *outs, int num_outs, size_t num_rows ){
+	size_t r;
+	int k;
+	for( k=0; k<num_outs; k++ ){
+		for( r=0; r<num_rows; r++ )
+			outs[k][r] = sqrt( -1.0 );
+	}
+}
+
+/**
+ @brief shared implementation of parser_batch_eval() and parser_batch_eval_set(), writing the first num_outs outputs of the program to the columns outs
+*/
+static int parser_batch_eval_columns( parser_batch *pb, size_t num_rows, double * const *outs, int num_outs ){
+	parser_batch_plan plan;
+	parser_batch_scratch scratch;
+	const char *err;
+	size_t first;
+	int n, ok;
+
+	pb->error = NULL;
+	scratch.buffers = NULL;
+	scratch.failed  = NULL;
+	scratch.active  = NULL;
+	scratch.resume  = NULL;
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && !parser_batch_scratch_init( &plan, &scratch ) ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	if( ok ){
+		for( first=0; first<num_rows; first += n ){
+			n = num_rows - first < PARSER_BATCH_CHUNK_SIZE ? (int)(num_rows - first) : PARSER_BATCH_CHUNK_SIZE;
+			err = parser_batch_run_chunk( pb, &plan, &scratch, first, n, outs, num_outs );
+			if( err && !pb->error )
+				pb->error = err;
+		}
+		ok = pb->error == NULL;
+	} else {
+		parser_batch_fail( outs, num_outs, num_rows );
+	}
+	parser_batch_scratch_free( &scratch );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+int parser_batch_eval( parser_batch *pb, size_t num_rows, double *out ){
+	return parser_batch_eval_columns( pb, num_rows, &out, 1 );
+}
+
+int parser_batch_eval_set( parser_batch *pb, size_t num_rows, double * const *outs ){
+	return parser_batch_eval_columns( pb, num_rows, outs, pb->program->num_outputs );
+}
+
+int parser_batch_eval_float( parser_batch *pb, size_t num_rows, float *out ){
+	parser_batch_plan plan;
+	parser_batch_scratch scratch;
+	const char *err;
+	size_t first;
+	int n, ok;
+
+	pb->error = NULL;
+	scratch.buffers = NULL;
+	scratch.failed  = NULL;
+	scratch.active  = NULL;
+	scratch.resume  = NULL;
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && !parser_batch_scratch_init( &plan, &scratch ) ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	if( ok ){
+		for( first=0; first<num_rows; first += n ){
+			n = num_rows - first < PARSER_BATCH_CHUNK_SIZE ? (int)(num_rows - first) : PARSER_BATCH_CHUNK_SIZE;
+			err = parser_batch_run_chunk_float( pb, &plan, &scratch, first, n, out );
+			if( err && !pb->error )
+				pb->error = err;
+		}
+		ok = pb->error == NULL;
+	} else {
+		for( first=0; first<num_rows; first++ )
+			out[first] = (float)sqrt( -1.0 );
+	}
+	parser_batch_scratch_free( &scratch );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+/**
+ @brief shared implementation of parser_batch_eval_bitmap() and parser_batch_eval_selection(), testing the truth of the first output of each chunk while it is still in its register rather than writing it to a column of doubles
+ @param[out] bitmap packed bitmap of the selected rows, NULL if not wanted
+ @param[out] selection indices of the selected rows, NULL if not wanted
+ @param[out] num_selected number of selected rows, NULL if not wanted
+*/
+static int parser_batch_eval_predicate( parser_batch *pb, size_t num_rows, unsigned char *bitmap, size_t *selection, size_t *num_selected ){
+	const parser_program *prog = pb->program;
+	parser_batch_plan plan;
+	parser_batch_scratch scratch;
+	const double *v;
+	const char *err;
+	size_t first, count = 0;
+	int r, n, ok;
+
+	pb->error = NULL;
+	scratch.buffers = NULL;
+	scratch.failed  = NULL;
+	scratch.active  = NULL;
+	scratch.resume  = NULL;
+	if( bitmap )
+		memset( bitmap, 0, (num_rows+7)/8 );
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && !parser_batch_scratch_init( &plan, &scratch ) ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	if( ok ){
+		// the output register is kept to the end of the chunk, and the jumps
+		// of && and || already mask off the rows whose result is known, so
+		// each conjunct is only evaluated for the rows still selected
+		v = scratch.buffers + plan.regs[prog->outputs[0]]*PARSER_BATCH_CHUNK_SIZE;
+		for( first=0; first<num_rows; first += n ){
+			n = num_rows - first < PARSER_BATCH_CHUNK_SIZE ? (int)(num_rows - first) : PARSER_BATCH_CHUNK_SIZE;
+			err = parser_batch_run_chunk( pb, &plan, &scratch, first, n, NULL, 0 );
+			if( err && !pb->error )
+				pb->error = err;
+			for( r=0; r<n; r++ ){
+				if( scratch.failed[r] || !PARSER_TRUTH( v[r] ) )
+					continue;
+				if( bitmap )
+					bitmap[(first+r)>>3] |= (unsigned char)( 1 << ( (first+r) & 7 ) );
+				if( selection )
+					selection[count] = first + r;
+				count++;
+			}
+		}
+		ok = pb->error == NULL;
+	}
+	if( num_selected )
+		*num_selected = count;
+	parser_batch_scratch_free( &scratch );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+int parser_batch_eval_bitmap( parser_batch *pb, size_t num_rows, unsigned char *bitmap, size_t *num_selected ){
+	return parser_batch_eval_predicate( pb, num_rows, bitmap, NULL, num_selected );
+}
+
+int parser_batch_eval_selection( parser_batch *pb, size_t num_rows, size_t *selection, size_t *num_selected ){
+	return parser_batch_eval_predicate( pb, num_rows, NULL, selection, num_selected );
+}
+
+int parser_batch_eval_gradient( parser_batch *pb, size_t num_rows, int output, const int *wrt, int num_wrt, double *out, double * const *gradients ){
+	const parser_program *prog = pb->program;
+	parser_batch_plan plan;
+	double *scratch, *vars, *gradient;
+	const char *err;
+	size_t r;
+	int i, ok;
+
+	// rows are differentiated one at a time, reusing the variable bindings
+	// of the plan and a single scratch array
+	pb->error = NULL;
+	scratch = PARSER_MALLOC( ( 3*prog->num_nodes + 2*prog->num_variables + num_wrt + 1 )*sizeof(double) );
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && !scratch ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	if( ok ){
+		vars     = scratch + 3*prog->num_nodes + prog->num_variables;
+		gradient = vars + prog->num_variables;
+		for( i=0; i<prog->num_variables; i++ ){
+			if( !plan.columns[i] )
+				vars[i] = plan.constants[i];
+		}
+		for( r=0; r<num_rows; r++ ){
+			for( i=0; i<prog->num_variables; i++ ){
+				if( plan.columns[i] )
+					parser_batch_load( plan.columns[i] + r*plan.strides[i], plan.strides[i], plan.types[i], vars+i, 1 );
+			}
+			if( !parser_program_gradient( prog, vars, pb->user_data, output, wrt, num_wrt, scratch, out+r, gradient, &err ) && !pb->error )
+				pb->error = err;
+			for( i=0; i<num_wrt; i++ )
+				gradients[i][r] = gradient[i];
+		}
+		ok = pb->error == NULL;
+	} else {
+		parser_batch_fail( &out, 1, num_rows );
+		parser_batch_fail( gradients, num_wrt, num_rows );
+	}
+	PARSER_FREE( scratch );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+/**
+ @brief clears count reductions
+*/
+static void parser_batch_partial_init( parser_batch_partial *partials, size_t count ){
+	size_t k;
+	for( k=0; k<count; k++ ){
+		partials[k].count        = 0;
+		partials[k].sum          = 0.0;
+		partials[k].compensation = 0.0;
+		partials[k].min          = HUGE_VAL;
+		partials[k].max          = -HUGE_VAL;
+	}
+}
+
+/**
+ @brief adds a value to a compensated sum with Neumaier's variant of Kahan summation, which keeps the rounding error of whichever term is smaller
+*/
+static void parser_batch_compensated_add( double *sum, double *compensation, double value ){
+	double t = *sum + value;
+	if( fabs( *sum ) >= fabs( value ) )
+		*compensation += ( *sum - t ) + value;
+	else
+		*compensation += ( value - t ) + *sum;
+	*sum = t;
+}
+
+/**
+ @brief adds the reduction of a later range of rows to a reduction
+*/
+static void parser_batch_partial_merge( parser_batch_partial *p, const parser_batch_partial *q ){
+	parser_batch_compensated_add( &p->sum, &p->compensation, q->sum );
+	p->compensation += q->compensation;
+	p->count        += q->count;
+	p->min           = q->min < p->min ? q->min : p->min;
+	p->max           = q->max > p->max ? q->max : p->max;
+}
+
+/**
+ @brief reduces the outputs of the rows [first,last), one task of parser_batch_reduce() or parser_batch_reduce_parallel(). Rows that fail to evaluate are left out of the reductions.
+ @param[out] partials reduction of each output over the rows
+ @return NULL if every row evaluated successfully, otherwise the error of the first failing chunk
+*/
+static const char *parser_batch_reduce_rows( const parser_batch *pb, const parser_batch_plan *plan, parser_batch_scratch *scratch, size_t first, size_t last, parser_batch_partial *partials ){
+	const parser_program *prog = pb->program;
+	parser_batch_partial *p;
+	const double *v;
+	const char *err, *first_err = NULL;
+	int k, r, n;
+
+	parser_batch_partial_init( partials, prog->num_outputs );
+	for( ; first<last; first += n ){
+		n = last - first < PARSER_BATCH_CHUNK_SIZE ? (int)(last - first) : PARSER_BATCH_CHUNK_SIZE;
+		err = parser_batch_run_chunk( pb, plan, scratch, first, n, NULL, 0 );
+		first_err = first_err ? first_err : err;
+
+		// the outputs are reduced straight from their registers
+		for( k=0, p=partials; k<prog->num_outputs; k++, p++ ){
+			v = scratch->buffers + plan->regs[prog->outputs[k]]*PARSER_BATCH_CHUNK_SIZE;
+			for( r=0; r<n; r++ ){
+				if( err && scratch->failed[r] )
+					continue;
+				parser_batch_compensated_add( &p->sum, &p->compensation, v[r] );
+				p->min = v[r] < p->min ? v[r] : p->min;
+				p->max = v[r] > p->max ? v[r] : p->max;
+				p->count++;
+			}
+		}
+	}
+	return first_err;
+}
+
+/**
+ @brief writes the public results of num_outs reductions
+*/
+static void parser_batch_partial_finish( const parser_batch_partial *partials, int num_outs, parser_reduction *out ){
+	int k;
+	for( k=0; k<num_outs; k++, partials++, out++ ){
+		// an infinite sum leaves a nan compensation
+		out->count = partials->count;
+		out->sum   = partials->compensation == partials->compensation ? partials->sum + partials->compensation : partials->sum;
+		out->mean  = partials->count ? out->sum/(double)partials->count : sqrt( -1.0 );
+		out->min   = partials->min;
+		out->max   = partials->max;
+	}
+}
+
+int parser_batch_reduce( parser_batch *pb, size_t num_rows, parser_reduction *out ){
+	const parser_program *prog = pb->program;
+	parser_batch_plan plan;
+	parser_batch_scratch scratch;
+	parser_batch_partial *total, *task, empty;
+	const char *err;
+	size_t first, last, task_rows = PARSER_PARALLEL_TASK_CHUNKS*PARSER_BATCH_CHUNK_SIZE;
+	int k, ok;
+
+	pb->error = NULL;
+	scratch.buffers = NULL;
+	scratch.failed  = NULL;
+	scratch.active  = NULL;
+	scratch.resume  = NULL;
+	total = PARSER_MALLOC( 2*prog->num_outputs*sizeof(parser_batch_partial) );
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && ( !total || !parser_batch_scratch_init( &plan, &scratch ) ) ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	if( ok ){
+		// rows are reduced in the same tasks, merged in the same order, as
+		// parser_batch_reduce_parallel() so the results are identical
+		task = total + prog->num_outputs;
+		parser_batch_partial_init( total, prog->num_outputs );
+		for( first=0; first<num_rows; first = last ){
+			last = num_rows - first < task_rows ? num_rows : first + task_rows;
+			err = parser_batch_reduce_rows( pb, &plan, &scratch, first, last, task );
+			if( err && !pb->error )
+				pb->error = err;
+			for( k=0; k<prog->num_outputs; k++ )
+				parser_batch_partial_merge( total+k, task+k );
+		}
+		parser_batch_partial_finish( total, prog->num_outputs, out );
+		ok = pb->error == NULL;
+	} else {
+		parser_batch_partial_init( &empty, 1 );
+		for( k=0; k<prog->num_outputs; k++ )
+			parser_batch_partial_finish( &empty, 1, out+k );
+	}
+	PARSER_FREE( total );
+	parser_batch_scratch_free( &scratch );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+/**
+ @brief job data of parser_batch_eval_parallel() and parser_batch_eval_set_parallel()
+*/
+typedef struct {
+	const parser_batch      *pb;
+	const parser_batch_plan *plan;
+	size_t                   num_rows;
+
+	/** @brief output columns */
+	double * const          *outs;
+	int                      num_outs;
+
+	/** @brief num_outs reductions per task, NULL to write the output columns instead */
+	parser_batch_partial    *partials;
+
+	/** @brief scratch space of each thread */
+	parser_batch_scratch    *scratch;
+
+	/** @brief first error found by each thread, and the first row of the chunk it was found in */
+	const char             **errors;
+	size_t                  *error_rows;
+} parser_batch_job;
+
+/**
+ @brief evaluates the chunks of one task of parser_batch_eval_parallel()
+*/
+static void parser_batch_task( void *context, int thread, size_t task ){
+	parser_batch_job *job = (parser_batch_job*)context;
+	size_t first, last;
+	const char *err;
+	int n;
+
+	first = task*PARSER_PARALLEL_TASK_CHUNKS*PARSER_BATCH_CHUNK_SIZE;
+	last  = first + PARSER_PARALLEL_TASK_CHUNKS*PARSER_BATCH_CHUNK_SIZE;
+	last  = last < job->num_rows ? last : job->num_rows;
+	if( job->partials ){
+		err = parser_batch_reduce_rows( job->pb, job->plan, job->scratch+thread, first, last, job->partials + task*job->num_outs );
+		if( err && ( !job->errors[thread] || first < job->error_rows[thread] ) ){
+			job->errors[thread]     = err;
+			job->error_rows[thread] = first;
+		}
+		return;
+	}
+	for( ; first<last; first += n ){
+		n = last - first < PARSER_BATCH_CHUNK_SIZE ? (int)(last - first) : PARSER_BATCH_CHUNK_SIZE;
+		err = parser_batch_run_chunk( job->pb, job->plan, job->scratch+thread, first, n, job->outs, job->num_outs );
+		if( err && ( !job->errors[thread] || first < job->error_rows[thread] ) ){
+			job->errors[thread]     = err;
+			job->error_rows[thread] = first;
+		}
+	}
+}
+
+/**
+ @brief shared implementation of parser_batch_eval_parallel(), parser_batch_eval_set_parallel() and parser_batch_reduce_parallel(), see parser_batch_eval_columns(). Reductions pass NULL outs and a partial reduction of each output for each task.
+*/
+static int parser_batch_run_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, double * const *outs, int num_outs, parser_batch_partial *partials ){
+	parser_batch_plan plan;
+	parser_batch_job job;
+	size_t r = 0, task_rows = PARSER_PARALLEL_TASK_CHUNKS*PARSER_BATCH_CHUNK_SIZE;
+	int i, num_threads, ok;
+
+	pb->error = NULL;
+	num_threads     = parser_pool_num_threads( pool );
+	job.pb          = pb;
+	job.plan        = &plan;
+	job.num_rows    = num_rows;
+	job.outs        = outs;
+	job.num_outs    = num_outs;
+	job.partials    = partials;
+	job.scratch     = PARSER_CALLOC( num_threads, sizeof(parser_batch_scratch) );
+	job.errors      = PARSER_CALLOC( num_threads, sizeof(const char*) );
+	job.error_rows  = PARSER_CALLOC( num_threads, sizeof(size_t) );
+
+	// the plan, and so the variable callbacks, is made once on the calling thread
+	ok = parser_batch_plan_init( pb, &plan );
+	if( ok && ( !job.scratch || !job.errors || !job.error_rows ) ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+	}
+	for( i=0; i<num_threads && ok; i++ ){
+		if( !parser_batch_scratch_init( &plan, job.scratch+i ) ){
+			pb->error = "Out of memory while evaluating expression!";
+			ok = PARSER_FALSE;
+		}
+	}
+
+	if( ok ){
+		parser_pool_run( pool, (num_rows + task_rows - 1)/task_rows, parser_batch_task, &job );
+
+		// report the error of the first failing chunk, as parser_batch_eval() does
+		for( i=0; i<num_threads; i++ ){
+			if( job.errors[i] && ( !pb->error || job.error_rows[i] < r ) ){
+				pb->error = job.errors[i];
+				r = job.error_rows[i];
+			}
+		}
+		ok = pb->error == NULL;
+	} else if( outs ){
+		parser_batch_fail( outs, num_outs, num_rows );
+	}
+
+	for( i=0; i<num_threads && job.scratch; i++ )
+		parser_batch_scratch_free( job.scratch+i );
+	PARSER_FREE( job.scratch );
+	PARSER_FREE( job.errors );
+	PARSER_FREE( job.error_rows );
+	parser_batch_plan_free( &plan );
+	return ok;
+}
+
+int parser_batch_eval_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, double *out ){
+	if( !pool )
+		return parser_batch_eval( pb, num_rows, out );
+	return parser_batch_run_parallel( pb, pool, num_rows, &out, 1, NULL );
+}
+
+int parser_batch_eval_set_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, double * const *outs ){
+	if( !pool )
+		return parser_batch_eval_set( pb, num_rows, outs );
+	return parser_batch_run_parallel( pb, pool, num_rows, outs, pb->program->num_outputs, NULL );
+}
+
+int parser_batch_reduce_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, parser_reduction *out ){
+	const parser_program *prog = pb->program;
+	parser_batch_partial *total, *partials, empty;
+	size_t t, num_tasks, task_rows = PARSER_PARALLEL_TASK_CHUNKS*PARSER_BATCH_CHUNK_SIZE;
+	int k, ok;
+
+	if( !pool )
+		return parser_batch_reduce( pb, num_rows, out );
+
+	// each task keeps its own reductions, which are merged in task order so
+	// the results do not depend on the number of threads or the scheduling.
+	// The reductions start empty in case the evaluation can not be started
+	num_tasks = (num_rows + task_rows - 1)/task_rows;
+	total     = PARSER_MALLOC( (num_tasks + 1)*prog->num_outputs*sizeof(parser_batch_partial) );
+	if( !total ){
+		pb->error = "Out of memory while evaluating expression!";
+		ok = PARSER_FALSE;
+		num_tasks = 0;
+		partials = NULL;
+	} else {
+		partials = total + prog->num_outputs;
+		parser_batch_partial_init( total, (num_tasks + 1)*prog->num_outputs );
+		ok = parser_batch_run_parallel( pb, pool, num_rows, NULL, prog->num_outputs, partials );
+	}
+	for( t=0; t<num_tasks; t++ ){
+		for( k=0; k<prog->num_outputs; k++ )
+			parser_batch_partial_merge( total+k, partials + t*prog->num_outputs + k );
+	}
+	if( total ){
+		parser_batch_partial_finish( total, prog->num_outputs, out );
+	} else {
+		parser_batch_partial_init( &empty, 1 );
+		for( k=0; k<prog->num_outputs; k++ )
+			parser_batch_partial_finish( &empty, 1, out+k );
+	}
+	PARSER_FREE( total );
+	return ok;
+}
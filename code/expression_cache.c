@@ -0,0 +1,378 @@
+#include<stdio.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_cache.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief cache of compiled programs keyed by expression text, see expression_parser.h for more information and license terms.
+
+ The cache is split into PARSER_CACHE_SHARDS independent shards, the shard of an expression being chosen by the hash of its text.  Each shard is a chained hash table with its own lock, its own least recently used list and an equal share of the memory budget, so threads looking up different expressions rarely contend and there is no lock common to all lookups.  Entries are reference counted: a lookup takes a reference that is released once the program has been evaluated, so an entry evicted by another thread in the meantime stays valid until its last evaluation completes.  Programs are compiled outside of the shard locks, a miss only holds the lock to insert the new entry.  Define PARSER_EXCLUDE_THREADS to build without locks, in which case a cache may only be used by one thread at a time.
+*/
+
+#include"expression_internal.h"
+
+#if !defined(PARSER_EXCLUDE_THREADS) && !defined(_WIN32)
+#define PARSER_CACHE_PTHREADS
+#include<pthread.h>
+#endif
+
+/**
+ @brief number of buckets of the hash table of a shard when the cache is created, the tables double in size when they hold more entries than buckets
+*/
+#define PARSER_CACHE_INITIAL_BUCKETS 16
+
+/**
+ @brief a compiled program in the cache, allocated together with a copy of its expression text
+*/
+typedef struct parser_cache_entry {
+	/** @brief next entry of the same hash table bucket */
+	struct parser_cache_entry *next;
+
+	/** @brief neighbours in the least recently used list of the shard, prev is more recently used */
+	struct parser_cache_entry *prev_used;
+	struct parser_cache_entry *next_used;
+
+	/** @brief key: hash and text of the expression and the callbacks captured by the program */
+	unsigned long              hash;
+	const char                *expr;
+	parser_variable_callback   variable_cb;
+	parser_function_callback   function_cb;
+
+	/** @brief compiled program and memory used by the entry in bytes */
+	parser_program            *prog;
+	size_t                     bytes;
+
+	/** @brief number of evaluations using the entry, plus one while it is held by the cache */
+	int                        refs;
+} parser_cache_entry;
+
+/**
+ @brief one shard of the cache. Padded to a cache line so threads do not contend for the locks of neighbouring shards.
+*/
+typedef struct {
+#if defined(PARSER_CACHE_PTHREADS)
+	pthread_mutex_t     lock;
+#endif
+	/** @brief hash table, the number of buckets is a power of two */
+	parser_cache_entry **buckets;
+	size_t               num_buckets;
+
+	/** @brief most and least recently used entries */
+	parser_cache_entry  *first_used;
+	parser_cache_entry  *last_used;
+
+	/** @brief number of entries and memory they use in bytes */
+	size_t               num_entries;
+	size_t               bytes;
+
+	/** @brief counters reported by parser_cache_get_stats() */
+	unsigned long        hits;
+	unsigned long        misses;
+	unsigned long        evictions;
+
+	char                 padding[64];
+} parser_cache_shard;
+
+struct parser_cache {
+	/** @brief memory budget of each shard in bytes */
+	size_t             max_bytes;
+
+	parser_cache_shard shards[PARSER_CACHE_SHARDS];
+};
+
+/**
+ @brief FNV-1a hash of an expression
+*/
+static unsigned long parser_cache_hash( const char *expr, size_t *len ){
+	unsigned long hash = 2166136261UL;
+	const char *c;
+	for( c=expr; *c; c++ )
+		hash = ( (hash ^ (unsigned char)*c)*16777619UL ) & 0xffffffffUL;
+	*len = c - expr;
+	return hash;
+}
+
+static void parser_cache_lock( parser_cache_shard *shard ){
+#if defined(PARSER_CACHE_PTHREADS)
+	pthread_mutex_lock( &shard->lock );
+#else
+	(void)shard;
+#endif
+}
+
+static void parser_cache_unlock( parser_cache_shard *shard ){
+#if defined(PARSER_CACHE_PTHREADS)
+	pthread_mutex_unlock( &shard->lock );
+#else
+	(void)shard;
+#endif
+}
+
+/**
+ @brief bucket of a hash, the low bits of the hash select the shard so the bucket uses the others
+*/
+static parser_cache_entry **parser_cache_bucket( parser_cache_shard *shard, unsigned long hash ){
+	return shard->buckets + ( (hash / PARSER_CACHE_SHARDS) & (shard->num_buckets-1) );
+}
+
+/**
+ @brief looks up an expression in a shard, the shard must be locked
+ @return entry or NULL if the expression is not in the shard
+*/
+static parser_cache_entry *parser_cache_find( parser_cache_shard *shard, unsigned long hash, const char *expr, parser_variable_callback variable_cb, parser_function_callback function_cb ){
+	parser_cache_entry *entry;
+	for( entry=*parser_cache_bucket( shard, hash ); entry; entry=entry->next ){
+		if( entry->hash == hash && entry->variable_cb == variable_cb && entry->function_cb == function_cb && strcmp( entry->expr, expr ) == 0 )
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ @brief removes an entry from the least recently used list of its shard
+*/
+static void parser_cache_unlink_used( parser_cache_shard *shard, parser_cache_entry *entry ){
+	if( entry->prev_used )
+		entry->prev_used->next_used = entry->next_used;
+	else
+		shard->first_used = entry->next_used;
+	if( entry->next_used )
+		entry->next_used->prev_used = entry->prev_used;
+	else
+		shard->last_used = entry->prev_used;
+}
+
+/**
+ @brief makes an entry the most recently used of its shard
+*/
+static void parser_cache_link_used( parser_cache_shard *shard, parser_cache_entry *entry ){
+	entry->prev_used = NULL;
+	entry->next_used = shard->first_used;
+	if( shard->first_used )
+		shard->first_used->prev_used = entry;
+	else
+		shard->last_used = entry;
+	shard->first_used = entry;
+}
+
+/**
+ @brief doubles the number of buckets of a shard, leaving the table unchanged if memory can not be allocated
+*/
+static void parser_cache_grow( parser_cache_shard *shard ){
+	parser_cache_entry **buckets = shard->buckets, *entry, *next;
+	size_t i, num_buckets = shard->num_buckets;
+
+	shard->buckets = PARSER_CALLOC( 2*num_buckets, sizeof(parser_cache_entry*) );
+	if( !shard->buckets ){
+		shard->buckets = buckets;
+		return;
+	}
+	shard->num_buckets = 2*num_buckets;
+	for( i=0; i<num_buckets; i++ ){
+		for( entry=buckets[i]; entry; entry=next ){
+			next = entry->next;
+			entry->next = *parser_cache_bucket( shard, entry->hash );
+			*parser_cache_bucket( shard, entry->hash ) = entry;
+		}
+	}
+	PARSER_FREE( buckets );
+}
+
+/**
+ @brief releases a reference to an entry, the shard of the entry must be locked
+ @return PARSER_TRUE if this was the last reference, the entry must then be freed with parser_cache_entry_free() once the shard is unlocked
+*/
+static int parser_cache_release( parser_cache_entry *entry ){
+	return --entry->refs == 0;
+}
+
+static void parser_cache_entry_free( parser_cache_entry *entry ){
+	parser_program_free( entry->prog );
+	PARSER_FREE( entry );
+}
+
+/**
+ @brief removes an entry from its shard, which must be locked, and releases the reference held by the cache
+ @return PARSER_TRUE if the entry must be freed with parser_cache_entry_free() once the shard is unlocked
+*/
+static int parser_cache_evict( parser_cache_shard *shard, parser_cache_entry *entry ){
+	parser_cache_entry **link = parser_cache_bucket( shard, entry->hash );
+	while( *link != entry )
+		link = &(*link)->next;
+	*link = entry->next;
+	parser_cache_unlink_used( shard, entry );
+	shard->num_entries--;
+	shard->bytes -= entry->bytes;
+	shard->evictions++;
+	return parser_cache_release( entry );
+}
+
+/**
+ @brief inserts a new entry, holding one reference for the caller, into a shard, evicting least recently used entries to stay within the memory budget. If another thread inserted the same expression meanwhile its entry is used instead. Entries larger than the budget of a shard are not inserted, the caller holds their only reference.
+ @return entry to evaluate, referenced for the caller
+*/
+static parser_cache_entry *parser_cache_insert( parser_cache *cache, parser_cache_shard *shard, parser_cache_entry *entry ){
+	parser_cache_entry *existing, *evicted = NULL, *next;
+
+	parser_cache_lock( shard );
+	existing = parser_cache_find( shard, entry->hash, entry->expr, entry->variable_cb, entry->function_cb );
+	if( existing ){
+		existing->refs++;
+	} else if( entry->bytes <= cache->max_bytes ){
+		// evicted entries are chained through next, which they no longer need
+		while( shard->last_used && shard->bytes + entry->bytes > cache->max_bytes ){
+			next = shard->last_used;
+			if( parser_cache_evict( shard, next ) ){
+				next->next = evicted;
+				evicted = next;
+			}
+		}
+		if( shard->num_entries >= shard->num_buckets )
+			parser_cache_grow( shard );
+		entry->next = *parser_cache_bucket( shard, entry->hash );
+		*parser_cache_bucket( shard, entry->hash ) = entry;
+		parser_cache_link_used( shard, entry );
+		shard->num_entries++;
+		shard->bytes += entry->bytes;
+		entry->refs++;
+	}
+	parser_cache_unlock( shard );
+
+	for( ; evicted; evicted=next ){
+		next = evicted->next;
+		parser_cache_entry_free( evicted );
+	}
+	if( existing ){
+		parser_cache_entry_free( entry );
+		return existing;
+	}
+	return entry;
+}
+
+parser_cache *parser_cache_new( size_t max_bytes ){
+	parser_cache *cache = PARSER_CALLOC( 1, sizeof(parser_cache) );
+	int i;
+
+	if( !cache )
+		return NULL;
+	cache->max_bytes = max_bytes / PARSER_CACHE_SHARDS;
+	for( i=0; i<PARSER_CACHE_SHARDS; i++ ){
+		cache->shards[i].num_buckets = PARSER_CACHE_INITIAL_BUCKETS;
+		cache->shards[i].buckets = PARSER_CALLOC( PARSER_CACHE_INITIAL_BUCKETS, sizeof(parser_cache_entry*) );
+		if( !cache->shards[i].buckets ){
+			while( i-- > 0 )
+				PARSER_FREE( cache->shards[i].buckets );
+			PARSER_FREE( cache );
+			return NULL;
+		}
+#if defined(PARSER_CACHE_PTHREADS)
+		pthread_mutex_init( &cache->shards[i].lock, NULL );
+#endif
+	}
+	return cache;
+}
+
+void parser_cache_free( parser_cache *cache ){
+	parser_cache_entry *entry, *next;
+	int i;
+
+	if( !cache )
+		return;
+	for( i=0; i<PARSER_CACHE_SHARDS; i++ ){
+		for( entry=cache->shards[i].first_used; entry; entry=next ){
+			next = entry->next_used;
+			parser_cache_entry_free( entry );
+		}
+		PARSER_FREE( cache->shards[i].buckets );
+#if defined(PARSER_CACHE_PTHREADS)
+		pthread_mutex_destroy( &cache->shards[i].lock );
+#endif
+	}
+	PARSER_FREE( cache );
+}
+
+void parser_cache_get_stats( parser_cache *cache, parser_cache_stats *stats ){
+	parser_cache_shard *shard;
+	int i;
+
+	memset( stats, 0, sizeof(parser_cache_stats) );
+	for( i=0; i<PARSER_CACHE_SHARDS; i++ ){
+		shard = cache->shards+i;
+		parser_cache_lock( shard );
+		stats->hits      += shard->hits;
+		stats->misses    += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->entries   += shard->num_entries;
+		stats->bytes     += shard->bytes;
+		parser_cache_unlock( shard );
+	}
+}
+
+double parse_expression_with_cache( parser_cache *cache, const char *expr, parser_variable_callback variable_cb, parser_function_callback function_cb, void *user_data ){
+	parser_cache_shard *shard;
+	parser_cache_entry *entry;
+	parser_program *prog;
+	parser_data pd;
+	const char *error;
+	unsigned long hash;
+	size_t len;
+	double val;
+	int dead;
+
+	if( !cache )
+		return parse_expression_with_callbacks( expr, variable_cb, function_cb, user_data );
+
+	hash  = parser_cache_hash( expr, &len );
+	shard = cache->shards + hash % PARSER_CACHE_SHARDS;
+	parser_cache_lock( shard );
+	entry = parser_cache_find( shard, hash, expr, variable_cb, function_cb );
+	if( entry ){
+		entry->refs++;
+		parser_cache_unlink_used( shard, entry );
+		parser_cache_link_used( shard, entry );
+		shard->hits++;
+	} else {
+		shard->misses++;
+	}
+	parser_cache_unlock( shard );
+
+	if( !entry ){
+		// expressions that fail to compile are parsed, which reports the error
+		parser_data_init( &pd, expr, variable_cb, function_cb, NULL );
+		prog = parser_compile( &pd );
+		if( !prog )
+			return parse_expression_with_callbacks( expr, variable_cb, function_cb, user_data );
+		entry = PARSER_MALLOC( sizeof(parser_cache_entry)+len+1 );
+		if( !entry ){
+			parser_program_free( prog );
+			return parse_expression_with_callbacks( expr, variable_cb, function_cb, user_data );
+		}
+		memcpy( entry+1, expr, len+1 );
+		entry->next        = NULL;
+		entry->prev_used   = NULL;
+		entry->next_used   = NULL;
+		entry->hash        = hash;
+		entry->expr        = (const char*)(entry+1);
+		entry->variable_cb = variable_cb;
+		entry->function_cb = function_cb;
+		entry->prog        = prog;
+		entry->bytes       = sizeof(parser_cache_entry) + len+1 + parser_program_size( prog );
+		entry->refs        = 1;
+		entry = parser_cache_insert( cache, shard, entry );
+	}
+
+	val = parser_program_eval( entry->prog, user_data, &error );
+
+	parser_cache_lock( shard );
+	dead = parser_cache_release( entry );
+	parser_cache_unlock( shard );
+	if( dead )
+		parser_cache_entry_free( entry );
+
+	if( error ){
+		printf("Error: %s\n", error );
+		printf("Expression '%s' failed to parse, returning nan\n", expr );
+	}
+	return val;
+}
@@ -0,0 +1,311 @@
+#include<math.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_diff.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief automatic differentiation of compiled programs, see expression_parser.h for more information and license terms.
+
+ Both modes start with an ordinary evaluation of the program, which leaves the value of every node in the scratch array, and then apply the chain rule node by node using the partial derivatives of each node with respect to its operands.  Reverse mode scans the nodes backwards from the differentiated output accumulating the derivative of the output with respect to every node (its adjoint), so a single sweep yields the derivatives with respect to all variables.  Forward mode scans the nodes forwards carrying the derivative of every node along one direction, so a single sweep yields the directional derivatives of all outputs.
+
+ Nodes skipped by a jump have no value.  Their operations are not differentiated: the lazy operations do not depend on them, so they receive a zero adjoint in reverse mode and are never read with a nonzero partial derivative in forward mode.  Likewise a node is only differentiated when it depends on the differentiated variables, so a user function whose arguments do not depend on them does not make the evaluation fail.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief maximum number of operands of a node, three for a ? b : c or the arguments of a function call
+*/
+#define PARSER_DIFF_MAX_OPERANDS ( PARSER_MAX_ARGUMENT_COUNT > 3 ? PARSER_MAX_ARGUMENT_COUNT : 3 )
+
+/**
+ @brief operand nodes of a node, the arguments of function calls
+ @param[out] operands receives the node indices, at most PARSER_DIFF_MAX_OPERANDS
+ @return number of operands
+*/
+static int parser_diff_operands( const parser_program *prog, int i, int *operands ){
+	const parser_node *node = prog->nodes+i;
+	int j;
+
+	if( PARSER_OP_HAS_ARGS( prog->ops[i] ) ){
+		for( j=0; j<node->b; j++ )
+			operands[j] = prog->args[node->a+j];
+		return node->b;
+	}
+	operands[0] = node->a;
+	operands[1] = node->b;
+	operands[2] = node->c;
+	return parser_op_arity( prog->ops[i] );
+}
+
+/**
+ @brief partial derivatives of a node with respect to its operands, in the order of parser_diff_operands()
+ @param[in] values value of every evaluated node
+ @param[out] partials receives one value per operand
+ @return NULL on success, otherwise the error string
+*/
+static const char *parser_diff_partials( const parser_program *prog, int i, const double *values, void *user_data, double *partials ){
+	const parser_node *node = prog->nodes+i;
+	double args[PARSER_MAX_ARGUMENT_COUNT], v = values[i], d;
+	int j;
+
+	// shorthands for the operand values of the node, as in parser_program_run()
+#define A values[node->a]
+#define B values[node->b]
+	partials[0] = partials[1] = partials[2] = 0.0;
+	switch( prog->ops[i] ){
+		case PARSER_OP_NEG:   partials[0] = -1.0; break;
+		case PARSER_OP_ADD:   partials[0] = 1.0; partials[1] = 1.0; break;
+		case PARSER_OP_SUB:   partials[0] = 1.0; partials[1] = -1.0; break;
+		case PARSER_OP_MUL:   partials[0] = B; partials[1] = A; break;
+		case PARSER_OP_DIV:   partials[0] = 1.0/B; partials[1] = -v/B; break;
+		case PARSER_OP_POW:
+			// pow( x, 0 ) is constant, and pow( x, y ) only varies smoothly with y for x > 0
+			partials[0] = B == 0.0 ? 0.0 : B*pow( A, B-1.0 );
+			partials[1] = A > 0.0 ? v*log( A ) : 0.0;
+			break;
+		case PARSER_OP_SELECT:
+			partials[1] = PARSER_TRUTH( A ) ? 1.0 : 0.0;
+			partials[2] = 1.0 - partials[1];
+			break;
+		case PARSER_OP_NOT:
+		case PARSER_OP_LT:
+		case PARSER_OP_LE:
+		case PARSER_OP_GT:
+		case PARSER_OP_GE:
+		case PARSER_OP_EQ:
+		case PARSER_OP_NE:
+		case PARSER_OP_AND:
+		case PARSER_OP_OR:
+		case PARSER_OP_ABS:
+		case PARSER_OP_FLOOR:
+		case PARSER_OP_CEIL:
+		case PARSER_OP_ROUND:
+			// piecewise constant
+			break;
+		case PARSER_OP_SQRT:  partials[0] = 0.5/v; break;
+		case PARSER_OP_LOG:   partials[0] = 1.0/A; break;
+		case PARSER_OP_EXP:   partials[0] = v; break;
+		case PARSER_OP_SIN:   partials[0] = cos( A ); break;
+		case PARSER_OP_ASIN:  partials[0] = 1.0/sqrt( 1.0 - A*A ); break;
+		case PARSER_OP_COS:   partials[0] = -sin( A ); break;
+		case PARSER_OP_ACOS:  partials[0] = -1.0/sqrt( 1.0 - A*A ); break;
+		case PARSER_OP_TAN:   partials[0] = 1.0 + v*v; break;
+		case PARSER_OP_ATAN:  partials[0] = 1.0/( 1.0 + A*A ); break;
+		case PARSER_OP_ATAN2:
+			d = A*A + B*B;
+			partials[0] = B/d;
+			partials[1] = -A/d;
+			break;
+		case PARSER_OP_FABS:  partials[0] = A > 0.0 ? 1.0 : A < 0.0 ? -1.0 : 0.0; break;
+		case PARSER_OP_CALL:
+			return "Function has no derivative!";
+		case PARSER_OP_NATIVE:
+			if( !prog->natives[node->c].derivative )
+				return "Function has no derivative!";
+			for( j=0; j<node->b; j++ )
+				args[j] = values[prog->args[node->a+j]];
+			if( !prog->natives[node->c].derivative( user_data, node->b, args, v, partials ) )
+				return "Function derivative evaluation failed!";
+			break;
+		default:
+			return "Unknown operation!";
+	}
+#undef A
+#undef B
+	return NULL;
+}
+
+/**
+ @brief evaluates the whole program, leaving the value of every node in values
+ @return NULL on success, otherwise the error string
+*/
+static const char *parser_diff_run( const parser_program *prog, const double *slots, double *values, void *user_data ){
+	const char *err = NULL;
+	if( prog->jit )
+		parser_jit_run( prog, slots, values, user_data, &err );
+	else
+		parser_program_run( prog, 0, prog->num_nodes, slots, values, user_data, &err );
+	return err;
+}
+
+/**
+ @brief looks up each distinct variable of a program exactly once through the variable callback
+ @param[out] vars receives num_variables values
+ @return NULL on success, otherwise the error string
+*/
+static const char *parser_diff_lookup( const parser_program *prog, void *user_data, double *vars ){
+	int i;
+	for( i=0; i<prog->num_variables; i++ ){
+		if( !prog->variable_cb || !prog->variable_cb( user_data, prog->variables[i], vars+i ) )
+			return "Could not look up value for variable!";
+	}
+	return NULL;
+}
+
+int parser_program_gradient( const parser_program *prog, const double *slots, void *user_data, int output, const int *wrt, int num_wrt, double *scratch, double *value, double *gradient, const char **error ){
+	double *values = scratch, *active = scratch + prog->num_nodes, *adjoints = active + prog->num_nodes, *var_adjoints = adjoints + prog->num_nodes;
+	double partials[PARSER_DIFF_MAX_OPERANDS];
+	int operands[PARSER_DIFF_MAX_OPERANDS];
+	const char *err = NULL;
+	int i, j, n;
+
+	if( output < 0 || output >= prog->num_outputs )
+		err = "Invalid output or variable slot!";
+	for( j=0; j<num_wrt && !err; j++ ){
+		if( wrt[j] < 0 || wrt[j] >= prog->num_variables )
+			err = "Invalid output or variable slot!";
+	}
+	if( !err )
+		err = parser_diff_run( prog, slots, values, user_data );
+
+	if( !err ){
+		// flag the nodes that depend on the chosen variables, the others have
+		// no derivative and are left out of the sweep
+		memset( var_adjoints, 0, prog->num_variables*sizeof(double) );
+		for( j=0; j<num_wrt; j++ )
+			var_adjoints[wrt[j]] = 1.0;
+		for( i=0; i<=prog->outputs[output]; i++ ){
+			active[i] = 0.0;
+			if( prog->ops[i] == PARSER_OP_VAR ){
+				active[i] = var_adjoints[prog->nodes[i].a];
+			} else if( !PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+				n = parser_diff_operands( prog, i, operands );
+				for( j=0; j<n && active[i] == 0.0; j++ )
+					active[i] = active[operands[j]];
+			}
+		}
+
+		// adjoints of every node followed by those of the variable slots
+		memset( adjoints, 0, ( prog->num_nodes + prog->num_variables )*sizeof(double) );
+		adjoints[prog->outputs[output]] = 1.0;
+		for( i=prog->outputs[output]; i>=0 && !err; i-- ){
+			if( adjoints[i] == 0.0 || active[i] == 0.0 )
+				continue;
+			if( prog->ops[i] == PARSER_OP_VAR ){
+				var_adjoints[prog->nodes[i].a] += adjoints[i];
+				continue;
+			}
+			n   = parser_diff_operands( prog, i, operands );
+			err = parser_diff_partials( prog, i, values, user_data, partials );
+			for( j=0; j<n && !err; j++ ){
+				// operands the node does not depend on, e.g. the operand of a
+				// ? b : c that was not selected, may not have been evaluated
+				if( partials[j] != 0.0 )
+					adjoints[operands[j]] += adjoints[i]*partials[j];
+			}
+		}
+	}
+
+	*value = err ? sqrt( -1.0 ) : values[prog->outputs[output]];
+	for( j=0; j<num_wrt; j++ )
+		gradient[j] = err ? sqrt( -1.0 ) : var_adjoints[wrt[j]];
+	*error = err;
+	return err ? PARSER_FALSE : PARSER_TRUE;
+}
+
+int parser_program_eval_gradient( const parser_program *prog, const double *slots, void *user_data, int output, const int *wrt, int num_wrt, double *value, double *gradient, const char **error ){
+	double stack_values[PARSER_PROGRAM_STACK_SIZE], *values = stack_values, *vars;
+	const char *err = NULL;
+	int i, size = 3*prog->num_nodes + 2*prog->num_variables;
+
+	// scratch holds the gradient scratch space followed by the variable slots
+	if( size > PARSER_PROGRAM_STACK_SIZE ){
+		values = PARSER_MALLOC( size*sizeof(double) );
+		if( !values ){
+			*value = sqrt( -1.0 );
+			for( i=0; i<num_wrt; i++ )
+				gradient[i] = sqrt( -1.0 );
+			if( error ) *error = "Out of memory while evaluating expression!";
+			return PARSER_FALSE;
+		}
+	}
+	vars = values + 3*prog->num_nodes + prog->num_variables;
+
+	if( !slots ){
+		err   = parser_diff_lookup( prog, user_data, vars );
+		slots = vars;
+	}
+	if( !err ){
+		parser_program_gradient( prog, slots, user_data, output, wrt, num_wrt, values, value, gradient, &err );
+	} else {
+		*value = sqrt( -1.0 );
+		for( i=0; i<num_wrt; i++ )
+			gradient[i] = sqrt( -1.0 );
+	}
+
+	if( values != stack_values )
+		PARSER_FREE( values );
+	if( error )
+		*error = err;
+	return err ? PARSER_FALSE : PARSER_TRUE;
+}
+
+int parser_program_eval_tangent( const parser_program *prog, const double *slots, const double *tangents, void *user_data, double *out, double *derivatives, const char **error ){
+	double stack_values[PARSER_PROGRAM_STACK_SIZE], *values = stack_values, *dots = NULL, d;
+	double partials[PARSER_DIFF_MAX_OPERANDS];
+	int operands[PARSER_DIFF_MAX_OPERANDS];
+	const char *err = NULL;
+	int i, j, n, size = 2*prog->num_nodes + prog->num_variables;
+
+	// scratch holds the value and the derivative of every node followed by
+	// the variable slots
+	if( size > PARSER_PROGRAM_STACK_SIZE ){
+		values = PARSER_MALLOC( size*sizeof(double) );
+		if( !values )
+			err = "Out of memory while evaluating expression!";
+	}
+	if( !err ){
+		dots = values + prog->num_nodes;
+		if( !slots ){
+			err   = parser_diff_lookup( prog, user_data, dots + prog->num_nodes );
+			slots = dots + prog->num_nodes;
+		}
+	}
+	if( !err )
+		err = parser_diff_run( prog, slots, values, user_data );
+
+	if( !err ){
+		// nodes skipped by a jump keep a zero derivative
+		memset( dots, 0, prog->num_nodes*sizeof(double) );
+		for( i=0; i<prog->num_nodes && !err; i++ ){
+			switch( prog->ops[i] ){
+				case PARSER_OP_CONST:
+					break;
+				case PARSER_OP_VAR:
+					dots[i] = tangents[prog->nodes[i].a];
+					break;
+				case PARSER_OP_JUMP_FALSE:
+				case PARSER_OP_JUMP_TRUE:
+				case PARSER_OP_JUMP:
+					// follow the jumps taken by the evaluation
+					if( prog->ops[i] == PARSER_OP_JUMP || PARSER_TRUTH( values[prog->nodes[i].a] ) == ( prog->ops[i] == PARSER_OP_JUMP_TRUE ) )
+						i = prog->nodes[i].b-1;
+					break;
+				default:
+					n = parser_diff_operands( prog, i, operands );
+					for( j=0; j<n && dots[operands[j]] == 0.0; j++ );
+					if( j == n )
+						break;
+					err = parser_diff_partials( prog, i, values, user_data, partials );
+					for( d=0.0, j=0; j<n && !err; j++ ){
+						if( partials[j] != 0.0 )
+							d += partials[j]*dots[operands[j]];
+					}
+					dots[i] = d;
+					break;
+			}
+		}
+	}
+
+	for( i=0; i<prog->num_outputs; i++ ){
+		out[i]         = err ? sqrt( -1.0 ) : values[prog->outputs[i]];
+		derivatives[i] = err ? sqrt( -1.0 ) : dots[prog->outputs[i]];
+	}
+	if( values != stack_values )
+		PARSER_FREE( values );
+	if( error )
+		*error = err;
+	return err ? PARSER_FALSE : PARSER_TRUE;
+}
@@ -0,0 +1,143 @@
+#include<math.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_float.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief single precision evaluation of compiled programs, see expression_parser.h for more information and license terms.
+
+ The single precision evaluator runs the same programs as parser_program_run(), node by node in float: literals are rounded to float once per evaluation, the built-in functions use their float versions, e.g. sinf(), and booleans are tested against PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT.  Domain errors are checked exactly as in double precision.  User and registered functions only have double precision interfaces, so their arguments are widened to double and their results rounded to float.
+*/
+
+#include"expression_internal.h"
+
+int parser_program_run_float( const parser_program *prog, int first, int last, const float *slots, float *values, void *user_data, const char **error ){
+	const parser_node *node = prog->nodes+first;
+	double args[PARSER_MAX_ARGUMENT_COUNT], result;
+	int i, j;
+
+	// shorthands for the operand values of the current node
+#define A values[node->a]
+#define B values[node->b]
+#define C values[node->c]
+	for( i=first; i<last; i++, node++ ){
+		switch( prog->ops[i] ){
+			case PARSER_OP_CONST: values[i] = (float)prog->constants[node->a]; break;
+			case PARSER_OP_VAR:   values[i] = slots[node->a]; break;
+			case PARSER_OP_NEG:   values[i] = -A; break;
+			case PARSER_OP_NOT:   values[i] = PARSER_TRUTH_FLOAT( A ) ? 0.0f : 1.0f; break;
+			case PARSER_OP_ADD:   values[i] = A + B; break;
+			case PARSER_OP_SUB:   values[i] = A - B; break;
+			case PARSER_OP_MUL:   values[i] = A * B; break;
+			case PARSER_OP_DIV:   values[i] = A / B; break;
+			case PARSER_OP_POW:   values[i] = PARSER_FLOAT_MATH( pow )( A, B ); break;
+			case PARSER_OP_LT:    values[i] = A <  B ? 1.0f : 0.0f; break;
+			case PARSER_OP_LE:    values[i] = A <= B ? 1.0f : 0.0f; break;
+			case PARSER_OP_GT:    values[i] = A >  B ? 1.0f : 0.0f; break;
+			case PARSER_OP_GE:    values[i] = A >= B ? 1.0f : 0.0f; break;
+			case PARSER_OP_EQ:    values[i] = fabsf(A - B) < PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT ? 1.0f : 0.0f; break;
+			case PARSER_OP_NE:    values[i] = fabsf(A - B) > PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT ? 1.0f : 0.0f; break;
+			case PARSER_OP_AND:   values[i] = PARSER_TRUTH_FLOAT( A ) && PARSER_TRUTH_FLOAT( B ) ? 1.0f : 0.0f; break;
+			case PARSER_OP_OR:    values[i] = PARSER_TRUTH_FLOAT( A ) || PARSER_TRUTH_FLOAT( B ) ? 1.0f : 0.0f; break;
+			case PARSER_OP_SELECT: values[i] = PARSER_TRUTH_FLOAT( A ) ? B : C; break;
+			case PARSER_OP_JUMP_FALSE:
+			case PARSER_OP_JUMP_TRUE:
+			case PARSER_OP_JUMP:
+				if( prog->ops[i] == PARSER_OP_JUMP || PARSER_TRUTH_FLOAT( A ) == ( prog->ops[i] == PARSER_OP_JUMP_TRUE ) ){
+					i    = node->b-1;
+					node = prog->nodes+i;
+				}
+				break;
+			case PARSER_OP_SQRT:
+				if( A < 0.0f ){
+					*error = "sqrt(x) undefined for x < 0!";
+					return PARSER_FALSE;
+				}
+				values[i] = PARSER_FLOAT_MATH( sqrt )( A );
+				break;
+			case PARSER_OP_LOG:
+				if( A <= 0.0f ){
+					*error = "log(x) undefined for x <= 0!";
+					return PARSER_FALSE;
+				}
+				values[i] = PARSER_FLOAT_MATH( log )( A );
+				break;
+			case PARSER_OP_EXP:   values[i] = PARSER_FLOAT_MATH( exp )( A ); break;
+			case PARSER_OP_SIN:   values[i] = PARSER_FLOAT_MATH( sin )( A ); break;
+			case PARSER_OP_ASIN:
+				if( fabsf(A) > 1.0f ){
+					*error = "asin(x) undefined for |x| > 1!";
+					return PARSER_FALSE;
+				}
+				values[i] = PARSER_FLOAT_MATH( asin )( A );
+				break;
+			case PARSER_OP_COS:   values[i] = PARSER_FLOAT_MATH( cos )( A ); break;
+			case PARSER_OP_ACOS:
+				if( fabsf(A) > 1.0f ){
+					*error = "acos(x) undefined for |x| > 1!";
+					return PARSER_FALSE;
+				}
+				values[i] = PARSER_FLOAT_MATH( acos )( A );
+				break;
+			case PARSER_OP_TAN:   values[i] = PARSER_FLOAT_MATH( tan )( A ); break;
+			case PARSER_OP_ATAN:  values[i] = PARSER_FLOAT_MATH( atan )( A ); break;
+			case PARSER_OP_ATAN2: values[i] = PARSER_FLOAT_MATH( atan2 )( A, B ); break;
+			case PARSER_OP_ABS:   values[i] = (float)abs( (int)A ); break;
+			case PARSER_OP_FABS:  values[i] = fabsf( A ); break;
+			case PARSER_OP_FLOOR: values[i] = PARSER_FLOAT_MATH( floor )( A ); break;
+			case PARSER_OP_CEIL:  values[i] = PARSER_FLOAT_MATH( ceil )( A ); break;
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+			case PARSER_OP_ROUND: values[i] = roundf( A ); break;
+#else
+			case PARSER_OP_ROUND: values[i] = A >= 0.0f ? (float)floor( A + 0.5 ) : (float)ceil( A - 0.5 ); break;
+#endif
+			case PARSER_OP_CALL:
+				for( j=0; j<node->b; j++ )
+					args[j] = values[prog->args[node->a+j]];
+				if( !prog->function_cb || !prog->function_cb( user_data, prog->functions[node->c], node->b, args, &result ) ){
+					*error = "Tried to call unknown built-in function!";
+					return PARSER_FALSE;
+				}
+				values[i] = (float)result;
+				break;
+			case PARSER_OP_NATIVE:
+				for( j=0; j<node->b; j++ )
+					args[j] = values[prog->args[node->a+j]];
+				if( !prog->natives[node->c].fn( user_data, node->b, args, &result ) ){
+					*error = "Function evaluation failed!";
+					return PARSER_FALSE;
+				}
+				values[i] = (float)result;
+				break;
+			default:
+				*error = "Unknown operation!";
+				return PARSER_FALSE;
+		}
+	}
+#undef A
+#undef B
+#undef C
+	return PARSER_TRUE;
+}
+
+float parser_program_eval_float( const parser_program *prog, const float *slots, void *user_data, const char **error ){
+	float stack_values[PARSER_PROGRAM_STACK_SIZE], *values = stack_values, result;
+	const char *err = NULL;
+
+	if( prog->num_nodes > PARSER_PROGRAM_STACK_SIZE ){
+		values = PARSER_MALLOC( prog->num_nodes*sizeof(float) );
+		if( !values ){
+			if( error ) *error = "Out of memory while evaluating expression!";
+			return (float)sqrt( -1.0 );
+		}
+	}
+	parser_program_run_float( prog, 0, prog->num_nodes, slots, values, user_data, &err );
+	result = err ? (float)sqrt( -1.0 ) : values[prog->outputs[0]];
+
+	if( values != stack_values )
+		PARSER_FREE( values );
+	if( error )
+		*error = err;
+	return result;
+}
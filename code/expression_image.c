@@ -0,0 +1,389 @@
+#include<stdio.h>
+#include<stddef.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_image.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief binary images of compiled programs, see expression_parser.h for more information and license terms.
+
+ An image is a header followed by the constants pool, the operands of the nodes, the output and argument indices, the operations of the nodes, a table of name offsets and the nul-terminated names of the variables, user functions and native functions of a program.  Everything is addressed by offsets from the start of the image, so it can be loaded from anywhere in memory, and the arrays have the layout the evaluators use, so parser_program_load() points the program into the image instead of copying it.  Only the tables of name pointers and of native functions, which hold pointers that can not be stored, are allocated when loading.  Images are padded to a multiple of 8 bytes and may be concatenated, e.g. to store a whole rule set in one file mapped with parser_image_map().
+
+ Images are checked with a checksum and validated before use, every index is checked against the sizes of the arrays, so a corrupt or malicious image is rejected rather than read out of bounds.  Images are specific to the byte order and the data layout of the platform that wrote them, which are recorded in the header along with a version number that changes whenever the layout of the nodes or the operation codes change.
+*/
+
+#include"expression_internal.h"
+
+#if !defined(_WIN32)
+#define PARSER_IMAGE_MMAP
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#endif
+
+/**
+ @brief version of the image layout, incremented whenever the nodes, the operation codes or the layout below change
+*/
+#define PARSER_IMAGE_VERSION 2
+
+/**
+ @brief written as an int to detect images of a different byte order
+*/
+#define PARSER_IMAGE_BYTE_ORDER 0x01020304
+
+/**
+ @brief header of an image, all offsets are in bytes from the start of the image
+*/
+typedef struct {
+	/** @brief "EXPR" followed by a nul character and padding */
+	char magic[8];
+
+	/** @brief PARSER_IMAGE_VERSION, PARSER_IMAGE_BYTE_ORDER and sizeof(parser_node) of the writer */
+	int  version;
+	int  byte_order;
+	int  node_size;
+
+	/** @brief size of the image in bytes, a multiple of 8, and its checksum, computed with this field set to zero */
+	int  size;
+	int  checksum;
+
+	/** @brief sizes of the arrays of the program */
+	int  num_nodes;
+	int  num_constants;
+	int  num_outputs;
+	int  num_args;
+	int  num_variables;
+	int  num_functions;
+	int  num_natives;
+	int  num_eliminated;
+
+	/** @brief offsets of the constants, nodes, outputs, args and ops arrays */
+	int  constants;
+	int  nodes;
+	int  outputs;
+	int  args;
+	int  ops;
+
+	/** @brief offset of the name table, the offsets within the strings of the variable, user function and native function names in that order */
+	int  names;
+
+	/** @brief offset and size of the nul-terminated strings */
+	int  strings;
+	int  strings_size;
+} parser_image_header;
+
+/**
+ @brief rounds a size up to a multiple of 8 bytes, the alignment of the constants
+*/
+#define PARSER_IMAGE_ALIGN( size ) ( ( (size) + 7 ) & ~(size_t)7 )
+
+/**
+ @brief FNV-1a hash of an image, skipping the checksum field
+*/
+static int parser_image_checksum( const unsigned char *data, size_t size ){
+	const size_t skip = offsetof( parser_image_header, checksum );
+	unsigned long hash = 2166136261UL;
+	size_t i;
+	for( i=0; i<size; i++ ){
+		if( i >= skip && i < skip+sizeof(int) )
+			continue;
+		hash = ( (hash ^ data[i])*16777619UL ) & 0xffffffffUL;
+	}
+	return (int)(hash & 0x7fffffffUL);
+}
+
+/**
+ @brief name of an entry of the name table of a program: variables first, then user functions, then native functions
+*/
+static const char *parser_image_name( const parser_program *prog, int i ){
+	if( i < prog->num_variables )
+		return prog->variables[i];
+	i -= prog->num_variables;
+	if( i < prog->num_functions )
+		return prog->functions[i];
+	return prog->natives[i - prog->num_functions].name;
+}
+
+size_t parser_program_save( const parser_program *prog, void *buffer, size_t size ){
+	parser_image_header header;
+	unsigned char *data = (unsigned char*)buffer;
+	int i, num_names = prog->num_variables + prog->num_functions + prog->num_natives, *names;
+	size_t total, len;
+
+	memset( &header, 0, sizeof(header) );
+	memcpy( header.magic, "EXPR", 5 );
+	header.version        = PARSER_IMAGE_VERSION;
+	header.byte_order     = PARSER_IMAGE_BYTE_ORDER;
+	header.node_size      = sizeof(parser_node);
+	header.num_nodes      = prog->num_nodes;
+	header.num_constants  = prog->num_constants;
+	header.num_outputs    = prog->num_outputs;
+	header.num_args       = prog->num_args;
+	header.num_variables  = prog->num_variables;
+	header.num_functions  = prog->num_functions;
+	header.num_natives    = prog->num_natives;
+	header.num_eliminated = prog->num_eliminated;
+	header.constants      = PARSER_IMAGE_ALIGN( sizeof(parser_image_header) );
+	header.nodes          = header.constants + prog->num_constants*sizeof(double);
+	header.outputs        = header.nodes + prog->num_nodes*sizeof(parser_node);
+	header.args           = header.outputs + prog->num_outputs*sizeof(int);
+	header.ops            = header.args + prog->num_args*sizeof(int);
+	header.names          = PARSER_IMAGE_ALIGN( header.ops + prog->num_nodes );
+	header.strings        = header.names + num_names*sizeof(int);
+	for( i=0; i<num_names; i++ )
+		header.strings_size += strlen( parser_image_name( prog, i ) )+1;
+	total = PARSER_IMAGE_ALIGN( header.strings + header.strings_size );
+	header.size = (int)total;
+	if( !buffer || size < total )
+		return total;
+
+	memset( data, 0, total );
+	if( prog->num_constants > 0 )
+		memcpy( data+header.constants, prog->constants, prog->num_constants*sizeof(double) );
+	memcpy( data+header.nodes, prog->nodes, prog->num_nodes*sizeof(parser_node) );
+	memcpy( data+header.ops, prog->ops, prog->num_nodes );
+	memcpy( data+header.outputs, prog->outputs, prog->num_outputs*sizeof(int) );
+	if( prog->num_args > 0 )
+		memcpy( data+header.args, prog->args, prog->num_args*sizeof(int) );
+	names = (int*)(data+header.names);
+	for( len=0, i=0; i<num_names; i++ ){
+		names[i] = (int)len;
+		strcpy( (char*)data+header.strings+len, parser_image_name( prog, i ) );
+		len += strlen( parser_image_name( prog, i ) )+1;
+	}
+	memcpy( data, &header, sizeof(header) );
+	header.checksum = parser_image_checksum( data, total );
+	memcpy( data, &header, sizeof(header) );
+	return total;
+}
+
+size_t parser_program_image_size( const void *data, size_t size ){
+	const parser_image_header *header = (const parser_image_header*)data;
+	if( size < sizeof(parser_image_header) || memcmp( header->magic, "EXPR", 5 ) != 0 || header->size < (int)sizeof(parser_image_header) || (size_t)header->size > size )
+		return 0;
+	return header->size;
+}
+
+/**
+ @brief checks that a section of an image of the given size lies within it and is aligned for its elements
+*/
+static int parser_image_section( const parser_image_header *header, int offset, int count, size_t element_size, size_t alignment ){
+	return count >= 0 && offset >= (int)sizeof(parser_image_header) && offset <= header->size && offset % alignment == 0 && (size_t)count <= (size_t)( header->size - offset ) / element_size;
+}
+
+/**
+ @brief checks that node k can be an operand of node i: an earlier node that has a value, i.e. not a jump
+*/
+static int parser_image_operand( const unsigned char *ops, int k, int i ){
+	return k >= 0 && k < i && !PARSER_OP_IS_JUMP( ops[k] );
+}
+
+/**
+ @brief checks every operation and every index of the nodes, outputs and arguments of an image against the array it indexes, and that operands never name a jump, which has no value, so that a loaded program never reads out of bounds
+ @return PARSER_TRUE if the program is well formed
+*/
+static int parser_image_validate( const parser_image_header *header, const unsigned char *ops, const parser_node *nodes, const int *outputs, const int *args ){
+	const parser_node *node;
+	int i, j, op, arity;
+
+	if( header->num_nodes < 1 || header->num_outputs < 1 )
+		return PARSER_FALSE;
+	for( i=0; i<header->num_nodes; i++ ){
+		if( ops[i] >= PARSER_OP_COUNT )
+			return PARSER_FALSE;
+	}
+	for( i=0; i<header->num_outputs; i++ ){
+		if( outputs[i] < 0 || outputs[i] >= header->num_nodes || PARSER_OP_IS_JUMP( ops[outputs[i]] ) )
+			return PARSER_FALSE;
+	}
+	for( i=0; i<header->num_nodes; i++ ){
+		node = nodes+i;
+		op   = ops[i];
+		arity = parser_op_arity( op );
+		if( ( arity > 0 && !parser_image_operand( ops, node->a, i ) ) || ( arity > 1 && !parser_image_operand( ops, node->b, i ) ) || ( arity > 2 && !parser_image_operand( ops, node->c, i ) ) )
+			return PARSER_FALSE;
+		if( PARSER_OP_IS_JUMP( op ) ){
+			// the target may not be past the lazy operation the jump belongs to
+			if( node->c <= i || node->c >= header->num_nodes || !PARSER_OP_IS_LAZY( ops[node->c] ) || node->b <= i || node->b > node->c )
+				return PARSER_FALSE;
+		} else if( op == PARSER_OP_CONST ){
+			if( node->a < 0 || node->a >= header->num_constants )
+				return PARSER_FALSE;
+		} else if( op == PARSER_OP_VAR ){
+			if( node->a < 0 || node->a >= header->num_variables )
+				return PARSER_FALSE;
+		} else if( PARSER_OP_HAS_ARGS( op ) ){
+			if( node->b < 0 || node->b > PARSER_MAX_ARGUMENT_COUNT || node->a < 0 || node->a > header->num_args - node->b )
+				return PARSER_FALSE;
+			if( node->c < 0 || node->c >= ( op == PARSER_OP_CALL ? header->num_functions : header->num_natives ) )
+				return PARSER_FALSE;
+			for( j=0; j<node->b; j++ ){
+				if( !parser_image_operand( ops, args[node->a+j], i ) )
+					return PARSER_FALSE;
+			}
+		}
+	}
+	return PARSER_TRUE;
+}
+
+parser_program *parser_program_load( const void *data, size_t size, parser_variable_callback variable_cb, parser_function_callback function_cb, const parser_registry *reg, const char **error ){
+	const parser_image_header *header = (const parser_image_header*)data;
+	const parser_native *native;
+	parser_program *prog;
+	const char *strings, *err = NULL;
+	const int *names;
+	int i, j, num_names;
+
+	// the header is checked field by field before anything it points to is read
+	if( ( (size_t)data & 7 ) != 0 )
+		err = "Program image is not aligned to 8 bytes!";
+	else if( parser_program_image_size( data, size ) == 0 )
+		err = "Invalid program image!";
+	else if( header->version != PARSER_IMAGE_VERSION || header->byte_order != PARSER_IMAGE_BYTE_ORDER || header->node_size != (int)sizeof(parser_node) )
+		err = "Program image was written by an incompatible version or platform!";
+	else if( header->checksum != parser_image_checksum( (const unsigned char*)data, header->size ) )
+		err = "Program image checksum mismatch!";
+	else if( header->num_variables < 0 || header->num_functions < 0 || header->num_natives < 0 ||
+			!parser_image_section( header, header->constants, header->num_constants, sizeof(double), 8 ) ||
+			!parser_image_section( header, header->nodes, header->num_nodes, sizeof(parser_node), sizeof(int) ) ||
+			!parser_image_section( header, header->ops, header->num_nodes, 1, 1 ) ||
+			!parser_image_section( header, header->outputs, header->num_outputs, sizeof(int), sizeof(int) ) ||
+			!parser_image_section( header, header->args, header->num_args, sizeof(int), sizeof(int) ) ||
+			!parser_image_section( header, header->names, header->num_variables + header->num_functions + header->num_natives, sizeof(int), sizeof(int) ) ||
+			!parser_image_section( header, header->strings, header->strings_size, 1, 1 ) ||
+			( header->strings_size > 0 && ((const char*)data)[header->strings + header->strings_size - 1] != '\0' ) )
+		err = "Invalid program image!";
+	else if( !parser_image_validate( header, (const unsigned char*)data+header->ops, (const parser_node*)((const char*)data+header->nodes), (const int*)((const char*)data+header->outputs), (const int*)((const char*)data+header->args) ) )
+		err = "Invalid program image!";
+	else if( header->num_natives > 0 && !reg )
+		err = "Program image calls native functions, but no registry was given!";
+	if( err ){
+		if( error )
+			*error = err;
+		return NULL;
+	}
+
+	names   = (const int*)((const char*)data + header->names);
+	strings = (const char*)data + header->strings;
+	num_names = header->num_variables + header->num_functions + header->num_natives;
+	for( i=0; i<num_names; i++ ){
+		if( names[i] < 0 || names[i] >= header->strings_size ){
+			if( error )
+				*error = "Invalid program image!";
+			return NULL;
+		}
+	}
+
+	prog = PARSER_CALLOC( 1, sizeof(parser_program) );
+	if( !prog ){
+		if( error )
+			*error = "Out of memory!";
+		return NULL;
+	}
+	prog->image          = data;
+	prog->ops            = (unsigned char*)data + header->ops;
+	prog->nodes          = (parser_node*)((const char*)data + header->nodes);
+	prog->num_nodes      = prog->max_nodes = header->num_nodes;
+	prog->constants      = (double*)((const char*)data + header->constants);
+	prog->num_constants  = prog->max_constants = header->num_constants;
+	prog->outputs        = (int*)((const char*)data + header->outputs);
+	prog->num_outputs    = prog->max_outputs = header->num_outputs;
+	prog->args           = (int*)((const char*)data + header->args);
+	prog->num_args       = prog->max_args = header->num_args;
+	prog->num_eliminated = header->num_eliminated;
+	prog->variable_cb    = variable_cb;
+	prog->function_cb    = function_cb;
+
+	// the name and native tables hold pointers, so they are built here
+	prog->variables = PARSER_MALLOC( ( header->num_variables + 1 )*sizeof(char*) );
+	prog->functions = PARSER_MALLOC( ( header->num_functions + 1 )*sizeof(char*) );
+	prog->natives   = PARSER_MALLOC( ( header->num_natives + 1 )*sizeof(parser_native) );
+	if( !prog->variables || !prog->functions || !prog->natives ){
+		parser_program_free( prog );
+		if( error )
+			*error = "Out of memory!";
+		return NULL;
+	}
+	for( i=0; i<header->num_variables; i++ )
+		prog->variables[i] = (char*)strings + names[i];
+	prog->num_variables = prog->max_variables = header->num_variables;
+	for( i=0; i<header->num_functions; i++ )
+		prog->functions[i] = (char*)strings + names[header->num_variables+i];
+	prog->num_functions = prog->max_functions = header->num_functions;
+
+	// native functions are resolved by name, the calls must suit their arity
+	for( i=0; i<header->num_natives; i++ ){
+		native = parser_registry_find( reg, strings + names[header->num_variables+header->num_functions+i] );
+		if( !native ){
+			parser_program_free( prog );
+			if( error )
+				*error = "Program image calls a native function that is not registered!";
+			return NULL;
+		}
+		prog->natives[i] = *native;
+		prog->natives[i].name = (char*)strings + names[header->num_variables+header->num_functions+i];
+		prog->num_natives = prog->max_natives = i+1;
+		for( j=0; j<prog->num_nodes; j++ ){
+			if( prog->ops[j] == PARSER_OP_NATIVE && prog->nodes[j].c == i && ( prog->nodes[j].b < native->min_args || prog->nodes[j].b > native->max_args ) ){
+				parser_program_free( prog );
+				if( error )
+					*error = "Incorrect number of arguments to native function!";
+				return NULL;
+			}
+		}
+	}
+	if( error )
+		*error = NULL;
+	return prog;
+}
+
+void *parser_image_map( const char *filename, size_t *size ){
+#if defined(PARSER_IMAGE_MMAP)
+	struct stat st;
+	void *data;
+	int fd = open( filename, O_RDONLY );
+
+	if( fd < 0 )
+		return NULL;
+	if( fstat( fd, &st ) != 0 || st.st_size == 0 ){
+		close( fd );
+		return NULL;
+	}
+	data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( data == MAP_FAILED )
+		return NULL;
+	*size = st.st_size;
+	return data;
+#else
+	FILE *fp = fopen( filename, "rb" );
+	void *data = NULL;
+	long len;
+
+	if( !fp )
+		return NULL;
+	if( fseek( fp, 0, SEEK_END ) == 0 && ( len = ftell( fp ) ) > 0 && fseek( fp, 0, SEEK_SET ) == 0 ){
+		data = PARSER_MALLOC( len );
+		if( data && fread( data, 1, len, fp ) != (size_t)len ){
+			PARSER_FREE( data );
+			data = NULL;
+		}
+		*size = len;
+	}
+	fclose( fp );
+	return data;
+#endif
+}
+
+void parser_image_unmap( void *data, size_t size ){
+	if( !data )
+		return;
+#if defined(PARSER_IMAGE_MMAP)
+	munmap( data, size );
+#else
+	(void)size;
+	PARSER_FREE( data );
+#endif
+}
@@ -0,0 +1,501 @@
+#ifndef EXPRESSION_INTERNAL_H
+#define EXPRESSION_INTERNAL_H
+
+/**
+ @file expression_internal.h
+ @author James Gregson (james.gregson@gmail.com)
+ @brief internal data structures shared by the translation units of the library. Application code should only include expression_parser.h, everything in this file may change without notice.
+*/
+
+#include"expression_parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ @brief kinds of tokens produced by the lexer, see parser_token
+*/
+typedef enum {
+	PARSER_TOKEN_END,			/**< end of the input */
+	PARSER_TOKEN_NUMBER,		/**< numeric literal without sign, converted to parser_token::value */
+	PARSER_TOKEN_IDENTIFIER,	/**< variable or function name */
+	PARSER_TOKEN_LPAREN,		/**< ( */
+	PARSER_TOKEN_RPAREN,		/**< ) */
+	PARSER_TOKEN_COMMA,			/**< , */
+	PARSER_TOKEN_PLUS,			/**< + */
+	PARSER_TOKEN_MINUS,			/**< - */
+	PARSER_TOKEN_STAR,			/**< * */
+	PARSER_TOKEN_SLASH,			/**< / */
+	PARSER_TOKEN_CARET,			/**< ^ */
+	PARSER_TOKEN_NOT,			/**< ! */
+	PARSER_TOKEN_LT,			/**< < */
+	PARSER_TOKEN_LE,			/**< <= */
+	PARSER_TOKEN_GT,			/**< > */
+	PARSER_TOKEN_GE,			/**< >= */
+	PARSER_TOKEN_EQ,			/**< == */
+	PARSER_TOKEN_NE,			/**< != */
+	PARSER_TOKEN_AND,			/**< && */
+	PARSER_TOKEN_OR,			/**< || */
+	PARSER_TOKEN_QUESTION,		/**< ? of a conditional expression */
+	PARSER_TOKEN_COLON,			/**< : of a conditional expression */
+	PARSER_TOKEN_ASSIGN,		/**< a single =, always an error */
+	PARSER_TOKEN_AMPERSAND,		/**< a single &, always an error */
+	PARSER_TOKEN_BAR,			/**< a single |, always an error */
+	PARSER_TOKEN_INVALID		/**< a character that does not start a token, or a malformed numeric literal */
+} parser_token_type;
+
+/**
+ @brief character classes of parser_char_class
+*/
+#define PARSER_CHAR_SPACE 1		/**< whitespace, as isspace() in the "C" locale */
+#define PARSER_CHAR_DIGIT 2		/**< decimal digit */
+#define PARSER_CHAR_ALPHA 4		/**< letter or underscore, may start an identifier */
+
+/**
+ @brief character class of every character, a combination of the PARSER_CHAR_* flags, see expression_lexer.c
+*/
+extern const unsigned char parser_char_class[256];
+
+/**
+ @brief converts the unsigned numeric literal starting at str[*pos], with optional digits, an optional decimal point, optional digits and an optional exponent, to the correctly rounded double, see expression_number.c
+ @param[in] str nul-terminated input string
+ @param[in,out] pos position of the literal, advanced past it
+ @param[out] value receives the value of the literal
+ @return PARSER_TRUE if the literal has at least one digit before the exponent, PARSER_FALSE otherwise
+*/
+int parser_convert_double( const char *str, int *pos, double *value );
+
+/**
+ @brief binding strength of the binary operators, from loosest to tightest, used by the precedence climbing parser and compiler
+*/
+typedef enum {
+	PARSER_PRECEDENCE_NONE,			/**< not a binary operator */
+	PARSER_PRECEDENCE_CONDITIONAL,	/**< ? :, right-associative */
+	PARSER_PRECEDENCE_OR,			/**< ||, left-associative */
+	PARSER_PRECEDENCE_AND,			/**< &&, left-associative */
+	PARSER_PRECEDENCE_EQUALITY,		/**< == and !=, at most one per operand of && */
+	PARSER_PRECEDENCE_COMPARISON,	/**< <, <=, > and >=, at most one per operand of == */
+	PARSER_PRECEDENCE_ADD,			/**< + and -, left-associative */
+	PARSER_PRECEDENCE_MUL,			/**< * and /, left-associative */
+	PARSER_PRECEDENCE_POWER			/**< ^, right-associative */
+} parser_precedence;
+
+/**
+ @brief precedence of every kind of token as a binary operator, PARSER_PRECEDENCE_NONE for tokens that are not. The single characters '=', '&' and '|' have the precedence of the operators they start, so they are reported where those would be read, see expression_lexer.c
+*/
+extern const unsigned char parser_token_precedence[PARSER_TOKEN_INVALID+1];
+
+/**
+ @brief reads a subexpression with the precedence climbing parser, stopping at the first binary operator that binds more loosely than precedence
+ @param[in] pd parser_data structure, an error is raised on malformed input or if subexpressions nest deeper than PARSER_MAX_NESTING_DEPTH
+ @param[in] precedence loosest parser_precedence to read, PARSER_PRECEDENCE_CONDITIONAL for a whole expression
+ @return value of the subexpression
+*/
+double parser_read_binary( parser_data *pd, int precedence );
+
+/**
+ @brief current token of a parser_data structure
+*/
+#define PARSER_TOKEN( pd ) ( (pd)->tokens + (pd)->token )
+
+/**
+ @brief kind of the current token of a parser_data structure
+*/
+#define PARSER_TOKEN_TYPE( pd ) ( (pd)->tokens[(pd)->token].type )
+
+/**
+ @brief advances to the next token, refilling the token window as needed. The window always holds the token following the current one, unless the current token is the end of the input, which is never advanced past.
+*/
+void parser_token_next( parser_data *pd );
+
+/**
+ @brief copies the current token, an identifier, to a nul-terminated string
+ @param[in] pd parser_data structure, an error is raised if the identifier is too long
+ @param[out] name buffer of PARSER_MAX_TOKEN_SIZE characters
+ @return length of the identifier
+*/
+int parser_token_name( parser_data *pd, char *name );
+
+/**
+ @brief reads a numeric literal, preceded by a sign if the sign directly precedes its digits, and advances past it
+ @param[in] pd parser_data structure, an error is raised if the current token is not a literal
+ @return value of the literal
+*/
+double parser_token_number( parser_data *pd );
+
+/**
+ @brief operation codes for the nodes of a compiled program
+*/
+typedef enum {
+	PARSER_OP_CONST,	/**< literal value, parser_node::a is its index in parser_program::constants */
+	PARSER_OP_VAR,		/**< variable lookup, parser_node::a is the variable slot */
+	PARSER_OP_NEG,		/**< unary negation of a */
+	PARSER_OP_NOT,		/**< boolean not of a */
+	PARSER_OP_ADD,		/**< a + b */
+	PARSER_OP_SUB,		/**< a - b */
+	PARSER_OP_MUL,		/**< a * b */
+	PARSER_OP_DIV,		/**< a / b */
+	PARSER_OP_POW,		/**< pow( a, b ), used for both '^' and pow(x,y) */
+	PARSER_OP_LT,		/**< a < b */
+	PARSER_OP_LE,		/**< a <= b */
+	PARSER_OP_GT,		/**< a > b */
+	PARSER_OP_GE,		/**< a >= b */
+	PARSER_OP_EQ,		/**< a == b, to within PARSER_BOOLEAN_EQUALITY_THRESHOLD */
+	PARSER_OP_NE,		/**< a != b, to within PARSER_BOOLEAN_EQUALITY_THRESHOLD */
+	PARSER_OP_AND,		/**< boolean a && b, b is only evaluated if a is true, see PARSER_OP_JUMP_FALSE */
+	PARSER_OP_OR,		/**< boolean a || b, b is only evaluated if a is false, see PARSER_OP_JUMP_TRUE */
+	PARSER_OP_SELECT,	/**< a ? b : c, only the selected operand is evaluated, see PARSER_OP_JUMP_FALSE and PARSER_OP_JUMP */
+	PARSER_OP_JUMP_FALSE,	/**< continues evaluation at node b if a is false, see parser_node */
+	PARSER_OP_JUMP_TRUE,	/**< continues evaluation at node b if a is true */
+	PARSER_OP_JUMP,		/**< continues evaluation at node b */
+	PARSER_OP_SQRT,		/**< sqrt( a ), domain checked */
+	PARSER_OP_LOG,		/**< log( a ), domain checked */
+	PARSER_OP_EXP,		/**< exp( a ) */
+	PARSER_OP_SIN,		/**< sin( a ) */
+	PARSER_OP_ASIN,		/**< asin( a ), domain checked */
+	PARSER_OP_COS,		/**< cos( a ) */
+	PARSER_OP_ACOS,		/**< acos( a ), domain checked */
+	PARSER_OP_TAN,		/**< tan( a ) */
+	PARSER_OP_ATAN,		/**< atan( a ) */
+	PARSER_OP_ATAN2,	/**< atan2( a, b ) */
+	PARSER_OP_ABS,		/**< integer abs( a ) */
+	PARSER_OP_FABS,		/**< fabs( a ) */
+	PARSER_OP_FLOOR,	/**< floor( a ) */
+	PARSER_OP_CEIL,		/**< ceil( a ) */
+	PARSER_OP_ROUND,	/**< round( a ) */
+	PARSER_OP_CALL,		/**< user function call through the function callback, see parser_node */
+	PARSER_OP_NATIVE,	/**< call of a registered native function, see parser_node */
+	PARSER_OP_COUNT
+} parser_opcode;
+
+/**
+ @brief true for operations that take their operands from parser_program::args rather than parser_node::a and parser_node::b
+*/
+#define PARSER_OP_HAS_ARGS( op ) ( (op) == PARSER_OP_CALL || (op) == PARSER_OP_NATIVE )
+
+/**
+ @brief true for the operations that skip the following nodes, up to parser_node::b, on their condition
+*/
+#define PARSER_OP_IS_JUMP( op ) ( (op) == PARSER_OP_JUMP_FALSE || (op) == PARSER_OP_JUMP_TRUE || (op) == PARSER_OP_JUMP )
+
+/**
+ @brief true for the operations whose operands are guarded by jumps, see parser_node
+*/
+#define PARSER_OP_IS_LAZY( op ) ( (op) == PARSER_OP_AND || (op) == PARSER_OP_OR || (op) == PARSER_OP_SELECT )
+
+/**
+ @brief true if a value is true under the boolean convention of the library
+*/
+#define PARSER_TRUTH( x ) ( fabs(x) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD )
+
+/**
+ @brief true if a float is true under the single precision boolean convention of the library
+*/
+#define PARSER_TRUTH_FLOAT( x ) ( fabsf(x) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT )
+
+/**
+ @brief float version of a math function, e.g. PARSER_FLOAT_MATH( sin )( x ). Compilers without the C99 float functions compute in double and round the result.
+*/
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#define PARSER_FLOAT_MATH( fn ) fn##f
+#else
+#define PARSER_FLOAT_MATH( fn ) (float)fn
+#define fabsf( x ) ((float)fabs( x ))
+#endif
+
+/**
+ @brief a registered native function, see parser_registry_add()
+*/
+typedef struct {
+	/** @brief function name, NULL for an empty registry entry */
+	char                  *name;
+
+	/** @brief function to call */
+	parser_native_function fn;
+
+	/** @brief minimum and maximum number of arguments */
+	int                    min_args;
+	int                    max_args;
+
+	/** @brief zero or PARSER_FUNCTION_PURE */
+	int                    flags;
+
+	/** @brief partial derivatives of the function, NULL if it can not be differentiated */
+	parser_native_derivative derivative;
+} parser_native;
+
+/**
+ @brief registry of native functions, an open addressing hash table keyed by function name
+*/
+struct parser_registry {
+	/** @brief table entries, the capacity is always a power of two */
+	parser_native *entries;
+	int            capacity;
+	int            count;
+};
+
+/**
+ @brief operands of a single node of a compiled program, the operation of node i is entry i of parser_program::ops. Nodes are stored in post-order, so the operands of a node always precede it and a program can be evaluated by a single forward scan over the node array. The value of node i is written to entry i of the evaluation scratch array.
+
+ Short-circuit operators and conditional expressions skip the nodes of the operands they do not need with jump nodes, which have no value.  The right operand of a && b is preceded by a PARSER_OP_JUMP_FALSE node on a that jumps to the PARSER_OP_AND node, and likewise for || with PARSER_OP_JUMP_TRUE.  For a ? b : c, a PARSER_OP_JUMP_FALSE node on a jumps over the nodes of b to those of c, and a PARSER_OP_JUMP node between them jumps over the nodes of c to the PARSER_OP_SELECT node.  The nodes between a jump and its target form a region that is only evaluated on some paths, so the optimizer never lets nodes outside a region use a node inside it, and the lazy operation only reads the operands that were evaluated.
+*/
+typedef struct {
+	/** @brief index of the first operand node, constant index for PARSER_OP_CONST, variable slot for PARSER_OP_VAR, or the offset of the first argument in parser_program::args for PARSER_OP_CALL and PARSER_OP_NATIVE */
+	int    a;
+
+	/** @brief index of the second operand node, the number of arguments for PARSER_OP_CALL and PARSER_OP_NATIVE, or the node to continue at for the jumps */
+	int    b;
+
+	/** @brief index of the third operand node for PARSER_OP_SELECT, index of the function name in parser_program::functions for PARSER_OP_CALL, index of the function in parser_program::natives for PARSER_OP_NATIVE, index of the lazy operation that the region belongs to for the jumps, unused otherwise */
+	int    c;
+} parser_node;
+
+/**
+ @brief compiled form of an expression, see parser_compile()
+*/
+struct parser_program {
+	/** @brief post-order node array, split into the operation of every node, one of parser_opcode, and its operands */
+	unsigned char *ops;
+	parser_node   *nodes;
+	int            num_nodes;
+	int            max_nodes;
+
+	/** @brief literal values, one per PARSER_OP_CONST node in node order */
+	double      *constants;
+	int          num_constants;
+	int          max_constants;
+
+	/** @brief node holding the result of each compiled expression, a single entry, the last node, for programs from parser_compile() */
+	int         *outputs;
+	int          num_outputs;
+	int          max_outputs;
+
+	/** @brief argument node indices for user function calls */
+	int         *args;
+	int          num_args;
+	int          max_args;
+
+	/** @brief distinct variable names, indexed by variable slot */
+	char       **variables;
+	int          num_variables;
+	int          max_variables;
+
+	/** @brief distinct user function names, indexed by parser_node::c */
+	char       **functions;
+	int          num_functions;
+	int          max_functions;
+
+	/** @brief native functions called by the program, copied from the registry at compile time and indexed by parser_node::c */
+	parser_native *natives;
+	int            num_natives;
+	int            max_natives;
+
+	/** @brief executable machine code from parser_program_jit(), NULL if the program is interpreted */
+	void          *jit;
+	size_t         jit_size;
+	size_t         jit_entry;
+
+	/** @brief number of nodes removed by common subexpression elimination */
+	int            num_eliminated;
+
+	/** @brief callbacks captured from the parser_data structure the program was compiled from */
+	parser_variable_callback variable_cb;
+	parser_function_callback function_cb;
+
+	/** @brief image the program was loaded from by parser_program_load(), NULL for compiled programs. The nodes, constants, outputs, args and names then point into the image and are not freed with the program. */
+	const void              *image;
+
+	/** @brief arena the program was compiled into, NULL if it was allocated with PARSER_MALLOC. The program is then a single allocation from the arena, which is not freed with the program. */
+	parser_arena            *arena;
+};
+
+/**
+ @brief looks up a native function in a registry
+ @param[in] reg registry to search
+ @param[in] name nul-terminated function name
+ @return registry entry, or NULL if no function of that name is registered
+*/
+const parser_native *parser_registry_find( const parser_registry *reg, const char *name );
+
+/**
+ @brief looks up a built-in function by name using a perfect hash
+ @param[in] name nul-terminated function name
+ @param[in] len length of the name
+ @param[out] num_args number of arguments of the built-in function, set only if it was found
+ @return operation code of the built-in function, or -1 if name is not a built-in function
+*/
+int parser_builtin_lookup( const char *name, int len, int *num_args );
+
+/**
+ @brief returns the number of operands of a node with the given opcode, from zero to three for a, b and c. PARSER_OP_CALL and PARSER_OP_NATIVE nodes take their operands from parser_program::args instead, and the target of a jump is not an operand
+*/
+int parser_op_arity( int op );
+
+/**
+ @brief evaluates a range of nodes of a compiled program given the values of its variables, indexed by variable slot
+ @param[in] prog the program to evaluate
+ @param[in] first index of the first node to evaluate, the values of all operands of the range must already be in values
+ @param[in] last one past the index of the last node to evaluate, prog->num_nodes to evaluate the whole program
+ @param[in] slots values of the program variables, indexed by variable slot
+ @param[out] values scratch array with one entry per node, receives the value of every evaluated node
+ @param[in] user_data pointer passed through to the function callback
+ @param[out] error set to an error string if evaluation failed, untouched otherwise
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+*/
+int parser_program_run( const parser_program *prog, int first, int last, const double *slots, double *values, void *user_data, const char **error );
+
+/**
+ @brief evaluates one output of a program and its gradient with respect to chosen variables, see parser_program_eval_gradient() and expression_diff.c
+ @param[in] prog program to evaluate
+ @param[in] slots values of the program variables, indexed by variable slot
+ @param[in] user_data pointer passed through to the function callback and native functions
+ @param[in] output index of the output to differentiate
+ @param[in] wrt slots of the variables to differentiate with respect to
+ @param[in] num_wrt number of variables to differentiate with respect to
+ @param[in] scratch scratch array of 3*num_nodes + num_variables values
+ @param[out] value receives the value of the output, nan on failure
+ @param[out] gradient receives num_wrt partial derivatives, nan on failure
+ @param[out] error set to an error string if evaluation failed, to NULL otherwise
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+*/
+int parser_program_gradient( const parser_program *prog, const double *slots, void *user_data, int output, const int *wrt, int num_wrt, double *scratch, double *value, double *gradient, const char **error );
+
+/**
+ @brief constant folding pass, see expression_optimize.c. Replaces every node whose operands are all constant, and that is not a variable, a user function call or a call of an impure native function, by a literal and removes the nodes that are no longer referenced by an output.
+ @param[inout] prog program to optimize
+ @param[in] user_data pointer passed to native functions evaluated at compile time
+ @return number of nodes removed, or -1 if memory could not be allocated, in which case the program must be discarded
+*/
+int parser_program_fold( parser_program *prog, void *user_data );
+
+/**
+ @brief common subexpression elimination pass, see expression_optimize.c. Merges structurally identical nodes by hash-consing, so that every distinct subexpression of all outputs is evaluated once, and removes the duplicates.
+ @param[inout] prog program to optimize
+ @return number of nodes removed, or -1 if memory could not be allocated, in which case the program is unchanged
+*/
+int parser_program_share( parser_program *prog );
+
+/**
+ @brief evaluates a program translated by parser_program_jit(), see expression_jit.c. The arguments and result are the same as for parser_program_run() over the whole program.
+*/
+int parser_jit_run( const parser_program *prog, const double *slots, double *values, void *user_data, const char **error );
+
+/**
+ @brief evaluates the nodes [first,last) of a program in single precision, see expression_float.c. The arguments and result are the same as for parser_program_run().
+*/
+int parser_program_run_float( const parser_program *prog, int first, int last, const float *slots, float *values, void *user_data, const char **error );
+
+/**
+ @brief releases the machine code of a program, if any
+*/
+void parser_jit_free( parser_program *prog );
+
+/**
+ @brief rounds a size up to a multiple of PARSER_ARENA_ALIGNMENT
+*/
+#define PARSER_ARENA_ROUND( size ) ( ( (size) + PARSER_ARENA_ALIGNMENT-1 ) & ~(size_t)(PARSER_ARENA_ALIGNMENT-1) )
+
+/**
+ @brief position in an arena, see parser_arena_get_mark()
+*/
+typedef struct {
+	void  *blocks;
+	size_t used;
+	size_t retired;
+} parser_arena_mark;
+
+/**
+ @brief grows or shrinks an allocation from an arena, in place if it is the most recent allocation and the block has room, see expression_arena.c
+ @param[inout] arena arena the allocation was made from
+ @param[in] ptr allocation, may be NULL
+ @param[in] old_size size the allocation was made with
+ @param[in] new_size new size in bytes
+ @return allocation holding the first old_size bytes of ptr, NULL on failure in which case ptr is unchanged
+*/
+void *parser_arena_realloc( parser_arena *arena, void *ptr, size_t old_size, size_t new_size );
+
+/**
+ @brief records the current position of an arena, to release everything allocated after it with parser_arena_rewind() or parser_arena_keep()
+*/
+void parser_arena_get_mark( const parser_arena *arena, parser_arena_mark *mark );
+
+/**
+ @brief releases everything allocated from an arena after a mark
+*/
+void parser_arena_rewind( parser_arena *arena, const parser_arena_mark *mark );
+
+/**
+ @brief releases everything allocated from an arena after a mark except one allocation, which is moved to the mark, or to the start of the current block if it does not fit in the block of the mark
+ @param[inout] arena arena to rewind
+ @param[in] mark position to rewind to
+ @param[in] data allocation to keep, made after the mark, it must be the most recent allocation
+ @param[in] size size of the allocation
+ @return new address of the allocation
+*/
+void *parser_arena_keep( parser_arena *arena, const parser_arena_mark *mark, void *data, size_t size );
+
+/**
+ @brief grows an array of a program, from the arena of the program if it has one, so that it can hold at least count entries
+ @param[inout] prog program the array belongs to
+ @param[inout] array array to grow, may point to NULL
+ @param[inout] max capacity of the array, updated
+ @param[in] count number of entries needed
+ @param[in] size size of an entry in bytes
+ @return PARSER_TRUE on success, PARSER_FALSE if memory could not be allocated, in which case the array is unchanged
+*/
+int parser_program_reserve( parser_program *prog, void **array, int *max, int count, size_t size );
+
+/**
+ @brief allocates scratch memory for an optimization pass over a program, from the arena of the program if it has one, where it is released with the scratch memory of the compiler
+*/
+void *parser_program_scratch( parser_program *prog, size_t size );
+
+/**
+ @brief releases memory from parser_program_scratch()
+*/
+void parser_program_scratch_free( parser_program *prog, void *ptr );
+
+/**
+ @brief function running one task of a parallel job, see parser_pool_run()
+ @param[in] context job data passed to parser_pool_run()
+ @param[in] thread index of the thread running the task, from zero to parser_pool_num_threads()-1, for selecting per-thread scratch space
+ @param[in] task index of the task
+*/
+typedef void (*parser_pool_task)( void *context, int thread, size_t task );
+
+/**
+ @brief returns the number of threads of a pool, including the calling thread, see expression_pool.c
+*/
+int parser_pool_num_threads( const parser_pool *pool );
+
+/**
+ @brief runs tasks 0 to num_tasks-1 of a job on the threads of a pool, including the calling thread, and returns once all of them have completed. Jobs submitted from several threads at once are run one after the other.
+ @param[in] pool thread pool
+ @param[in] num_tasks number of tasks
+ @param[in] task function running a single task
+ @param[in] context job data passed to the task function
+*/
+void parser_pool_run( parser_pool *pool, size_t num_tasks, parser_pool_task task, void *context );
+
+/**
+ @brief applies a vectorized kernel for an operation to a chunk of rows of the batch evaluator, see expression_simd.c
+ @param[in] op operation to apply
+ @param[out] v n results, may alias a or b
+ @param[in] a n values of the first operand
+ @param[in] b n values of the second operand, equal to a for unary operations
+ @param[in] n number of rows
+ @return number of leading rows processed, zero if the operation has no kernel. The caller processes the remaining rows.
+*/
+int parser_simd_kernel( int op, double *v, const double *a, const double *b, int n );
+
+/**
+ @brief single precision version of parser_simd_kernel(), four (SSE2) or eight (AVX2) rows per instruction
+*/
+int parser_simd_kernel_float( int op, float *v, const float *a, const float *b, int n );
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
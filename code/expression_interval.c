@@ -0,0 +1,434 @@
+#include<math.h>
+#include<limits.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_interval.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief interval evaluation of compiled programs, see expression_parser.h for more information and license terms.
+
+ Every node of the program is evaluated once over intervals rather than values: given bounds on each variable, a node receives an interval containing its value for every row within the bounds that evaluates it successfully, and a flag telling whether any such row may fail to evaluate it, e.g. with a domain error.  Rows that fail produce nan, which is false, so an interval only needs to cover the rows that succeed.  An empty interval means that no row evaluates the node successfully.
+
+ Comparisons and boolean operators produce [0,0], [1,1] or [0,1] following the truth convention of the library, a value being true when its magnitude is at least PARSER_BOOLEAN_EQUALITY_THRESHOLD.  Jumps are not followed: the lazy operations combine the intervals of the operands that some row may select, so the operand of a && b that no row needs neither contributes to the result nor makes it fail.  Operations whose result may be nan, e.g. 0/0 or pow() of a negative base, produce the whole real line, which is never definitely true or false.  The result is conservative, correlations between operands are ignored, so x - x over [0,1] is [-1,1].
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief flags of the truth values an interval may take, see parser_interval_truth()
+*/
+#define PARSER_INTERVAL_MAY_BE_FALSE 1
+#define PARSER_INTERVAL_MAY_BE_TRUE  2
+
+/**
+ @brief interval with the given bounds, a nan bound is replaced by the corresponding infinity
+*/
+static parser_interval parser_interval_make( double lo, double hi ){
+	parser_interval r;
+	r.lo = lo == lo ? lo : -HUGE_VAL;
+	r.hi = hi == hi ? hi : HUGE_VAL;
+	return r;
+}
+
+static parser_interval parser_interval_empty( void ){
+	return parser_interval_make( HUGE_VAL, -HUGE_VAL );
+}
+
+static parser_interval parser_interval_full( void ){
+	return parser_interval_make( -HUGE_VAL, HUGE_VAL );
+}
+
+#define PARSER_INTERVAL_IS_EMPTY( x ) ( (x).lo > (x).hi )
+
+/**
+ @brief smallest interval containing two intervals
+*/
+static parser_interval parser_interval_union( parser_interval a, parser_interval b ){
+	if( PARSER_INTERVAL_IS_EMPTY( a ) )
+		return b;
+	if( PARSER_INTERVAL_IS_EMPTY( b ) )
+		return a;
+	return parser_interval_make( a.lo < b.lo ? a.lo : b.lo, a.hi > b.hi ? a.hi : b.hi );
+}
+
+/**
+ @brief smallest interval containing four values
+*/
+static parser_interval parser_interval_hull( double v0, double v1, double v2, double v3 ){
+	double lo = v0, hi = v0;
+	lo = v1 < lo ? v1 : lo;  hi = v1 > hi ? v1 : hi;
+	lo = v2 < lo ? v2 : lo;  hi = v2 > hi ? v2 : hi;
+	lo = v3 < lo ? v3 : lo;  hi = v3 > hi ? v3 : hi;
+	return parser_interval_make( lo, hi );
+}
+
+/**
+ @brief truth values that the values of an interval may take, a combination of the PARSER_INTERVAL_MAY_BE_* flags, zero for an empty interval
+*/
+static int parser_interval_truth( parser_interval x ){
+	int flags = 0;
+	if( PARSER_INTERVAL_IS_EMPTY( x ) )
+		return 0;
+	if( x.lo < PARSER_BOOLEAN_EQUALITY_THRESHOLD && x.hi > -PARSER_BOOLEAN_EQUALITY_THRESHOLD )
+		flags |= PARSER_INTERVAL_MAY_BE_FALSE;
+	if( x.lo <= -PARSER_BOOLEAN_EQUALITY_THRESHOLD || x.hi >= PARSER_BOOLEAN_EQUALITY_THRESHOLD )
+		flags |= PARSER_INTERVAL_MAY_BE_TRUE;
+	return flags;
+}
+
+/**
+ @brief interval of a boolean result that may take the truth values of a combination of the PARSER_INTERVAL_MAY_BE_* flags
+*/
+static parser_interval parser_interval_boolean( int flags ){
+	if( !flags )
+		return parser_interval_empty();
+	return parser_interval_make( flags & PARSER_INTERVAL_MAY_BE_FALSE ? 0.0 : 1.0, flags & PARSER_INTERVAL_MAY_BE_TRUE ? 1.0 : 0.0 );
+}
+
+/**
+ @brief product of two intervals. Zero times an infinite bound is nan, as it is when the program runs, so it may produce any value
+*/
+static parser_interval parser_interval_mul( parser_interval a, parser_interval b ){
+	double p[4];
+	int i;
+	p[0] = a.lo*b.lo;
+	p[1] = a.lo*b.hi;
+	p[2] = a.hi*b.lo;
+	p[3] = a.hi*b.hi;
+	for( i=0; i<4; i++ ){
+		if( p[i] != p[i] )
+			return parser_interval_full();
+	}
+	return parser_interval_hull( p[0], p[1], p[2], p[3] );
+}
+
+/**
+ @brief quotient of two intervals. Division by an interval containing zero may produce any value, and so may the quotient of two infinite bounds
+*/
+static parser_interval parser_interval_div( parser_interval a, parser_interval b ){
+	double q[4];
+	int i;
+	if( b.lo <= 0.0 && b.hi >= 0.0 )
+		return parser_interval_full();
+	q[0] = a.lo/b.lo;
+	q[1] = a.lo/b.hi;
+	q[2] = a.hi/b.lo;
+	q[3] = a.hi/b.hi;
+	for( i=0; i<4; i++ ){
+		if( q[i] != q[i] )
+			return parser_interval_full();
+	}
+	return parser_interval_hull( q[0], q[1], q[2], q[3] );
+}
+
+/**
+ @brief true if a + k*period lies within x for some integer k
+*/
+static int parser_interval_contains_periodic( parser_interval x, double a, double period ){
+	return ceil( (x.lo - a)/period ) <= floor( (x.hi - a)/period );
+}
+
+/**
+ @brief interval of sin() or cos() over x, given the position of a maximum and of a minimum of the function
+*/
+static parser_interval parser_interval_periodic( parser_interval x, double (*fn)( double ), double peak, double trough ){
+	const double two_pi = 6.283185307179586;
+	double lo, hi;
+	if( !( x.hi - x.lo < two_pi ) )
+		return parser_interval_make( -1.0, 1.0 );
+	lo = fn( x.lo ) < fn( x.hi ) ? fn( x.lo ) : fn( x.hi );
+	hi = fn( x.lo ) > fn( x.hi ) ? fn( x.lo ) : fn( x.hi );
+	if( parser_interval_contains_periodic( x, peak, two_pi ) )
+		hi = 1.0;
+	if( parser_interval_contains_periodic( x, trough, two_pi ) )
+		lo = -1.0;
+	return parser_interval_make( lo, hi );
+}
+
+/**
+ @brief interval of fabs() over x
+*/
+static parser_interval parser_interval_fabs( parser_interval x ){
+	if( x.lo >= 0.0 )
+		return x;
+	if( x.hi <= 0.0 )
+		return parser_interval_make( -x.hi, -x.lo );
+	return parser_interval_make( 0.0, -x.lo > x.hi ? -x.lo : x.hi );
+}
+
+/**
+ @brief interval of pow() over a box of bases and exponents
+*/
+static parser_interval parser_interval_pow( parser_interval a, parser_interval b ){
+	double n = b.lo;
+
+	if( b.lo == b.hi && n == floor( n ) && fabs( n ) < 9007199254740992.0 ){
+		// integer powers are defined for every base, and monotone on each
+		// side of zero
+		if( n == 0.0 )
+			return parser_interval_make( 1.0, 1.0 );
+		if( a.lo < 0.0 && a.hi > 0.0 && n > 0.0 && fmod( n, 2.0 ) == 0.0 )
+			return parser_interval_make( 0.0, pow( a.lo, n ) > pow( a.hi, n ) ? pow( a.lo, n ) : pow( a.hi, n ) );
+		if( a.lo <= 0.0 && a.hi >= 0.0 && n < 0.0 )
+			return parser_interval_full();
+		if( a.lo < 0.0 && a.hi > 0.0 )
+			return parser_interval_make( pow( a.lo, n ), pow( a.hi, n ) );
+		return pow( a.lo, n ) < pow( a.hi, n ) ? parser_interval_make( pow( a.lo, n ), pow( a.hi, n ) ) : parser_interval_make( pow( a.hi, n ), pow( a.lo, n ) );
+	}
+	if( a.lo >= 0.0 ){
+		// monotone in each argument for non-negative bases, so the extremes
+		// are at the corners
+		return parser_interval_hull( pow( a.lo, b.lo ), pow( a.lo, b.hi ), pow( a.hi, b.lo ), pow( a.hi, b.hi ) );
+	}
+	// negative bases with non-integer exponents produce nan
+	return parser_interval_full();
+}
+
+/**
+ @brief restricts an interval to the domain [lo,hi] of a built-in function, flagging the node if part of the interval is outside of it
+*/
+static parser_interval parser_interval_domain( parser_interval x, double lo, double hi, unsigned char *fails ){
+	if( x.lo < lo || x.hi > hi )
+		*fails = 1;
+	return parser_interval_make( x.lo > lo ? x.lo : lo, x.hi < hi ? x.hi : hi );
+}
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#define parser_interval_round( x ) round( x )
+#else
+static double parser_interval_round( double x ){
+	return x >= 0.0 ? floor( x + 0.5 ) : ceil( x - 0.5 );
+}
+#endif
+
+/**
+ @brief evaluates every node of a program over intervals
+ @param[in] bounds interval of each variable, indexed by variable slot
+ @param[out] x receives the interval of every node
+ @param[out] fails receives, for every node, whether a row may fail to evaluate it
+*/
+static void parser_interval_run( const parser_program *prog, const parser_interval *bounds, void *user_data, parser_interval *x, unsigned char *fails ){
+	const parser_node *node = prog->nodes;
+	double args[PARSER_MAX_ARGUMENT_COUNT], v;
+	parser_interval a, b, c, d;
+	int i, j, ta, empty, point;
+
+	for( i=0; i<prog->num_nodes; i++, node++ ){
+		fails[i] = 0;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+			x[i] = parser_interval_empty();
+			continue;
+		}
+
+		// operands, and the flags that non-lazy operations inherit from them
+		a = b = c = parser_interval_empty();
+		empty = 0;
+		point = 1;
+		if( PARSER_OP_HAS_ARGS( prog->ops[i] ) ){
+			for( j=0; j<node->b; j++ ){
+				a = x[prog->args[node->a+j]];
+				fails[i] |= fails[prog->args[node->a+j]];
+				empty |= PARSER_INTERVAL_IS_EMPTY( a );
+				point &= a.lo == a.hi;
+				args[j] = a.lo;
+			}
+		} else if( prog->ops[i] != PARSER_OP_CONST && prog->ops[i] != PARSER_OP_VAR ){
+			a = x[node->a];
+			b = parser_op_arity( prog->ops[i] ) >= 2 ? x[node->b] : a;
+			c = parser_op_arity( prog->ops[i] ) >= 3 ? x[node->c] : b;
+			if( !PARSER_OP_IS_LAZY( prog->ops[i] ) ){
+				fails[i] = fails[node->a] | ( parser_op_arity( prog->ops[i] ) >= 2 ? fails[node->b] : 0 );
+				empty = PARSER_INTERVAL_IS_EMPTY( a ) || PARSER_INTERVAL_IS_EMPTY( b );
+			}
+		}
+		if( empty ){
+			x[i] = parser_interval_empty();
+			continue;
+		}
+
+		switch( prog->ops[i] ){
+			case PARSER_OP_CONST: x[i] = parser_interval_make( prog->constants[node->a], prog->constants[node->a] ); break;
+			case PARSER_OP_VAR:   x[i] = parser_interval_make( bounds[node->a].lo, bounds[node->a].hi ); break;
+			case PARSER_OP_NEG:   x[i] = parser_interval_make( -a.hi, -a.lo ); break;
+			case PARSER_OP_ADD:   x[i] = parser_interval_make( a.lo + b.lo, a.hi + b.hi ); break;
+			case PARSER_OP_SUB:   x[i] = parser_interval_make( a.lo - b.hi, a.hi - b.lo ); break;
+			case PARSER_OP_MUL:   x[i] = parser_interval_mul( a, b ); break;
+			case PARSER_OP_DIV:   x[i] = parser_interval_div( a, b ); break;
+			case PARSER_OP_POW:   x[i] = parser_interval_pow( a, b ); break;
+			case PARSER_OP_NOT:
+				ta = parser_interval_truth( a );
+				x[i] = parser_interval_boolean( ( ta & PARSER_INTERVAL_MAY_BE_TRUE ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) | ( ta & PARSER_INTERVAL_MAY_BE_FALSE ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) );
+				break;
+			case PARSER_OP_LT: x[i] = parser_interval_boolean( ( a.lo <  b.hi ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) | ( a.hi >= b.lo ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) ); break;
+			case PARSER_OP_LE: x[i] = parser_interval_boolean( ( a.lo <= b.hi ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) | ( a.hi >  b.lo ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) ); break;
+			case PARSER_OP_GT: x[i] = parser_interval_boolean( ( a.hi >  b.lo ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) | ( a.lo <= b.hi ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) ); break;
+			case PARSER_OP_GE: x[i] = parser_interval_boolean( ( a.hi >= b.lo ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) | ( a.lo <  b.hi ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) ); break;
+			case PARSER_OP_EQ:
+				// equal to within the threshold, |a - b| < PARSER_BOOLEAN_EQUALITY_THRESHOLD
+				d = parser_interval_make( a.lo - b.hi, a.hi - b.lo );
+				x[i] = parser_interval_boolean( ( d.lo < PARSER_BOOLEAN_EQUALITY_THRESHOLD && d.hi > -PARSER_BOOLEAN_EQUALITY_THRESHOLD ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) |
+				                                ( d.lo <= -PARSER_BOOLEAN_EQUALITY_THRESHOLD || d.hi >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) );
+				break;
+			case PARSER_OP_NE:
+				// different by more than the threshold, |a - b| > PARSER_BOOLEAN_EQUALITY_THRESHOLD
+				d = parser_interval_make( a.lo - b.hi, a.hi - b.lo );
+				x[i] = parser_interval_boolean( ( d.lo < -PARSER_BOOLEAN_EQUALITY_THRESHOLD || d.hi > PARSER_BOOLEAN_EQUALITY_THRESHOLD ? PARSER_INTERVAL_MAY_BE_TRUE : 0 ) |
+				                                ( d.lo <= PARSER_BOOLEAN_EQUALITY_THRESHOLD && d.hi >= -PARSER_BOOLEAN_EQUALITY_THRESHOLD ? PARSER_INTERVAL_MAY_BE_FALSE : 0 ) );
+				break;
+			case PARSER_OP_AND:
+				// b only matters, and may only fail, for the rows where a is true
+				ta = parser_interval_truth( a );
+				fails[i] = fails[node->a] | ( ta & PARSER_INTERVAL_MAY_BE_TRUE ? fails[node->b] : 0 );
+				if( ta & PARSER_INTERVAL_MAY_BE_TRUE )
+					ta = ( ta & PARSER_INTERVAL_MAY_BE_FALSE ) | parser_interval_truth( b );
+				x[i] = parser_interval_boolean( ta );
+				break;
+			case PARSER_OP_OR:
+				ta = parser_interval_truth( a );
+				fails[i] = fails[node->a] | ( ta & PARSER_INTERVAL_MAY_BE_FALSE ? fails[node->b] : 0 );
+				if( ta & PARSER_INTERVAL_MAY_BE_FALSE )
+					ta = ( ta & PARSER_INTERVAL_MAY_BE_TRUE ) | parser_interval_truth( b );
+				x[i] = parser_interval_boolean( ta );
+				break;
+			case PARSER_OP_SELECT:
+				ta = parser_interval_truth( a );
+				fails[i] = fails[node->a] | ( ta & PARSER_INTERVAL_MAY_BE_TRUE ? fails[node->b] : 0 ) | ( ta & PARSER_INTERVAL_MAY_BE_FALSE ? fails[node->c] : 0 );
+				x[i] = parser_interval_union( ta & PARSER_INTERVAL_MAY_BE_TRUE ? b : parser_interval_empty(), ta & PARSER_INTERVAL_MAY_BE_FALSE ? c : parser_interval_empty() );
+				break;
+			case PARSER_OP_SQRT:
+				if( a.hi < 0.0 ){
+					fails[i] = 1;
+					x[i] = parser_interval_empty();
+					break;
+				}
+				a = parser_interval_domain( a, 0.0, HUGE_VAL, fails+i );
+				x[i] = parser_interval_make( sqrt( a.lo ), sqrt( a.hi ) );
+				break;
+			case PARSER_OP_LOG:
+				if( a.hi <= 0.0 ){
+					fails[i] = 1;
+					x[i] = parser_interval_empty();
+					break;
+				}
+				if( a.lo <= 0.0 )
+					fails[i] = 1;
+				x[i] = parser_interval_make( a.lo > 0.0 ? log( a.lo ) : -HUGE_VAL, log( a.hi ) );
+				break;
+			case PARSER_OP_EXP:   x[i] = parser_interval_make( exp( a.lo ), exp( a.hi ) ); break;
+			case PARSER_OP_SIN:   x[i] = parser_interval_periodic( a, sin, 1.5707963267948966, -1.5707963267948966 ); break;
+			case PARSER_OP_COS:   x[i] = parser_interval_periodic( a, cos, 0.0, 3.141592653589793 ); break;
+			case PARSER_OP_ASIN:
+			case PARSER_OP_ACOS:
+				if( a.hi < -1.0 || a.lo > 1.0 ){
+					fails[i] = 1;
+					x[i] = parser_interval_empty();
+					break;
+				}
+				a = parser_interval_domain( a, -1.0, 1.0, fails+i );
+				x[i] = prog->ops[i] == PARSER_OP_ASIN ? parser_interval_make( asin( a.lo ), asin( a.hi ) ) : parser_interval_make( acos( a.hi ), acos( a.lo ) );
+				break;
+			case PARSER_OP_TAN:
+				// tan() is increasing between its poles
+				if( !( a.hi - a.lo < 3.141592653589793 ) || parser_interval_contains_periodic( a, 1.5707963267948966, 3.141592653589793 ) )
+					x[i] = parser_interval_full();
+				else
+					x[i] = parser_interval_make( tan( a.lo ), tan( a.hi ) );
+				break;
+			case PARSER_OP_ATAN:  x[i] = parser_interval_make( atan( a.lo ), atan( a.hi ) ); break;
+			case PARSER_OP_ATAN2:
+				// monotone in each argument away from the cut along the negative x axis
+				if( b.lo > 0.0 || a.lo > 0.0 || a.hi < 0.0 )
+					x[i] = parser_interval_hull( atan2( a.lo, b.lo ), atan2( a.lo, b.hi ), atan2( a.hi, b.lo ), atan2( a.hi, b.hi ) );
+				else
+					x[i] = parser_interval_make( -3.141592653589793, 3.141592653589793 );
+				break;
+			case PARSER_OP_ABS:
+				// the conversion to int truncates towards zero
+				if( a.lo <= (double)INT_MIN || a.hi >= (double)INT_MAX )
+					x[i] = parser_interval_full();
+				else
+					x[i] = parser_interval_fabs( parser_interval_make( (double)(int)a.lo, (double)(int)a.hi ) );
+				break;
+			case PARSER_OP_FABS:  x[i] = parser_interval_fabs( a ); break;
+			case PARSER_OP_FLOOR: x[i] = parser_interval_make( floor( a.lo ), floor( a.hi ) ); break;
+			case PARSER_OP_CEIL:  x[i] = parser_interval_make( ceil( a.lo ), ceil( a.hi ) ); break;
+			case PARSER_OP_ROUND: x[i] = parser_interval_make( parser_interval_round( a.lo ), parser_interval_round( a.hi ) ); break;
+			case PARSER_OP_NATIVE:
+				// pure functions of single values are evaluated, as by the optimizer
+				if( point && ( prog->natives[node->c].flags & PARSER_FUNCTION_PURE ) ){
+					if( prog->natives[node->c].fn( user_data, node->b, args, &v ) ){
+						x[i] = parser_interval_make( v, v );
+					} else {
+						fails[i] = 1;
+						x[i] = parser_interval_empty();
+					}
+					break;
+				}
+				fails[i] = 1;
+				x[i] = parser_interval_full();
+				break;
+			default:
+				// user functions may return anything, or fail
+				fails[i] = 1;
+				x[i] = parser_interval_full();
+				break;
+		}
+	}
+}
+
+/**
+ @brief evaluates a program over intervals and returns the intervals of a range of its outputs
+ @param[in] first index of the first output
+ @param[in] count number of outputs
+ @param[out] out receives count intervals, the whole real line if memory could not be allocated
+ @param[out] may_fail receives count flags, may be NULL
+ @return PARSER_TRUE on success, PARSER_FALSE if memory could not be allocated
+*/
+static int parser_interval_outputs( const parser_program *prog, const parser_interval *bounds, void *user_data, int first, int count, parser_interval *out, int *may_fail ){
+	parser_interval stack_values[PARSER_PROGRAM_STACK_SIZE/2], *x = stack_values;
+	unsigned char stack_fails[PARSER_PROGRAM_STACK_SIZE/2], *fails = stack_fails;
+	int i;
+
+	if( prog->num_nodes > PARSER_PROGRAM_STACK_SIZE/2 ){
+		x = PARSER_MALLOC( prog->num_nodes*( sizeof(parser_interval) + 1 ) );
+		if( !x ){
+			for( i=0; i<count; i++ ){
+				out[i] = parser_interval_full();
+				if( may_fail ) may_fail[i] = PARSER_TRUE;
+			}
+			return PARSER_FALSE;
+		}
+		fails = (unsigned char*)( x + prog->num_nodes );
+	}
+
+	parser_interval_run( prog, bounds, user_data, x, fails );
+	for( i=0; i<count; i++ ){
+		out[i] = x[prog->outputs[first+i]];
+		if( may_fail ) may_fail[i] = fails[prog->outputs[first+i]] ? PARSER_TRUE : PARSER_FALSE;
+	}
+
+	if( x != stack_values )
+		PARSER_FREE( x );
+	return PARSER_TRUE;
+}
+
+int parser_program_eval_interval( const parser_program *prog, const parser_interval *bounds, void *user_data, parser_interval *out, int *may_fail ){
+	return parser_interval_outputs( prog, bounds, user_data, 0, prog->num_outputs, out, may_fail );
+}
+
+int parser_program_eval_predicate( const parser_program *prog, const parser_interval *bounds, void *user_data, int output ){
+	parser_interval out;
+	int truth, may_fail;
+
+	if( output < 0 || output >= prog->num_outputs || !parser_interval_outputs( prog, bounds, user_data, output, 1, &out, &may_fail ) )
+		return PARSER_PREDICATE_UNKNOWN;
+
+	// rows that fail produce nan, which is false
+	truth = parser_interval_truth( out );
+	if( !( truth & PARSER_INTERVAL_MAY_BE_TRUE ) )
+		return PARSER_PREDICATE_FALSE;
+	if( !( truth & PARSER_INTERVAL_MAY_BE_FALSE ) && !may_fail )
+		return PARSER_PREDICATE_TRUE;
+	return PARSER_PREDICATE_UNKNOWN;
+}
@@ -0,0 +1,542 @@
+#include<math.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_jit.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief translation of compiled programs to x86-64 machine code, see expression_parser.h for more information and license terms.
+
+ The JIT is a template compiler: every node of the program is translated to a short, fixed sequence of SSE2 scalar instructions that loads the operands from the scratch array, computes the result and stores it back, exactly as parser_program_run() does but without the dispatch over the operation codes.  Functions without an SSE2 equivalent (sin, exp, pow, ...) are called through libm, user and native functions through their function pointers, using the System V calling convention.  Domain checks branch to a common exit that returns an error code, and the jumps of short-circuit operators and conditional expressions are translated to conditional branches to the code of their target node, patched once all nodes are translated.  The code is written to anonymous memory with mmap() and made executable once complete, so no page is ever writable and executable at the same time.  Define PARSER_EXCLUDE_JIT to build without the JIT, on other platforms parser_program_jit() always fails and programs stay with the interpreter.
+*/
+
+#include"expression_internal.h"
+
+#if !defined(PARSER_EXCLUDE_JIT) && defined(__x86_64__) && !defined(_WIN32)
+#define PARSER_JIT_X86_64
+#include<sys/mman.h>
+#endif
+
+#if defined(PARSER_JIT_X86_64)
+
+/**
+ @brief error strings of the error codes returned by the generated code, these match parser_program_run()
+*/
+static const char *parser_jit_errors[] = {
+	NULL,
+	"sqrt(x) undefined for x < 0!",
+	"log(x) undefined for x <= 0!",
+	"asin(x) undefined for |x| > 1!",
+	"acos(x) undefined for |x| > 1!",
+	"Tried to call unknown built-in function!",
+	"Function evaluation failed!"
+};
+
+/**
+ @brief signature of the generated code
+ @return zero on success, otherwise an index into parser_jit_errors
+*/
+typedef int (*parser_jit_function)( double *values, const double *slots, void *user_data );
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#define parser_jit_round round
+#else
+// matches parser_round() in expression_parser.c for pre-C99 compilers
+static double parser_jit_round( double x ){
+	double i = (double)(int)x;
+	if( x >= 0.0 )
+		return ( (x-i) >= 0.5 ) ? i + 1.0 : i;
+	return ( -x+i >= 0.5 ) ? i - 1.0 : i;
+}
+#endif
+
+/**
+ @brief growable buffer the machine code is assembled into before it is copied to executable memory
+*/
+typedef struct {
+	unsigned char *code;
+	size_t         size;
+	size_t         capacity;
+	int            failed;
+} parser_jit_buffer;
+
+/**
+ @brief appends n bytes to the code buffer, setting the failed flag if memory could not be allocated
+*/
+static void parser_jit_bytes( parser_jit_buffer *buf, const unsigned char *bytes, size_t n ){
+	unsigned char *tmp;
+	size_t capacity;
+	if( buf->failed )
+		return;
+	if( buf->size + n > buf->capacity ){
+		capacity = buf->capacity ? 2*buf->capacity : 4096;
+		while( capacity < buf->size + n )
+			capacity *= 2;
+		tmp = PARSER_REALLOC( buf->code, capacity );
+		if( !tmp ){
+			buf->failed = PARSER_TRUE;
+			return;
+		}
+		buf->code     = tmp;
+		buf->capacity = capacity;
+	}
+	memcpy( buf->code + buf->size, bytes, n );
+	buf->size += n;
+}
+
+/**
+ @brief appends up to four opcode bytes, stopping at the first negative one
+*/
+static void parser_jit_op( parser_jit_buffer *buf, int b0, int b1, int b2, int b3 ){
+	unsigned char bytes[4];
+	int n = 0;
+	if( b0 >= 0 ) bytes[n++] = (unsigned char)b0;
+	if( b1 >= 0 ) bytes[n++] = (unsigned char)b1;
+	if( b2 >= 0 ) bytes[n++] = (unsigned char)b2;
+	if( b3 >= 0 ) bytes[n++] = (unsigned char)b3;
+	parser_jit_bytes( buf, bytes, n );
+}
+
+/**
+ @brief appends a little-endian 32-bit immediate or displacement
+*/
+static void parser_jit_u32( parser_jit_buffer *buf, unsigned int v ){
+	unsigned char bytes[4];
+	bytes[0] = v & 0xff;
+	bytes[1] = (v >> 8) & 0xff;
+	bytes[2] = (v >> 16) & 0xff;
+	bytes[3] = (v >> 24) & 0xff;
+	parser_jit_bytes( buf, bytes, 4 );
+}
+
+/**
+ @brief appends mov rax, imm64
+*/
+static void parser_jit_mov_rax( parser_jit_buffer *buf, const void *bits ){
+	parser_jit_op( buf, 0x48, 0xb8, -1, -1 );
+	parser_jit_bytes( buf, (const unsigned char*)bits, 8 );
+}
+
+/**
+ @brief appends movsd xmm, [rbx + 8*node], loading the value of a node
+*/
+static void parser_jit_load( parser_jit_buffer *buf, int xmm, int node ){
+	parser_jit_op( buf, 0xf2, 0x0f, 0x10, 0x83 | (xmm << 3) );
+	parser_jit_u32( buf, 8*node );
+}
+
+/**
+ @brief appends movsd [rbx + 8*node], xmm, storing the value of a node
+*/
+static void parser_jit_store( parser_jit_buffer *buf, int xmm, int node ){
+	parser_jit_op( buf, 0xf2, 0x0f, 0x11, 0x83 | (xmm << 3) );
+	parser_jit_u32( buf, 8*node );
+}
+
+/**
+ @brief appends an SSE2 register to register instruction with a one byte prefix, e.g. addsd or andpd
+*/
+static void parser_jit_sse( parser_jit_buffer *buf, int prefix, int opcode, int dst, int src ){
+	parser_jit_op( buf, prefix, 0x0f, opcode, 0xc0 | (dst << 3) | src );
+}
+
+/**
+ @brief appends cmpsd dst, src, predicate, leaving an all-ones mask in dst where the predicate holds
+*/
+static void parser_jit_cmp( parser_jit_buffer *buf, int dst, int src, int predicate ){
+	parser_jit_sse( buf, 0xf2, 0xc2, dst, src );
+	parser_jit_op( buf, predicate, -1, -1, -1 );
+}
+
+/**
+ @brief loads a double constant into an xmm register through rax
+*/
+static void parser_jit_constant( parser_jit_buffer *buf, int xmm, double value ){
+	parser_jit_mov_rax( buf, &value );
+	parser_jit_op( buf, 0x66, 0x48, 0x0f, 0x6e );
+	parser_jit_op( buf, 0xc0 | (xmm << 3), -1, -1, -1 );
+}
+
+/**
+ @brief loads the mask clearing the sign bit into an xmm register
+*/
+static void parser_jit_abs_mask( parser_jit_buffer *buf, int xmm ){
+	unsigned char bits[8] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f };
+	parser_jit_mov_rax( buf, bits );
+	parser_jit_op( buf, 0x66, 0x48, 0x0f, 0x6e );
+	parser_jit_op( buf, 0xc0 | (xmm << 3), -1, -1, -1 );
+}
+
+/**
+ @brief appends a call through rax to a function pointer
+*/
+static void parser_jit_call( parser_jit_buffer *buf, void (*fn)( void ) ){
+	parser_jit_mov_rax( buf, &fn );
+	parser_jit_op( buf, 0xff, 0xd0, -1, -1 );
+}
+
+/**
+ @brief appends a jump to the common exit at the start of the code, returning an error code
+*/
+static void parser_jit_exit( parser_jit_buffer *buf, int code ){
+	parser_jit_op( buf, 0xb8, -1, -1, -1 );
+	parser_jit_u32( buf, code );
+	parser_jit_op( buf, 0xe9, -1, -1, -1 );
+	parser_jit_u32( buf, (unsigned int)(-(int)(buf->size + 4)) );
+}
+
+/**
+ @brief appends a conditional exit: unless the condition of the short jump opcode skip holds, return an error code
+*/
+static void parser_jit_check( parser_jit_buffer *buf, int skip, int code ){
+	// mov eax, imm32 and jmp rel32 are 10 bytes
+	parser_jit_op( buf, skip, 10, -1, -1 );
+	parser_jit_exit( buf, code );
+}
+
+/**
+ @brief appends a placeholder for the displacement of a jump to another node, patched by parser_program_jit()
+*/
+static void parser_jit_branch( parser_jit_buffer *buf, int b0, int b1 ){
+	parser_jit_op( buf, b0, b1, -1, -1 );
+	parser_jit_u32( buf, 0 );
+}
+
+/**
+ @brief copies the arguments of a function call to the argument area at the top of the stack
+*/
+static void parser_jit_args( parser_jit_buffer *buf, const parser_program *prog, const parser_node *node ){
+	int j;
+	for( j=0; j<node->b; j++ ){
+		parser_jit_load( buf, 0, prog->args[node->a+j] );
+		parser_jit_op( buf, 0xf2, 0x0f, 0x11, 0x84 );
+		parser_jit_op( buf, 0x24, -1, -1, -1 );
+		parser_jit_u32( buf, 8*j );
+	}
+}
+
+/**
+ @brief returns the libm function implementing an operation, NULL for operations that are inlined
+*/
+static double (*parser_jit_libm( int op ))( double ){
+	switch( op ){
+		case PARSER_OP_LOG:   return log;
+		case PARSER_OP_EXP:   return exp;
+		case PARSER_OP_SIN:   return sin;
+		case PARSER_OP_ASIN:  return asin;
+		case PARSER_OP_COS:   return cos;
+		case PARSER_OP_ACOS:  return acos;
+		case PARSER_OP_TAN:   return tan;
+		case PARSER_OP_ATAN:  return atan;
+		case PARSER_OP_FLOOR: return floor;
+		case PARSER_OP_CEIL:  return ceil;
+		case PARSER_OP_ROUND: return parser_jit_round;
+		default:              return NULL;
+	}
+}
+
+/**
+ @brief translates one node, leaving its value in values[i]. The code of a jump ends with the 32-bit displacement of the branch, which is patched once the offset of its target is known.
+*/
+static void parser_jit_node( parser_jit_buffer *buf, const parser_program *prog, int i ){
+	const parser_node *node = prog->nodes+i;
+	double (*fn)( double );
+	int n, op = prog->ops[i];
+
+	// operands go to xmm0 and xmm1, the result is stored from xmm0
+	n = parser_op_arity( op );
+	if( n > 0 ) parser_jit_load( buf, 0, node->a );
+	if( n > 1 ) parser_jit_load( buf, 1, node->b );
+
+	switch( op ){
+		case PARSER_OP_CONST:
+			parser_jit_mov_rax( buf, prog->constants+node->a );
+			parser_jit_op( buf, 0x48, 0x89, 0x83, -1 );
+			parser_jit_u32( buf, 8*i );
+			return;
+		case PARSER_OP_VAR:
+			// movsd xmm0, [r12 + 8*slot]
+			parser_jit_op( buf, 0xf2, 0x41, 0x0f, 0x10 );
+			parser_jit_op( buf, 0x84, 0x24, -1, -1 );
+			parser_jit_u32( buf, 8*node->a );
+			break;
+		case PARSER_OP_NEG:
+			parser_jit_constant( buf, 1, -0.0 );
+			parser_jit_sse( buf, 0x66, 0x57, 0, 1 );
+			break;
+		case PARSER_OP_ADD: parser_jit_sse( buf, 0xf2, 0x58, 0, 1 ); break;
+		case PARSER_OP_SUB: parser_jit_sse( buf, 0xf2, 0x5c, 0, 1 ); break;
+		case PARSER_OP_MUL: parser_jit_sse( buf, 0xf2, 0x59, 0, 1 ); break;
+		case PARSER_OP_DIV: parser_jit_sse( buf, 0xf2, 0x5e, 0, 1 ); break;
+		case PARSER_OP_LT:
+		case PARSER_OP_LE:
+		case PARSER_OP_GT:
+		case PARSER_OP_GE:
+			// ordered predicates, false for nan as in C; > and >= swap the operands
+			if( op == PARSER_OP_LT || op == PARSER_OP_LE ){
+				parser_jit_cmp( buf, 0, 1, op == PARSER_OP_LT ? 1 : 2 );
+			} else {
+				parser_jit_cmp( buf, 1, 0, op == PARSER_OP_GT ? 1 : 2 );
+				parser_jit_sse( buf, 0x66, 0x28, 0, 1 );
+			}
+			parser_jit_constant( buf, 2, 1.0 );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			break;
+		case PARSER_OP_EQ:
+		case PARSER_OP_NE:
+			// fabs(a-b) < threshold, or threshold < fabs(a-b)
+			parser_jit_sse( buf, 0xf2, 0x5c, 0, 1 );
+			parser_jit_abs_mask( buf, 2 );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			parser_jit_constant( buf, 1, PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+			if( op == PARSER_OP_EQ ){
+				parser_jit_cmp( buf, 0, 1, 1 );
+			} else {
+				parser_jit_cmp( buf, 1, 0, 1 );
+				parser_jit_sse( buf, 0x66, 0x28, 0, 1 );
+			}
+			parser_jit_constant( buf, 2, 1.0 );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			break;
+		case PARSER_OP_NOT:
+		case PARSER_OP_AND:
+		case PARSER_OP_OR:
+			// operands are true where threshold <= fabs(x)
+			parser_jit_abs_mask( buf, 2 );
+			parser_jit_constant( buf, 3, PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			parser_jit_sse( buf, 0x66, 0x28, 2, 3 );
+			parser_jit_cmp( buf, 2, 0, 2 );
+			if( op != PARSER_OP_NOT ){
+				parser_jit_abs_mask( buf, 0 );
+				parser_jit_sse( buf, 0x66, 0x54, 1, 0 );
+				parser_jit_cmp( buf, 3, 1, 2 );
+				parser_jit_sse( buf, 0x66, op == PARSER_OP_AND ? 0x54 : 0x56, 2, 3 );
+			}
+			parser_jit_constant( buf, 0, 1.0 );
+			if( op == PARSER_OP_NOT ){
+				parser_jit_sse( buf, 0x66, 0x55, 2, 0 );
+				parser_jit_sse( buf, 0x66, 0x28, 0, 2 );
+			} else {
+				parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			}
+			break;
+		case PARSER_OP_SELECT:
+			// blend b and c with the mask of threshold <= fabs(a), only the
+			// selected operand was evaluated but both are in the scratch array
+			parser_jit_abs_mask( buf, 2 );
+			parser_jit_constant( buf, 3, PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 2 );
+			parser_jit_cmp( buf, 3, 0, 2 );
+			parser_jit_load( buf, 0, node->c );
+			parser_jit_sse( buf, 0x66, 0x54, 1, 3 );
+			parser_jit_sse( buf, 0x66, 0x55, 3, 0 );
+			parser_jit_sse( buf, 0x66, 0x56, 3, 1 );
+			parser_jit_sse( buf, 0x66, 0x28, 0, 3 );
+			break;
+		case PARSER_OP_JUMP_FALSE:
+		case PARSER_OP_JUMP_TRUE:
+			// ucomisd fabs(a), threshold sets the carry flag where a is false, nan included
+			parser_jit_abs_mask( buf, 1 );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 1 );
+			parser_jit_constant( buf, 1, PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+			parser_jit_sse( buf, 0x66, 0x2e, 0, 1 );
+			parser_jit_branch( buf, 0x0f, op == PARSER_OP_JUMP_FALSE ? 0x82 : 0x83 );
+			return;
+		case PARSER_OP_JUMP:
+			parser_jit_branch( buf, 0xe9, -1 );
+			return;
+		case PARSER_OP_SQRT:
+			parser_jit_sse( buf, 0x66, 0x57, 1, 1 );
+			parser_jit_sse( buf, 0x66, 0x2e, 1, 0 );
+			parser_jit_check( buf, 0x76, 1 );
+			parser_jit_sse( buf, 0xf2, 0x51, 0, 0 );
+			break;
+		case PARSER_OP_FABS:
+			parser_jit_abs_mask( buf, 1 );
+			parser_jit_sse( buf, 0x66, 0x54, 0, 1 );
+			break;
+		case PARSER_OP_ABS:
+			// cvttsd2si eax, xmm0; mov ecx, eax; neg ecx; cmovs ecx, eax; cvtsi2sd xmm0, ecx
+			parser_jit_op( buf, 0xf2, 0x0f, 0x2c, 0xc0 );
+			parser_jit_op( buf, 0x89, 0xc1, 0xf7, 0xd9 );
+			parser_jit_op( buf, 0x0f, 0x48, 0xc8, -1 );
+			parser_jit_op( buf, 0xf2, 0x0f, 0x2a, 0xc1 );
+			break;
+		case PARSER_OP_POW:
+			parser_jit_call( buf, (void (*)( void ))pow );
+			break;
+		case PARSER_OP_ATAN2:
+			parser_jit_call( buf, (void (*)( void ))atan2 );
+			break;
+		case PARSER_OP_CALL:
+			if( !prog->function_cb ){
+				parser_jit_exit( buf, 5 );
+				return;
+			}
+			// function_cb( user_data, name, num_args, args, values+i )
+			parser_jit_args( buf, prog, node );
+			parser_jit_op( buf, 0x4c, 0x89, 0xef, -1 );
+			parser_jit_op( buf, 0x48, 0xbe, -1, -1 );
+			parser_jit_bytes( buf, (const unsigned char*)&prog->functions[node->c], 8 );
+			parser_jit_op( buf, 0xba, -1, -1, -1 );
+			parser_jit_u32( buf, node->b );
+			parser_jit_op( buf, 0x48, 0x89, 0xe1, -1 );
+			parser_jit_op( buf, 0x4c, 0x8d, 0x83, -1 );
+			parser_jit_u32( buf, 8*i );
+			parser_jit_call( buf, (void (*)( void ))prog->function_cb );
+			parser_jit_op( buf, 0x85, 0xc0, -1, -1 );
+			parser_jit_check( buf, 0x75, 5 );
+			return;
+		case PARSER_OP_NATIVE:
+			// fn( user_data, num_args, args, values+i )
+			parser_jit_args( buf, prog, node );
+			parser_jit_op( buf, 0x4c, 0x89, 0xef, -1 );
+			parser_jit_op( buf, 0xbe, -1, -1, -1 );
+			parser_jit_u32( buf, node->b );
+			parser_jit_op( buf, 0x48, 0x89, 0xe2, -1 );
+			parser_jit_op( buf, 0x48, 0x8d, 0x8b, -1 );
+			parser_jit_u32( buf, 8*i );
+			parser_jit_call( buf, (void (*)( void ))prog->natives[node->c].fn );
+			parser_jit_op( buf, 0x85, 0xc0, -1, -1 );
+			parser_jit_check( buf, 0x75, 6 );
+			return;
+		default:
+			fn = parser_jit_libm( op );
+			if( op == PARSER_OP_LOG ){
+				parser_jit_sse( buf, 0x66, 0x57, 1, 1 );
+				parser_jit_sse( buf, 0x66, 0x2e, 1, 0 );
+				parser_jit_check( buf, 0x72, 2 );
+			} else if( op == PARSER_OP_ASIN || op == PARSER_OP_ACOS ){
+				parser_jit_abs_mask( buf, 1 );
+				parser_jit_sse( buf, 0x66, 0x54, 1, 0 );
+				parser_jit_constant( buf, 2, 1.0 );
+				parser_jit_sse( buf, 0x66, 0x2e, 1, 2 );
+				parser_jit_check( buf, 0x76, op == PARSER_OP_ASIN ? 3 : 4 );
+			}
+			if( !fn ){
+				buf->failed = PARSER_TRUE;
+				return;
+			}
+			parser_jit_call( buf, (void (*)( void ))fn );
+			break;
+	}
+	parser_jit_store( buf, 0, i );
+}
+
+int parser_program_jit( parser_program *prog ){
+	parser_jit_buffer buf;
+	unsigned int frame, rel;
+	size_t entry, *offsets, at;
+	void *code;
+	int i;
+
+	if( prog->jit )
+		return PARSER_TRUE;
+	memset( &buf, 0, sizeof(parser_jit_buffer) );
+
+	// code offset of every node, for the jumps
+	offsets = PARSER_MALLOC( (prog->num_nodes+1)*sizeof(size_t) );
+	if( !offsets )
+		return PARSER_FALSE;
+
+	// the argument area keeps rsp 16-byte aligned after pushing three registers
+	frame = (8*PARSER_MAX_ARGUMENT_COUNT + 15) & ~15u;
+
+	// common exit at offset zero: add rsp, frame; pop r13; pop r12; pop rbx; ret
+	parser_jit_op( &buf, 0x48, 0x81, 0xc4, -1 );
+	parser_jit_u32( &buf, frame );
+	parser_jit_op( &buf, 0x41, 0x5d, 0x41, 0x5c );
+	parser_jit_op( &buf, 0x5b, 0xc3, -1, -1 );
+
+	// entry: save rbx, r12, r13 and keep values, slots and user_data in them
+	entry = buf.size;
+	parser_jit_op( &buf, 0x53, 0x41, 0x54, -1 );
+	parser_jit_op( &buf, 0x41, 0x55, -1, -1 );
+	parser_jit_op( &buf, 0x48, 0x81, 0xec, -1 );
+	parser_jit_u32( &buf, frame );
+	parser_jit_op( &buf, 0x48, 0x89, 0xfb, -1 );
+	parser_jit_op( &buf, 0x49, 0x89, 0xf4, -1 );
+	parser_jit_op( &buf, 0x49, 0x89, 0xd5, -1 );
+
+	for( i=0; i<prog->num_nodes; i++ ){
+		offsets[i] = buf.size;
+		parser_jit_node( &buf, prog, i );
+	}
+	offsets[prog->num_nodes] = buf.size;
+
+	// the displacement of a jump is relative to the code of the next node
+	for( i=0; i<prog->num_nodes && !buf.failed; i++ ){
+		if( !PARSER_OP_IS_JUMP( prog->ops[i] ) )
+			continue;
+		at  = offsets[i+1]-4;
+		rel = (unsigned int)( offsets[prog->nodes[i].b] - offsets[i+1] );
+		buf.code[at]   = rel & 0xff;
+		buf.code[at+1] = (rel >> 8) & 0xff;
+		buf.code[at+2] = (rel >> 16) & 0xff;
+		buf.code[at+3] = (rel >> 24) & 0xff;
+	}
+	PARSER_FREE( offsets );
+
+	// success returns zero
+	parser_jit_op( &buf, 0x31, 0xc0, -1, -1 );
+	parser_jit_op( &buf, 0xe9, -1, -1, -1 );
+	parser_jit_u32( &buf, (unsigned int)(-(int)(buf.size + 4)) );
+
+	if( buf.failed ){
+		PARSER_FREE( buf.code );
+		return PARSER_FALSE;
+	}
+	code = mmap( NULL, buf.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	if( code == MAP_FAILED ){
+		PARSER_FREE( buf.code );
+		return PARSER_FALSE;
+	}
+	memcpy( code, buf.code, buf.size );
+	PARSER_FREE( buf.code );
+	if( mprotect( code, buf.size, PROT_READ | PROT_EXEC ) != 0 ){
+		munmap( code, buf.size );
+		return PARSER_FALSE;
+	}
+	prog->jit       = code;
+	prog->jit_size  = buf.size;
+	prog->jit_entry = entry;
+	return PARSER_TRUE;
+}
+
+int parser_jit_run( const parser_program *prog, const double *slots, double *values, void *user_data, const char **error ){
+	parser_jit_function fn;
+	void *entry = (unsigned char*)prog->jit + prog->jit_entry;
+	int code;
+
+	// object to function pointer conversion is not defined in ISO C, copy the bits
+	memcpy( &fn, &entry, sizeof(fn) );
+	code = fn( values, slots, user_data );
+	if( code ){
+		*error = parser_jit_errors[code];
+		return PARSER_FALSE;
+	}
+	return PARSER_TRUE;
+}
+
+void parser_jit_free( parser_program *prog ){
+	if( prog->jit )
+		munmap( prog->jit, prog->jit_size );
+	prog->jit = NULL;
+}
+
+#else
+
+int parser_program_jit( parser_program *prog ){
+	return PARSER_FALSE;
+}
+
+int parser_jit_run( const parser_program *prog, const double *slots, double *values, void *user_data, const char **error ){
+	return parser_program_run( prog, 0, prog->num_nodes, slots, values, user_data, error );
+}
+
+void parser_jit_free( parser_program *prog ){
+	prog->jit = NULL;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_lexer.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief tokenizer shared by the parser and the compiler, see expression_parser.h for more information and license terms.
+
+ The input is scanned once, left to right, into a window of PARSER_TOKEN_BUFFER_SIZE tokens held by the parser_data structure.  The window is refilled as the grammar consumes tokens, so any length of input is tokenized without allocating memory.  Characters are classified with a lookup table instead of the <ctype.h> functions, which makes the lexer independent of the locale, and whitespace is skipped here so the grammar never sees it.  The lexer itself never fails: characters that do not start a token and malformed literals become PARSER_TOKEN_INVALID tokens, which the grammar reports where they occur.
+*/
+
+#include"expression_internal.h"
+
+#if PARSER_TOKEN_BUFFER_SIZE < 2
+#error "PARSER_TOKEN_BUFFER_SIZE must be at least 2, the grammar looks one token ahead"
+#endif
+
+#define S PARSER_CHAR_SPACE
+#define D PARSER_CHAR_DIGIT
+#define A PARSER_CHAR_ALPHA
+
+const unsigned char parser_char_class[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0, /* 0x00 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x10 */
+	S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x20 */
+	D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, /* 0x30 */
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, /* 0x40 */
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A, /* 0x50 */
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A, /* 0x60 */
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0, /* 0x70 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x80 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0x90 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xa0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xb0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xc0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xd0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, /* 0xe0 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0  /* 0xf0 */
+};
+
+#undef S
+#undef D
+#undef A
+
+const unsigned char parser_token_precedence[PARSER_TOKEN_INVALID+1] = {
+	PARSER_PRECEDENCE_NONE,			/* END */
+	PARSER_PRECEDENCE_NONE,			/* NUMBER */
+	PARSER_PRECEDENCE_NONE,			/* IDENTIFIER */
+	PARSER_PRECEDENCE_NONE,			/* LPAREN */
+	PARSER_PRECEDENCE_NONE,			/* RPAREN */
+	PARSER_PRECEDENCE_NONE,			/* COMMA */
+	PARSER_PRECEDENCE_ADD,			/* PLUS */
+	PARSER_PRECEDENCE_ADD,			/* MINUS */
+	PARSER_PRECEDENCE_MUL,			/* STAR */
+	PARSER_PRECEDENCE_MUL,			/* SLASH */
+	PARSER_PRECEDENCE_POWER,		/* CARET */
+	PARSER_PRECEDENCE_NONE,			/* NOT */
+	PARSER_PRECEDENCE_COMPARISON,	/* LT */
+	PARSER_PRECEDENCE_COMPARISON,	/* LE */
+	PARSER_PRECEDENCE_COMPARISON,	/* GT */
+	PARSER_PRECEDENCE_COMPARISON,	/* GE */
+	PARSER_PRECEDENCE_EQUALITY,		/* EQ */
+	PARSER_PRECEDENCE_EQUALITY,		/* NE */
+	PARSER_PRECEDENCE_AND,			/* AND */
+	PARSER_PRECEDENCE_OR,			/* OR */
+	PARSER_PRECEDENCE_CONDITIONAL,	/* QUESTION */
+	PARSER_PRECEDENCE_NONE,			/* COLON */
+	PARSER_PRECEDENCE_EQUALITY,		/* ASSIGN */
+	PARSER_PRECEDENCE_AND,			/* AMPERSAND */
+	PARSER_PRECEDENCE_OR,			/* BAR */
+	PARSER_PRECEDENCE_NONE			/* INVALID */
+};
+
+/**
+ @brief character class of a character of the input
+*/
+#define PARSER_CHAR_CLASS( c ) parser_char_class[(unsigned char)(c)]
+
+/**
+ @brief scans a numeric literal without sign, as parser_read_double() does
+ @param[in] str input string
+ @param[in] pos position of the first character of the literal
+ @param[out] token receives the literal, as a PARSER_TOKEN_NUMBER token or as a PARSER_TOKEN_INVALID token if it has no digits
+ @return position following the literal
+*/
+static int parser_lex_number( const char *str, int pos, parser_token *token ){
+	token->type = parser_convert_double( str, &pos, &token->value ) ? PARSER_TOKEN_NUMBER : PARSER_TOKEN_INVALID;
+	return pos;
+}
+
+/**
+ @brief refills the token window from pd->pos, keeping the tokens that have not been consumed yet. Tokens are read until the window is full or the end of the input is reached.
+*/
+static void parser_lex( parser_data *pd ){
+	const char *str = pd->str;
+	parser_token *token;
+	int pos = pd->pos, n = pd->num_tokens - pd->token;
+
+	memmove( pd->tokens, pd->tokens+pd->token, n*sizeof(parser_token) );
+	pd->token = 0;
+
+	while( n < PARSER_TOKEN_BUFFER_SIZE && ( n == 0 || pd->tokens[n-1].type != PARSER_TOKEN_END ) ){
+		while( PARSER_CHAR_CLASS( str[pos] ) & PARSER_CHAR_SPACE )
+			pos++;
+
+		token = pd->tokens + n++;
+		token->pos   = pos;
+		token->value = 0.0;
+		if( PARSER_CHAR_CLASS( str[pos] ) & PARSER_CHAR_ALPHA ){
+			token->type = PARSER_TOKEN_IDENTIFIER;
+			while( PARSER_CHAR_CLASS( str[pos] ) & (PARSER_CHAR_ALPHA|PARSER_CHAR_DIGIT) )
+				pos++;
+		} else if( PARSER_CHAR_CLASS( str[pos] ) & PARSER_CHAR_DIGIT || str[pos] == '.' ){
+			pos = parser_lex_number( str, pos, token );
+		} else {
+			// operators, the two character operators are matched first
+			switch( str[pos++] ){
+				case '\0':
+					token->type = PARSER_TOKEN_END;
+					pos--;
+					break;
+				case '(': token->type = PARSER_TOKEN_LPAREN; break;
+				case ')': token->type = PARSER_TOKEN_RPAREN; break;
+				case ',': token->type = PARSER_TOKEN_COMMA;  break;
+				case '+': token->type = PARSER_TOKEN_PLUS;   break;
+				case '-': token->type = PARSER_TOKEN_MINUS;  break;
+				case '*': token->type = PARSER_TOKEN_STAR;   break;
+				case '/': token->type = PARSER_TOKEN_SLASH;  break;
+				case '^': token->type = PARSER_TOKEN_CARET;  break;
+				case '?': token->type = PARSER_TOKEN_QUESTION; break;
+				case ':': token->type = PARSER_TOKEN_COLON;  break;
+				case '<':
+					token->type = str[pos] == '=' ? PARSER_TOKEN_LE : PARSER_TOKEN_LT;
+					pos += str[pos] == '=';
+					break;
+				case '>':
+					token->type = str[pos] == '=' ? PARSER_TOKEN_GE : PARSER_TOKEN_GT;
+					pos += str[pos] == '=';
+					break;
+				case '=':
+					token->type = str[pos] == '=' ? PARSER_TOKEN_EQ : PARSER_TOKEN_ASSIGN;
+					pos += str[pos] == '=';
+					break;
+				case '!':
+					token->type = str[pos] == '=' ? PARSER_TOKEN_NE : PARSER_TOKEN_NOT;
+					pos += str[pos] == '=';
+					break;
+				case '&':
+					token->type = str[pos] == '&' ? PARSER_TOKEN_AND : PARSER_TOKEN_AMPERSAND;
+					pos += str[pos] == '&';
+					break;
+				case '|':
+					token->type = str[pos] == '|' ? PARSER_TOKEN_OR : PARSER_TOKEN_BAR;
+					pos += str[pos] == '|';
+					break;
+				default:
+					token->type = PARSER_TOKEN_INVALID;
+					break;
+			}
+		}
+		token->len = pos - token->pos;
+	}
+	pd->num_tokens = n;
+	pd->pos        = pos;
+}
+
+void parser_tokenize( parser_data *pd ){
+	pd->num_tokens = 0;
+	pd->token      = 0;
+	parser_lex( pd );
+}
+
+void parser_token_next( parser_data *pd ){
+	if( pd->tokens[pd->token].type == PARSER_TOKEN_END )
+		return;
+
+	// keep the current token and the one following it in the window
+	if( ++pd->token >= pd->num_tokens-1 && pd->tokens[pd->num_tokens-1].type != PARSER_TOKEN_END )
+		parser_lex( pd );
+}
+
+int parser_token_name( parser_data *pd, char *name ){
+	const parser_token *token = PARSER_TOKEN( pd );
+	if( token->len >= PARSER_MAX_TOKEN_SIZE )
+		parser_error( pd, "Identifier too long, increase PARSER_MAX_TOKEN_SIZE and recompile!" );
+	memcpy( name, pd->str+token->pos, token->len );
+	name[token->len] = '\0';
+	return token->len;
+}
+
+double parser_token_number( parser_data *pd ){
+	const parser_token *token = PARSER_TOKEN( pd );
+	double sign = 1.0, value;
+
+	// a sign directly followed by a literal belongs to the literal, as in
+	// parser_read_double(), the window always holds the following token
+	if( ( token->type == PARSER_TOKEN_PLUS || token->type == PARSER_TOKEN_MINUS ) && token[1].type == PARSER_TOKEN_NUMBER && token[1].pos == token->pos+1 ){
+		sign = token->type == PARSER_TOKEN_MINUS ? -1.0 : 1.0;
+		parser_token_next( pd );
+		token = PARSER_TOKEN( pd );
+	}
+	if( token->type != PARSER_TOKEN_NUMBER )
+		parser_error( pd, "Failed to read real number" );
+	value = sign*token->value;
+	parser_token_next( pd );
+	return value;
+}
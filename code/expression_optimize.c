@@ -0,0 +1,348 @@
+#include<math.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_optimize.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief optimization passes over compiled programs, see expression_parser.h for more information and license terms.
+
+ The passes run once at the end of parser_compile() and rewrite the post-order node array in place: constant folding first, so that equal literals are merged by common subexpression elimination afterwards.  Evaluation errors are never raised at compile time: a constant subtree that fails to evaluate, e.g. sqrt(-1), is left as it is so that evaluating the program reports exactly the error the parser reports.
+
+ Nodes between a jump and its target are only evaluated on some paths, see parser_node.  Both passes keep the order of the nodes, so these regions stay contiguous, and common subexpression elimination only merges a node into one that is evaluated whenever it is.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief checks whether a node may be evaluated at compile time once its operands are known
+*/
+static int parser_optimize_foldable( const parser_program *prog, int i ){
+	switch( prog->ops[i] ){
+		case PARSER_OP_VAR:
+		case PARSER_OP_CALL:
+		case PARSER_OP_JUMP_FALSE:
+		case PARSER_OP_JUMP_TRUE:
+		case PARSER_OP_JUMP:
+			return PARSER_FALSE;
+		case PARSER_OP_NATIVE:
+			return (prog->natives[prog->nodes[i].c].flags & PARSER_FUNCTION_PURE) != 0;
+		default:
+			return PARSER_TRUE;
+	}
+}
+
+/**
+ @brief removes the nodes that are not reachable from an output, renumbering the remaining nodes, the argument lists, the outputs and the constants. Jumps are kept as long as the lazy operation they belong to is, and continue at the first remaining node of their target or after it.
+ @param[inout] prog program to compact, its constants pool must have room for one entry per PARSER_OP_CONST node
+ @param[inout] index scratch array of prog->num_nodes entries
+ @param[in] values value of every PARSER_OP_CONST node, or NULL to take them from the constants pool
+ @return number of nodes removed
+*/
+static int parser_optimize_compact( parser_program *prog, int *index, const double *values ){
+	parser_node *node;
+	int i, j, n, op, num_args = 0, num_nodes = 0, num_constants = 0;
+
+	// mark reachable nodes, operands always precede their users
+	for( i=0; i<prog->num_nodes; i++ )
+		index[i] = 0;
+	for( i=0; i<prog->num_outputs; i++ )
+		index[prog->outputs[i]] = 1;
+	for( i=prog->num_nodes-1; i>=0; i-- ){
+		node = prog->nodes+i;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) )
+			index[i] = index[node->c] && PARSER_OP_IS_LAZY( prog->ops[node->c] );
+		if( !index[i] )
+			continue;
+		if( PARSER_OP_HAS_ARGS( prog->ops[i] ) ){
+			for( j=0; j<node->b; j++ )
+				index[prog->args[node->a+j]] = 1;
+		} else {
+			n = parser_op_arity( prog->ops[i] );
+			if( n > 0 ) index[node->a] = 1;
+			if( n > 1 ) index[node->b] = 1;
+			if( n > 2 ) index[node->c] = 1;
+		}
+	}
+
+	// move the reachable nodes down, the argument lists and constants shrink
+	// the same way, removed nodes map to the next remaining node for the jump
+	// targets. constants are in node order, so the pool is rewritten in place
+	for( i=0; i<prog->num_nodes; i++ ){
+		if( !index[i] ){
+			index[i] = num_nodes;
+			continue;
+		}
+		op   = prog->ops[i];
+		node = prog->nodes+num_nodes;
+		*node = prog->nodes[i];
+		prog->ops[num_nodes] = (unsigned char)op;
+		if( op == PARSER_OP_CONST ){
+			prog->constants[num_constants] = values ? values[i] : prog->constants[node->a];
+			node->a = num_constants++;
+		} else if( PARSER_OP_HAS_ARGS( op ) ){
+			for( j=0; j<node->b; j++ )
+				prog->args[num_args+j] = index[prog->args[node->a+j]];
+			node->a = num_args;
+			num_args += node->b;
+		} else {
+			n = parser_op_arity( op );
+			if( n > 0 ) node->a = index[node->a];
+			if( n > 1 ) node->b = index[node->b];
+			if( n > 2 ) node->c = index[node->c];
+		}
+		index[i] = num_nodes++;
+	}
+	for( i=0; i<num_nodes; i++ ){
+		node = prog->nodes+i;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+			node->b = index[node->b];
+			node->c = index[node->c];
+		}
+	}
+	for( i=0; i<prog->num_outputs; i++ )
+		prog->outputs[i] = index[prog->outputs[i]];
+	n = prog->num_nodes - num_nodes;
+	prog->num_nodes     = num_nodes;
+	prog->num_args      = num_args;
+	prog->num_constants = num_constants;
+	return n;
+}
+
+int parser_program_fold( parser_program *prog, void *user_data ){
+	parser_node *node;
+	double *values;
+	const char *error;
+	char *constant;
+	int *index, i, j, n, op, folded = 0, num_constants = 0;
+
+	if( prog->num_nodes == 0 )
+		return 0;
+	values   = parser_program_scratch( prog, prog->num_nodes*sizeof(double) );
+	constant = parser_program_scratch( prog, prog->num_nodes );
+	index    = parser_program_scratch( prog, prog->num_nodes*sizeof(int) );
+	if( !values || !constant || !index ){
+		parser_program_scratch_free( prog, values );
+		parser_program_scratch_free( prog, constant );
+		parser_program_scratch_free( prog, index );
+		return -1;
+	}
+
+	for( i=0; i<prog->num_nodes; i++ ){
+		node = prog->nodes+i;
+		op   = prog->ops[i];
+		constant[i] = op == PARSER_OP_CONST;
+		if( constant[i] ){
+			values[i] = prog->constants[node->a];
+			num_constants++;
+			continue;
+		}
+		if( !parser_optimize_foldable( prog, i ) )
+			continue;
+
+		// every operand must be a constant, except those that a lazy
+		// operation does not read given its constant first operand
+		constant[i] = 1;
+		if( PARSER_OP_HAS_ARGS( op ) ){
+			for( j=0; j<node->b; j++ )
+				constant[i] &= constant[prog->args[node->a+j]];
+		} else if( PARSER_OP_IS_LAZY( op ) && constant[node->a] ){
+			j = PARSER_TRUTH( values[node->a] );
+			if( op == PARSER_OP_AND )
+				constant[i] = !j || constant[node->b];
+			else if( op == PARSER_OP_OR )
+				constant[i] = j || constant[node->b];
+			else
+				constant[i] = constant[j ? node->b : node->c];
+		} else {
+			n = parser_op_arity( op );
+			if( n > 0 ) constant[i] &= constant[node->a];
+			if( n > 1 ) constant[i] &= constant[node->b];
+			if( n > 2 ) constant[i] &= constant[node->c];
+		}
+
+		// subtrees that fail to evaluate are kept, so the error is
+		// reported when the program is evaluated
+		if( constant[i] && !parser_program_run( prog, i, i+1, NULL, values, user_data, &error ) )
+			constant[i] = 0;
+		if( constant[i] ){
+			prog->ops[i] = PARSER_OP_CONST;
+			node->a = 0;
+			node->b = 0;
+			node->c = 0;
+			folded++;
+		}
+	}
+
+	// folded nodes take their values from the scratch array when the
+	// constants are compacted, the pool needs room for all of them
+	if( folded && !parser_program_reserve( prog, (void**)&prog->constants, &prog->max_constants, num_constants+folded, sizeof(double) ) )
+		n = -1;
+	else
+		n = folded ? parser_optimize_compact( prog, index, values ) : 0;
+	parser_program_scratch_free( prog, values );
+	parser_program_scratch_free( prog, constant );
+	parser_program_scratch_free( prog, index );
+	return n;
+}
+
+/**
+ @brief checks whether a node may be merged with a structurally identical node. Calls through the function callback and calls of impure native functions may have side effects or return different values for the same arguments, so every call is kept, as is every jump.
+*/
+static int parser_optimize_shareable( const parser_program *prog, int i ){
+	int op = prog->ops[i];
+	if( op == PARSER_OP_CALL || PARSER_OP_IS_JUMP( op ) )
+		return PARSER_FALSE;
+	if( op == PARSER_OP_NATIVE )
+		return (prog->natives[prog->nodes[i].c].flags & PARSER_FUNCTION_PURE) != 0;
+	return PARSER_TRUE;
+}
+
+/**
+ @brief hashes the operation and the operands of a node, only the fields used by the operation are hashed
+*/
+static unsigned int parser_optimize_hash( const parser_program *prog, int k ){
+	const parser_node *node = prog->nodes+k;
+	unsigned char bits[sizeof(double)];
+	unsigned int h = 2166136261u;
+	int i, n, op = prog->ops[k];
+
+	// FNV-1a over 32-bit words
+#define PARSER_HASH_WORD( w ) h = (h ^ (unsigned int)(w)) * 16777619u
+	PARSER_HASH_WORD( op );
+	if( op == PARSER_OP_CONST ){
+		memcpy( bits, prog->constants+node->a, sizeof(double) );
+		for( i=0; i<(int)sizeof(double); i++ )
+			PARSER_HASH_WORD( bits[i] );
+	} else if( op == PARSER_OP_VAR ){
+		PARSER_HASH_WORD( node->a );
+	} else if( PARSER_OP_HAS_ARGS( op ) ){
+		PARSER_HASH_WORD( node->c );
+		for( i=0; i<node->b; i++ )
+			PARSER_HASH_WORD( prog->args[node->a+i] );
+	} else {
+		n = parser_op_arity( op );
+		if( n > 0 ) PARSER_HASH_WORD( node->a );
+		if( n > 1 ) PARSER_HASH_WORD( node->b );
+		if( n > 2 ) PARSER_HASH_WORD( node->c );
+	}
+#undef PARSER_HASH_WORD
+	return h;
+}
+
+/**
+ @brief checks whether two nodes with already merged operands compute the same value
+*/
+static int parser_optimize_equal( const parser_program *prog, int i, int j ){
+	const parser_node *x = prog->nodes+i, *y = prog->nodes+j;
+	int n, op = prog->ops[i];
+	if( op != prog->ops[j] )
+		return PARSER_FALSE;
+	if( op == PARSER_OP_CONST ){
+		// compare bit patterns, so 0.0 and -0.0 are kept apart and nan matches nan
+		return memcmp( prog->constants+x->a, prog->constants+y->a, sizeof(double) ) == 0;
+	} else if( op == PARSER_OP_VAR ){
+		return x->a == y->a;
+	} else if( PARSER_OP_HAS_ARGS( op ) ){
+		return x->c == y->c && x->b == y->b && memcmp( prog->args+x->a, prog->args+y->a, x->b*sizeof(int) ) == 0;
+	}
+	n = parser_op_arity( op );
+	return ( n < 1 || x->a == y->a ) && ( n < 2 || x->b == y->b ) && ( n < 3 || x->c == y->c );
+}
+
+/**
+ @brief finds the innermost region of every node, the nodes between a jump and its target, as the half-open range [begin,end) of node indices. Nodes outside every region get the whole program.
+ @param[in] prog program to scan
+ @param[out] begin first node of the region of every node
+ @param[out] end one past the last node of the region of every node
+ @param[out] stack scratch array of prog->num_nodes entries
+*/
+static void parser_optimize_regions( const parser_program *prog, int *begin, int *end, int *stack ){
+	int i, depth = 0;
+
+	for( i=0; i<prog->num_nodes; i++ ){
+		while( depth > 0 && prog->nodes[stack[depth-1]].b <= i )
+			depth--;
+		begin[i] = depth > 0 ? stack[depth-1]+1 : 0;
+		end[i]   = depth > 0 ? prog->nodes[stack[depth-1]].b : prog->num_nodes;
+		if( PARSER_OP_IS_JUMP( prog->ops[i] ) ){
+			// the jump over the else branch of a ? b : c is the last node
+			// of the region of the then branch, which ends with it
+			while( depth > 0 && prog->nodes[stack[depth-1]].b <= i+1 )
+				depth--;
+			stack[depth++] = i;
+		}
+	}
+}
+
+int parser_program_share( parser_program *prog ){
+	parser_node *node;
+	int *table, *index, *begin, *end, i, j, n, t, op, size = 16;
+
+	if( prog->num_nodes == 0 )
+		return 0;
+	while( size < 2*prog->num_nodes )
+		size *= 2;
+	table = parser_program_scratch( prog, size*sizeof(int) );
+	index = parser_program_scratch( prog, prog->num_nodes*sizeof(int) );
+	begin = parser_program_scratch( prog, prog->num_nodes*sizeof(int) );
+	end   = parser_program_scratch( prog, prog->num_nodes*sizeof(int) );
+	if( !table || !index || !begin || !end ){
+		parser_program_scratch_free( prog, table );
+		parser_program_scratch_free( prog, index );
+		parser_program_scratch_free( prog, begin );
+		parser_program_scratch_free( prog, end );
+		return -1;
+	}
+	for( t=0; t<size; t++ )
+		table[t] = -1;
+	parser_optimize_regions( prog, begin, end, index );
+
+	// operands precede their users, so by the time a node is hashed its
+	// operands have already been replaced by their representatives
+	for( i=0; i<prog->num_nodes; i++ ){
+		node = prog->nodes+i;
+		op   = prog->ops[i];
+		if( PARSER_OP_HAS_ARGS( op ) ){
+			for( j=0; j<node->b; j++ )
+				prog->args[node->a+j] = index[prog->args[node->a+j]];
+		} else {
+			n = parser_op_arity( op );
+			if( n > 0 ) node->a = index[node->a];
+			if( n > 1 ) node->b = index[node->b];
+			if( n > 2 ) node->c = index[node->c];
+
+			// order the operands of commutative operations, so a+b matches b+a
+			if( ( op == PARSER_OP_ADD || op == PARSER_OP_MUL || op == PARSER_OP_EQ || op == PARSER_OP_NE ) && node->a > node->b ){
+				n       = node->a;
+				node->a = node->b;
+				node->b = n;
+			}
+		}
+
+		index[i] = i;
+		if( !parser_optimize_shareable( prog, i ) )
+			continue;
+		// a node in a region is only merged into a node whose region
+		// contains it, so the representative is evaluated whenever the node
+		// is, other identical nodes get their own entry
+		for( t = parser_optimize_hash( prog, i ) & (size-1); table[t] >= 0; t = (t+1) & (size-1) ){
+			j = table[t];
+			if( begin[j] <= begin[i] && end[i] <= end[j] && parser_optimize_equal( prog, j, i ) )
+				break;
+		}
+		if( table[t] >= 0 )
+			index[i] = table[t];
+		else
+			table[t] = i;
+	}
+	for( i=0; i<prog->num_outputs; i++ )
+		prog->outputs[i] = index[prog->outputs[i]];
+
+	n = parser_optimize_compact( prog, index, NULL );
+	parser_program_scratch_free( prog, table );
+	parser_program_scratch_free( prog, index );
+	parser_program_scratch_free( prog, begin );
+	parser_program_scratch_free( prog, end );
+	return n;
+}
@@ -1,5 +1,4 @@
 #include<math.h>
-#include<ctype.h>
 #include<stdio.h>
 #include<string.h>
 #include<stdlib.h>
@@ -10,7 +9,7 @@
  @brief implementation of the mathematical expression parser, see expression_parser.h for more information and license terms.
 */
 
-#include"expression_parser.h"
+#include"expression_internal.h"
 
 double parse_expression( const char *expr ){
 	return parse_expression_with_callbacks( expr, NULL, NULL, NULL );
@@ -29,7 +28,7 @@ double parse_expression_with_callbacks( const char *expr, parser_variable_callba
 }
 
 parser_data *parser_data_new( const char *str, parser_variable_callback variable_cb, parser_function_callback function_cb, void *user_data ){
-	parser_data *pd = malloc( sizeof( parser_data ) );
+	parser_data *pd = PARSER_MALLOC( sizeof( parser_data ) );
 	if( !pd ) return NULL;
 	pd->str = str;
 	pd->len = strlen( str )+1;
@@ -38,6 +37,11 @@ parser_data *parser_data_new( const char *str, parser_variable_callback variable
 	pd->user_data   = user_data;
 	pd->variable_cb = variable_cb;
 	pd->function_cb = function_cb;
+	pd->registry    = NULL;
+	pd->optimize    = PARSER_TRUE;
+	pd->arena       = NULL;
+	pd->recursive_descent = PARSER_FALSE;
+	parser_tokenize( pd );
 	return pd;
 }
 
@@ -49,24 +53,30 @@ int parser_data_init( parser_data *pd, const char *str, parser_variable_callback
 	pd->user_data   = user_data;
 	pd->variable_cb = variable_cb;
 	pd->function_cb = function_cb;
+	pd->registry    = NULL;
+	pd->optimize    = PARSER_TRUE;
+	pd->arena       = NULL;
+	pd->recursive_descent = PARSER_FALSE;
+	parser_tokenize( pd );
 	return PARSER_TRUE;
 }
 
 void parser_data_free( parser_data *pd ){
-	free( pd );
+	PARSER_FREE( pd );
 }
 
 double parser_parse( parser_data *pd ){
     double result = 0.0;
+	pd->depth = 0;
+	pd->skip  = 0;
 	// set the jump position and launch the parser
 	if( !setjmp( pd->err_jmp_buf ) ){
 #if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
-		result = parser_read_boolean_or( pd );
+		result = pd->recursive_descent ? parser_read_conditional( pd ) : parser_read_binary( pd, PARSER_PRECEDENCE_CONDITIONAL );
 #else
-		result = parser_read_expr( pd );
+		result = pd->recursive_descent ? parser_read_expr( pd ) : parser_read_binary( pd, PARSER_PRECEDENCE_ADD );
 #endif
-        parser_eat_whitespace( pd );
-        if( pd->pos < pd->len-1 ){
+        if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_END ){
             parser_error( pd, "Failed to reach end of input expression, likely malformed input" );
         } else return result;
 	} else {
@@ -103,123 +113,75 @@ char parser_eat( parser_data *pd ){
 }
 
 void parser_eat_whitespace( parser_data *pd ){
-	while( isspace( parser_peek( pd ) ) )
+	while( parser_char_class[(unsigned char)parser_peek( pd )] & PARSER_CHAR_SPACE )
 		parser_eat( pd );
 }
 
 double parser_read_double( parser_data *pd ){
-	char c, token[PARSER_MAX_TOKEN_SIZE];
-	int pos=0;
-    double val=0.0;
+	char c;
+	double sign=1.0, val=0.0;
 	
 	// read a leading sign
 	c = parser_peek( pd );
-	if( c == '+' || c == '-' )
-		token[pos++] = parser_eat( pd );
-	
-	// read optional digits leading the decimal point
-	while( isdigit(parser_peek(pd)) )
-		token[pos++] = parser_eat( pd );
-	
-	// read the optional decimal point
-	c = parser_peek( pd );
-	if( c == '.' )
-		token[pos++] = parser_eat( pd );
-	
-	// read optional digits after the decimal point
-	while( isdigit(parser_peek(pd)) )
-		token[pos++] = parser_eat( pd );
-	
-	// read the exponent delimiter
-	c = parser_peek( pd );
-	if( c == 'e' || c == 'E' ){
-		token[pos++] = parser_eat( pd );
-		
-		// check if the expoentn has a sign,
-		// if so, read it 
-		c = parser_peek( pd );
-		if( c == '+' || c == '-' ){
-			token[pos++] = parser_eat( pd );
-		}
+	if( c == '+' || c == '-' ){
+		parser_eat( pd );
+		sign = c == '-' ? -1.0 : 1.0;
 	}
 	
-	// read the exponent delimiter
-	while( isdigit(parser_peek(pd) ) )
-		token[pos++] = parser_eat( pd );
+	// convert the digits, decimal point and exponent in place, the input
+	// is nul-terminated so the conversion stops at its end
+	if( !parser_convert_double( pd->str, &pd->pos, &val ) )
+		parser_error( pd, "Failed to read real number" );
 	
 	// remove any trailing whitespace
 	parser_eat_whitespace( pd );
 	
-    // null-terminate the string
-  	token[pos] = '\0';
-
-    // check that a double-precision was read, otherwise throw an error
-    if( pos == 0 || sscanf( token, "%lf", &val ) != 1 )
-        parser_error( pd, "Failed to read real number" );
-    
-    // return the parsed value
-	return val;
+	// return the parsed value
+	return sign*val;
 }
 
 double parser_read_argument( parser_data *pd ){
-	char c;
 	double val;
-	// eat leading whitespace
-	parser_eat_whitespace( pd );
 	
 	// read the argument
-	val = parser_read_expr( pd );
-	
-	// read trailing whitespace
-	parser_eat_whitespace( pd );
+	val = pd->recursive_descent ? parser_read_expr( pd ) : parser_read_binary( pd, PARSER_PRECEDENCE_ADD );
 	
 	// check if there's a comma
-	c = parser_peek( pd );
-	if( c == ',' )
-		parser_eat( pd );
-	
-	// eat trailing whitespace
-	parser_eat_whitespace( pd );
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_COMMA )
+		parser_token_next( pd );
 	
 	// return result
 	return val;
 }
 
 int parser_read_argument_list( parser_data *pd, int *num_args, double *args ){
-	char c;
+	int type;
 	
 	// set the initial number of arguments to zero
 	*num_args = 0;
 	
-	// eat any leading whitespace
-	parser_eat_whitespace( pd );
-	while( parser_peek( pd ) != ')' ){
+	while( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN ){
 		
 		// check that we haven't read too many arguments
 		if( *num_args >= PARSER_MAX_ARGUMENT_COUNT )
 			parser_error( pd, "Exceeded maximum argument count for function call, increase PARSER_MAX_ARGUMENT_COUNT and recompile!" );
 		
 		// read the argument and add it to the list of arguments
-		args[*num_args] = parser_read_expr( pd );
+		args[*num_args] = pd->recursive_descent ? parser_read_expr( pd ) : parser_read_binary( pd, PARSER_PRECEDENCE_ADD );
 		*num_args = *num_args+1;
-		
-		// eat any following whitespace
-		parser_eat_whitespace( pd );
 	
-		// check the next character
-		c = parser_peek( pd );
-		if( c == ')' ){
+		// check the next token
+		type = PARSER_TOKEN_TYPE( pd );
+		if( type == PARSER_TOKEN_RPAREN ){
 			// closing parenthesis, end of argument list, return
-			// and allow calling function to match the character
+			// and allow calling function to match the token
 			break;
-	    } else if( c == ',' ){
+	    } else if( type == PARSER_TOKEN_COMMA ){
 			// comma, indicates another argument follows, match
-			// the comma, eat any remaining whitespace and continue
-			// parsing arguments
-			parser_eat( pd );
-			parser_eat_whitespace( pd );
+			// the comma and continue parsing arguments
+			parser_token_next( pd );
 		} else {
-			// invalid character, print an error and return
+			// invalid token, print an error and return
 			parser_error( pd, "Expected ')' or ',' in function argument list!" );
 			return PARSER_FALSE;
 		}
@@ -242,83 +204,161 @@ int parser_round(double x){
 }
 #endif
 
+/**
+ @brief entry of the built-in function table
+*/
+typedef struct {
+	const char *name;
+	int         op;
+	int         num_args;
+} parser_builtin;
+
+/**
+ @brief perfect hash of a function name of length len into parser_builtin_table. The multipliers were found by a brute-force search so that every built-in function name maps to its own entry of the 32 entry table, so a lookup costs one hash and at most one strcmp(). The table and the multipliers must be regenerated together when built-in functions are added.
+*/
+#define PARSER_BUILTIN_HASH( name, len ) ( ( (unsigned char)(name)[0] + 4*(unsigned char)(name)[1] + 14*(unsigned char)(name)[(len)-1] + (len) ) & 31 )
+
+/**
+ @brief built-in functions, indexed by PARSER_BUILTIN_HASH() of their names
+*/
+static const parser_builtin parser_builtin_table[32] = {
+	{ NULL,    0,               0 }, /*  0 */
+	{ NULL,    0,               0 }, /*  1 */
+	{ NULL,    0,               0 }, /*  2 */
+	{ "ceil",  PARSER_OP_CEIL,  1 }, /*  3 */
+	{ NULL,    0,               0 }, /*  4 */
+	{ NULL,    0,               0 }, /*  5 */
+	{ NULL,    0,               0 }, /*  6 */
+	{ NULL,    0,               0 }, /*  7 */
+	{ "exp",   PARSER_OP_EXP,   1 }, /*  8 */
+	{ NULL,    0,               0 }, /*  9 */
+	{ NULL,    0,               0 }, /* 10 */
+	{ "round", PARSER_OP_ROUND, 1 }, /* 11 */
+	{ "cos",   PARSER_OP_COS,   1 }, /* 12 */
+	{ "log",   PARSER_OP_LOG,   1 }, /* 13 */
+	{ NULL,    0,               0 }, /* 14 */
+	{ NULL,    0,               0 }, /* 15 */
+	{ NULL,    0,               0 }, /* 16 */
+	{ "pow",   PARSER_OP_POW,   2 }, /* 17 */
+	{ "atan2", PARSER_OP_ATAN2, 2 }, /* 18 */
+	{ "sqrt",  PARSER_OP_SQRT,  1 }, /* 19 */
+	{ NULL,    0,               0 }, /* 20 */
+	{ "asin",  PARSER_OP_ASIN,  1 }, /* 21 */
+	{ "abs",   PARSER_OP_ABS,   1 }, /* 22 */
+	{ "floor", PARSER_OP_FLOOR, 1 }, /* 23 */
+	{ "fabs",  PARSER_OP_FABS,  1 }, /* 24 */
+	{ "atan",  PARSER_OP_ATAN,  1 }, /* 25 */
+	{ NULL,    0,               0 }, /* 26 */
+	{ "acos",  PARSER_OP_ACOS,  1 }, /* 27 */
+	{ NULL,    0,               0 }, /* 28 */
+	{ NULL,    0,               0 }, /* 29 */
+	{ "sin",   PARSER_OP_SIN,   1 }, /* 30 */
+	{ "tan",   PARSER_OP_TAN,   1 }  /* 31 */
+};
+
+int parser_builtin_lookup( const char *name, int len, int *num_args ){
+	const parser_builtin *builtin;
+	if( len < 1 )
+		return -1;
+	builtin = parser_builtin_table + PARSER_BUILTIN_HASH( name, len );
+	if( !builtin->name || strcmp( builtin->name, name ) != 0 )
+		return -1;
+	*num_args = builtin->num_args;
+	return builtin->op;
+}
+
 double parser_read_builtin( parser_data *pd ){
 	double v0=0.0, v1=0.0, args[PARSER_MAX_ARGUMENT_COUNT];
-	char c, token[PARSER_MAX_TOKEN_SIZE];
-	int num_args, pos=0;
-	
-	c = parser_peek( pd );
-	if( isalpha(c) || c == '_' ){
-		// alphabetic character or underscore, indicates that either a function 
-		// call or variable follows
-		while( isalpha(c) || isdigit(c) || c == '_' ){
-			token[pos++] = parser_eat( pd );
-			c = parser_peek( pd );
-		}
-		token[pos] = '\0';
-		
-		// check for an opening bracket, which indicates a function call
-		if( parser_peek(pd) == '(' ){
+	char token[PARSER_MAX_TOKEN_SIZE];
+	int num_args, pos, end;
+	const parser_native *native;
+	
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_IDENTIFIER ){
+		// identifier, indicates that either a function call or variable follows
+		pos = parser_token_name( pd, token );
+		end = PARSER_TOKEN( pd )->pos + pos;
+		parser_token_next( pd );
+		
+		// check for an opening bracket directly following the name, which
+		// indicates a function call
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN && PARSER_TOKEN( pd )->pos == end ){
 			// eat the bracket
-			parser_eat(pd);
+			parser_token_next( pd );
 			
-			// start handling the specific built-in functions
-			if( strcmp( token, "pow" ) == 0 ){
+			// start handling the specific built-in functions, dispatching on the
+			// operation found by the perfect hash lookup of the function name
+			switch( parser_builtin_lookup( token, pos, &num_args ) ){
+			case PARSER_OP_POW:
 				v0 = parser_read_argument( pd );
 				v1 = parser_read_argument( pd );
 				v0 = pow( v0, v1 );
-			} else if( strcmp( token, "sqrt" ) == 0 ){
+				break;
+			case PARSER_OP_SQRT:
 				v0 = parser_read_argument( pd );
-				if( v0 < 0.0 ) 
+				if( v0 < 0.0 && !pd->skip )
 					parser_error( pd, "sqrt(x) undefined for x < 0!" );
 				v0 = sqrt( v0 );
-			} else if( strcmp( token, "log" ) == 0 ){
+				break;
+			case PARSER_OP_LOG:
 				v0 = parser_read_argument( pd );
-				if( v0 <= 0 )
+				if( v0 <= 0 && !pd->skip )
 					parser_error( pd, "log(x) undefined for x <= 0!" );
 				v0 = log( v0 );
-			} else if( strcmp( token, "exp" ) == 0 ){
+				break;
+			case PARSER_OP_EXP:
 				v0 = parser_read_argument( pd );
 				v0 = exp( v0 );
-			} else if( strcmp( token, "sin" ) == 0 ){
+				break;
+			case PARSER_OP_SIN:
 				v0 = parser_read_argument( pd );	
 				v0 = sin( v0 );
-			} else if( strcmp( token, "asin" ) == 0 ){
+				break;
+			case PARSER_OP_ASIN:
 				v0 = parser_read_argument( pd );
-				if( fabs(v0) > 1.0 )
+				if( fabs(v0) > 1.0 && !pd->skip )
 					parser_error( pd, "asin(x) undefined for |x| > 1!" );
 				v0 = asin( v0 );
-			} else if( strcmp( token, "cos" ) == 0 ){
+				break;
+			case PARSER_OP_COS:
 				v0 = parser_read_argument( pd );
 				v0 = cos( v0 );
-			} else if( strcmp( token, "acos" ) == 0 ){
+				break;
+			case PARSER_OP_ACOS:
 				v0 = parser_read_argument( pd );
-				if( fabs(v0 ) > 1.0 )
+				if( fabs(v0) > 1.0 && !pd->skip )
 					parser_error( pd, "acos(x) undefined for |x| > 1!" );
 				v0 = acos( v0 );
-			} else if( strcmp( token, "tan" ) == 0 ){
+				break;
+			case PARSER_OP_TAN:
 				v0 = parser_read_argument( pd );	
 				v0 = tan( v0 );
-			} else if( strcmp( token, "atan" ) == 0 ){
+				break;
+			case PARSER_OP_ATAN:
 				v0 = parser_read_argument( pd );
 				v0 = atan( v0 );
-			} else if( strcmp( token, "atan2" ) == 0 ){
+				break;
+			case PARSER_OP_ATAN2:
 				v0 = parser_read_argument( pd );
 				v1 = parser_read_argument( pd );
 				v0 = atan2( v0, v1 );
-			} else if( strcmp( token, "abs" ) == 0 ){
+				break;
+			case PARSER_OP_ABS:
 				v0 = parser_read_argument( pd );
 				v0 = abs( (int)v0 );
-			} else if( strcmp( token, "fabs" ) == 0 ){
+				break;
+			case PARSER_OP_FABS:
 				v0 = parser_read_argument( pd );
 				v0 = fabs( v0 );
-			} else if( strcmp( token, "floor" ) == 0 ){
+				break;
+			case PARSER_OP_FLOOR:
 				v0 = parser_read_argument( pd );
 				v0 = floor( v0 );
-			} else if( strcmp( token, "ceil" ) == 0 ){
+				break;
+			case PARSER_OP_CEIL:
 				v0 = parser_read_argument( pd );
-				v0 = floor( v0 );
-			} else if( strcmp( token, "round" ) == 0 ){
+				v0 = ceil( v0 );
+				break;
+			case PARSER_OP_ROUND:
 				v0 = parser_read_argument( pd );
 #if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
 				// This is a C99 compiler - use the built-in round function.
@@ -327,18 +367,31 @@ double parser_read_builtin( parser_data *pd ){
 				// This is not a C99-compliant compiler - use our own round function.
 				v0 = parser_round( v0 );
 #endif
-			} else {
+				break;
+			default:
 				parser_read_argument_list( pd, &num_args, args );
-				if( pd->function_cb && pd->function_cb( pd->user_data, token, num_args, args, &v1 ) ){
+				native = pd->registry ? parser_registry_find( pd->registry, token ) : NULL;
+				if( native ){
+					if( num_args < native->min_args || num_args > native->max_args )
+						parser_error( pd, "Wrong number of arguments in function call!" );
+					if( !pd->skip && !native->fn( pd->user_data, num_args, args, &v1 ) )
+						parser_error( pd, "Function evaluation failed!" );
+					v0 = v1;
+				} else if( pd->skip ){
+					// functions are not called in operands that are not evaluated
+					v0 = 0.0;
+				} else if( pd->function_cb && pd->function_cb( pd->user_data, token, num_args, args, &v1 ) ){
 					v0 = v1;
 				} else {
 					parser_error( pd, "Tried to call unknown built-in function!" );
 				}
+				break;
 			}
 		
 			// eat closing bracket of function call
-			if( parser_eat( pd ) != ')' )
+			if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
 				parser_error( pd, "Expected ')' in built-in call!" );
+			parser_token_next( pd );
 		} else {
 			// no opening bracket, indicates a variable lookup
 			if( pd->variable_cb != NULL && pd->variable_cb( pd->user_data, token, &v1 ) ){
@@ -349,12 +402,9 @@ double parser_read_builtin( parser_data *pd ){
 		}
 	} else {
 		// not a built-in function call, just read a literal double
-		v0 = parser_read_double( pd );
+		v0 = parser_token_number( pd );
 	}
 	
-	// consume whitespace
-	parser_eat_whitespace( pd );
-	
 	// return the value
 	return v0;
 }
@@ -363,64 +413,52 @@ double parser_read_paren( parser_data *pd ){
 	double val;
 	
 	// check if the expression has a parenthesis
-	if( parser_peek( pd ) == '(' ){
-		// eat the character
-		parser_eat( pd );
-		
-		// eat remaining whitespace
-		parser_eat_whitespace( pd );
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN ){
+		// eat the token
+		parser_token_next( pd );
 		
 		// if there is a parenthesis, read it 
 		// and then read an expression, then
 		// match the closing brace
-		val = parser_read_boolean_or( pd );
-		
-		// consume remaining whitespace
-		parser_eat_whitespace( pd );
+		val = parser_read_conditional( pd );
 		
 		// match the closing brace
-		if( parser_peek(pd) != ')' )
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
 			parser_error( pd, "Expected ')'!" );		
-		parser_eat(pd);
+		parser_token_next( pd );
 	} else {
 		// otherwise just read a literal value
 		val = parser_read_builtin( pd );
 	}
-	// eat following whitespace
-	parser_eat_whitespace( pd );
 	
 	// return the result
 	return val;
 }
 
 double parser_read_unary( parser_data *pd ){
-	char c;
+	int type;
 	double v0;
-	c = parser_peek( pd );
-	if( c == '!' ){
-		// if the first character is a '!', perform a boolean not operation
+	type = PARSER_TOKEN_TYPE( pd );
+	if( type == PARSER_TOKEN_NOT ){
+		// if the first token is a '!', perform a boolean not operation
 #if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
-		parser_eat(pd);
-		parser_eat_whitespace(pd);
+		parser_token_next( pd );
 		v0 = parser_read_paren(pd);
 		v0 = fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 0.0 : 1.0;
 #else
 		parser_error( pd, "Expected '+' or '-' for unary expression, got '!'" );
 #endif
-	} else if( c == '-' ){
+	} else if( type == PARSER_TOKEN_MINUS ){
 		// perform unary negation
-		parser_eat(pd);
-		parser_eat_whitespace(pd);
+		parser_token_next( pd );
 		v0 = -parser_read_paren(pd);
-	} else if( c == '+' ){
+	} else if( type == PARSER_TOKEN_PLUS ){
 		// consume extra '+' sign and continue reading
-		parser_eat( pd );
-		parser_eat_whitespace(pd);
+		parser_token_next( pd );
 		v0 = parser_read_paren(pd);
 	} else {
 		v0 = parser_read_paren(pd);
 	}
-	parser_eat_whitespace(pd);
 	return v0;
 }
 
@@ -430,23 +468,16 @@ double parser_read_power( parser_data *pd ){
 	// read the first operand
 	v0 = parser_read_unary( pd );
 	
-	// eat remaining whitespace
-	parser_eat_whitespace( pd );
-	
 	// attempt to read the exponentiation operator
-	while( parser_peek(pd) == '^' ){
-		parser_eat(pd );
-		
-		// eat remaining whitespace
-		parser_eat_whitespace( pd );
+	while( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_CARET ){
+		parser_token_next( pd );
 		
 		// handles case of a negative immediately 
 		// following exponentiation but leading
 		// the parenthetical exponent
-		if( parser_peek( pd ) == '-' ){
-			parser_eat( pd );
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_MINUS ){
+			parser_token_next( pd );
 			s = -1.0;
-			parser_eat_whitespace( pd );
 		}
 		
 		// read the second operand
@@ -454,9 +485,6 @@ double parser_read_power( parser_data *pd ){
 		
 		// perform the exponentiation
 		v0 = pow( v0, v1 );
-		
-		// eat remaining whitespace
-		parser_eat_whitespace( pd );
 	}
 	
 	// return the result
@@ -465,80 +493,63 @@ double parser_read_power( parser_data *pd ){
 
 double parser_read_term( parser_data *pd ){
 	double v0;
-	char c;
+	int type;
 	
 	// read the first operand
 	v0 = parser_read_power( pd );
 	
-	// eat remaining whitespace
-	parser_eat_whitespace( pd );
-	
-	// check to see if the next character is a
+	// check to see if the next token is a
 	// multiplication or division operand
-	c = parser_peek( pd );
-	while( c == '*' || c == '/' ){
-		// eat the character
-		parser_eat( pd );
-		
-		// eat remaining whitespace
-		parser_eat_whitespace( pd );
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_STAR || type == PARSER_TOKEN_SLASH ){
+		// eat the token
+		parser_token_next( pd );
 		
 		// perform the appropriate operation
-		if( c == '*' ){
+		if( type == PARSER_TOKEN_STAR ){
 			v0 *= parser_read_power( pd );
-		} else if( c == '/' ){
+		} else {
 			v0 /= parser_read_power( pd );
 		}
 		
-		// eat remaining whitespace
-		parser_eat_whitespace( pd );
-		
-		// update the character
-		c = parser_peek( pd );
+		// update the token
+		type = PARSER_TOKEN_TYPE( pd );
 	}
 	return v0;
 }
 
 double parser_read_expr( parser_data *pd ){
 	double v0 = 0.0;
-	char c;
+	int type;
 	
 	// handle unary minus
-	c = parser_peek( pd );
-	if( c == '+' || c == '-' ){
-		parser_eat( pd );
-		parser_eat_whitespace( pd );
-		if( c == '+' )
+	type = PARSER_TOKEN_TYPE( pd );
+	if( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ){
+		parser_token_next( pd );
+		if( type == PARSER_TOKEN_PLUS )
 			v0 += parser_read_term( pd );
-		else if( c == '-' )
+		else
 			v0 -= parser_read_term( pd );
 	} else {
 		v0 = parser_read_term( pd );
 	}
-	parser_eat_whitespace( pd );
 	
 	// check if there is an addition or
 	// subtraction operation following
-	c = parser_peek( pd );
-	while( c == '+' || c == '-' ){
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ){
 		// advance the input
-		parser_eat( pd );
-		
-		// eat any extra whitespace
-		parser_eat_whitespace( pd );
+		parser_token_next( pd );
 		
 		// perform the operation
-		if( c == '+' ){		
+		if( type == PARSER_TOKEN_PLUS ){		
 			v0 += parser_read_term( pd );
-		} else if( c == '-' ){
+		} else {
 			v0 -= parser_read_term( pd );
 		}
 		
-		// eat whitespace
-		parser_eat_whitespace( pd );
-		
-		// update the character being tested in the while loop
-		c = parser_peek( pd );
+		// update the token being tested in the while loop
+		type = PARSER_TOKEN_TYPE( pd );
 	}
 	
 	// return expression result
@@ -546,196 +557,290 @@ double parser_read_expr( parser_data *pd ){
 }
 
 double parser_read_boolean_comparison( parser_data *pd ){
-	char c, oper[] = { '\0', '\0', '\0' };
+	int type;
 	double v0, v1;
 	
-	// eat whitespace
-	parser_eat_whitespace( pd );
-	
 	// read the first value
 	v0 = parser_read_expr( pd );
 	
-	// eat trailing whitespace
-	parser_eat_whitespace( pd );
-	
 	// try to perform boolean comparison operator. Unlike the other operators
 	// like the arithmetic operations and the boolean and/or operations, we
 	// only allow one operation to be performed. This is done since cascading
 	// operations would have unintended results: 2.0 < 3.0 < 1.5 would
 	// evaluate to true, since (2.0 < 3.0) == 1.0, which is less than 1.5, even
 	// though the 3.0 < 1.5 does not hold.
-	c = parser_peek( pd );
-	if( c == '>' || c == '<' ){
+	type = PARSER_TOKEN_TYPE( pd );
+	if( type == PARSER_TOKEN_LT || type == PARSER_TOKEN_LE || type == PARSER_TOKEN_GT || type == PARSER_TOKEN_GE ){
 		// read the operation
-		oper[0] = parser_eat( pd );
-		c = parser_peek( pd );
-		if( c == '=' )
-			oper[1] = parser_eat( pd );
-		
-		// eat trailing whitespace
-		parser_eat_whitespace( pd );
+		parser_token_next( pd );
 		
 		// try to read the next term
 		v1 = parser_read_expr( pd );
 		
 		// perform the boolean operations
-		if( strcmp( oper, "<" ) == 0 ){
+		if( type == PARSER_TOKEN_LT ){
 			v0 = (v0 < v1) ? 1.0 : 0.0;
-		} else if( strcmp( oper, ">" ) == 0 ){
+		} else if( type == PARSER_TOKEN_GT ){
 			v0 = (v0 > v1) ? 1.0 : 0.0;
-		} else if( strcmp( oper, "<=" ) == 0 ){
+		} else if( type == PARSER_TOKEN_LE ){
 			v0 = (v0 <= v1) ? 1.0 : 0.0;
-		} else if( strcmp( oper, ">=" ) == 0 ){
-			v0 = (v0 >= v1) ? 1.0 : 0.0;
 		} else {
-			parser_error( pd, "Unknown operation!" );
+			v0 = (v0 >= v1) ? 1.0 : 0.0;
 		}
-		
-		// read trailing whitespace
-		parser_eat_whitespace( pd );
 	}
 	return v0;
 }
 
 double parser_read_boolean_equality( parser_data *pd ){
-	char c, oper[] = { '\0', '\0', '\0' };
+	int type;
 	double v0, v1;
 	
-	// eat whitespace
-	parser_eat_whitespace( pd );
-	
 	// read the first value
 	v0 = parser_read_boolean_comparison( pd );
 	
-	// eat trailing whitespace
-	parser_eat_whitespace( pd );
-	
-	// try to perform boolean equality operator
-	c = parser_peek( pd );
-	if( c == '=' || c == '!' ){
-		if( c == '!' ){
-			// try to match '!=' without advancing input to not clobber unary not
-			if( parser_peek_n( pd, 1 ) == '=' ){
-				oper[0] = parser_eat( pd );
-				oper[1] = parser_eat( pd );
-			} else {
-				return v0;
-			}
-		} else {
-			// try to match '=='
-			oper[0] = parser_eat( pd );
-			c = parser_peek( pd );
-			if( c != '=' )
-				parser_error( pd, "Expected a '=' for boolean '==' operator!" );
-			oper[1] = parser_eat( pd );
-		}
-		// eat trailing whitespace
-		parser_eat_whitespace( pd );
+	// try to perform boolean equality operator, a '!' that is not
+	// followed by '=' is a separate token and not matched here
+	type = PARSER_TOKEN_TYPE( pd );
+	if( type == PARSER_TOKEN_EQ || type == PARSER_TOKEN_NE || type == PARSER_TOKEN_ASSIGN ){
+		if( type == PARSER_TOKEN_ASSIGN )
+			parser_error( pd, "Expected a '=' for boolean '==' operator!" );
+		parser_token_next( pd );
 		
 		// try to read the next term
 		v1 = parser_read_boolean_comparison( pd );
 		
 		// perform the boolean operations
-		if( strcmp( oper, "==" ) == 0 ){
+		if( type == PARSER_TOKEN_EQ ){
 			v0 = ( fabs(v0 - v1) < PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0;
-		} else if( strcmp( oper, "!=" ) == 0 ){
-			v0 = ( fabs(v0 - v1) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0;
 		} else {
-			parser_error( pd, "Unknown operation!" );
+			v0 = ( fabs(v0 - v1) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0;
 		}
-		
-		// read trailing whitespace
-		parser_eat_whitespace( pd );
 	}
 	return v0;
 }
 
 
 double parser_read_boolean_and( parser_data *pd ){
-	char c;
+	int type, skip;
 	double v0, v1;
 	
 	// tries to read a boolean comparison operator ( <, >, <=, >= ) 
 	// as the first operand of the expression
 	v0 = parser_read_boolean_equality( pd );
 	
-	// consume any whitespace befor the operator
-	parser_eat_whitespace( pd );
-	
-	// grab the next character and check if it matches an 'and'
+	// grab the next token and check if it matches an 'and'
 	// operation. If so, match and perform and operations until
 	// there are no more to perform
-	c = parser_peek( pd );
-	while( c == '&' ){
-		// eat the first '&'
-		parser_eat( pd );
-		
-		// check for and eat the second '&'
-		c = parser_peek( pd );
-		if( c != '&' )
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_AND || type == PARSER_TOKEN_AMPERSAND ){
+		// a single '&' is not an operator
+		if( type == PARSER_TOKEN_AMPERSAND )
 			parser_error( pd, "Expected '&' to follow '&' in logical and operation!" );
-		parser_eat( pd );
-		
-		// eat any remaining whitespace
-		parser_eat_whitespace( pd );
+		parser_token_next( pd );
 
-		// read the second operand of the
+		// read the second operand, which is only evaluated if the first is true
+		skip = !PARSER_TRUTH( v0 );
+		pd->skip += skip;
 		v1 = parser_read_boolean_equality( pd );
+		pd->skip -= skip;
 		
 		// perform the operation, returning 1.0 for TRUE and 0.0 for FALSE
 		v0 = ( fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD && fabs(v1) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0;
-	
-		// eat any following whitespace
-		parser_eat_whitespace( pd );
 		
-		// grab the next character to continue trying to perform 'and' operations
-		c = parser_peek( pd );
+		// grab the next token to continue trying to perform 'and' operations
+		type = PARSER_TOKEN_TYPE( pd );
 	}
 	
 	return v0;
 }
 
 double parser_read_boolean_or( parser_data *pd ){
-	char c;
+	int type, skip;
 	double v0, v1;
 	
 	// read the first term
 	v0 = parser_read_boolean_and( pd );
-	
-	// eat whitespace
-	parser_eat_whitespace( pd );
 
-	// grab the next character and check if it matches an 'or'
+	// grab the next token and check if it matches an 'or'
 	// operation. If so, match and perform and operations until
 	// there are no more to perform
-	c = parser_peek( pd );
-	while( c == '|' ){
-		// match the first '|' character
-		parser_eat( pd );
-		
-		// check for and match the second '|' character
-		c = parser_peek( pd );
-		if( c != '|' )
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_OR || type == PARSER_TOKEN_BAR ){
+		// a single '|' is not an operator
+		if( type == PARSER_TOKEN_BAR )
 			parser_error( pd, "Expected '|' to follow '|' in logical or operation!" );
-		parser_eat( pd );
-		
-		// eat any following whitespace
-		parser_eat_whitespace( pd );
+		parser_token_next( pd );
 		
-		// read the second operand
+		// read the second operand, which is only evaluated if the first is false
+		skip = PARSER_TRUTH( v0 );
+		pd->skip += skip;
 		v1 = parser_read_boolean_and( pd );
+		pd->skip -= skip;
 	
 		// perform the 'or' operation
 		v0 = ( fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs(v1) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0;
 		
-		// eat any following whitespace
-		parser_eat_whitespace( pd );
-		
-		// grab the next character to continue trying to match
+		// grab the next token to continue trying to match
 		// 'or' operations
-		c = parser_peek( pd );
+		type = PARSER_TOKEN_TYPE( pd );
 	}
 	
 	// return the resulting value
 	return v0;
+}
+
+double parser_read_conditional( parser_data *pd ){
+	double v0, v1, v2;
+	int skip;
+
+	// read the condition
+	v0 = parser_read_boolean_or( pd );
+
+	// if a '?' follows, read both operands, right-associatively, but only
+	// evaluate the one selected by the condition
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_QUESTION ){
+		parser_token_next( pd );
+		skip = !PARSER_TRUTH( v0 );
+		pd->skip += skip;
+		v1 = parser_read_conditional( pd );
+		pd->skip -= skip;
+
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_COLON )
+			parser_error( pd, "Expected ':' in conditional expression!" );
+		parser_token_next( pd );
+
+		pd->skip += !skip;
+		v2 = parser_read_conditional( pd );
+		pd->skip -= !skip;
+		v0 = skip ? v2 : v1;
+	}
+	return v0;
+}
+
+/**
+ @brief reads an operand of the binary operators: an optional '!', '-' or '+' applied to an expression in parentheses or a builtin, as parser_read_unary() does
+*/
+static double parser_read_operand( parser_data *pd ){
+	int type;
+	double v0;
+
+	type = PARSER_TOKEN_TYPE( pd );
+#if defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	if( type == PARSER_TOKEN_NOT )
+		parser_error( pd, "Expected '+' or '-' for unary expression, got '!'" );
+#endif
+	if( type == PARSER_TOKEN_NOT || type == PARSER_TOKEN_MINUS || type == PARSER_TOKEN_PLUS )
+		parser_token_next( pd );
+
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN ){
+		parser_token_next( pd );
+		v0 = parser_read_binary( pd, PARSER_PRECEDENCE_CONDITIONAL );
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
+			parser_error( pd, "Expected ')'!" );
+		parser_token_next( pd );
+	} else {
+		v0 = parser_read_builtin( pd );
+	}
+
+	if( type == PARSER_TOKEN_NOT )
+		v0 = fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 0.0 : 1.0;
+	else if( type == PARSER_TOKEN_MINUS )
+		v0 = -v0;
+	return v0;
+}
+
+double parser_read_binary( parser_data *pd, int precedence ){
+	int type, level, limit = PARSER_PRECEDENCE_POWER, skip;
+	double v0, v1, v2, s;
+
+	if( ++pd->depth > PARSER_MAX_NESTING_DEPTH )
+		parser_error( pd, "Expression nested too deeply, increase PARSER_MAX_NESTING_DEPTH and recompile!" );
+
+	// a sign leading an operand of '+' or of a looser operator applies to
+	// the whole first term, as in parser_read_expr(), otherwise only to the
+	// following parenthetical or literal, as in parser_read_unary()
+	type = PARSER_TOKEN_TYPE( pd );
+	if( precedence <= PARSER_PRECEDENCE_ADD && ( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ) ){
+		parser_token_next( pd );
+		v1 = parser_read_binary( pd, PARSER_PRECEDENCE_MUL );
+		v0 = type == PARSER_TOKEN_PLUS ? 0.0 + v1 : 0.0 - v1;
+	} else {
+		v0 = parser_read_operand( pd );
+	}
+
+	// apply operators while they bind at least as tightly as precedence, the
+	// operators that bind more tightly than the current one were already read
+	// by its right operand, limit stops a second comparison or equality test
+	for( ;; ){
+		type  = PARSER_TOKEN_TYPE( pd );
+		level = parser_token_precedence[type];
+		if( level < precedence || level > limit )
+			break;
+		if( type == PARSER_TOKEN_ASSIGN )
+			parser_error( pd, "Expected a '=' for boolean '==' operator!" );
+		if( type == PARSER_TOKEN_AMPERSAND )
+			parser_error( pd, "Expected '&' to follow '&' in logical and operation!" );
+		if( type == PARSER_TOKEN_BAR )
+			parser_error( pd, "Expected '|' to follow '|' in logical or operation!" );
+		parser_token_next( pd );
+
+		if( type == PARSER_TOKEN_QUESTION ){
+			// right-associative, only the operand selected by the condition
+			// is evaluated, as in parser_read_conditional()
+			skip = !PARSER_TRUTH( v0 );
+			pd->skip += skip;
+			v1 = parser_read_binary( pd, PARSER_PRECEDENCE_CONDITIONAL );
+			pd->skip -= skip;
+			if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_COLON )
+				parser_error( pd, "Expected ':' in conditional expression!" );
+			parser_token_next( pd );
+			pd->skip += !skip;
+			v2 = parser_read_binary( pd, PARSER_PRECEDENCE_CONDITIONAL );
+			pd->skip -= !skip;
+			v0 = skip ? v2 : v1;
+			// the conditional is the loosest level, so no operator can
+			// apply to it as a whole
+			break;
+		}
+
+		if( type == PARSER_TOKEN_CARET ){
+			// right-associative, a '-' directly after the operator negates
+			// the whole exponent, as in parser_read_power()
+			s = 1.0;
+			if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_MINUS ){
+				parser_token_next( pd );
+				s = -1.0;
+			}
+			v1 = s*parser_read_binary( pd, PARSER_PRECEDENCE_POWER );
+		} else {
+			// the right operand of && and || is skipped when the left one
+			// decides the result
+			skip = type == PARSER_TOKEN_AND ? !PARSER_TRUTH( v0 ) : type == PARSER_TOKEN_OR ? PARSER_TRUTH( v0 ) : 0;
+			pd->skip += skip;
+			v1 = parser_read_binary( pd, level+1 );
+			pd->skip -= skip;
+		}
+
+		switch( type ){
+			case PARSER_TOKEN_PLUS:  v0 += v1; break;
+			case PARSER_TOKEN_MINUS: v0 -= v1; break;
+			case PARSER_TOKEN_STAR:  v0 *= v1; break;
+			case PARSER_TOKEN_SLASH: v0 /= v1; break;
+			case PARSER_TOKEN_CARET: v0 = pow( v0, v1 ); break;
+			case PARSER_TOKEN_LT:    v0 = (v0 < v1) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_GT:    v0 = (v0 > v1) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_LE:    v0 = (v0 <= v1) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_GE:    v0 = (v0 >= v1) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_EQ:    v0 = ( fabs(v0 - v1) < PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_NE:    v0 = ( fabs(v0 - v1) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0; break;
+			case PARSER_TOKEN_AND:   v0 = ( fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD && fabs(v1) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0; break;
+			default:                 v0 = ( fabs(v0) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs(v1) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ? 1.0 : 0.0; break;
+		}
+
+		// comparisons and equality tests do not chain
+		limit = level == PARSER_PRECEDENCE_COMPARISON || level == PARSER_PRECEDENCE_EQUALITY ? level-1 : level;
+	}
+
+	pd->depth--;
+	return v0;
 }
\ No newline at end of file
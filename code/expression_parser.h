@@ -4,7 +4,7 @@
 /**
  @mainpage
  @author James Gregson james.gregson@gmail.com <br>&nbsp;<br>
- @brief A simple C expression parser.  Hand-rolled recursive descent style algorithm implements the parser, removing the need for external tools such as lex/yacc. Reads mathematical expression in infix notation (with a few built-in mathematical functions) and produces double-precision results.  
+ @brief A simple C expression parser.  Hand-rolled operator precedence climbing algorithm implements the parser, removing the need for external tools such as lex/yacc. Reads mathematical expression in infix notation (with a few built-in mathematical functions) and produces double-precision results.  
  
  The library handles:
  
@@ -19,6 +19,10 @@
  - standard boolean operations (==,!=,>,<,>=,<=,&&,||,!) using the convention
  that False := fabs(value) <= PARSER_BOOLEAN_EQUALITY_THRESHOLD and
  True = !False := fabs(value) > PARSER_BOOLEAN_EQUALITY_THRESHOLD
+ - short-circuit evaluation of && and ||, and the conditional operator
+ 'cond ? a : b', which only evaluate the operands they need, as in C. Calls and
+ domain errors in operands that are not evaluated have no effect, e.g.
+ 'x > 0 ? sqrt(x) : 0' never fails.
  - predefined named variables and functions via a callback interface (see below)
  
  Operator precedence and syntax matches the C language as closely as possible to allow straightforward validation of code-correctness.  I.e. the parser should produce the same result as the C language to within rounding errors when only operations from C are used.
@@ -32,6 +36,28 @@
  Licence: GPLv2 for non-commercial use. Contact me for commercial licensing. This code is provided as-is, with no warranty whatsoever.
  
  Predefined variables and functions are accomodated with a callback interface that allows driver code to look up named variables and evaluate functions as required by the parser.  These callbacks must match the call-signature for the parser_variable_callback and parser_function_callback types below.  The variable callback takes the name of the variable to be looked up and returns true if the named variable value was copied into the output argument, returning false otherwise.  The function callback operates similarly, taking the name of the function to evaluate as well as a list of arguments to that function and (if successful) placing the evaluated function value in the return argument and returning true.  Function calls may be arbitrarily nested.
+ 
+ Expressions that are evaluated many times, e.g. with different variable values, can be compiled once with parser_compile() into a parser_program and then evaluated with parser_program_eval().  Compiled programs follow exactly the same grammar as parser_parse(), but the input is only parsed once and evaluation is a single pass over a flat array of pre-resolved operations, with each distinct variable looked up once per evaluation.  Subexpressions that do not depend on any variable or impure function, e.g. sqrt(2) or pow(10,-3), are folded into literals at compile time, while subexpressions that fail to evaluate, e.g. sqrt(-1), are kept so the program reports the error when evaluated, just as the parser does.  Repeated subexpressions are evaluated only once, and parser_compile_set() compiles several related expressions into one program so that they share their variable lookups and common subexpressions too.
+ 
+ Programs can also be evaluated over whole tables of variable values with parser_batch_eval(), binding each variable to a (possibly strided) column of doubles, or of floats, 32 or 64 bit integers or bytes, which are converted to double a chunk at a time as they are read rather than copied to a temporary array of doubles.  The batch evaluator applies each operation to chunks of PARSER_BATCH_CHUNK_SIZE rows at a time, so the per-row cost is a tight loop over arrays rather than a string lookup per variable occurrence.  parser_batch_eval_set() writes every output of a program from parser_compile_set() to its own column in the same pass over the rows.  Filters can be evaluated as predicates with parser_batch_eval_bitmap() and parser_batch_eval_selection(), which produce a packed bitmap or the indices of the selected rows rather than a column of doubles, and only evaluate the operands of && and || for the rows they can still change.  parser_batch_reduce() computes the count, sum, mean, minimum and maximum of expressions over the rows without writing their values at all, with compensated sums that are identical however many threads are used.
+ 
+ Large tables can be evaluated on several cores with parser_batch_eval_parallel(), which splits the rows into tasks that the threads of a parser_pool share by work stealing.  All threads use the same compiled program, each with its own scratch space, so user and native functions must be thread safe when used this way.
+ 
+ Compiled programs can be translated to native x86-64 machine code with parser_program_jit(), which removes the interpreter dispatch from parser_program_eval() and friends.  On other platforms, or if PARSER_EXCLUDE_JIT is defined, parser_program_jit() fails and programs are interpreted as before.
+ 
+ Compiled programs can be saved as binary images with parser_program_save() and loaded back with parser_program_load(), which uses the image in place, e.g. from a file mapped with parser_image_map(), so an application with many configured expressions does not have to parse them at every start.
+ 
+ Large sets of expressions can be compiled into a parser_arena by setting parser_data::arena.  The arena hands out memory from a caller supplied buffer, so compilation need not allocate at all, and then from large blocks, and it releases every program compiled into it at once with parser_arena_reset().
+
+ Applications that evaluate the same expressions over and over can use parse_expression_with_cache() in place of parse_expression_with_callbacks().  It keeps the programs compiled from recently used expressions in a parser_cache with a bounded memory budget, so an expression seen before is evaluated without being parsed again.  A cache can be shared between threads.
+ 
+ Functions can be registered by name, with their number of arguments and whether they are pure, in a parser_registry.  Setting parser_data::registry makes both the parser and parser_compile() resolve registered functions once and call them directly, checking the number of arguments in the expression.  Calls of pure functions are treated like the built-in functions by the optimizer.
+
+ Compiled programs can be differentiated with respect to their variables, e.g. for the objective functions of an optimizer.  parser_program_eval_gradient() returns the value of an expression and its gradient with respect to chosen variables with a single reverse sweep over the program, parser_batch_eval_gradient() does the same for every row of a table, and parser_program_eval_tangent() returns the directional derivatives of all outputs with a single forward sweep.  Every built-in function is differentiated, registered functions are differentiated if a derivative was registered with parser_registry_add_derivative(), and user functions called through the function callback can not be differentiated.
+
+ Compiled programs can also be evaluated over intervals with parser_program_eval_interval(), given bounds on each variable, e.g. the minimum and maximum of each column of a block of rows.  The result is an interval containing the value of every row within the bounds, so parser_program_eval_predicate() can tell that a filter is definitely true or definitely false for the whole block, which can then be kept or skipped without evaluating any of its rows.
+
+ Where float precision is enough, parser_program_eval_float() and parser_batch_eval_float() evaluate compiled programs in single precision, with the float versions of the built-in functions and the boolean threshold PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT, so the batch kernels process twice as many rows per instruction and float columns are read without conversion to double.  Measured against double precision on the expressions of the interval tests in test.c, at the 40401 points of a grid over [-3,7] x [-3,7], single built-in functions agree to within 1.2e-7 relative to max(1,|value|), about one float rounding, and compound expressions to within 1.2e-5, the worst case being cancellation in 'pow( x, y ) + x^2 - exp( -x*y ) + x^-1 + y^3'.  Domain errors are reported at the same points.  Discontinuous expressions, i.e. floor(), ceil(), round() and comparisons, can take the other branch where their argument is within rounding of a discontinuity, which happened at 116 of the points for 'fabs( x - y )*floor( x ) + ceil( y ) + round( x*y ) + abs( x ) + fabs( y - x )' and 6 for 'x/y > 0.5 && x - y >= -1 && !(y == 3)'.  Values between PARSER_BOOLEAN_EQUALITY_THRESHOLD and PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT in magnitude are true in double precision but false in single precision.
  */
 
 #include<setjmp.h>
@@ -48,6 +74,13 @@ extern "C" {
 #define PARSER_BOOLEAN_EQUALITY_THRESHOLD	(1e-10)
 #endif
 
+/**
+ @brief threshold for defining true and false in single precision, see parser_program_eval_float() and parser_batch_eval_float(). The default is PARSER_BOOLEAN_EQUALITY_THRESHOLD scaled to the precision of float: 1e-10 is about 2^-33, using 33 of the 53 significand bits of a double, and the same fraction of the 24 bits of a float gives 2^-15, about 3e-5.  Smaller thresholds would fall below the rounding error of float for values of order one.
+*/
+#if !defined(PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT)
+#define PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT	(3e-5f)
+#endif
+
 /**
  @brief maximum length for tokens in characters for expressions, define this in the compiler options to change the maximum size
 */
@@ -55,6 +88,20 @@ extern "C" {
 #define PARSER_MAX_TOKEN_SIZE 256
 #endif
 
+/**
+ @brief number of tokens held by the token window of a parser_data structure. The input is tokenized in batches of this size as the grammar consumes it, so it trades the size of parser_data against the number of refills. must be at least 2, define this in the compiler options to change.
+*/
+#if !defined(PARSER_TOKEN_BUFFER_SIZE)
+#define PARSER_TOKEN_BUFFER_SIZE 64
+#endif
+
+/**
+ @brief maximum nesting depth of subexpressions, e.g. parentheses, function arguments and exponents, accepted by the precedence climbing parser. Bounds the stack space used by parser_parse() and parser_compile() whatever the input, define this in the compiler options to change.
+*/
+#if !defined(PARSER_MAX_NESTING_DEPTH)
+#define PARSER_MAX_NESTING_DEPTH 1024
+#endif
+
 /**
  @brief maximum number of arguments to user-defined functions, define this in the compiler opetions to change.
 */
@@ -62,6 +109,56 @@ extern "C" {
 #define PARSER_MAX_ARGUMENT_COUNT 10
 #endif
 
+/**
+ @brief number of nodes of a compiled program that parser_program_eval() can evaluate using stack storage only, larger programs allocate their scratch space on the heap. define this in the compiler options to change.
+*/
+#if !defined(PARSER_PROGRAM_STACK_SIZE)
+#define PARSER_PROGRAM_STACK_SIZE 256
+#endif
+
+/**
+ @brief number of rows processed together by the batch evaluator. Every operation of a program is applied to a whole chunk of rows before moving to the next operation, so the chunk size trades loop overhead against the size of the per-chunk scratch space, which should stay within the processor caches. define this in the compiler options to change.
+*/
+#if !defined(PARSER_BATCH_CHUNK_SIZE)
+#define PARSER_BATCH_CHUNK_SIZE 256
+#endif
+
+/**
+ @brief number of batch chunks in a task of parser_batch_eval_parallel(). Tasks are the unit of work distributed between threads, so they must be large enough to amortize the scheduling cost but small enough to balance the load. define this in the compiler options to change.
+*/
+#if !defined(PARSER_PARALLEL_TASK_CHUNKS)
+#define PARSER_PARALLEL_TASK_CHUNKS 16
+#endif
+
+/**
+ @brief number of independently locked shards of a parser_cache. Threads only contend when looking up expressions of the same shard, but the memory budget is split evenly between the shards. define this in the compiler options to change.
+*/
+#if !defined(PARSER_CACHE_SHARDS)
+#define PARSER_CACHE_SHARDS 16
+#endif
+
+/**
+ @brief alignment in bytes of the memory handed out by a parser_arena, a power of two. define this in the compiler options to change.
+*/
+#if !defined(PARSER_ARENA_ALIGNMENT)
+#define PARSER_ARENA_ALIGNMENT 16
+#endif
+
+/**
+ @brief allocation functions used by the library for compiled programs, batch evaluation, registries and thread pools. Parsing with parser_parse() never allocates. define these in the compiler options, all four together, to the names of functions with the signatures of malloc(), calloc(), realloc() and free() to use another allocator, or to count allocations as the benchmarks do. the functions are declared here and defined by the application.
+*/
+#if !defined(PARSER_MALLOC)
+#define PARSER_MALLOC  malloc
+#define PARSER_CALLOC  calloc
+#define PARSER_REALLOC realloc
+#define PARSER_FREE    free
+#else
+void *PARSER_MALLOC( size_t size );
+void *PARSER_CALLOC( size_t count, size_t size );
+void *PARSER_REALLOC( void *ptr, size_t size );
+void  PARSER_FREE( void *ptr );
+#endif
+
 /**
  @brief definitions for parser true and false
 */
@@ -88,6 +185,122 @@ typedef int (*parser_variable_callback)( void *user_data, const char *name, doub
 */
 typedef int (*parser_function_callback)( void *user_data, const char *name, const int num_args, const double *args, double *value );
 
+/**
+ @brief definition of the type of functions registered with a parser_registry. Unlike the function callback, a registered function is resolved by name once, when the expression is parsed or compiled, and is then called directly.
+ @param[in] user_data user-specified data pointer that will be passed to the function, the same pointer that is passed to the callbacks
+ @param[in] num_args the number of arguments in the function call
+ @param[in] args a pointer to a double precision list of arguments for the function call
+ @param[out] value the return value of the evaluated function
+ @return PARSER_TRUE if the function was evaluated successfully and value was set, PARSER_FALSE otherwise
+*/
+typedef int (*parser_native_function)( void *user_data, const int num_args, const double *args, double *value );
+
+/**
+ @brief definition of the type of the derivatives of registered functions, see parser_registry_add_derivative()
+ @param[in] user_data user-specified data pointer that will be passed to the function, the same pointer that is passed to the callbacks
+ @param[in] num_args the number of arguments in the function call
+ @param[in] args a pointer to a double precision list of arguments for the function call
+ @param[in] value the value of the function for these arguments
+ @param[out] partials receives num_args values, the partial derivatives of the function with respect to each argument
+ @return PARSER_TRUE if the derivatives were evaluated successfully, PARSER_FALSE otherwise
+*/
+typedef int (*parser_native_derivative)( void *user_data, const int num_args, const double *args, double value, double *partials );
+
+/**
+ @brief flag for parser_registry_add(), marks a function as pure: its result depends only on its arguments and it has no side effects, so calls with constant arguments may be evaluated once at compile time
+*/
+#define PARSER_FUNCTION_PURE 1
+
+/**
+ @brief registry of named native functions with their arity and flags, see parser_registry_new(). The structure is opaque to users of the library.
+*/
+typedef struct parser_registry parser_registry;
+
+/**
+ @brief pool of worker threads for parser_batch_eval_parallel(), see parser_pool_new(). The structure is opaque to users of the library.
+*/
+typedef struct parser_pool parser_pool;
+
+/**
+ @brief cache of compiled programs keyed by expression text for parse_expression_with_cache(), see parser_cache_new(). The structure is opaque to users of the library.
+*/
+typedef struct parser_cache parser_cache;
+
+/**
+ @brief counters of a parser_cache, see parser_cache_get_stats()
+*/
+typedef struct {
+	/** @brief number of lookups that found a compiled program */
+	unsigned long hits;
+
+	/** @brief number of lookups that compiled the expression */
+	unsigned long misses;
+
+	/** @brief number of programs removed to stay within the memory budget */
+	unsigned long evictions;
+
+	/** @brief number of programs held by the cache */
+	size_t        entries;
+
+	/** @brief memory used by the programs held by the cache in bytes */
+	size_t        bytes;
+} parser_cache_stats;
+
+/**
+ @brief bump allocator that programs can be compiled into, see parser_arena_init(). Programs compiled into an arena are released all at once by parser_arena_reset(). The structure may be placed on the stack, its fields are for use by the library only.
+*/
+typedef struct {
+	/** @brief block that allocations are made from, its size and the number of bytes of it in use */
+	unsigned char *block;
+	size_t         size;
+	size_t         used;
+
+	/** @brief blocks allocated by the arena, most recent first, NULL while allocating from the buffer */
+	void          *blocks;
+
+	/** @brief buffer given to parser_arena_init(), aligned to PARSER_ARENA_ALIGNMENT */
+	unsigned char *buffer;
+	size_t         buffer_size;
+
+	/** @brief minimum size of the blocks allocated once the buffer is full, zero if the arena never allocates */
+	size_t         block_size;
+
+	/** @brief bytes in use in the buffer and blocks that allocations are no longer made from */
+	size_t         retired;
+} parser_arena;
+
+/**
+ @brief closed interval of values, see parser_program_eval_interval(). The interval is empty if lo > hi, bounds may be infinite.
+*/
+typedef struct {
+	double lo;
+	double hi;
+} parser_interval;
+
+/**
+ @brief results of parser_program_eval_predicate()
+*/
+#define PARSER_PREDICATE_FALSE   0	/**< the predicate is false, or fails to evaluate, for every row within the bounds */
+#define PARSER_PREDICATE_TRUE    1	/**< the predicate is true for every row within the bounds */
+#define PARSER_PREDICATE_UNKNOWN 2	/**< the predicate may be true for some rows and false for others */
+
+/**
+ @brief a token of the input, produced by the lexer, see parser_tokenize()
+*/
+typedef struct {
+	/** @brief kind of token, for use by the library only */
+	int    type;
+
+	/** @brief position of the first character of the token in the input */
+	int    pos;
+
+	/** @brief number of characters of the token */
+	int    len;
+
+	/** @brief value of a numeric literal */
+	double value;
+} parser_token;
+
 /**
  @brief main data structure for the parser, holds a pointer to the input string and the index of the current position of the parser in the input
 */
@@ -99,8 +312,23 @@ typedef struct {
 	/** @brief length of input string */
 	int        len;
 	
-	/** @brief current parser position in the input */
+	/** @brief position in the input up to which it has been tokenized */
 	int        pos;
+
+	/** @brief window of tokens read from the input, refilled as the grammar consumes them */
+	parser_token tokens[PARSER_TOKEN_BUFFER_SIZE];
+
+	/** @brief number of tokens in the window */
+	int        num_tokens;
+
+	/** @brief index of the current token in the window */
+	int        token;
+
+	/** @brief nesting depth of the subexpression being read, see PARSER_MAX_NESTING_DEPTH */
+	int        depth;
+
+	/** @brief non-zero while reading an operand that short-circuit evaluation skips, in which case functions are not called and their arguments are not checked. Variables are still looked up, as compiled programs look up all of theirs. */
+	int        skip;
 	
 	/** @brief position to return to for exception handling */
 	jmp_buf		err_jmp_buf;
@@ -116,8 +344,92 @@ typedef struct {
 	
 	/** @brief callback function used to perform user-function evaluations, set to NULL if not used */
 	parser_function_callback	function_cb;
+
+	/** @brief registry of native functions, consulted after the built-in functions and before the function callback. Set to NULL by parser_data_init() and parser_data_new(), assign a registry to use one */
+	const parser_registry		*registry;
+
+	/** @brief PARSER_TRUE to fold constants and eliminate common subexpressions in parser_compile(). Set to PARSER_TRUE by parser_data_init() and parser_data_new(), clearing it keeps one node per operation of the input, e.g. for testing */
+	int							optimize;
+
+	/** @brief arena that parser_compile() and parser_compile_set() allocate programs from, NULL to allocate them with PARSER_MALLOC. Set to NULL by parser_data_init() and parser_data_new() */
+	parser_arena				*arena;
+
+	/** @brief PARSER_TRUE to read the input with the recursive descent functions parser_read_conditional() and friends, one function per precedence level, instead of the precedence climbing parser. Both accept the same grammar with the same results and errors, the recursive descent parser is kept for differential testing. Set to PARSER_FALSE by parser_data_init() and parser_data_new(), applies to both parser_parse() and parser_compile() */
+	int							recursive_descent;
 } parser_data;
 
+/**
+ @brief compiled form of an expression, produced by parser_compile() and evaluated by parser_program_eval(). The structure is opaque to users of the library.
+*/
+typedef struct parser_program parser_program;
+
+/**
+ @brief element types of the columns bound for batch evaluation, see parser_binding
+*/
+#define PARSER_TYPE_DOUBLE 0	/**< double */
+#define PARSER_TYPE_FLOAT  1	/**< float */
+#define PARSER_TYPE_INT32  2	/**< 32 bit signed integer */
+#define PARSER_TYPE_INT64  3	/**< 64 bit signed integer */
+#define PARSER_TYPE_UINT8  4	/**< 8 bit unsigned integer */
+
+/**
+ @brief binds a variable of a compiled program to a column of values for batch evaluation, see parser_batch_eval(). Columns of any PARSER_TYPE_* element type are converted to double a chunk at a time as they are read, so they need not be copied to arrays of doubles first.
+*/
+typedef struct {
+	/** @brief name of the variable */
+	const char   *name;
+
+	/** @brief value of the variable for the first row, of the element type given by type */
+	const void   *data;
+
+	/** @brief distance in bytes between the values of consecutive rows, set to 0 for a contiguous array */
+	size_t        stride;
+
+	/** @brief element type of the column, one of the PARSER_TYPE_* constants, PARSER_TYPE_DOUBLE (zero) for an array of doubles */
+	int           type;
+} parser_binding;
+
+/**
+ @brief data structure for evaluating a compiled program over many rows of variable values, initialize with parser_batch_init()
+*/
+typedef struct {
+	/** @brief program to evaluate */
+	const parser_program *program;
+
+	/** @brief columns holding the values of the program variables */
+	const parser_binding *bindings;
+
+	/** @brief number of entries in bindings */
+	int                   num_bindings;
+
+	/** @brief data pointer that is passed to the variable and function callbacks of the program. Variables without a binding are looked up once per call to parser_batch_eval() through the variable callback. Set to NULL if not used */
+	void                 *user_data;
+
+	/** @brief use the SSE2/AVX2 kernels where available, set to PARSER_TRUE by parser_batch_init(). Set to PARSER_FALSE to force the portable scalar loops, e.g. for benchmarking */
+	int                   simd;
+
+	/** @brief error string of the most recent evaluation, or NULL if it succeeded */
+	const char           *error;
+} parser_batch;
+
+/**
+ @brief aggregates of the values of one expression over the rows of a table, see parser_batch_reduce()
+*/
+typedef struct {
+	/** @brief number of rows that evaluated successfully, which are the rows aggregated */
+	size_t count;
+
+	/** @brief compensated sum of the values */
+	double sum;
+
+	/** @brief sum/count, nan if no row was aggregated */
+	double mean;
+
+	/** @brief smallest and largest value, HUGE_VAL and -HUGE_VAL if no row was aggregated. nan values are ignored */
+	double min;
+	double max;
+} parser_reduction;
+
 /**
  @brief convenience function for using the library, handles initialization and destruction. basically just wraps parser_parse().
  @param[in] expr expression to parse
@@ -181,6 +493,14 @@ void parser_error( parser_data *pd, const char *err );
  @return character that is offset characters from the current input
  */
 char parser_peek( parser_data *pd );
+
+/**
+ @brief looks at an input character n characters past the current one, without consuming any
+ @param[in] pd input parser_data structure to operate on
+ @param[in] n offset of the character relative to the current character
+ @return character that is n characters from the current input
+ */
+char parser_peek_n( parser_data *pd, int n );
 	
 /**
  @brief returns the current character, and advances the input position
@@ -195,6 +515,12 @@ char parser_eat( parser_data *pd );
  */
 void parser_eat_whitespace( parser_data *pd );
 
+/**
+ @brief tokenizes the input from the current position, discarding any tokens read before. parser_data_init() and parser_data_new() tokenize the input, call this after changing the input string or position by hand.
+ @param[in] pd input parser_data structure to operate on
+ */
+void parser_tokenize( parser_data *pd );
+
 /**
  @brief reads and converts a double precision floating point value in one of the many forms,
  e.g. +1.0, -1.0, -1, +1, -1., 1., 0.5, .5, .5e10, .5e-2
@@ -274,6 +600,452 @@ double parser_read_boolean_and( parser_data *pd );
 */
 double parser_read_boolean_or( parser_data *pd );
 
+/**
+ @brief reads a conditional expression 'cond ? a : b' (if found), evaluating only the selected operand
+ @param[in] pd input parser_data structure
+ @return expression value
+*/
+double parser_read_conditional( parser_data *pd );
+
+/**
+ @brief compiles the expression held by a parser_data structure into a program that can be evaluated repeatedly without re-parsing the input.  The grammar is identical to parser_parse(), but variables and user functions are not looked up until the program is evaluated, so the callbacks of pd are stored in the program and no callbacks are made during compilation.
+ @param[inout] pd parser_data structure holding the input string and callbacks, initialized with parser_data_init() or parser_data_new(). On failure pd->error is set.
+ @return newly allocated program on success, NULL on failure. Release with parser_program_free(), or with parser_arena_reset() if it was compiled into pd->arena.
+ */
+parser_program *parser_compile( parser_data *pd );
+
+/**
+ @brief compiles several expressions into a single program with one output per expression.  Variables, literals and common subexpressions are shared between the expressions, so each is evaluated once per evaluation of the program.
+ @param[inout] pd parser_data structure holding the callbacks, user data and registry, initialized with parser_data_init() or parser_data_new(). The input is replaced by each expression in turn. On failure pd->error is set and pd holds the failing expression.
+ @param[in] exprs expressions to compile
+ @param[in] num_exprs number of expressions, at least one
+ @return newly allocated program on success, NULL on failure. Release with parser_program_free(), or with parser_arena_reset() if it was compiled into pd->arena.
+ */
+parser_program *parser_compile_set( parser_data *pd, const char * const *exprs, int num_exprs );
+
+/**
+ @brief evaluates a compiled program. Each distinct variable is looked up once per evaluation through the variable callback, user functions are evaluated through the function callback. Domain errors in built-in functions are reported the same way as by parser_parse(), also when the expression reads a variable that cannot be looked up after the failing function. Programs from parser_compile_set() return the value of their first expression, use parser_program_eval_set() for all of them.
+ @param[in] prog program to evaluate
+ @param[in] user_data pointer passed to the variable and function callbacks, for holding the application state (e.g. variable values) of this evaluation. Set to NULL if unused.
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return expression value, or nan on failure
+ */
+double parser_program_eval( const parser_program *prog, void *user_data, const char **error );
+
+/**
+ @brief evaluates a compiled program with the variable values supplied in an array indexed by variable slot, bypassing the variable callback entirely.  Use parser_program_num_variables() and parser_program_variable_slot() to build the array.
+ @param[in] prog program to evaluate
+ @param[in] slots array of parser_program_num_variables() values, entry i holds the value of the variable named parser_program_variable_name( prog, i )
+ @param[in] user_data pointer passed to the function callback, set to NULL if unused
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return expression value, or nan on failure
+ */
+double parser_program_eval_slots( const parser_program *prog, const double *slots, void *user_data, const char **error );
+
+/**
+ @brief evaluates a compiled program reading each variable through a pointer, indexed by variable slot. Useful when the variable values live in application data structures that are updated in place between evaluations.
+ @param[in] prog program to evaluate
+ @param[in] pointers array of parser_program_num_variables() pointers, entry i points to the value of the variable named parser_program_variable_name( prog, i )
+ @param[in] user_data pointer passed to the function callback, set to NULL if unused
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return expression value, or nan on failure
+ */
+double parser_program_eval_pointers( const parser_program *prog, const double * const *pointers, void *user_data, const char **error );
+
+/**
+ @brief translates a compiled program to native x86-64 machine code, which is then used by parser_program_eval(), parser_program_eval_slots(), parser_program_eval_pointers() and parser_program_eval_set() in place of the interpreter. Results and error reporting are unchanged. Batch evaluation is not affected. Only available on x86-64 platforms using the System V calling convention, unless PARSER_EXCLUDE_JIT is defined.
+ @param[inout] prog compiled program
+ @return PARSER_TRUE on success, PARSER_FALSE if the JIT is not available or executable memory could not be allocated. The program remains usable, and interpreted, on failure.
+ */
+int parser_program_jit( parser_program *prog );
+
+/**
+ @brief evaluates every expression of a program from parser_compile_set() in a single pass, looking up each distinct variable once
+ @param[in] prog program to evaluate
+ @param[in] user_data pointer passed to the variable and function callbacks, set to NULL if unused
+ @param[out] out receives parser_program_num_outputs() values, in the order the expressions were passed to parser_compile_set(). All values are nan on failure
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+ */
+int parser_program_eval_set( const parser_program *prog, void *user_data, double *out, const char **error );
+
+/**
+ @brief evaluates a compiled program in single precision with the variable values supplied in an array indexed by variable slot, like parser_program_eval_slots().  Every operation is computed in float with the float versions of the built-in functions, and booleans use PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT.  Literals are rounded to float, and user and registered functions are called with their arguments converted to double, their result being rounded to float.  Programs translated by parser_program_jit() are interpreted.
+ @param[in] prog program to evaluate
+ @param[in] slots array of parser_program_num_variables() values indexed by variable slot
+ @param[in] user_data pointer passed to the function callback, set to NULL if unused
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return expression value, or nan on failure
+ */
+float parser_program_eval_float( const parser_program *prog, const float *slots, void *user_data, const char **error );
+
+/**
+ @brief evaluates one expression of a compiled program together with its gradient with respect to chosen variables, using a forward pass to compute the value followed by a single reverse sweep over the program (reverse mode automatic differentiation), whatever the number of variables.  Operations that are piecewise constant, i.e. comparisons, boolean operators, abs(), floor(), ceil() and round(), have zero derivative, and a ? b : c is differentiated through the selected operand.  Evaluation fails if the derivative of a user function, or of a registered function without a registered derivative, is needed.
+ @param[in] prog program to evaluate
+ @param[in] slots array of parser_program_num_variables() variable values indexed by variable slot, or NULL to look the variables up through the variable callback
+ @param[in] user_data pointer passed to the callbacks and registered functions, set to NULL if unused
+ @param[in] output index of the expression to differentiate, zero for programs from parser_compile()
+ @param[in] wrt slots of the variables to differentiate with respect to
+ @param[in] num_wrt number of variables to differentiate with respect to
+ @param[out] value receives the value of the expression, nan on failure
+ @param[out] gradient receives num_wrt partial derivatives, in the order of wrt. All nan on failure
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+ */
+int parser_program_eval_gradient( const parser_program *prog, const double *slots, void *user_data, int output, const int *wrt, int num_wrt, double *value, double *gradient, const char **error );
+
+/**
+ @brief evaluates every expression of a compiled program together with its directional derivative along a vector of variable perturbations, using a single forward pass that carries the derivative of every node (forward mode automatic differentiation).  Derivatives are defined as for parser_program_eval_gradient().
+ @param[in] prog program to evaluate
+ @param[in] slots array of parser_program_num_variables() variable values indexed by variable slot, or NULL to look the variables up through the variable callback
+ @param[in] tangents array of parser_program_num_variables() perturbations indexed by variable slot, e.g. one for a single variable and zero for the others to differentiate with respect to that variable
+ @param[in] user_data pointer passed to the callbacks and registered functions, set to NULL if unused
+ @param[out] out receives parser_program_num_outputs() values, nan on failure
+ @param[out] derivatives receives parser_program_num_outputs() directional derivatives, nan on failure
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+ */
+int parser_program_eval_tangent( const parser_program *prog, const double *slots, const double *tangents, void *user_data, double *out, double *derivatives, const char **error );
+
+/**
+ @brief evaluates every expression of a compiled program over intervals of variable values (interval arithmetic), giving for each expression an interval that contains its value for every combination of variable values within the bounds.  Comparisons and boolean operators give [0,0], [1,1] or [0,1] under the PARSER_BOOLEAN_EQUALITY_THRESHOLD semantics.  The intervals are conservative, e.g. x - x over [0,1] gives [-1,1], and operations that may produce nan, such as division by an interval containing zero, give the whole real line.  Rows that fail to evaluate, e.g. with a domain error, are left out of the interval, an empty interval meaning that every row fails.  User functions and impure registered functions are not called and may take any value, pure registered functions are called if all of their arguments are single values.
+ @param[in] prog program to evaluate
+ @param[in] bounds array of parser_program_num_variables() intervals indexed by variable slot, e.g. the minimum and maximum of each column of a block of rows
+ @param[in] user_data pointer passed to the registered functions, set to NULL if unused
+ @param[out] out receives parser_program_num_outputs() intervals, in the order the expressions were passed to parser_compile_set()
+ @param[out] may_fail receives parser_program_num_outputs() flags, PARSER_TRUE if some row within the bounds may fail to evaluate the expression. May be NULL if not needed
+ @return PARSER_TRUE on success, PARSER_FALSE if memory could not be allocated, in which case every interval is the whole real line
+ */
+int parser_program_eval_interval( const parser_program *prog, const parser_interval *bounds, void *user_data, parser_interval *out, int *may_fail );
+
+/**
+ @brief decides whether an expression used as a filter is true for every row, false for every row or neither, given bounds on each variable, see parser_program_eval_interval(). Rows that fail to evaluate produce nan, which is false, so a predicate is only definitely true if no row can fail.
+ @param[in] prog program to evaluate
+ @param[in] bounds array of parser_program_num_variables() intervals indexed by variable slot
+ @param[in] user_data pointer passed to the registered functions, set to NULL if unused
+ @param[in] output index of the expression to test, zero for programs from parser_compile()
+ @return PARSER_PREDICATE_TRUE, PARSER_PREDICATE_FALSE or PARSER_PREDICATE_UNKNOWN, which is also returned on failure
+ */
+int parser_program_eval_predicate( const parser_program *prog, const parser_interval *bounds, void *user_data, int output );
+
+/**
+ @brief returns the number of expressions compiled into a program, one for parser_compile()
+ @param[in] prog compiled program
+ @return number of outputs
+ */
+int parser_program_num_outputs( const parser_program *prog );
+
+/**
+ @brief returns the number of operations removed from a program by common subexpression elimination, i.e. the number of repeated subexpressions that are evaluated only once
+ @param[in] prog compiled program
+ @return number of eliminated nodes
+ */
+int parser_program_num_eliminated( const parser_program *prog );
+
+/**
+ @brief returns the number of operations of a compiled program after optimization, mostly useful for testing and diagnostics
+ @param[in] prog compiled program
+ @return number of nodes
+ */
+int parser_program_num_nodes( const parser_program *prog );
+
+/**
+ @brief returns the number of distinct (free) variables of a compiled program, variables are numbered by slot from zero in order of first appearance in the expression
+ @param[in] prog compiled program
+ @return number of variable slots
+ */
+int parser_program_num_variables( const parser_program *prog );
+
+/**
+ @brief returns the name of the variable bound to a slot
+ @param[in] prog compiled program
+ @param[in] slot variable slot, from zero to parser_program_num_variables()-1
+ @return variable name, or NULL if the slot is out of range. The string is owned by the program.
+ */
+const char *parser_program_variable_name( const parser_program *prog, int slot );
+
+/**
+ @brief returns the slot of a named variable
+ @param[in] prog compiled program
+ @param[in] name variable name
+ @return variable slot, or -1 if the program does not use the variable
+ */
+int parser_program_variable_slot( const parser_program *prog, const char *name );
+
+/**
+ @brief returns the memory used by a compiled program in bytes, including its machine code if it was translated by parser_program_jit()
+ @param[in] prog compiled program
+ @return size of the program in bytes
+ */
+size_t parser_program_size( const parser_program *prog );
+
+/**
+ @brief frees a program returned by parser_compile(). The memory of programs compiled into a parser_arena is only released by parser_arena_reset(), this only releases their machine code.
+ @param[in] prog program to free, may be NULL
+ */
+void parser_program_free( parser_program *prog );
+
+/**
+ @brief initializes an arena that programs can be compiled into by setting parser_data::arena, so that a large set of expressions is compiled without a call to PARSER_MALLOC per array and released at once.  Each program is packed into a single allocation, compilation needs scratch space in the arena beyond the size of the program, which is reused by the next program.  An arena may only be used by one thread at a time.
+ @param[out] arena arena to initialize
+ @param[in] buffer memory that allocations are made from first, e.g. a stack or static array, may be NULL
+ @param[in] size size of the buffer in bytes
+ @param[in] block_size size of the blocks allocated with PARSER_MALLOC once the buffer is full, zero to never allocate, in which case compilation fails when the buffer is full
+ */
+void parser_arena_init( parser_arena *arena, void *buffer, size_t size, size_t block_size );
+
+/**
+ @brief allocates memory from an arena, aligned to PARSER_ARENA_ALIGNMENT
+ @param[inout] arena arena to allocate from
+ @param[in] size number of bytes
+ @return memory on success, NULL if the arena is full and may not allocate another block. The memory is released by parser_arena_reset().
+ */
+void *parser_arena_alloc( parser_arena *arena, size_t size );
+
+/**
+ @brief releases every program compiled into an arena and all other memory allocated from it, in time independent of the number of programs.  Programs translated by parser_program_jit() must be freed with parser_program_free() first.  The arena may be used again.
+ @param[inout] arena arena to reset
+ */
+void parser_arena_reset( parser_arena *arena );
+
+/**
+ @brief returns the number of bytes allocated from an arena, e.g. by the programs compiled into it
+ @param[in] arena arena to query
+ @return bytes in use
+ */
+size_t parser_arena_used( const parser_arena *arena );
+
+/**
+ @brief allocates a new, empty function registry
+ @return registry on success, NULL on failure. Release with parser_registry_free().
+ */
+parser_registry *parser_registry_new( void );
+
+/**
+ @brief frees a registry returned by parser_registry_new(). Programs compiled with the registry remain valid.
+ @param[in] reg registry to free, may be NULL
+ */
+void parser_registry_free( parser_registry *reg );
+
+/**
+ @brief registers a native function, replacing any function previously registered under the same name. Built-in functions can not be replaced.
+ @param[inout] reg registry to add the function to
+ @param[in] name name of the function as used in expressions, copied by the registry
+ @param[in] fn function to call
+ @param[in] min_args minimum number of arguments
+ @param[in] max_args maximum number of arguments, at most PARSER_MAX_ARGUMENT_COUNT. Set equal to min_args for a fixed number of arguments
+ @param[in] flags zero or PARSER_FUNCTION_PURE
+ @return PARSER_TRUE on success, PARSER_FALSE if the arguments are invalid or memory could not be allocated
+ */
+int parser_registry_add( parser_registry *reg, const char *name, parser_native_function fn, int min_args, int max_args, int flags );
+
+/**
+ @brief registers the derivative of a registered function, so that parser_program_eval_gradient() and friends can differentiate programs calling it. Programs copy the derivative when they are compiled or loaded. Registering the function again with parser_registry_add() removes its derivative.
+ @param[inout] reg registry holding the function
+ @param[in] name name of the function
+ @param[in] derivative function returning the partial derivatives, NULL to remove the derivative
+ @return PARSER_TRUE on success, PARSER_FALSE if no function of that name is registered
+ */
+int parser_registry_add_derivative( parser_registry *reg, const char *name, parser_native_derivative derivative );
+
+/**
+ @brief initializes a parser_batch structure, e.g. one on the stack. The program and bindings are referenced, not copied, and must remain valid while the structure is used.
+ @param[inout] pb parser_batch structure to initialize
+ @param[in] prog compiled program to evaluate
+ @param[in] bindings array of variable bindings, may be NULL if num_bindings is zero
+ @param[in] num_bindings number of variable bindings
+ @param[in] user_data pointer passed to the program callbacks, set to NULL if not needed
+ @return true if initialization was successful, false otherwise
+ */
+int parser_batch_init( parser_batch *pb, const parser_program *prog, const parser_binding *bindings, int num_bindings, void *user_data );
+
+/**
+ @brief evaluates the program of a parser_batch structure for num_rows rows of bound variable values, writing one result per row.  Rows are processed in chunks of PARSER_BATCH_CHUNK_SIZE, applying each operation of the program to the whole chunk at a time.  Rows that fail to evaluate, e.g. due to a domain error in a built-in function, produce nan and the error is reported in pb->error. Programs from parser_compile_set() produce the values of their first expression.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] out array of num_rows results
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval( parser_batch *pb, size_t num_rows, double *out );
+
+/**
+ @brief evaluates every expression of a program from parser_compile_set() for num_rows rows of bound variable values in a single pass over the rows, like parser_batch_eval(). Each output is written to its own column, rows that fail to evaluate produce nan in every column.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] outs parser_program_num_outputs() arrays of num_rows results, in the order the expressions were passed to parser_compile_set()
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_set( parser_batch *pb, size_t num_rows, double * const *outs );
+
+/**
+ @brief evaluates the program of a parser_batch structure for num_rows rows of bound variable values in single precision, like parser_batch_eval() but computing in float as parser_program_eval_float() does.  Registers hold floats, so the SIMD kernels process twice as many rows per instruction, and bound columns of any type are converted to float as they are read.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] out array of num_rows results
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_float( parser_batch *pb, size_t num_rows, float *out );
+
+/**
+ @brief evaluates the program of a parser_batch structure as a filter predicate for num_rows rows of bound variable values, setting bit r%8 of byte r/8 of a packed bitmap for each row r whose result is true, i.e. at least PARSER_BOOLEAN_EQUALITY_THRESHOLD in magnitude as for the boolean operators, so results closer to zero are not selected.  The result of each chunk is tested while it is still in cache rather than written to a column of doubles, and the operands of && and || are only evaluated for the rows whose result they can still change.  Rows that fail to evaluate are not selected and the error is reported in pb->error.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] bitmap array of (num_rows+7)/8 bytes, cleared before the selected rows are set
+ @param[out] num_selected number of selected rows, may be NULL
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_bitmap( parser_batch *pb, size_t num_rows, unsigned char *bitmap, size_t *num_selected );
+
+/**
+ @brief evaluates the program of a parser_batch structure as a filter predicate like parser_batch_eval_bitmap(), writing the indices of the selected rows in increasing order instead of a bitmap
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] selection array of up to num_rows row indices
+ @param[out] num_selected number of selected rows written to selection
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_selection( parser_batch *pb, size_t num_rows, size_t *selection, size_t *num_selected );
+
+/**
+ @brief evaluates one expression of the program of a parser_batch structure together with its gradient with respect to chosen variables for num_rows rows of bound variable values, see parser_program_eval_gradient(). Variables are bound as for parser_batch_eval() and differentiated with respect to whether or not they are bound. Rows that fail to evaluate produce nan and the error is reported in pb->error.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[in] output index of the expression to differentiate, zero for programs from parser_compile()
+ @param[in] wrt slots of the variables to differentiate with respect to
+ @param[in] num_wrt number of variables to differentiate with respect to
+ @param[out] out array of num_rows values
+ @param[out] gradients num_wrt arrays of num_rows partial derivatives, in the order of wrt
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_gradient( parser_batch *pb, size_t num_rows, int output, const int *wrt, int num_wrt, double *out, double * const *gradients );
+
+/**
+ @brief creates a pool of threads for parallel batch evaluation. Threads wait for work and consume no processor time between evaluations, so a pool is meant to be created once and reused.
+ @param[in] num_threads number of threads evaluating rows, including the thread calling parser_batch_eval_parallel(), or zero for one per online processor. Always one if the library was built with PARSER_EXCLUDE_THREADS or threads are not supported on the platform.
+ @return pool on success, NULL on failure. Release with parser_pool_free().
+ */
+parser_pool *parser_pool_new( int num_threads );
+
+/**
+ @brief stops the threads of a pool and frees it, no evaluation may be running
+ @param[in] pool pool to free, may be NULL
+ */
+void parser_pool_free( parser_pool *pool );
+
+/**
+ @brief evaluates the program of a parser_batch structure like parser_batch_eval(), splitting the rows into tasks of PARSER_PARALLEL_TASK_CHUNKS chunks that are run by the threads of a pool with work stealing.  The program and the variable bindings are shared, each thread has its own evaluation scratch space.  Variables without a binding are still looked up once, from the calling thread, but user and native functions are called from every thread of the pool and must be thread safe.  Results, including the reported error, are identical to parser_batch_eval().
+ @param[inout] pb initialized parser_batch structure
+ @param[in] pool thread pool from parser_pool_new(), NULL to evaluate on the calling thread only
+ @param[in] num_rows number of rows to evaluate
+ @param[out] out num_rows results
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, double *out );
+
+/**
+ @brief evaluates every expression of a program from parser_compile_set() like parser_batch_eval_set(), sharing the rows between the threads of a pool like parser_batch_eval_parallel()
+ @param[inout] pb initialized parser_batch structure
+ @param[in] pool thread pool from parser_pool_new(), NULL to evaluate on the calling thread only
+ @param[in] num_rows number of rows to evaluate
+ @param[out] outs parser_program_num_outputs() arrays of num_rows results
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_eval_set_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, double * const *outs );
+
+/**
+ @brief computes the count, sum, mean, minimum and maximum of each expression of the program of a parser_batch structure over num_rows rows of bound variable values, without writing the values to memory.  Each chunk of results is added to the aggregates while it is still in cache.  Sums use compensated (Kahan-Neumaier) summation over tasks of PARSER_PARALLEL_TASK_CHUNKS chunks that are merged in row order, so the results are accurate and identical to those of parser_batch_reduce_parallel() with any number of threads.  Rows that fail to evaluate are left out of the aggregates and the error is reported in pb->error.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] num_rows number of rows to evaluate
+ @param[out] out parser_program_num_outputs() aggregates, one for programs from parser_compile()
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_reduce( parser_batch *pb, size_t num_rows, parser_reduction *out );
+
+/**
+ @brief computes the aggregates of parser_batch_reduce(), sharing the rows between the threads of a pool like parser_batch_eval_parallel().  Every task is aggregated separately and the tasks are merged in row order, so the results are identical to parser_batch_reduce() whatever the number of threads.
+ @param[inout] pb initialized parser_batch structure
+ @param[in] pool thread pool from parser_pool_new(), NULL to evaluate on the calling thread only
+ @param[in] num_rows number of rows to evaluate
+ @param[out] out parser_program_num_outputs() aggregates
+ @return PARSER_TRUE if every row evaluated successfully, PARSER_FALSE otherwise
+ */
+int parser_batch_reduce_parallel( parser_batch *pb, parser_pool *pool, size_t num_rows, parser_reduction *out );
+
+/**
+ @brief writes a compiled program as a binary image that parser_program_load() can use in place, e.g. to store the programs of a rule set in a file rather than parsing the expressions at every start. Images may be concatenated, they are padded to a multiple of 8 bytes. The machine code of the JIT is not saved.
+ @param[in] prog program to save
+ @param[out] buffer receives the image, may be NULL to query the size
+ @param[in] size size of buffer in bytes
+ @return size of the image in bytes. Nothing is written if it is larger than size.
+ */
+size_t parser_program_save( const parser_program *prog, void *buffer, size_t size );
+
+/**
+ @brief returns the size of the image at the start of a buffer, e.g. to step through concatenated images. The image is not validated.
+ @param[in] data image written by parser_program_save()
+ @param[in] size size of the buffer in bytes
+ @return size of the image in bytes, zero if data does not start with an image header or the image is larger than size
+ */
+size_t parser_program_image_size( const void *data, size_t size );
+
+/**
+ @brief loads a program from an image written by parser_program_save().  The nodes and names of the program are used in place, not copied, so loading is a validation of the image and a few small allocations, and the image must not be modified or released until the program is freed.  The checksum of the image and every index in it are checked, corrupt images are rejected.  Native functions are looked up by name in a registry and must accept the number of arguments of every call.
+ @param[in] data image, aligned to 8 bytes, e.g. from parser_image_map() or malloc()
+ @param[in] size size of the buffer in bytes, may be larger than the image
+ @param[in] variable_cb variable callback of the program, as for parser_compile()
+ @param[in] function_cb function callback of the program, as for parser_compile()
+ @param[in] reg registry of the native functions called by the program, may be NULL if it calls none
+ @param[out] error set to the error string on failure and to NULL on success, may be NULL if not needed
+ @return loaded program on success, NULL on failure. Release with parser_program_free().
+ */
+parser_program *parser_program_load( const void *data, size_t size, parser_variable_callback variable_cb, parser_function_callback function_cb, const parser_registry *reg, const char **error );
+
+/**
+ @brief maps a file of program images read-only into memory, with mmap() where available, so images can be loaded from it without reading the whole file
+ @param[in] filename file to map
+ @param[out] size receives the size of the file in bytes
+ @return start of the mapping, NULL on failure. Release with parser_image_unmap() once every program loaded from it has been freed.
+ */
+void *parser_image_map( const char *filename, size_t *size );
+
+/**
+ @brief releases a mapping from parser_image_map()
+ @param[in] data start of the mapping, may be NULL
+ @param[in] size size of the mapping
+ */
+void parser_image_unmap( void *data, size_t size );
+
+/**
+ @brief creates a cache of compiled programs for parse_expression_with_cache(). The cache may be shared by any number of threads.
+ @param[in] max_bytes memory budget of the cache in bytes, least recently used programs are evicted to stay within it. The budget is split evenly between PARSER_CACHE_SHARDS shards.
+ @return cache on success, NULL on failure. Release with parser_cache_free().
+ */
+parser_cache *parser_cache_new( size_t max_bytes );
+
+/**
+ @brief frees a cache and the programs it holds, no thread may be using it
+ @param[in] cache cache to free, may be NULL
+ */
+void parser_cache_free( parser_cache *cache );
+
+/**
+ @brief evaluates an expression like parse_expression_with_callbacks(), but through a program compiled once per distinct expression text and pair of callbacks and kept in a cache, so that repeated expressions are not parsed again.  Results are those of parser_program_eval(), which match parser_parse().  Expressions that fail to compile are parsed every time, to report the error, and are not cached.
+ @param[inout] cache cache from parser_cache_new(), NULL to parse without caching
+ @param[in] expr expression to evaluate
+ @param[in] variable_cb variable callback, may be NULL
+ @param[in] function_cb function callback, may be NULL
+ @param[in] user_data pointer passed to the callbacks
+ @return value of the expression, nan on failure
+ */
+double parse_expression_with_cache( parser_cache *cache, const char *expr, parser_variable_callback variable_cb, parser_function_callback function_cb, void *user_data );
+
+/**
+ @brief reads the counters of a cache, e.g. to monitor its hit rate
+ @param[in] cache cache to query
+ @param[out] stats receives the counters, summed over the shards
+ */
+void parser_cache_get_stats( parser_cache *cache, parser_cache_stats *stats );
+
 #ifdef __cplusplus
 };
 #endif
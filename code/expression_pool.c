@@ -0,0 +1,297 @@
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_pool.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief work-stealing thread pool for parallel batch evaluation, see expression_parser.h for more information and license terms.
+
+ A job is a range of independent tasks, numbered from zero.  Every thread of the pool, including the calling thread, starts with an equal contiguous share of the tasks in its own queue and takes tasks from the front of it.  A thread whose queue runs dry steals the back half of the queue of another thread, so threads that finish early, or are descheduled, balance out without any central queue.  Tasks are never created during a job, so a thread is done once it finds every queue empty.  Define PARSER_EXCLUDE_THREADS to build without threads, in which case the calling thread runs every task.
+*/
+
+#include"expression_internal.h"
+
+#if !defined(PARSER_EXCLUDE_THREADS) && !defined(_WIN32)
+#define PARSER_POOL_PTHREADS
+#include<pthread.h>
+#include<unistd.h>
+#endif
+
+/**
+ @brief task queue of one thread, the range of tasks [begin,end). Padded to a cache line so threads do not contend for each other's queues.
+*/
+typedef struct {
+#if defined(PARSER_POOL_PTHREADS)
+	pthread_mutex_t lock;
+#endif
+	size_t          begin;
+	size_t          end;
+	char            padding[64];
+} parser_pool_queue;
+
+struct parser_pool {
+	/** @brief number of threads running tasks, including the calling thread */
+	int                num_threads;
+
+	/** @brief one task queue per thread */
+	parser_pool_queue *queues;
+
+	/** @brief task function and context of the current job */
+	parser_pool_task   task;
+	void              *context;
+
+#if defined(PARSER_POOL_PTHREADS)
+	/** @brief worker threads, num_threads-1 of them */
+	pthread_t         *threads;
+
+	/** @brief serializes jobs submitted from different threads */
+	pthread_mutex_t    busy;
+
+	/** @brief protects generation, running and quit */
+	pthread_mutex_t    lock;
+	pthread_cond_t     start;
+	pthread_cond_t     done;
+
+	/** @brief incremented for every job, workers wait for it to change */
+	int                generation;
+
+	/** @brief number of workers still running the current job */
+	int                running;
+
+	/** @brief set to make the workers exit */
+	int                quit;
+
+	/** @brief number of worker threads started */
+	int                num_started;
+#endif
+};
+
+/**
+ @brief takes the next task from the queue of a thread, stealing half of another queue when it is empty
+ @return PARSER_TRUE with the task index in task, PARSER_FALSE once every queue is empty
+*/
+static int parser_pool_next( parser_pool *pool, int thread, size_t *task ){
+	parser_pool_queue *own = pool->queues+thread, *victim;
+	size_t mid = 0, end = 0;
+	int i, found = PARSER_FALSE, stolen = PARSER_FALSE;
+
+#if defined(PARSER_POOL_PTHREADS)
+	pthread_mutex_lock( &own->lock );
+#endif
+	if( own->begin < own->end ){
+		*task = own->begin++;
+		found = PARSER_TRUE;
+	}
+#if defined(PARSER_POOL_PTHREADS)
+	pthread_mutex_unlock( &own->lock );
+#endif
+
+	// steal the back half of the first non-empty queue, starting from the next thread
+	for( i=1; i<pool->num_threads && !found && !stolen; i++ ){
+		victim = pool->queues + (thread+i) % pool->num_threads;
+#if defined(PARSER_POOL_PTHREADS)
+		pthread_mutex_lock( &victim->lock );
+#endif
+		if( victim->begin < victim->end ){
+			mid = victim->begin + (victim->end - victim->begin)/2;
+			end = victim->end;
+			victim->end = mid;
+			stolen = PARSER_TRUE;
+		}
+#if defined(PARSER_POOL_PTHREADS)
+		pthread_mutex_unlock( &victim->lock );
+#endif
+	}
+
+	// the stolen range is moved to the own queue after releasing the victim,
+	// holding both locks could deadlock two threads stealing from each other
+	if( stolen ){
+		*task = mid;
+#if defined(PARSER_POOL_PTHREADS)
+		pthread_mutex_lock( &own->lock );
+#endif
+		own->begin = mid+1;
+		own->end   = end;
+#if defined(PARSER_POOL_PTHREADS)
+		pthread_mutex_unlock( &own->lock );
+#endif
+	}
+	return found || stolen;
+}
+
+/**
+ @brief runs tasks of the current job on a thread until every queue is empty
+*/
+static void parser_pool_work( parser_pool *pool, int thread ){
+	size_t task;
+	while( parser_pool_next( pool, thread, &task ) )
+		pool->task( pool->context, thread, task );
+}
+
+#if defined(PARSER_POOL_PTHREADS)
+/**
+ @brief argument of a worker thread
+*/
+typedef struct {
+	parser_pool *pool;
+	int          thread;
+} parser_pool_worker;
+
+/**
+ @brief main function of the worker threads, waits for jobs and runs them until the pool is freed
+*/
+static void *parser_pool_main( void *arg ){
+	parser_pool_worker *worker = (parser_pool_worker*)arg;
+	parser_pool *pool = worker->pool;
+	int thread = worker->thread, generation = 0;
+
+	PARSER_FREE( worker );
+	pthread_mutex_lock( &pool->lock );
+	for( ;; ){
+		while( !pool->quit && pool->generation == generation )
+			pthread_cond_wait( &pool->start, &pool->lock );
+		if( pool->quit )
+			break;
+		generation = pool->generation;
+		pthread_mutex_unlock( &pool->lock );
+
+		parser_pool_work( pool, thread );
+
+		pthread_mutex_lock( &pool->lock );
+		if( --pool->running == 0 )
+			pthread_cond_signal( &pool->done );
+	}
+	pthread_mutex_unlock( &pool->lock );
+	return NULL;
+}
+#endif
+
+parser_pool *parser_pool_new( int num_threads ){
+	parser_pool *pool;
+	int i;
+#if defined(PARSER_POOL_PTHREADS)
+	parser_pool_worker *worker;
+	long num_cpus;
+
+	if( num_threads <= 0 ){
+		num_cpus = sysconf( _SC_NPROCESSORS_ONLN );
+		num_threads = num_cpus > 0 ? (int)num_cpus : 1;
+	}
+#else
+	num_threads = 1;
+#endif
+
+	pool = PARSER_CALLOC( 1, sizeof(parser_pool) );
+	if( !pool )
+		return NULL;
+	pool->num_threads = num_threads;
+	pool->queues = PARSER_CALLOC( num_threads, sizeof(parser_pool_queue) );
+	if( !pool->queues ){
+		PARSER_FREE( pool );
+		return NULL;
+	}
+
+#if defined(PARSER_POOL_PTHREADS)
+	pool->threads = PARSER_CALLOC( num_threads, sizeof(pthread_t) );
+	if( !pool->threads ){
+		PARSER_FREE( pool->queues );
+		PARSER_FREE( pool );
+		return NULL;
+	}
+	for( i=0; i<num_threads; i++ )
+		pthread_mutex_init( &pool->queues[i].lock, NULL );
+	pthread_mutex_init( &pool->busy, NULL );
+	pthread_mutex_init( &pool->lock, NULL );
+	pthread_cond_init( &pool->start, NULL );
+	pthread_cond_init( &pool->done, NULL );
+
+	// the calling thread is thread zero, start the others
+	for( i=1; i<num_threads; i++ ){
+		worker = PARSER_MALLOC( sizeof(parser_pool_worker) );
+		if( !worker )
+			break;
+		worker->pool   = pool;
+		worker->thread = i;
+		if( pthread_create( pool->threads+pool->num_started, NULL, parser_pool_main, worker ) != 0 ){
+			PARSER_FREE( worker );
+			break;
+		}
+		pool->num_started++;
+	}
+	if( pool->num_started < num_threads-1 ){
+		parser_pool_free( pool );
+		return NULL;
+	}
+#else
+	(void)i;
+#endif
+	return pool;
+}
+
+void parser_pool_free( parser_pool *pool ){
+#if defined(PARSER_POOL_PTHREADS)
+	int i;
+#endif
+	if( !pool )
+		return;
+#if defined(PARSER_POOL_PTHREADS)
+	pthread_mutex_lock( &pool->lock );
+	pool->quit = PARSER_TRUE;
+	pthread_cond_broadcast( &pool->start );
+	pthread_mutex_unlock( &pool->lock );
+	for( i=0; i<pool->num_started; i++ )
+		pthread_join( pool->threads[i], NULL );
+
+	for( i=0; i<pool->num_threads; i++ )
+		pthread_mutex_destroy( &pool->queues[i].lock );
+	pthread_mutex_destroy( &pool->busy );
+	pthread_mutex_destroy( &pool->lock );
+	pthread_cond_destroy( &pool->start );
+	pthread_cond_destroy( &pool->done );
+	PARSER_FREE( pool->threads );
+#endif
+	PARSER_FREE( pool->queues );
+	PARSER_FREE( pool );
+}
+
+int parser_pool_num_threads( const parser_pool *pool ){
+	return pool->num_threads;
+}
+
+void parser_pool_run( parser_pool *pool, size_t num_tasks, parser_pool_task task, void *context ){
+	int i;
+
+#if defined(PARSER_POOL_PTHREADS)
+	pthread_mutex_lock( &pool->busy );
+#endif
+	pool->task    = task;
+	pool->context = context;
+
+	// equal contiguous shares, so tasks of neighbouring rows stay on one thread
+	for( i=0; i<pool->num_threads; i++ ){
+		pool->queues[i].begin = num_tasks*i/pool->num_threads;
+		pool->queues[i].end   = num_tasks*(i+1)/pool->num_threads;
+	}
+
+#if defined(PARSER_POOL_PTHREADS)
+	if( pool->num_threads > 1 ){
+		pthread_mutex_lock( &pool->lock );
+		pool->running = pool->num_threads-1;
+		pool->generation++;
+		pthread_cond_broadcast( &pool->start );
+		pthread_mutex_unlock( &pool->lock );
+	}
+#endif
+
+	parser_pool_work( pool, 0 );
+
+#if defined(PARSER_POOL_PTHREADS)
+	if( pool->num_threads > 1 ){
+		pthread_mutex_lock( &pool->lock );
+		while( pool->running > 0 )
+			pthread_cond_wait( &pool->done, &pool->lock );
+		pthread_mutex_unlock( &pool->lock );
+	}
+	pthread_mutex_unlock( &pool->busy );
+#endif
+}
@@ -0,0 +1,1080 @@
+#include<math.h>
+#include<stdio.h>
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_program.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief compilation of expressions to programs and evaluation of compiled programs, see expression_parser.h for more information and license terms.
+
+ The compiler follows the same grammar as the parser in expression_parser.c, with the same precedence climbing and recursive descent implementations, but rather than evaluating as it reads the input, each grammar rule appends nodes to a post-order node array.  Evaluating a program is then a single forward scan over that array with no string handling at all.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief state of the compiler, the input and error handling are managed by the parser_data structure as for parser_parse()
+*/
+typedef struct {
+	parser_data    *pd;
+	parser_program *prog;
+} parser_compiler;
+
+int parser_op_arity( int op ){
+	switch( op ){
+		case PARSER_OP_CONST:
+		case PARSER_OP_VAR:
+		case PARSER_OP_CALL:
+		case PARSER_OP_NATIVE:
+			return 0;
+		case PARSER_OP_ADD:
+		case PARSER_OP_SUB:
+		case PARSER_OP_MUL:
+		case PARSER_OP_DIV:
+		case PARSER_OP_POW:
+		case PARSER_OP_LT:
+		case PARSER_OP_LE:
+		case PARSER_OP_GT:
+		case PARSER_OP_GE:
+		case PARSER_OP_EQ:
+		case PARSER_OP_NE:
+		case PARSER_OP_AND:
+		case PARSER_OP_OR:
+		case PARSER_OP_ATAN2:
+			return 2;
+		case PARSER_OP_SELECT:
+			return 3;
+		case PARSER_OP_JUMP:
+			return 0;
+		default:
+			return 1;
+	}
+}
+
+/**
+ @brief makes a copy of a string, since strdup() is not part of C89, from the arena of the program if it has one, bailing on allocation failure
+*/
+static char *parser_compile_string( parser_compiler *pc, const char *str ){
+	size_t len = strlen( str );
+	char *copy = pc->prog->arena ? parser_arena_alloc( pc->prog->arena, len+1 ) : PARSER_MALLOC( len+1 );
+	if( !copy )
+		parser_error( pc->pd, "Out of memory while compiling expression!" );
+	memcpy( copy, str, len+1 );
+	return copy;
+}
+
+int parser_program_reserve( parser_program *prog, void **array, int *max, int count, size_t size ){
+	void *tmp;
+	int new_max;
+	if( count <= *max )
+		return PARSER_TRUE;
+	for( new_max = *max ? 2*(*max) : 16; new_max < count; new_max *= 2 );
+	if( prog->arena )
+		tmp = parser_arena_realloc( prog->arena, *array, (*max)*size, new_max*size );
+	else
+		tmp = PARSER_REALLOC( *array, new_max*size );
+	if( !tmp )
+		return PARSER_FALSE;
+	*array = tmp;
+	*max = new_max;
+	return PARSER_TRUE;
+}
+
+/**
+ @brief grows an array so that it can hold at least one more entry, bailing on allocation failure
+*/
+static void parser_compile_reserve( parser_compiler *pc, void **array, int *max, int count, size_t size ){
+	if( !parser_program_reserve( pc->prog, array, max, count+1, size ) )
+		parser_error( pc->pd, "Out of memory while compiling expression!" );
+}
+
+/**
+ @brief appends a node to the program under construction, literal values go to the constants pool
+ @return index of the new node
+*/
+static int parser_compile_emit( parser_compiler *pc, int op, int a, int b, int c, double value ){
+	parser_program *prog = pc->prog;
+	parser_node *node;
+	int max;
+
+	// the operations and operands grow together
+	max = prog->max_nodes;
+	parser_compile_reserve( pc, (void**)&prog->ops, &max, prog->num_nodes, 1 );
+	parser_compile_reserve( pc, (void**)&prog->nodes, &prog->max_nodes, prog->num_nodes, sizeof(parser_node) );
+	if( op == PARSER_OP_CONST ){
+		parser_compile_reserve( pc, (void**)&prog->constants, &prog->max_constants, prog->num_constants, sizeof(double) );
+		prog->constants[prog->num_constants] = value;
+		a = prog->num_constants++;
+	}
+	prog->ops[prog->num_nodes] = (unsigned char)op;
+	node = prog->nodes + prog->num_nodes;
+	node->a = a;
+	node->b = b;
+	node->c = c;
+	return prog->num_nodes++;
+}
+
+/**
+ @brief sets the target of a jump node emitted before the nodes it skips
+ @param[in] jump index of the jump node
+ @param[in] target index of the node to continue at
+ @param[in] lazy index of the lazy operation node that the jump belongs to
+*/
+static void parser_compile_patch( parser_compiler *pc, int jump, int target, int lazy ){
+	pc->prog->nodes[jump].b = target;
+	pc->prog->nodes[jump].c = lazy;
+}
+
+/**
+ @brief looks up a name in a name table, adding it if not present
+ @return index of the name in the table
+*/
+static int parser_compile_intern( parser_compiler *pc, char ***names, int *num, int *max, const char *name ){
+	int i;
+	for( i=0; i<*num; i++ ){
+		if( strcmp( (*names)[i], name ) == 0 )
+			return i;
+	}
+	parser_compile_reserve( pc, (void**)names, max, *num, sizeof(char*) );
+	(*names)[*num] = parser_compile_string( pc, name );
+	return (*num)++;
+}
+
+static int parser_compile_conditional( parser_compiler *pc );
+static int parser_compile_expr( parser_compiler *pc );
+static int parser_compile_binary( parser_compiler *pc, int precedence );
+
+/**
+ @brief compiles an argument of a function call with the grammar selected by parser_data::recursive_descent
+*/
+static int parser_compile_subexpression( parser_compiler *pc ){
+	return pc->pd->recursive_descent ? parser_compile_expr( pc ) : parser_compile_binary( pc, PARSER_PRECEDENCE_ADD );
+}
+
+/**
+ @brief compiles a single argument of a built-in function, see parser_read_argument()
+*/
+static int parser_compile_argument( parser_compiler *pc ){
+	int n = parser_compile_subexpression( pc );
+	if( PARSER_TOKEN_TYPE( pc->pd ) == PARSER_TOKEN_COMMA )
+		parser_token_next( pc->pd );
+	return n;
+}
+
+/**
+ @brief compiles the argument list of a user function call, see parser_read_argument_list()
+ @return number of arguments, the argument node indices are stored in args
+*/
+static int parser_compile_argument_list( parser_compiler *pc, int *args ){
+	parser_data *pd = pc->pd;
+	int num_args = 0, type;
+
+	while( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN ){
+		if( num_args >= PARSER_MAX_ARGUMENT_COUNT )
+			parser_error( pd, "Exceeded maximum argument count for function call, increase PARSER_MAX_ARGUMENT_COUNT and recompile!" );
+		args[num_args++] = parser_compile_subexpression( pc );
+		type = PARSER_TOKEN_TYPE( pd );
+		if( type == PARSER_TOKEN_RPAREN ){
+			break;
+		} else if( type == PARSER_TOKEN_COMMA ){
+			parser_token_next( pd );
+		} else {
+			parser_error( pd, "Expected ')' or ',' in function argument list!" );
+		}
+	}
+	return num_args;
+}
+
+/**
+ @brief appends the argument node indices of a function call to the program argument list
+*/
+static void parser_compile_push_args( parser_compiler *pc, int num_args, const int *args ){
+	parser_program *prog = pc->prog;
+	int i;
+	for( i=0; i<num_args; i++ ){
+		parser_compile_reserve( pc, (void**)&prog->args, &prog->max_args, prog->num_args, sizeof(int) );
+		prog->args[prog->num_args++] = args[i];
+	}
+}
+
+/**
+ @brief compiles a call of a registered native function, copying its registry entry into the program
+ @return index of the node holding the result of the call
+*/
+static int parser_compile_native( parser_compiler *pc, const parser_native *native, int num_args, const int *args ){
+	parser_program *prog = pc->prog;
+	int i;
+
+	if( num_args < native->min_args || num_args > native->max_args )
+		parser_error( pc->pd, "Wrong number of arguments in function call!" );
+
+	// copy the registry entry so the program does not depend on the registry
+	for( i=0; i<prog->num_natives; i++ ){
+		if( strcmp( prog->natives[i].name, native->name ) == 0 )
+			break;
+	}
+	if( i == prog->num_natives ){
+		parser_compile_reserve( pc, (void**)&prog->natives, &prog->max_natives, prog->num_natives, sizeof(parser_native) );
+		prog->natives[i] = *native;
+		prog->natives[i].name = parser_compile_string( pc, native->name );
+		prog->num_natives++;
+	}
+	parser_compile_push_args( pc, num_args, args );
+	return parser_compile_emit( pc, PARSER_OP_NATIVE, prog->num_args-num_args, num_args, i, 0.0 );
+}
+
+/**
+ @brief compiles built-in and user function calls, variables and literals, see parser_read_builtin()
+*/
+static int parser_compile_builtin( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	parser_program *prog = pc->prog;
+	char token[PARSER_MAX_TOKEN_SIZE];
+	int i, n, op, num_args, args[PARSER_MAX_ARGUMENT_COUNT], pos, end;
+	const parser_native *native;
+
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_IDENTIFIER ){
+		pos = parser_token_name( pd, token );
+		end = PARSER_TOKEN( pd )->pos + pos;
+		parser_token_next( pd );
+
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN && PARSER_TOKEN( pd )->pos == end ){
+			parser_token_next( pd );
+
+			op = parser_builtin_lookup( token, pos, &num_args );
+			if( op >= 0 ){
+				// built-in functions read a fixed number of arguments
+				// with optional separating commas, as the parser does
+				args[0] = parser_compile_argument( pc );
+				args[1] = num_args > 1 ? parser_compile_argument( pc ) : -1;
+				n = parser_compile_emit( pc, op, args[0], args[1], 0, 0.0 );
+			} else {
+				num_args = parser_compile_argument_list( pc, args );
+				native = pd->registry ? parser_registry_find( pd->registry, token ) : NULL;
+				if( native ){
+					n = parser_compile_native( pc, native, num_args, args );
+				} else {
+					// user function, store the argument node indices and the
+					// function name, the callback is made at evaluation time
+					parser_compile_push_args( pc, num_args, args );
+					i = parser_compile_intern( pc, &prog->functions, &prog->num_functions, &prog->max_functions, token );
+					n = parser_compile_emit( pc, PARSER_OP_CALL, prog->num_args-num_args, num_args, i, 0.0 );
+				}
+			}
+
+			if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
+				parser_error( pd, "Expected ')' in built-in call!" );
+			parser_token_next( pd );
+		} else {
+			// variable, resolved to a slot that is filled once per evaluation
+			i = parser_compile_intern( pc, &prog->variables, &prog->num_variables, &prog->max_variables, token );
+			n = parser_compile_emit( pc, PARSER_OP_VAR, i, 0, 0, 0.0 );
+		}
+	} else {
+		n = parser_compile_emit( pc, PARSER_OP_CONST, 0, 0, 0, parser_token_number( pd ) );
+	}
+	return n;
+}
+
+/**
+ @brief compiles a parenthetical expression or a builtin, see parser_read_paren()
+*/
+static int parser_compile_paren( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n;
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN ){
+		parser_token_next( pd );
+		n = parser_compile_conditional( pc );
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
+			parser_error( pd, "Expected ')'!" );
+		parser_token_next( pd );
+	} else {
+		n = parser_compile_builtin( pc );
+	}
+	return n;
+}
+
+/**
+ @brief compiles unary operations, see parser_read_unary()
+*/
+static int parser_compile_unary( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int type = PARSER_TOKEN_TYPE( pd ), n = -1;
+	if( type == PARSER_TOKEN_NOT ){
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		parser_token_next( pd );
+		n = parser_compile_paren( pc );
+		n = parser_compile_emit( pc, PARSER_OP_NOT, n, 0, 0, 0.0 );
+#else
+		parser_error( pd, "Expected '+' or '-' for unary expression, got '!'" );
+#endif
+	} else if( type == PARSER_TOKEN_MINUS ){
+		parser_token_next( pd );
+		n = parser_compile_paren( pc );
+		n = parser_compile_emit( pc, PARSER_OP_NEG, n, 0, 0, 0.0 );
+	} else if( type == PARSER_TOKEN_PLUS ){
+		parser_token_next( pd );
+		n = parser_compile_paren( pc );
+	} else {
+		n = parser_compile_paren( pc );
+	}
+	return n;
+}
+
+/**
+ @brief compiles (right-associative) exponentiation, see parser_read_power()
+*/
+static int parser_compile_power( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, negate = 0;
+
+	n0 = parser_compile_unary( pc );
+	while( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_CARET ){
+		parser_token_next( pd );
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_MINUS ){
+			parser_token_next( pd );
+			negate = 1;
+		}
+		n1 = parser_compile_power( pc );
+		if( negate )
+			n1 = parser_compile_emit( pc, PARSER_OP_NEG, n1, 0, 0, 0.0 );
+		n0 = parser_compile_emit( pc, PARSER_OP_POW, n0, n1, 0, 0.0 );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles multiplication and division, see parser_read_term()
+*/
+static int parser_compile_term( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, type;
+
+	n0 = parser_compile_power( pc );
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_STAR || type == PARSER_TOKEN_SLASH ){
+		parser_token_next( pd );
+		n1 = parser_compile_power( pc );
+		n0 = parser_compile_emit( pc, type == PARSER_TOKEN_STAR ? PARSER_OP_MUL : PARSER_OP_DIV, n0, n1, 0, 0.0 );
+		type = PARSER_TOKEN_TYPE( pd );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles addition and subtraction, see parser_read_expr()
+*/
+static int parser_compile_expr( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, type;
+
+	type = PARSER_TOKEN_TYPE( pd );
+	if( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ){
+		parser_token_next( pd );
+		// a leading sign is 0.0 +/- v as in the parser, not a negation, so that signed zeros match
+		n1 = parser_compile_emit( pc, PARSER_OP_CONST, 0, 0, 0, 0.0 );
+		n0 = parser_compile_term( pc );
+		n0 = parser_compile_emit( pc, type == PARSER_TOKEN_PLUS ? PARSER_OP_ADD : PARSER_OP_SUB, n1, n0, 0, 0.0 );
+	} else {
+		n0 = parser_compile_term( pc );
+	}
+
+	type = PARSER_TOKEN_TYPE( pd );
+	while( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ){
+		parser_token_next( pd );
+		n1 = parser_compile_term( pc );
+		n0 = parser_compile_emit( pc, type == PARSER_TOKEN_PLUS ? PARSER_OP_ADD : PARSER_OP_SUB, n0, n1, 0, 0.0 );
+		type = PARSER_TOKEN_TYPE( pd );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles a single, non-chaining comparison, see parser_read_boolean_comparison()
+*/
+static int parser_compile_boolean_comparison( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, op;
+
+	n0 = parser_compile_expr( pc );
+	switch( PARSER_TOKEN_TYPE( pd ) ){
+		case PARSER_TOKEN_LT: op = PARSER_OP_LT; break;
+		case PARSER_TOKEN_LE: op = PARSER_OP_LE; break;
+		case PARSER_TOKEN_GT: op = PARSER_OP_GT; break;
+		case PARSER_TOKEN_GE: op = PARSER_OP_GE; break;
+		default:              return n0;
+	}
+	parser_token_next( pd );
+	n1 = parser_compile_expr( pc );
+	return parser_compile_emit( pc, op, n0, n1, 0, 0.0 );
+}
+
+/**
+ @brief compiles a single, non-chaining equality test, see parser_read_boolean_equality()
+*/
+static int parser_compile_boolean_equality( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, op;
+
+	n0 = parser_compile_boolean_comparison( pc );
+	switch( PARSER_TOKEN_TYPE( pd ) ){
+		case PARSER_TOKEN_EQ: op = PARSER_OP_EQ; break;
+		case PARSER_TOKEN_NE: op = PARSER_OP_NE; break;
+		case PARSER_TOKEN_ASSIGN:
+			parser_error( pd, "Expected a '=' for boolean '==' operator!" );
+			return n0;
+		default:
+			return n0;
+	}
+	parser_token_next( pd );
+	n1 = parser_compile_boolean_comparison( pc );
+	return parser_compile_emit( pc, op, n0, n1, 0, 0.0 );
+}
+
+/**
+ @brief compiles boolean 'and' operations, see parser_read_boolean_and()
+*/
+static int parser_compile_boolean_and( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, j;
+
+	n0 = parser_compile_boolean_equality( pc );
+	while( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_AND || PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_AMPERSAND ){
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_AMPERSAND )
+			parser_error( pd, "Expected '&' to follow '&' in logical and operation!" );
+		parser_token_next( pd );
+		j  = parser_compile_emit( pc, PARSER_OP_JUMP_FALSE, n0, 0, 0, 0.0 );
+		n1 = parser_compile_boolean_equality( pc );
+		n0 = parser_compile_emit( pc, PARSER_OP_AND, n0, n1, 0, 0.0 );
+		parser_compile_patch( pc, j, n0, n0 );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles boolean 'or' operations, see parser_read_boolean_or()
+*/
+static int parser_compile_boolean_or( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, j;
+
+	n0 = parser_compile_boolean_and( pc );
+	while( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_OR || PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_BAR ){
+		if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_BAR )
+			parser_error( pd, "Expected '|' to follow '|' in logical or operation!" );
+		parser_token_next( pd );
+		j  = parser_compile_emit( pc, PARSER_OP_JUMP_TRUE, n0, 0, 0, 0.0 );
+		n1 = parser_compile_boolean_and( pc );
+		n0 = parser_compile_emit( pc, PARSER_OP_OR, n0, n1, 0, 0.0 );
+		parser_compile_patch( pc, j, n0, n0 );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles a conditional expression, see parser_read_conditional()
+*/
+static int parser_compile_conditional( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int n0, n1, n2, j0, j1;
+
+	n0 = parser_compile_boolean_or( pc );
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_QUESTION ){
+		parser_token_next( pd );
+		j0 = parser_compile_emit( pc, PARSER_OP_JUMP_FALSE, n0, 0, 0, 0.0 );
+		n1 = parser_compile_conditional( pc );
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_COLON )
+			parser_error( pd, "Expected ':' in conditional expression!" );
+		parser_token_next( pd );
+		j1 = parser_compile_emit( pc, PARSER_OP_JUMP, 0, 0, 0, 0.0 );
+		n2 = parser_compile_conditional( pc );
+		n0 = parser_compile_emit( pc, PARSER_OP_SELECT, n0, n1, n2, 0.0 );
+		parser_compile_patch( pc, j0, j1+1, n0 );
+		parser_compile_patch( pc, j1, n0, n0 );
+	}
+	return n0;
+}
+
+/**
+ @brief compiles an operand of the binary operators, see parser_read_operand()
+*/
+static int parser_compile_operand( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	int type, n;
+
+	type = PARSER_TOKEN_TYPE( pd );
+#if defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	if( type == PARSER_TOKEN_NOT )
+		parser_error( pd, "Expected '+' or '-' for unary expression, got '!'" );
+#endif
+	if( type == PARSER_TOKEN_NOT || type == PARSER_TOKEN_MINUS || type == PARSER_TOKEN_PLUS )
+		parser_token_next( pd );
+
+	if( PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_LPAREN ){
+		parser_token_next( pd );
+		n = parser_compile_binary( pc, PARSER_PRECEDENCE_CONDITIONAL );
+		if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_RPAREN )
+			parser_error( pd, "Expected ')'!" );
+		parser_token_next( pd );
+	} else {
+		n = parser_compile_builtin( pc );
+	}
+
+	if( type == PARSER_TOKEN_NOT )
+		n = parser_compile_emit( pc, PARSER_OP_NOT, n, 0, 0, 0.0 );
+	else if( type == PARSER_TOKEN_MINUS )
+		n = parser_compile_emit( pc, PARSER_OP_NEG, n, 0, 0, 0.0 );
+	return n;
+}
+
+/**
+ @brief compiles a subexpression with the precedence climbing parser, see parser_read_binary()
+*/
+static int parser_compile_binary( parser_compiler *pc, int precedence ){
+	parser_data *pd = pc->pd;
+	int n0, n1, n2, j0, j1, type, op, level, limit = PARSER_PRECEDENCE_POWER, negate;
+
+	if( ++pd->depth > PARSER_MAX_NESTING_DEPTH )
+		parser_error( pd, "Expression nested too deeply, increase PARSER_MAX_NESTING_DEPTH and recompile!" );
+
+	type = PARSER_TOKEN_TYPE( pd );
+	if( precedence <= PARSER_PRECEDENCE_ADD && ( type == PARSER_TOKEN_PLUS || type == PARSER_TOKEN_MINUS ) ){
+		parser_token_next( pd );
+		// a leading sign is 0.0 +/- v as in the parser, not a negation, so that signed zeros match
+		n1 = parser_compile_emit( pc, PARSER_OP_CONST, 0, 0, 0, 0.0 );
+		n0 = parser_compile_binary( pc, PARSER_PRECEDENCE_MUL );
+		n0 = parser_compile_emit( pc, type == PARSER_TOKEN_PLUS ? PARSER_OP_ADD : PARSER_OP_SUB, n1, n0, 0, 0.0 );
+	} else {
+		n0 = parser_compile_operand( pc );
+	}
+
+	for( ;; ){
+		type  = PARSER_TOKEN_TYPE( pd );
+		level = parser_token_precedence[type];
+		if( level < precedence || level > limit )
+			break;
+		switch( type ){
+			case PARSER_TOKEN_PLUS:  op = PARSER_OP_ADD; break;
+			case PARSER_TOKEN_MINUS: op = PARSER_OP_SUB; break;
+			case PARSER_TOKEN_STAR:  op = PARSER_OP_MUL; break;
+			case PARSER_TOKEN_SLASH: op = PARSER_OP_DIV; break;
+			case PARSER_TOKEN_CARET: op = PARSER_OP_POW; break;
+			case PARSER_TOKEN_LT:    op = PARSER_OP_LT;  break;
+			case PARSER_TOKEN_LE:    op = PARSER_OP_LE;  break;
+			case PARSER_TOKEN_GT:    op = PARSER_OP_GT;  break;
+			case PARSER_TOKEN_GE:    op = PARSER_OP_GE;  break;
+			case PARSER_TOKEN_EQ:    op = PARSER_OP_EQ;  break;
+			case PARSER_TOKEN_NE:    op = PARSER_OP_NE;  break;
+			case PARSER_TOKEN_AND:   op = PARSER_OP_AND; break;
+			case PARSER_TOKEN_OR:    op = PARSER_OP_OR;  break;
+			case PARSER_TOKEN_QUESTION: op = PARSER_OP_SELECT; break;
+			case PARSER_TOKEN_ASSIGN:
+				parser_error( pd, "Expected a '=' for boolean '==' operator!" );
+				return n0;
+			case PARSER_TOKEN_AMPERSAND:
+				parser_error( pd, "Expected '&' to follow '&' in logical and operation!" );
+				return n0;
+			default:
+				parser_error( pd, "Expected '|' to follow '|' in logical or operation!" );
+				return n0;
+		}
+		parser_token_next( pd );
+
+		j0 = -1;
+		if( op == PARSER_OP_SELECT ){
+			// right-associative, see parser_compile_conditional()
+			j0 = parser_compile_emit( pc, PARSER_OP_JUMP_FALSE, n0, 0, 0, 0.0 );
+			n1 = parser_compile_binary( pc, PARSER_PRECEDENCE_CONDITIONAL );
+			if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_COLON )
+				parser_error( pd, "Expected ':' in conditional expression!" );
+			parser_token_next( pd );
+			j1 = parser_compile_emit( pc, PARSER_OP_JUMP, 0, 0, 0, 0.0 );
+			n2 = parser_compile_binary( pc, PARSER_PRECEDENCE_CONDITIONAL );
+			n0 = parser_compile_emit( pc, PARSER_OP_SELECT, n0, n1, n2, 0.0 );
+			parser_compile_patch( pc, j0, j1+1, n0 );
+			parser_compile_patch( pc, j1, n0, n0 );
+			// the conditional is the loosest level, so no operator can
+			// apply to it as a whole
+			break;
+		}
+
+		if( op == PARSER_OP_POW ){
+			negate = PARSER_TOKEN_TYPE( pd ) == PARSER_TOKEN_MINUS;
+			if( negate )
+				parser_token_next( pd );
+			n1 = parser_compile_binary( pc, PARSER_PRECEDENCE_POWER );
+			if( negate )
+				n1 = parser_compile_emit( pc, PARSER_OP_NEG, n1, 0, 0, 0.0 );
+		} else {
+			// the right operand of && and || is skipped when the left one
+			// decides the result
+			if( op == PARSER_OP_AND || op == PARSER_OP_OR )
+				j0 = parser_compile_emit( pc, op == PARSER_OP_AND ? PARSER_OP_JUMP_FALSE : PARSER_OP_JUMP_TRUE, n0, 0, 0, 0.0 );
+			n1 = parser_compile_binary( pc, level+1 );
+		}
+		n0 = parser_compile_emit( pc, op, n0, n1, 0, 0.0 );
+		if( j0 >= 0 )
+			parser_compile_patch( pc, j0, n0, n0 );
+
+		// comparisons and equality tests do not chain
+		limit = level == PARSER_PRECEDENCE_COMPARISON || level == PARSER_PRECEDENCE_EQUALITY ? level-1 : level;
+	}
+
+	pd->depth--;
+	return n0;
+}
+
+/**
+ @brief compiles the input of a parser_data structure as the next output of the program, see parser_parse()
+*/
+static void parser_compile_output( parser_compiler *pc ){
+	parser_data *pd = pc->pd;
+	parser_program *prog = pc->prog;
+	int n;
+
+	pd->depth = 0;
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	n = pd->recursive_descent ? parser_compile_conditional( pc ) : parser_compile_binary( pc, PARSER_PRECEDENCE_CONDITIONAL );
+#else
+	n = pd->recursive_descent ? parser_compile_expr( pc ) : parser_compile_binary( pc, PARSER_PRECEDENCE_ADD );
+#endif
+	if( PARSER_TOKEN_TYPE( pd ) != PARSER_TOKEN_END )
+		parser_error( pd, "Failed to reach end of input expression, likely malformed input" );
+
+	parser_compile_reserve( pc, (void**)&prog->outputs, &prog->max_outputs, prog->num_outputs, sizeof(int) );
+	prog->outputs[prog->num_outputs++] = n;
+}
+
+/**
+ @brief copies a program compiled into an arena into a single allocation and releases the scratch memory of the compiler, i.e. everything allocated since the mark, bailing on allocation failure
+ @return packed program
+*/
+static parser_program *parser_compile_pack( parser_compiler *pc, const parser_arena_mark *mark ){
+	parser_program *prog = pc->prog, *packed;
+	size_t constants, nodes, outputs, args, ops, natives, names, strings, size, len;
+	unsigned char *data;
+	char *str;
+	int i;
+
+	// layout of the packed program, the constants and the arrays of pointers
+	// are aligned
+	constants = PARSER_ARENA_ROUND( sizeof(parser_program) );
+	nodes     = constants + prog->num_constants*sizeof(double);
+	outputs   = nodes + prog->num_nodes*sizeof(parser_node);
+	args      = outputs + prog->num_outputs*sizeof(int);
+	ops       = args + prog->num_args*sizeof(int);
+	natives   = PARSER_ARENA_ROUND( ops + prog->num_nodes );
+	names   = natives + prog->num_natives*sizeof(parser_native);
+	strings = names + ( prog->num_variables + prog->num_functions )*sizeof(char*);
+	size    = strings;
+	for( i=0; i<prog->num_variables; i++ )
+		size += strlen( prog->variables[i] )+1;
+	for( i=0; i<prog->num_functions; i++ )
+		size += strlen( prog->functions[i] )+1;
+	for( i=0; i<prog->num_natives; i++ )
+		size += strlen( prog->natives[i].name )+1;
+
+	data = parser_arena_alloc( prog->arena, size );
+	if( !data )
+		parser_error( pc->pd, "Out of memory while compiling expression!" );
+	memcpy( data, prog, sizeof(parser_program) );
+	if( prog->num_constants > 0 )
+		memcpy( data+constants, prog->constants, prog->num_constants*sizeof(double) );
+	memcpy( data+nodes, prog->nodes, prog->num_nodes*sizeof(parser_node) );
+	memcpy( data+ops, prog->ops, prog->num_nodes );
+	memcpy( data+outputs, prog->outputs, prog->num_outputs*sizeof(int) );
+	if( prog->num_args > 0 )
+		memcpy( data+args, prog->args, prog->num_args*sizeof(int) );
+	if( prog->num_natives > 0 )
+		memcpy( data+natives, prog->natives, prog->num_natives*sizeof(parser_native) );
+	str = (char*)data+strings;
+	for( i=0; i<prog->num_variables; i++, str += len )
+		memcpy( str, prog->variables[i], len = strlen( prog->variables[i] )+1 );
+	for( i=0; i<prog->num_functions; i++, str += len )
+		memcpy( str, prog->functions[i], len = strlen( prog->functions[i] )+1 );
+	for( i=0; i<prog->num_natives; i++, str += len )
+		memcpy( str, prog->natives[i].name, len = strlen( prog->natives[i].name )+1 );
+
+	// the packed program is moved to the mark, so its pointers are set after
+	data   = parser_arena_keep( prog->arena, mark, data, size );
+	packed = (parser_program*)data;
+	packed->constants = (double*)(data+constants);
+	packed->nodes     = (parser_node*)(data+nodes);
+	packed->ops       = data+ops;
+	packed->outputs   = (int*)(data+outputs);
+	packed->args      = (int*)(data+args);
+	packed->natives   = (parser_native*)(data+natives);
+	packed->variables = (char**)(data+names);
+	packed->functions = packed->variables + packed->num_variables;
+	packed->max_nodes     = packed->num_nodes;
+	packed->max_constants = packed->num_constants;
+	packed->max_outputs   = packed->num_outputs;
+	packed->max_args      = packed->num_args;
+	packed->max_natives   = packed->num_natives;
+	packed->max_variables = packed->num_variables;
+	packed->max_functions = packed->num_functions;
+	str = (char*)data+strings;
+	for( i=0; i<packed->num_variables; i++, str += strlen( str )+1 )
+		packed->variables[i] = str;
+	for( i=0; i<packed->num_functions; i++, str += strlen( str )+1 )
+		packed->functions[i] = str;
+	for( i=0; i<packed->num_natives; i++, str += strlen( str )+1 )
+		packed->natives[i].name = str;
+	return packed;
+}
+
+/**
+ @brief shared implementation of parser_compile() and parser_compile_set(), compiles the expressions of exprs or, if exprs is NULL, the input of pd and runs the optimization passes over the whole program
+*/
+static parser_program *parser_compile_common( parser_data *pd, const char * const *exprs, int num_exprs ){
+	parser_arena_mark mark;
+	parser_compiler pc;
+	parser_program *prog;
+	int i, n;
+
+	if( pd->arena ){
+		parser_arena_get_mark( pd->arena, &mark );
+		prog = parser_arena_alloc( pd->arena, sizeof(parser_program) );
+		if( prog )
+			memset( prog, 0, sizeof(parser_program) );
+	} else {
+		prog = PARSER_CALLOC( 1, sizeof(parser_program) );
+	}
+	if( !prog ){
+		pd->error = "Out of memory while compiling expression!";
+		return NULL;
+	}
+	prog->arena       = pd->arena;
+	prog->variable_cb = pd->variable_cb;
+	prog->function_cb = pd->function_cb;
+
+	pc.pd   = pd;
+	pc.prog = prog;
+
+	// set the jump position and launch the compiler
+	if( !setjmp( pd->err_jmp_buf ) ){
+		for( i=0; i<num_exprs; i++ ){
+			if( exprs ){
+				pd->str = exprs[i];
+				pd->len = strlen( exprs[i] )+1;
+				pd->pos = 0;
+				parser_tokenize( pd );
+			}
+			parser_compile_output( &pc );
+		}
+
+		if( pd->optimize ){
+			n = parser_program_fold( prog, pd->user_data ) < 0 ? -1 : parser_program_share( prog );
+			if( n < 0 )
+				parser_error( pd, "Out of memory while compiling expression!" );
+			prog->num_eliminated = n;
+		}
+		if( prog->arena )
+			prog = parser_compile_pack( &pc, &mark );
+	} else if( pd->arena ){
+		// error was returned, release the partial program
+		parser_arena_rewind( pd->arena, &mark );
+		return NULL;
+	} else {
+		parser_program_free( prog );
+		return NULL;
+	}
+	return prog;
+}
+
+parser_program *parser_compile( parser_data *pd ){
+	return parser_compile_common( pd, NULL, 1 );
+}
+
+parser_program *parser_compile_set( parser_data *pd, const char * const *exprs, int num_exprs ){
+	if( num_exprs < 1 ){
+		pd->error = "Expected at least one expression to compile!";
+		return NULL;
+	}
+	return parser_compile_common( pd, exprs, num_exprs );
+}
+
+size_t parser_program_size( const parser_program *prog ){
+	size_t size = sizeof(parser_program);
+	int i;
+
+	size += prog->max_nodes*( sizeof(parser_node) + 1 );
+	size += prog->max_constants*sizeof(double);
+	size += ( prog->max_outputs + prog->max_args )*sizeof(int);
+	size += ( prog->max_variables + prog->max_functions )*sizeof(char*);
+	size += prog->max_natives*sizeof(parser_native);
+	for( i=0; i<prog->num_variables; i++ )
+		size += strlen( prog->variables[i] )+1;
+	for( i=0; i<prog->num_functions; i++ )
+		size += strlen( prog->functions[i] )+1;
+	for( i=0; i<prog->num_natives; i++ )
+		size += strlen( prog->natives[i].name )+1;
+	return size + prog->jit_size;
+}
+
+void *parser_program_scratch( parser_program *prog, size_t size ){
+	return prog->arena ? parser_arena_alloc( prog->arena, size ) : PARSER_MALLOC( size );
+}
+
+void parser_program_scratch_free( parser_program *prog, void *ptr ){
+	if( !prog->arena )
+		PARSER_FREE( ptr );
+}
+
+void parser_program_free( parser_program *prog ){
+	int i;
+	if( !prog )
+		return;
+	parser_jit_free( prog );
+	if( prog->arena )
+		return;
+	if( !prog->image ){
+		for( i=0; i<prog->num_variables; i++ )
+			PARSER_FREE( prog->variables[i] );
+		for( i=0; i<prog->num_functions; i++ )
+			PARSER_FREE( prog->functions[i] );
+		for( i=0; i<prog->num_natives; i++ )
+			PARSER_FREE( prog->natives[i].name );
+		PARSER_FREE( prog->args );
+		PARSER_FREE( prog->outputs );
+		PARSER_FREE( prog->constants );
+		PARSER_FREE( prog->nodes );
+		PARSER_FREE( prog->ops );
+	}
+	PARSER_FREE( prog->natives );
+	PARSER_FREE( prog->variables );
+	PARSER_FREE( prog->functions );
+	PARSER_FREE( prog );
+}
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#define parser_program_round( x ) round( x )
+#else
+// matches parser_round() in expression_parser.c for pre-C99 compilers
+static double parser_program_round( double x ){
+	double i = (double)(int)x;
+	if( x >= 0.0 )
+		return ( (x-i) >= 0.5 ) ? i + 1.0 : i;
+	return ( -x+i >= 0.5 ) ? i - 1.0 : i;
+}
+#endif
+
+int parser_program_run( const parser_program *prog, int first, int last, const double *slots, double *values, void *user_data, const char **error ){
+	const parser_node *node = prog->nodes+first;
+	double args[PARSER_MAX_ARGUMENT_COUNT];
+	int i, j;
+
+	// shorthands for the operand values of the current node
+#define A values[node->a]
+#define B values[node->b]
+#define C values[node->c]
+	for( i=first; i<last; i++, node++ ){
+		switch( prog->ops[i] ){
+			case PARSER_OP_CONST: values[i] = prog->constants[node->a]; break;
+			case PARSER_OP_VAR:   values[i] = slots[node->a]; break;
+			case PARSER_OP_NEG:   values[i] = -A; break;
+			case PARSER_OP_NOT:   values[i] = fabs(A) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 0.0 : 1.0; break;
+			case PARSER_OP_ADD:   values[i] = A + B; break;
+			case PARSER_OP_SUB:   values[i] = A - B; break;
+			case PARSER_OP_MUL:   values[i] = A * B; break;
+			case PARSER_OP_DIV:   values[i] = A / B; break;
+			case PARSER_OP_POW:   values[i] = pow( A, B ); break;
+			case PARSER_OP_LT:    values[i] = A <  B ? 1.0 : 0.0; break;
+			case PARSER_OP_LE:    values[i] = A <= B ? 1.0 : 0.0; break;
+			case PARSER_OP_GT:    values[i] = A >  B ? 1.0 : 0.0; break;
+			case PARSER_OP_GE:    values[i] = A >= B ? 1.0 : 0.0; break;
+			case PARSER_OP_EQ:    values[i] = fabs(A - B) < PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0; break;
+			case PARSER_OP_NE:    values[i] = fabs(A - B) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0; break;
+			case PARSER_OP_AND:   values[i] = fabs(A) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD && fabs(B) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0; break;
+			case PARSER_OP_OR:    values[i] = fabs(A) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs(B) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ? 1.0 : 0.0; break;
+			case PARSER_OP_SELECT: values[i] = PARSER_TRUTH( A ) ? B : C; break;
+			case PARSER_OP_JUMP_FALSE:
+			case PARSER_OP_JUMP_TRUE:
+			case PARSER_OP_JUMP:
+				// skip the nodes the lazy operation does not read, the loop
+				// continues at the target
+				if( prog->ops[i] == PARSER_OP_JUMP || PARSER_TRUTH( A ) == ( prog->ops[i] == PARSER_OP_JUMP_TRUE ) ){
+					i    = node->b-1;
+					node = prog->nodes+i;
+				}
+				break;
+			case PARSER_OP_SQRT:
+				if( A < 0.0 ){
+					*error = "sqrt(x) undefined for x < 0!";
+					return PARSER_FALSE;
+				}
+				values[i] = sqrt( A );
+				break;
+			case PARSER_OP_LOG:
+				if( A <= 0.0 ){
+					*error = "log(x) undefined for x <= 0!";
+					return PARSER_FALSE;
+				}
+				values[i] = log( A );
+				break;
+			case PARSER_OP_EXP:   values[i] = exp( A ); break;
+			case PARSER_OP_SIN:   values[i] = sin( A ); break;
+			case PARSER_OP_ASIN:
+				if( fabs(A) > 1.0 ){
+					*error = "asin(x) undefined for |x| > 1!";
+					return PARSER_FALSE;
+				}
+				values[i] = asin( A );
+				break;
+			case PARSER_OP_COS:   values[i] = cos( A ); break;
+			case PARSER_OP_ACOS:
+				if( fabs(A) > 1.0 ){
+					*error = "acos(x) undefined for |x| > 1!";
+					return PARSER_FALSE;
+				}
+				values[i] = acos( A );
+				break;
+			case PARSER_OP_TAN:   values[i] = tan( A ); break;
+			case PARSER_OP_ATAN:  values[i] = atan( A ); break;
+			case PARSER_OP_ATAN2: values[i] = atan2( A, B ); break;
+			case PARSER_OP_ABS:   values[i] = abs( (int)A ); break;
+			case PARSER_OP_FABS:  values[i] = fabs( A ); break;
+			case PARSER_OP_FLOOR: values[i] = floor( A ); break;
+			case PARSER_OP_CEIL:  values[i] = ceil( A ); break;
+			case PARSER_OP_ROUND: values[i] = parser_program_round( A ); break;
+			case PARSER_OP_CALL:
+				for( j=0; j<node->b; j++ )
+					args[j] = values[prog->args[node->a+j]];
+				if( !prog->function_cb || !prog->function_cb( user_data, prog->functions[node->c], node->b, args, values+i ) ){
+					*error = "Tried to call unknown built-in function!";
+					return PARSER_FALSE;
+				}
+				break;
+			case PARSER_OP_NATIVE:
+				for( j=0; j<node->b; j++ )
+					args[j] = values[prog->args[node->a+j]];
+				if( !prog->natives[node->c].fn( user_data, node->b, args, values+i ) ){
+					*error = "Function evaluation failed!";
+					return PARSER_FALSE;
+				}
+				break;
+			default:
+				*error = "Unknown operation!";
+				return PARSER_FALSE;
+		}
+	}
+#undef A
+#undef B
+#undef C
+	return PARSER_TRUE;
+}
+
+/**
+ @brief shared implementation of parser_program_eval(), parser_program_eval_slots(), parser_program_eval_pointers() and parser_program_eval_set(). Variable values are taken from slots if it is not NULL, otherwise from pointers if it is not NULL, and are looked up through the variable callback otherwise.
+ @param[out] out receives the values of the first num_out outputs, nan on failure
+ @return PARSER_TRUE on success, PARSER_FALSE otherwise
+*/
+static int parser_program_eval_common( const parser_program *prog, const double *slots, const double * const *pointers, void *user_data, double *out, int num_out, const char **error ){
+	double stack_values[PARSER_PROGRAM_STACK_SIZE], *values = stack_values, *vars;
+	const char *err = NULL;
+	int i, missing = -1, size = prog->num_nodes + prog->num_variables;
+
+	// scratch holds one value per node followed by the variable slots
+	if( size > PARSER_PROGRAM_STACK_SIZE ){
+		values = PARSER_MALLOC( size*sizeof(double) );
+		if( !values ){
+			for( i=0; i<num_out; i++ )
+				out[i] = sqrt( -1.0 );
+			if( error ) *error = "Out of memory while evaluating expression!";
+			return PARSER_FALSE;
+		}
+	}
+	vars = values + prog->num_nodes;
+
+	if( slots ){
+		vars = (double*)slots;
+	} else if( pointers ){
+		for( i=0; i<prog->num_variables; i++ )
+			vars[i] = *pointers[i];
+	} else {
+		// look up each distinct variable exactly once, stopping at the first
+		// that cannot be looked up
+		for( i=0; i<prog->num_variables && missing < 0; i++ ){
+			if( !prog->variable_cb || !prog->variable_cb( user_data, prog->variables[i], vars+i ) )
+				missing = i;
+		}
+	}
+
+	if( missing >= 0 ){
+		// slots are numbered in the order the variables first appear, so the
+		// nodes before the first read of this or a later slot are those the
+		// parser evaluates before it fails the lookup. Their errors are
+		// reported first, as by parser_parse()
+		for( i=0; i<prog->num_nodes; i++ ){
+			if( prog->ops[i] == PARSER_OP_VAR && prog->nodes[i].a >= missing )
+				break;
+		}
+		if( parser_program_run( prog, 0, i, vars, values, user_data, &err ) )
+			err = "Could not look up value for variable!";
+	} else if( prog->jit )
+		parser_jit_run( prog, vars, values, user_data, &err );
+	else
+		parser_program_run( prog, 0, prog->num_nodes, vars, values, user_data, &err );
+	for( i=0; i<num_out; i++ )
+		out[i] = err ? sqrt( -1.0 ) : values[prog->outputs[i]];
+
+	if( values != stack_values )
+		PARSER_FREE( values );
+	if( error )
+		*error = err;
+	return err ? PARSER_FALSE : PARSER_TRUE;
+}
+
+double parser_program_eval( const parser_program *prog, void *user_data, const char **error ){
+	double result;
+	parser_program_eval_common( prog, NULL, NULL, user_data, &result, 1, error );
+	return result;
+}
+
+double parser_program_eval_slots( const parser_program *prog, const double *slots, void *user_data, const char **error ){
+	double result;
+	parser_program_eval_common( prog, slots, NULL, user_data, &result, 1, error );
+	return result;
+}
+
+double parser_program_eval_pointers( const parser_program *prog, const double * const *pointers, void *user_data, const char **error ){
+	double result;
+	parser_program_eval_common( prog, NULL, pointers, user_data, &result, 1, error );
+	return result;
+}
+
+int parser_program_eval_set( const parser_program *prog, void *user_data, double *out, const char **error ){
+	return parser_program_eval_common( prog, NULL, NULL, user_data, out, prog->num_outputs, error );
+}
+
+int parser_program_num_outputs( const parser_program *prog ){
+	return prog->num_outputs;
+}
+
+int parser_program_num_eliminated( const parser_program *prog ){
+	return prog->num_eliminated;
+}
+
+int parser_program_num_nodes( const parser_program *prog ){
+	return prog->num_nodes;
+}
+
+int parser_program_num_variables( const parser_program *prog ){
+	return prog->num_variables;
+}
+
+const char *parser_program_variable_name( const parser_program *prog, int slot ){
+	if( slot < 0 || slot >= prog->num_variables )
+		return NULL;
+	return prog->variables[slot];
+}
+
+int parser_program_variable_slot( const parser_program *prog, const char *name ){
+	int i;
+	for( i=0; i<prog->num_variables; i++ ){
+		if( strcmp( prog->variables[i], name ) == 0 )
+			return i;
+	}
+	return -1;
+}
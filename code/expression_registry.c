@@ -0,0 +1,121 @@
+#include<string.h>
+#include<stdlib.h>
+
+/**
+ @file expression_registry.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief registry of native functions, see expression_parser.h for more information and license terms.
+
+ The registry is an open addressing hash table with linear probing, keyed by function name.  Functions are looked up once when an expression is parsed or compiled, compiled programs keep a copy of the entries they call so the registry may be freed or modified afterwards.
+*/
+
+#include"expression_internal.h"
+
+/**
+ @brief FNV-1a hash of a nul-terminated string
+*/
+static unsigned int parser_registry_hash( const char *name ){
+	unsigned int h = 2166136261u;
+	while( *name ){
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ @brief finds the table entry holding name, or the empty entry where it would be inserted
+*/
+static parser_native *parser_registry_slot( parser_native *entries, int capacity, const char *name ){
+	unsigned int i = parser_registry_hash( name ) & (capacity-1);
+	while( entries[i].name && strcmp( entries[i].name, name ) != 0 )
+		i = (i+1) & (capacity-1);
+	return entries+i;
+}
+
+/**
+ @brief doubles the capacity of the table, rehashing all entries
+*/
+static int parser_registry_grow( parser_registry *reg ){
+	parser_native *entries;
+	int i, capacity = reg->capacity ? 2*reg->capacity : 16;
+
+	entries = PARSER_CALLOC( capacity, sizeof(parser_native) );
+	if( !entries )
+		return PARSER_FALSE;
+	for( i=0; i<reg->capacity; i++ ){
+		if( reg->entries[i].name )
+			*parser_registry_slot( entries, capacity, reg->entries[i].name ) = reg->entries[i];
+	}
+	PARSER_FREE( reg->entries );
+	reg->entries  = entries;
+	reg->capacity = capacity;
+	return PARSER_TRUE;
+}
+
+parser_registry *parser_registry_new( void ){
+	parser_registry *reg = PARSER_CALLOC( 1, sizeof(parser_registry) );
+	if( !reg )
+		return NULL;
+	if( !parser_registry_grow( reg ) ){
+		PARSER_FREE( reg );
+		return NULL;
+	}
+	return reg;
+}
+
+void parser_registry_free( parser_registry *reg ){
+	int i;
+	if( !reg )
+		return;
+	for( i=0; i<reg->capacity; i++ )
+		PARSER_FREE( reg->entries[i].name );
+	PARSER_FREE( reg->entries );
+	PARSER_FREE( reg );
+}
+
+int parser_registry_add( parser_registry *reg, const char *name, parser_native_function fn, int min_args, int max_args, int flags ){
+	parser_native *entry;
+	int num_args;
+	size_t len;
+
+	len = strlen( name );
+	if( !fn || len == 0 || min_args < 0 || max_args < min_args || max_args > PARSER_MAX_ARGUMENT_COUNT )
+		return PARSER_FALSE;
+	if( parser_builtin_lookup( name, (int)len, &num_args ) >= 0 )
+		return PARSER_FALSE;
+
+	// keep the load factor at or below one half
+	if( 2*(reg->count+1) > reg->capacity && !parser_registry_grow( reg ) )
+		return PARSER_FALSE;
+
+	entry = parser_registry_slot( reg->entries, reg->capacity, name );
+	if( !entry->name ){
+		entry->name = PARSER_MALLOC( len+1 );
+		if( !entry->name )
+			return PARSER_FALSE;
+		memcpy( entry->name, name, len+1 );
+		reg->count++;
+	}
+	entry->fn       = fn;
+	entry->min_args = min_args;
+	entry->max_args = max_args;
+	entry->flags    = flags;
+
+	// a replaced function loses the derivative of the previous one
+	entry->derivative = NULL;
+	return PARSER_TRUE;
+}
+
+int parser_registry_add_derivative( parser_registry *reg, const char *name, parser_native_derivative derivative ){
+	parser_native *entry = parser_registry_slot( reg->entries, reg->capacity, name );
+	if( !entry->name )
+		return PARSER_FALSE;
+	entry->derivative = derivative;
+	return PARSER_TRUE;
+}
+
+const parser_native *parser_registry_find( const parser_registry *reg, const char *name ){
+	const parser_native *entry = parser_registry_slot( reg->entries, reg->capacity, name );
+	return entry->name ? entry : NULL;
+}
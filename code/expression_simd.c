@@ -0,0 +1,216 @@
+#include<math.h>
+
+/**
+ @file expression_simd.c
+ @author James Gregson (james.gregson@gmail.com)
+ @brief SSE2 and AVX2 kernels for the batch evaluator, see expression_parser.h for more information and license terms.
+
+ Each kernel applies one operation to a chunk of rows, two (SSE2) or four (AVX2) rows per instruction, or four and eight rows in single precision.  Only the arithmetic, comparison and boolean operations and the operations with a direct instruction equivalent are vectorized, everything else (pow, trigonometric functions, ...) is left to the scalar loops of the batch evaluator.  Comparisons use ordered predicates, so rows holding nan produce exactly the same results as the scalar code.  The AVX2 kernels are compiled with a target attribute and selected at run-time, so the library does not need to be built with -mavx2.  Define PARSER_EXCLUDE_SIMD to build without any of the kernels.
+*/
+
+#include"expression_internal.h"
+
+#if !defined(PARSER_EXCLUDE_SIMD) && defined(__SSE2__)
+#define PARSER_SIMD_SSE2
+#include<emmintrin.h>
+#endif
+
+#if !defined(PARSER_EXCLUDE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PARSER_SIMD_AVX2
+#include<immintrin.h>
+#endif
+
+/**
+ @brief checks whether an operation has a vectorized kernel
+*/
+static int parser_simd_supported( int op ){
+	switch( op ){
+		case PARSER_OP_NEG:
+		case PARSER_OP_NOT:
+		case PARSER_OP_ADD:
+		case PARSER_OP_SUB:
+		case PARSER_OP_MUL:
+		case PARSER_OP_DIV:
+		case PARSER_OP_LT:
+		case PARSER_OP_LE:
+		case PARSER_OP_GT:
+		case PARSER_OP_GE:
+		case PARSER_OP_EQ:
+		case PARSER_OP_NE:
+		case PARSER_OP_AND:
+		case PARSER_OP_OR:
+		case PARSER_OP_SQRT:
+		case PARSER_OP_FABS:
+			return PARSER_TRUE;
+		default:
+			return PARSER_FALSE;
+	}
+}
+
+#if defined(PARSER_SIMD_SSE2)
+/**
+ @brief SSE2 kernels, two rows per instruction
+ @return number of leading rows processed, the remaining rows are left to the caller
+*/
+static int parser_simd_kernel_sse2( int op, double *v, const double *a, const double *b, int n ){
+	const __m128d sign = _mm_set1_pd( -0.0 ), one = _mm_set1_pd( 1.0 ), thresh = _mm_set1_pd( PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+	__m128d x, y;
+	int r = 0;
+
+	// applies a vector expression of x = a[r..r+1] and y = b[r..r+1]
+#define PARSER_SSE2_LOOP( expr ) for( ; r+2<=n; r+=2 ){ x = _mm_loadu_pd( a+r ); y = _mm_loadu_pd( b+r ); _mm_storeu_pd( v+r, (expr) ); }
+	switch( op ){
+		case PARSER_OP_NEG:  PARSER_SSE2_LOOP( _mm_xor_pd( x, sign ) ); break;
+		case PARSER_OP_NOT:  PARSER_SSE2_LOOP( _mm_andnot_pd( _mm_cmpge_pd( _mm_andnot_pd( sign, x ), thresh ), one ) ); break;
+		case PARSER_OP_ADD:  PARSER_SSE2_LOOP( _mm_add_pd( x, y ) ); break;
+		case PARSER_OP_SUB:  PARSER_SSE2_LOOP( _mm_sub_pd( x, y ) ); break;
+		case PARSER_OP_MUL:  PARSER_SSE2_LOOP( _mm_mul_pd( x, y ) ); break;
+		case PARSER_OP_DIV:  PARSER_SSE2_LOOP( _mm_div_pd( x, y ) ); break;
+		case PARSER_OP_LT:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmplt_pd( x, y ), one ) ); break;
+		case PARSER_OP_LE:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmple_pd( x, y ), one ) ); break;
+		case PARSER_OP_GT:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmpgt_pd( x, y ), one ) ); break;
+		case PARSER_OP_GE:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmpge_pd( x, y ), one ) ); break;
+		case PARSER_OP_EQ:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmplt_pd( _mm_andnot_pd( sign, _mm_sub_pd( x, y ) ), thresh ), one ) ); break;
+		case PARSER_OP_NE:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_cmpgt_pd( _mm_andnot_pd( sign, _mm_sub_pd( x, y ) ), thresh ), one ) ); break;
+		case PARSER_OP_AND:  PARSER_SSE2_LOOP( _mm_and_pd( _mm_and_pd( _mm_cmpge_pd( _mm_andnot_pd( sign, x ), thresh ), _mm_cmpge_pd( _mm_andnot_pd( sign, y ), thresh ) ), one ) ); break;
+		case PARSER_OP_OR:   PARSER_SSE2_LOOP( _mm_and_pd( _mm_or_pd( _mm_cmpge_pd( _mm_andnot_pd( sign, x ), thresh ), _mm_cmpge_pd( _mm_andnot_pd( sign, y ), thresh ) ), one ) ); break;
+		case PARSER_OP_SQRT: PARSER_SSE2_LOOP( _mm_sqrt_pd( x ) ); break;
+		case PARSER_OP_FABS: PARSER_SSE2_LOOP( _mm_andnot_pd( sign, x ) ); break;
+		default: break;
+	}
+#undef PARSER_SSE2_LOOP
+	return r;
+}
+/**
+ @brief single precision SSE2 kernels, four rows per instruction
+ @return number of leading rows processed, the remaining rows are left to the caller
+*/
+static int parser_simd_kernel_float_sse2( int op, float *v, const float *a, const float *b, int n ){
+	const __m128 sign = _mm_set1_ps( -0.0f ), one = _mm_set1_ps( 1.0f ), thresh = _mm_set1_ps( PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT );
+	__m128 x, y;
+	int r = 0;
+
+	// applies a vector expression of x = a[r..r+3] and y = b[r..r+3]
+#define PARSER_SSE2_LOOP( expr ) for( ; r+4<=n; r+=4 ){ x = _mm_loadu_ps( a+r ); y = _mm_loadu_ps( b+r ); _mm_storeu_ps( v+r, (expr) ); }
+	switch( op ){
+		case PARSER_OP_NEG:  PARSER_SSE2_LOOP( _mm_xor_ps( x, sign ) ); break;
+		case PARSER_OP_NOT:  PARSER_SSE2_LOOP( _mm_andnot_ps( _mm_cmpge_ps( _mm_andnot_ps( sign, x ), thresh ), one ) ); break;
+		case PARSER_OP_ADD:  PARSER_SSE2_LOOP( _mm_add_ps( x, y ) ); break;
+		case PARSER_OP_SUB:  PARSER_SSE2_LOOP( _mm_sub_ps( x, y ) ); break;
+		case PARSER_OP_MUL:  PARSER_SSE2_LOOP( _mm_mul_ps( x, y ) ); break;
+		case PARSER_OP_DIV:  PARSER_SSE2_LOOP( _mm_div_ps( x, y ) ); break;
+		case PARSER_OP_LT:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmplt_ps( x, y ), one ) ); break;
+		case PARSER_OP_LE:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmple_ps( x, y ), one ) ); break;
+		case PARSER_OP_GT:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmpgt_ps( x, y ), one ) ); break;
+		case PARSER_OP_GE:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmpge_ps( x, y ), one ) ); break;
+		case PARSER_OP_EQ:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmplt_ps( _mm_andnot_ps( sign, _mm_sub_ps( x, y ) ), thresh ), one ) ); break;
+		case PARSER_OP_NE:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_cmpgt_ps( _mm_andnot_ps( sign, _mm_sub_ps( x, y ) ), thresh ), one ) ); break;
+		case PARSER_OP_AND:  PARSER_SSE2_LOOP( _mm_and_ps( _mm_and_ps( _mm_cmpge_ps( _mm_andnot_ps( sign, x ), thresh ), _mm_cmpge_ps( _mm_andnot_ps( sign, y ), thresh ) ), one ) ); break;
+		case PARSER_OP_OR:   PARSER_SSE2_LOOP( _mm_and_ps( _mm_or_ps( _mm_cmpge_ps( _mm_andnot_ps( sign, x ), thresh ), _mm_cmpge_ps( _mm_andnot_ps( sign, y ), thresh ) ), one ) ); break;
+		case PARSER_OP_SQRT: PARSER_SSE2_LOOP( _mm_sqrt_ps( x ) ); break;
+		case PARSER_OP_FABS: PARSER_SSE2_LOOP( _mm_andnot_ps( sign, x ) ); break;
+		default: break;
+	}
+#undef PARSER_SSE2_LOOP
+	return r;
+}
+#endif
+
+#if defined(PARSER_SIMD_AVX2)
+/**
+ @brief AVX2 kernels, four rows per instruction
+ @return number of leading rows processed, the remaining rows are left to the caller
+*/
+__attribute__((target("avx2")))
+static int parser_simd_kernel_avx2( int op, double *v, const double *a, const double *b, int n ){
+	const __m256d sign = _mm256_set1_pd( -0.0 ), one = _mm256_set1_pd( 1.0 ), thresh = _mm256_set1_pd( PARSER_BOOLEAN_EQUALITY_THRESHOLD );
+	__m256d x, y;
+	int r = 0;
+
+	// applies a vector expression of x = a[r..r+3] and y = b[r..r+3]
+#define PARSER_AVX2_LOOP( expr ) for( ; r+4<=n; r+=4 ){ x = _mm256_loadu_pd( a+r ); y = _mm256_loadu_pd( b+r ); _mm256_storeu_pd( v+r, (expr) ); }
+	switch( op ){
+		case PARSER_OP_NEG:  PARSER_AVX2_LOOP( _mm256_xor_pd( x, sign ) ); break;
+		case PARSER_OP_NOT:  PARSER_AVX2_LOOP( _mm256_andnot_pd( _mm256_cmp_pd( _mm256_andnot_pd( sign, x ), thresh, _CMP_GE_OQ ), one ) ); break;
+		case PARSER_OP_ADD:  PARSER_AVX2_LOOP( _mm256_add_pd( x, y ) ); break;
+		case PARSER_OP_SUB:  PARSER_AVX2_LOOP( _mm256_sub_pd( x, y ) ); break;
+		case PARSER_OP_MUL:  PARSER_AVX2_LOOP( _mm256_mul_pd( x, y ) ); break;
+		case PARSER_OP_DIV:  PARSER_AVX2_LOOP( _mm256_div_pd( x, y ) ); break;
+		case PARSER_OP_LT:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( x, y, _CMP_LT_OQ ), one ) ); break;
+		case PARSER_OP_LE:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( x, y, _CMP_LE_OQ ), one ) ); break;
+		case PARSER_OP_GT:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( x, y, _CMP_GT_OQ ), one ) ); break;
+		case PARSER_OP_GE:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( x, y, _CMP_GE_OQ ), one ) ); break;
+		case PARSER_OP_EQ:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( _mm256_andnot_pd( sign, _mm256_sub_pd( x, y ) ), thresh, _CMP_LT_OQ ), one ) ); break;
+		case PARSER_OP_NE:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_cmp_pd( _mm256_andnot_pd( sign, _mm256_sub_pd( x, y ) ), thresh, _CMP_GT_OQ ), one ) ); break;
+		case PARSER_OP_AND:  PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_and_pd( _mm256_cmp_pd( _mm256_andnot_pd( sign, x ), thresh, _CMP_GE_OQ ), _mm256_cmp_pd( _mm256_andnot_pd( sign, y ), thresh, _CMP_GE_OQ ) ), one ) ); break;
+		case PARSER_OP_OR:   PARSER_AVX2_LOOP( _mm256_and_pd( _mm256_or_pd( _mm256_cmp_pd( _mm256_andnot_pd( sign, x ), thresh, _CMP_GE_OQ ), _mm256_cmp_pd( _mm256_andnot_pd( sign, y ), thresh, _CMP_GE_OQ ) ), one ) ); break;
+		case PARSER_OP_SQRT: PARSER_AVX2_LOOP( _mm256_sqrt_pd( x ) ); break;
+		case PARSER_OP_FABS: PARSER_AVX2_LOOP( _mm256_andnot_pd( sign, x ) ); break;
+		default: break;
+	}
+#undef PARSER_AVX2_LOOP
+	return r;
+}
+/**
+ @brief single precision AVX2 kernels, eight rows per instruction
+ @return number of leading rows processed, the remaining rows are left to the caller
+*/
+__attribute__((target("avx2")))
+static int parser_simd_kernel_float_avx2( int op, float *v, const float *a, const float *b, int n ){
+	const __m256 sign = _mm256_set1_ps( -0.0f ), one = _mm256_set1_ps( 1.0f ), thresh = _mm256_set1_ps( PARSER_BOOLEAN_EQUALITY_THRESHOLD_FLOAT );
+	__m256 x, y;
+	int r = 0;
+
+	// applies a vector expression of x = a[r..r+7] and y = b[r..r+7]
+#define PARSER_AVX2_LOOP( expr ) for( ; r+8<=n; r+=8 ){ x = _mm256_loadu_ps( a+r ); y = _mm256_loadu_ps( b+r ); _mm256_storeu_ps( v+r, (expr) ); }
+	switch( op ){
+		case PARSER_OP_NEG:  PARSER_AVX2_LOOP( _mm256_xor_ps( x, sign ) ); break;
+		case PARSER_OP_NOT:  PARSER_AVX2_LOOP( _mm256_andnot_ps( _mm256_cmp_ps( _mm256_andnot_ps( sign, x ), thresh, _CMP_GE_OQ ), one ) ); break;
+		case PARSER_OP_ADD:  PARSER_AVX2_LOOP( _mm256_add_ps( x, y ) ); break;
+		case PARSER_OP_SUB:  PARSER_AVX2_LOOP( _mm256_sub_ps( x, y ) ); break;
+		case PARSER_OP_MUL:  PARSER_AVX2_LOOP( _mm256_mul_ps( x, y ) ); break;
+		case PARSER_OP_DIV:  PARSER_AVX2_LOOP( _mm256_div_ps( x, y ) ); break;
+		case PARSER_OP_LT:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( x, y, _CMP_LT_OQ ), one ) ); break;
+		case PARSER_OP_LE:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( x, y, _CMP_LE_OQ ), one ) ); break;
+		case PARSER_OP_GT:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( x, y, _CMP_GT_OQ ), one ) ); break;
+		case PARSER_OP_GE:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( x, y, _CMP_GE_OQ ), one ) ); break;
+		case PARSER_OP_EQ:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( _mm256_andnot_ps( sign, _mm256_sub_ps( x, y ) ), thresh, _CMP_LT_OQ ), one ) ); break;
+		case PARSER_OP_NE:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_cmp_ps( _mm256_andnot_ps( sign, _mm256_sub_ps( x, y ) ), thresh, _CMP_GT_OQ ), one ) ); break;
+		case PARSER_OP_AND:  PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_and_ps( _mm256_cmp_ps( _mm256_andnot_ps( sign, x ), thresh, _CMP_GE_OQ ), _mm256_cmp_ps( _mm256_andnot_ps( sign, y ), thresh, _CMP_GE_OQ ) ), one ) ); break;
+		case PARSER_OP_OR:   PARSER_AVX2_LOOP( _mm256_and_ps( _mm256_or_ps( _mm256_cmp_ps( _mm256_andnot_ps( sign, x ), thresh, _CMP_GE_OQ ), _mm256_cmp_ps( _mm256_andnot_ps( sign, y ), thresh, _CMP_GE_OQ ) ), one ) ); break;
+		case PARSER_OP_SQRT: PARSER_AVX2_LOOP( _mm256_sqrt_ps( x ) ); break;
+		case PARSER_OP_FABS: PARSER_AVX2_LOOP( _mm256_andnot_ps( sign, x ) ); break;
+		default: break;
+	}
+#undef PARSER_AVX2_LOOP
+	return r;
+}
+#endif
+
+int parser_simd_kernel( int op, double *v, const double *a, const double *b, int n ){
+	if( !parser_simd_supported( op ) )
+		return 0;
+#if defined(PARSER_SIMD_AVX2)
+	if( __builtin_cpu_supports( "avx2" ) )
+		return parser_simd_kernel_avx2( op, v, a, b, n );
+#endif
+#if defined(PARSER_SIMD_SSE2)
+	return parser_simd_kernel_sse2( op, v, a, b, n );
+#else
+	return 0;
+#endif
+}
+
+int parser_simd_kernel_float( int op, float *v, const float *a, const float *b, int n ){
+	if( !parser_simd_supported( op ) )
+		return 0;
+#if defined(PARSER_SIMD_AVX2)
+	if( __builtin_cpu_supports( "avx2" ) )
+		return parser_simd_kernel_float_avx2( op, v, a, b, n );
+#endif
+#if defined(PARSER_SIMD_SSE2)
+	return parser_simd_kernel_float_sse2( op, v, a, b, n );
+#else
+	return 0;
+#endif
+}
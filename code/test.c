@@ -6,49 +6,90 @@
 #include<math.h>
 #include<stdio.h>
 #include<string.h>
+#include<stdlib.h>
+#include<stdint.h>
 
 #include"expression_parser.h"
 
+/**
+ @brief compiles an expression with parser_compile() and evaluates the program once with parser_program_eval(), the compiled counterpart of parse_expression_with_callbacks(). if jit is true the program is compiled without optimizations, so every operation of the input is kept, and translated to machine code with parser_program_jit(), falling back to the interpreter where the JIT is not available. errors are printed and nan is returned on failure.
+*/
+double compile_expression_with_callbacks( const char *expr, parser_variable_callback variable_cb, parser_function_callback function_cb, void *user_data, int jit ){
+	parser_data pd;
+	parser_program *prog;
+	const char *error;
+	double val;
+	parser_data_init( &pd, expr, variable_cb, function_cb, user_data );
+	pd.optimize = !jit;
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("Error: %s\n", pd.error );
+		printf("Expression '%s' failed to compile, returning nan\n", expr );
+		return sqrt( -1.0 );
+	}
+	if( jit )
+		parser_program_jit( prog );
+	val = parser_program_eval( prog, user_data, &error );
+	if( error ){
+		printf("Error: %s\n", error );
+		printf("Expression '%s' failed to evaluate, returning nan\n", expr );
+	}
+	parser_program_free( prog );
+	return val;
+}
+
 /**
  @brief macro for checking the correctness of the parser. parses the input expression in C using the preprocessor and with the parser using preprocessor stringification and compares the results. if the results are within PARSER_BOOLEAN_EQUALITY_THRESHOLD of each other, the result is assumed correct.  note that the expression argument must be parsable in C from the calling scope, i.e. if variables and functions are used, they must be defined where this macro is called from or a compile error will result.
 */
 #define parser_check( result, expr ) { \
-                                       double c_value, p_value; \
+                                       double c_value, p_value, q_value, j_value; \
                                        c_value = (double) expr; \
                                        p_value = parse_expression( #expr ); \
+                                       q_value = compile_expression_with_callbacks( #expr, NULL, NULL, NULL, PARSER_FALSE ); \
+                                       j_value = compile_expression_with_callbacks( #expr, NULL, NULL, NULL, PARSER_TRUE ); \
                                        printf("  '%s'\n", #expr ); \
-                                       if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){ \
+                                       if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs( c_value - q_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (q_value == q_value) != (c_value == c_value) || fabs( c_value - j_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (j_value == j_value) != (c_value == c_value) ){ \
                                            *result = PARSER_FALSE; \
 										   printf("         C: %f\n", c_value ); \
                                            printf("    Parsed: %f\n", p_value ); \
+                                           printf("  Compiled: %f\n", q_value ); \
+                                           printf("       JIT: %f\n", j_value ); \
                                        } \
                                      }
 /**
  @brief macro for checking the correctness of the parser. parses the input expression in C using the preprocessor and with the parser using preprocessor stringification and compares the results. if the results are within PARSER_BOOLEAN_EQUALITY_THRESHOLD of each other, the result is assumed correct.  note that the expression argument must be parsable in C from the calling scope, i.e. if variables and functions are used, they must be defined where this macro is called from or a compile error will result.
  */
 #define parser_check_with_callbacks( result, expr, user_vars, user_fncs, user_data ) { \
-                                                                                       double c_value, p_value; \
+                                                                                       double c_value, p_value, q_value, j_value; \
                                                                                        c_value = (double) expr; \
                                                                                        p_value = parse_expression_with_callbacks( #expr, user_vars, user_fncs, user_data ); \
+                                                                                       q_value = compile_expression_with_callbacks( #expr, user_vars, user_fncs, user_data, PARSER_FALSE ); \
+                                                                                       j_value = compile_expression_with_callbacks( #expr, user_vars, user_fncs, user_data, PARSER_TRUE ); \
                                                                                        printf("  '%s'\n", #expr ); \
-																					   if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){ \
+																					   if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs( c_value - q_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (q_value == q_value) != (c_value == c_value) || fabs( c_value - j_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (j_value == j_value) != (c_value == c_value) ){ \
                                                                                            *result = PARSER_FALSE; \
 																					       printf("         C: %f\n", c_value ); \
                                                                                            printf("    Parsed: %f\n", p_value ); \
+                                                                                           printf("  Compiled: %f\n", q_value ); \
+                                                                                           printf("       JIT: %f\n", j_value ); \
 																					  } \
 																					}
 /**
  @brief macro for checking the correctness of the parser. parses the input expression in C using the preprocessor and with the parser using preprocessor stringification and compares the results. if the results are within PARSER_BOOLEAN_EQUALITY_THRESHOLD of each other, the result is assumed correct.  note that the expression argument must be parsable in C from the calling scope, i.e. if variables and functions are used, they must be defined where this macro is called from or a compile error will result.
  */
 #define parser_check_boolean( result, expr ) { \
-                                               double c_value, p_value; \
+                                               double c_value, p_value, q_value, j_value; \
                                                c_value = (double) expr; \
                                                p_value = parse_expression( #expr ); \
+                                               q_value = compile_expression_with_callbacks( #expr, NULL, NULL, NULL, PARSER_FALSE ); \
+                                               j_value = compile_expression_with_callbacks( #expr, NULL, NULL, NULL, PARSER_TRUE ); \
 	                                           printf("  '%s'\n", #expr ); \
-                                               if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){ \
+                                               if( fabs( c_value - p_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || fabs( c_value - q_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (q_value == q_value) != (c_value == c_value) || fabs( c_value - j_value ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || (j_value == j_value) != (c_value == c_value) ){ \
                                                    *result = PARSER_FALSE; \
                                                    printf("         C: %f\n", c_value ); \
                                                    printf("    Parsed: %f\n", p_value ); \
+                                                   printf("  Compiled: %f\n", q_value ); \
+                                                   printf("       JIT: %f\n", j_value ); \
 											   } \
                                              }
 /**
@@ -134,6 +175,420 @@ void run_boolean_compound_tests(){
 	printf( "%s\n\n", result ? "passed" : "failed" );	
 }
 
+/**
+ @brief test that the built-in functions and arithmetic operations produce the same results in C, the parser and compiled programs
+*/
+void run_builtin_tests(){
+	int result = 1;
+	printf("Testing arithmetic and built-in functions:\n");
+	parser_check( &result, 2.0 + 3.0*4.0 - 6.0/3.0 );
+	parser_check( &result, -(3.0 - 4.0)/2.0 );
+	parser_check( &result, pow( 2.0, 3.0 ) );
+	parser_check( &result, sqrt( 2.0 ) );
+	parser_check( &result, log( 2.0 ) + exp( 0.5 ) );
+	parser_check( &result, sin( 0.3 ) + cos( 0.3 ) + tan( 0.3 ) );
+	parser_check( &result, asin( 0.3 ) + acos( 0.3 ) + atan( 0.3 ) );
+	parser_check( &result, atan2( 1.0, 2.0 ) );
+	parser_check( &result, fabs( -2.5 ) );
+	parser_check( &result, abs( -3 ) );
+	parser_check( &result, floor( 2.5 ) + floor( -2.5 ) );
+	parser_check( &result, ceil( 2.5 ) + ceil( -2.5 ) );
+	parser_check( &result, round( 2.5 ) + round( -2.4 ) );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief variable callback reading the variable 'x' from the user data pointer, used to check that compiled programs see updated variable values on every evaluation
+*/
+int user_var_x_cb( void *user_data, const char *name, double *value ){
+	if( strcmp( name, "x" ) == 0 ){
+		*value = *((double*)user_data);
+		return PARSER_TRUE;
+	}
+	return PARSER_FALSE;
+}
+
+/**
+ @brief parses and compiles an expression with the variable 'x', with both the precedence climbing and the recursive descent grammar, optimized and through the JIT, and checks the value, or, if error is not NULL, that all of them fail with that error
+ @return PARSER_TRUE if the parser and the compiled program agree with the expectation
+*/
+int check_parse_and_compile( const char *expr, double x, double expected, const char *error ){
+	const char *grammars[] = { "precedence climbing", "recursive descent" };
+	parser_data pd;
+	parser_program *prog;
+	const char *eval_error;
+	double parsed, compiled;
+	int rd, jit;
+
+	for( rd=0; rd<2; rd++ ){
+		parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+		pd.recursive_descent = rd;
+		parsed = parser_parse( &pd );
+		if( error ? !pd.error || strcmp( pd.error, error ) != 0 : pd.error || fabs( parsed - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+			printf("  parsing '%.40s' (%s): expected %s, got %f (%s)\n", expr, grammars[rd], error ? error : "a value", parsed, pd.error ? pd.error : "no error" );
+			return PARSER_FALSE;
+		}
+		// optimized, then unoptimized and translated by the JIT, so that
+		// every operation of the input is evaluated at run time
+		for( jit=0; jit<2; jit++ ){
+			parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+			pd.recursive_descent = rd;
+			pd.optimize = !jit;
+			prog = parser_compile( &pd );
+			eval_error = NULL;
+			compiled = 0.0;
+			if( prog ){
+				if( jit )
+					parser_program_jit( prog );
+				compiled = parser_program_eval( prog, &x, &eval_error );
+			}
+			parser_program_free( prog );
+			if( error ? prog || !pd.error || strcmp( pd.error, error ) != 0 : !prog || eval_error || fabs( compiled - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  compiling '%.40s' (%s%s): expected %s, got %f (%s)\n", expr, grammars[rd], jit ? ", jit" : "", error ? error : "a value", compiled, pd.error ? pd.error : "no error" );
+				return PARSER_FALSE;
+			}
+		}
+	}
+	return PARSER_TRUE;
+}
+
+/**
+ @brief test the tokenizer: every kind of whitespace, inputs much longer than the token window and the quirks of the grammar that depend on whitespace, which must be the same for the parser and compiled programs
+*/
+void run_tokenizer_tests(){
+	char *expr, name[PARSER_MAX_TOKEN_SIZE+2];
+	int i, len, result = 1;
+	double expected;
+
+	printf("Testing the tokenizer:\n");
+	result &= check_parse_and_compile( "\t2.0 *\n( 3.0\r+\v1.0 )\f", 0.0, 8.0, NULL );
+	result &= check_parse_and_compile( "2.5e1*x-.5E-1+3.", 2.0, 53.0 - 0.05, NULL );
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	result &= check_parse_and_compile( "x!=2 && !x<=1 || x==0", 2.0, 0.0, NULL );
+#endif
+
+	// a sign is part of a literal only if it directly precedes the digits,
+	// and a function name must be directly followed by its argument list
+	result &= check_parse_and_compile( "- -3", 0.0, 3.0, NULL );
+	result &= check_parse_and_compile( "2^- -x", 2.0, 4.0, NULL );
+	result &= check_parse_and_compile( "- - -3", 0.0, -3.0, NULL );
+	result &= check_parse_and_compile( "- - - 3", 0.0, 0.0, "Failed to read real number" );
+	result &= check_parse_and_compile( "x (4)", 0.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	// single characters of two character operators
+	result &= check_parse_and_compile( "1 & 2", 0.0, 0.0, "Expected '&' to follow '&' in logical and operation!" );
+	result &= check_parse_and_compile( "1 | 2", 0.0, 0.0, "Expected '|' to follow '|' in logical or operation!" );
+	result &= check_parse_and_compile( "1 = 2", 0.0, 0.0, "Expected a '=' for boolean '==' operator!" );
+#endif
+	result &= check_parse_and_compile( "1 + $", 0.0, 0.0, "Failed to read real number" );
+
+	// identifiers longer than PARSER_MAX_TOKEN_SIZE are rejected
+	memset( name, 'x', sizeof(name)-1 );
+	name[sizeof(name)-1] = '\0';
+	result &= check_parse_and_compile( name, 0.0, 0.0, "Identifier too long, increase PARSER_MAX_TOKEN_SIZE and recompile!" );
+
+	// a long expression, so that signed literals and two character operators
+	// straddle the boundaries of the token window at every offset
+	expr = malloc( 64*1000 );
+	if( !expr ){
+		printf("  out of memory\n");
+		result = PARSER_FALSE;
+	} else {
+		len = 0;
+		expected = 0.0;
+		for( i=0; i<1000; i++ ){
+			len += sprintf( expr+len, "%s%d*x - -%d.5 - (x>=%d)", i ? " + " : "", i, i%7, i%3 );
+			expected += i*1.5 + (i%7) + 0.5 - (1.5 >= i%3);
+		}
+		result &= check_parse_and_compile( expr, 1.5, expected, NULL );
+		free( expr );
+	}
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test the precedence and associativity of the operators, including the quirks of unary signs, and the nesting limit of the precedence climbing parser
+*/
+void run_precedence_tests(){
+	const char *nested = "Expression nested too deeply, increase PARSER_MAX_NESTING_DEPTH and recompile!";
+	parser_data pd;
+	parser_program *prog;
+	char *expr;
+	int i, len, result = 1;
+	double x = 2.0;
+
+	printf("Testing operator precedence:\n");
+	result &= check_parse_and_compile( "2^3^2", 0.0, 512.0, NULL );
+	result &= check_parse_and_compile( "2^-1^2", 0.0, 0.5, NULL );
+	result &= check_parse_and_compile( "2-3-4 + 8/4/2", 0.0, -4.0, NULL );
+	result &= check_parse_and_compile( "1 + 2*3^2 - 4/x", 2.0, 17.0, NULL );
+
+	// a leading sign applies to the whole term, a sign after '*' only to
+	// the following operand, before the exponentiation
+	result &= check_parse_and_compile( "-x^2", 3.0, -9.0, NULL );
+	result &= check_parse_and_compile( "3*-x^2", 2.0, 12.0, NULL );
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	result &= check_parse_and_compile( "1 < -x^2", 2.0, 0.0, NULL );
+	result &= check_parse_and_compile( "!x^2 + 1", 0.0, 2.0, NULL );
+#endif
+
+	// a leading sign is 0 - v and 0 + v, so it never produces a negative zero
+	// from a positive one, nor keeps a negative zero, e.g. in atan2(y, -1)
+	result &= check_parse_and_compile( "atan2(-(1<0), -1)", 0.0, 3.14159265358979, NULL );
+	result &= check_parse_and_compile( "atan2(+(-0.0*1), -1)", 0.0, 3.14159265358979, NULL );
+	result &= check_parse_and_compile( "atan2(-x, -1)", 0.0, 3.14159265358979, NULL );
+
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	// comparisons bind tighter than equality tests, neither chains
+	result &= check_parse_and_compile( "1 < 2 == x > 3", 4.0, 1.0, NULL );
+	result &= check_parse_and_compile( "x == 1 && 2 != 3 || 0", 1.0, 1.0, NULL );
+	result &= check_parse_and_compile( "(1 < 2) < 3", 0.0, 1.0, NULL );
+	result &= check_parse_and_compile( "1 < 2 < 3", 0.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+	result &= check_parse_and_compile( "1 == 1 != 0", 0.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+	result &= check_parse_and_compile( "(1 == 1 == 1)", 0.0, 0.0, "Expected ')'!" );
+
+	// the conditional is the loosest level, nothing applies to it as a whole
+	result &= check_parse_and_compile( "1 ? 7 : 0 == 0 == 0", 0.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+	result &= check_parse_and_compile( "1 ? 2 : 3 < 4 < 5", 0.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+	result &= check_parse_and_compile( "0 ? 2 : x ? 3 : 4 == 4", 0.0, 1.0, NULL );
+#endif
+
+	// nesting is limited by PARSER_MAX_NESTING_DEPTH rather than the stack
+	expr = malloc( 4*PARSER_MAX_NESTING_DEPTH + 16 );
+	if( !expr ){
+		printf("  out of memory\n");
+		result = PARSER_FALSE;
+	} else {
+		for( len=0, i=0; i<PARSER_MAX_NESTING_DEPTH/2; i++ )
+			expr[len++] = '(';
+		expr[len++] = 'x';
+		for( i=0; i<PARSER_MAX_NESTING_DEPTH/2; i++ )
+			expr[len++] = ')';
+		expr[len] = '\0';
+		result &= check_parse_and_compile( expr, 2.0, 2.0, NULL );
+
+		for( len=0, i=0; i<2*PARSER_MAX_NESTING_DEPTH; i++ )
+			len += sprintf( expr+len, "x^" );
+		expr[len++] = '1';
+		expr[len] = '\0';
+		// the recursive descent parser has no limit, only the default grammar is checked
+		parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+		parser_parse( &pd );
+		if( !pd.error || strcmp( pd.error, nested ) != 0 ){
+			printf("  parsing %d nested exponents: expected '%s'\n", 2*PARSER_MAX_NESTING_DEPTH, nested );
+			result = PARSER_FALSE;
+		}
+		parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+		prog = parser_compile( &pd );
+		if( prog || !pd.error || strcmp( pd.error, nested ) != 0 ){
+			printf("  compiling %d nested exponents: expected '%s'\n", 2*PARSER_MAX_NESTING_DEPTH, nested );
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+		free( expr );
+	}
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief parses and compiles a numeric literal and checks that both give exactly the value strtod() gives, bit for bit
+ @return PARSER_TRUE if the parser and the compiled program agree with strtod()
+*/
+int check_literal( const char *literal ){
+	parser_data pd;
+	parser_program *prog;
+	const char *eval_error = NULL;
+	double expected = strtod( literal, NULL ), parsed, compiled = 0.0;
+
+	parser_data_init( &pd, literal, NULL, NULL, NULL );
+	parsed = parser_parse( &pd );
+	parser_data_init( &pd, literal, NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( prog )
+		compiled = parser_program_eval( prog, NULL, &eval_error );
+	parser_program_free( prog );
+	if( memcmp( &parsed, &expected, sizeof(double) ) != 0 || !prog || eval_error || memcmp( &compiled, &expected, sizeof(double) ) != 0 ){
+		printf("  '%.60s': expected %.17g, parsed %.17g, compiled %.17g\n", literal, expected, parsed, compiled );
+		return PARSER_FALSE;
+	}
+	return PARSER_TRUE;
+}
+
+/**
+ @brief test the conversion of numeric literals against strtod(): literals that are hard to round, such as values halfway between two doubles, subnormal values and overflow, and random literals of up to 1000 digits with random exponents
+*/
+void run_literal_tests(){
+	const char *literals[] = {
+		"0", "0.0", "000.000e5", "1", "0.1", "5.", ".5", "1e23", "8.589973e9", "123456789012345678901234567890",
+		"9007199254740993", "9007199254740992.5", "9007199254740993.0000000000000000000000000001",
+		"1.7976931348623157e308", "1.7976931348623158e308", "1.7976931348623159e308", "1e309", "1e99999",
+		"2.2250738585072011e-308", "2.2250738585072014e-308", "4.9406564584124654e-324",
+		"2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400", "1e-99999", NULL
+	};
+	char literal[1100];
+	unsigned long seed = 12345;
+	int i, j, len, num_digits, result = 1;
+	double value;
+
+	printf("Testing numeric literals:\n");
+	for( i=0; literals[i]; i++ )
+		result &= check_literal( literals[i] );
+
+	// a literal without digits is an error, an exponent without digits is ignored
+	result &= check_parse_and_compile( ".", 0.0, 0.0, "Failed to read real number" );
+	result &= check_parse_and_compile( ".e5", 0.0, 0.0, "Failed to read real number" );
+	result &= check_parse_and_compile( "2e+*x", 3.0, 6.0, NULL );
+
+	for( i=0; i<20000 && result; i++ ){
+		seed = ( seed*1103515245 + 12345 ) & 0x7FFFFFFF;
+		if( i%4 == 0 ){
+			// random doubles printed with up to 17 digits, the shortest
+			// literals that are just off halfway between two doubles
+			value = ldexp( (double)seed / 0x7FFFFFFF, (int)(seed % 2100) - 1075 );
+			len = sprintf( literal, "%.*g", (int)(seed % 17) + 1, value );
+		} else {
+			// random digits with a random decimal point and exponent, a few
+			// of them longer than the 800 digits the slow path keeps
+			num_digits = i%100 == 1 ? 900 + (int)(seed % 100) : 1 + (int)(seed % 40);
+			len = 0;
+			for( j=0; j<num_digits; j++ ){
+				seed = ( seed*1103515245 + 12345 ) & 0x7FFFFFFF;
+				if( j == num_digits/2 && seed % 3 == 0 )
+					literal[len++] = '.';
+				literal[len++] = (char)( '0' + (seed >> 8) % 10 );
+			}
+			if( seed % 2 )
+				len += sprintf( literal+len, "e%d", (int)(seed >> 4) % 760 - 380 );
+			literal[len] = '\0';
+		}
+		result &= check_literal( literal );
+	}
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test that a compiled program can be evaluated many times with different variable values, and that evaluation errors are reported
+*/
+void run_compiled_program_tests(){
+	int i, result = 1;
+	double x = 0.0, value;
+	const char *error;
+	parser_data pd;
+	parser_program *prog;
+
+	printf("Testing repeated evaluation of compiled programs:\n");
+	parser_data_init( &pd, "x*x + 2*x - sqrt( x )", user_var_x_cb, NULL, &x );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  compilation failed: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		for( i=0; i<10; i++ ){
+			x = 0.5*i;
+			value = parser_program_eval( prog, &x, &error );
+			if( error || fabs( value - (x*x + 2*x - sqrt( x )) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  x = %f: expected %f, got %f\n", x, x*x + 2*x - sqrt( x ), value );
+				result = PARSER_FALSE;
+			}
+		}
+
+		// domain errors are reported at evaluation time
+		x = -1.0;
+		value = parser_program_eval( prog, &x, &error );
+		if( !error || value == value ){
+			printf("  expected a domain error for x = -1\n");
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+	}
+
+	// malformed input fails to compile
+	parser_data_init( &pd, "1 **/ 34 ", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( prog || !pd.error ){
+		printf("  expected '1 **/ 34 ' to fail to compile\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test that constant subexpressions are folded at compile time, that results are unchanged and that domain errors in constant subexpressions are still reported when the program is evaluated
+*/
+void run_constant_folding_tests(){
+	const char *exprs[] = { "2*3.14159*(3.0/4.0)*x", "sqrt(2) + x", "x*pow(10, -3)", "-(4 - 2^3) + x", "(1 < 2 && 3 != 3) + x", NULL };
+	const char *unbound[] = { "x + sqrt(-1) + y", "x + y + sqrt(-1)", NULL };
+	const char *error, *parse_error;
+	int i, jit, result = 1;
+	double x = 0.5, value, expected;
+	parser_data pd;
+	parser_program *prog;
+
+	printf("Testing constant folding of compiled programs:\n");
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], user_var_x_cb, NULL, &x );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		// every expression folds to a literal, the variable and one operation
+		value = parser_program_eval( prog, &x, &error );
+		expected = parse_expression_with_callbacks( exprs[i], user_var_x_cb, NULL, &x );
+		if( parser_program_num_nodes( prog ) != 3 || error || fabs( value - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+			printf("  '%s': expected %f in 3 nodes, got %f in %d nodes\n", exprs[i], expected, value, parser_program_num_nodes( prog ) );
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+	}
+
+	// fully constant expressions fold to a single literal
+	parser_data_init( &pd, "sqrt(2)*2 + floor(2.5)", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog || parser_program_num_nodes( prog ) != 1 || fabs( parser_program_eval( prog, NULL, &error ) - (sqrt(2.0)*2.0 + 2.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+		printf("  expected 'sqrt(2)*2 + floor(2.5)' to fold to a single literal\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// domain errors are not folded away, the program reports them like the parser
+	parser_data_init( &pd, "x + sqrt(-1)*2", user_var_x_cb, NULL, &x );
+	parser_parse( &pd );
+	parse_error = pd.error;
+	parser_data_init( &pd, "x + sqrt(-1)*2", user_var_x_cb, NULL, &x );
+	prog = parser_compile( &pd );
+	value = prog ? parser_program_eval( prog, &x, &error ) : 0.0;
+	if( !prog || !error || !parse_error || strcmp( error, parse_error ) != 0 || value == value ){
+		printf("  expected evaluating 'x + sqrt(-1)*2' to report '%s'\n", parse_error ? parse_error : "" );
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// the unbound variable y is read after the domain error in the first
+	// expression and before it in the second, the error that comes first wins
+	for( i=0; unbound[i]; i++ ){
+		parser_data_init( &pd, unbound[i], user_var_x_cb, NULL, &x );
+		parser_parse( &pd );
+		parse_error = pd.error;
+		for( jit=0; jit<2; jit++ ){
+			parser_data_init( &pd, unbound[i], user_var_x_cb, NULL, &x );
+			prog = parser_compile( &pd );
+			if( prog && jit )
+				parser_program_jit( prog );
+			value = prog ? parser_program_eval( prog, &x, &error ) : 0.0;
+			if( !prog || !error || !parse_error || strcmp( error, parse_error ) != 0 || value == value ){
+				printf("  expected evaluating '%s'%s to report '%s', got '%s'\n", unbound[i], jit ? " with the JIT" : "", parse_error ? parse_error : "", prog && error ? error : "" );
+				result = PARSER_FALSE;
+			}
+			parser_program_free( prog );
+		}
+	}
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
 /** 
     @brief test function for malformed inputs, to be sure that they throw errors appropriately. Note that there are lots of examples of counter-intuitive expressions that evaluate 'correctly', e.g. 1 + + -3 = -2.0 due to the binding of unary + and - operators.
 */
@@ -223,6 +678,1503 @@ int user_var_cb( void *user_data, const char *name, double *value ){
 	return PARSER_FALSE;
 }
 
+/**
+ @brief test evaluation of compiled programs with variable values supplied by slot, as an array of values or of pointers
+*/
+void run_variable_slot_tests(){
+	int i, result = 1;
+	double slots[3], *pointers[3], value;
+	const char *error, *names[] = { "x", "_y1", "a" };
+	parser_data pd;
+	parser_program *prog;
+
+	printf("Testing slot-indexed variables:\n");
+	parser_data_init( &pd, "x*x + x - _y1/a + x", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog || parser_program_num_variables( prog ) != 3 ){
+		printf("  expected three variables\n");
+		result = PARSER_FALSE;
+	} else {
+		for( i=0; i<3; i++ ){
+			if( strcmp( parser_program_variable_name( prog, i ), names[i] ) != 0 || parser_program_variable_slot( prog, names[i] ) != i ){
+				printf("  unexpected slot for variable '%s'\n", names[i] );
+				result = PARSER_FALSE;
+			}
+		}
+		if( parser_program_variable_slot( prog, "y" ) != -1 || parser_program_variable_name( prog, 3 ) != NULL ){
+			printf("  expected lookup of unknown variables to fail\n");
+			result = PARSER_FALSE;
+		}
+
+		slots[0] = 2.0;
+		slots[1] = 3.0;
+		slots[2] = 4.0;
+		value = parser_program_eval_slots( prog, slots, NULL, &error );
+		if( error || fabs( value - (2.0*2.0 + 2.0 - 3.0/4.0 + 2.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+			printf("  eval_slots: expected %f, got %f\n", 2.0*2.0 + 2.0 - 3.0/4.0 + 2.0, value );
+			result = PARSER_FALSE;
+		}
+
+		pointers[0] = slots+2;
+		pointers[1] = slots+1;
+		pointers[2] = slots;
+		value = parser_program_eval_pointers( prog, (const double * const *)pointers, NULL, &error );
+		if( error || fabs( value - (4.0*4.0 + 4.0 - 3.0/2.0 + 4.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+			printf("  eval_pointers: expected %f, got %f\n", 4.0*4.0 + 4.0 - 3.0/2.0 + 4.0, value );
+			result = PARSER_FALSE;
+		}
+	}
+	parser_program_free( prog );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief number of calls made to native_counted(), used to check that pure functions with constant arguments are only evaluated at compile time
+*/
+int native_calls = 0;
+
+/**
+ @brief native function returning the largest of its arguments
+*/
+int native_max( void *user_data, const int num_args, const double *args, double *value ){
+	int i;
+	*value = args[0];
+	for( i=1; i<num_args; i++ )
+		*value = args[i] > *value ? args[i] : *value;
+	return PARSER_TRUE;
+}
+
+/**
+ @brief native function returning its argument and counting the number of calls
+*/
+int native_counted( void *user_data, const int num_args, const double *args, double *value ){
+	native_calls++;
+	*value = args[0];
+	return PARSER_TRUE;
+}
+
+/**
+ @brief native function that fails for negative arguments
+*/
+int native_checked_sqrt( void *user_data, const int num_args, const double *args, double *value ){
+	if( args[0] < 0.0 )
+		return PARSER_FALSE;
+	*value = sqrt( args[0] );
+	return PARSER_TRUE;
+}
+
+/**
+ @brief test the native function registry with the parser, compiled programs and batch evaluation, including arity checks and compile-time evaluation of pure functions
+*/
+void run_registry_tests(){
+	int i, calls, result = 1;
+	double x = 2.0, value, xs[4] = { 0.0, 1.0, 2.0, 3.0 }, out[4], failing[8], failing_out[8];
+	float failing_fout[8];
+	const char *error;
+	parser_registry *reg;
+	parser_data pd;
+	parser_program *prog;
+	parser_binding binding;
+	parser_batch pb;
+
+	printf("Testing native function registry:\n");
+	reg = parser_registry_new();
+	if( !reg || !parser_registry_add( reg, "max_value", native_max, 1, PARSER_MAX_ARGUMENT_COUNT, PARSER_FUNCTION_PURE ) ||
+	    !parser_registry_add( reg, "pure_counted", native_counted, 1, 1, PARSER_FUNCTION_PURE ) ||
+	    !parser_registry_add( reg, "counted", native_counted, 1, 1, 0 ) ||
+	    !parser_registry_add( reg, "checked_sqrt", native_checked_sqrt, 1, 1, PARSER_FUNCTION_PURE ) ){
+		printf("  failed to register functions\n");
+		parser_registry_free( reg );
+		printf( "failed\n\n" );
+		return;
+	}
+	if( parser_registry_add( reg, "sqrt", native_checked_sqrt, 1, 1, 0 ) || parser_registry_add( reg, "too_many", native_max, 0, PARSER_MAX_ARGUMENT_COUNT+1, 0 ) ){
+		printf("  expected registration of a built-in name and of too many arguments to fail\n");
+		result = PARSER_FALSE;
+	}
+
+	// the direct parser resolves registered functions too
+	parser_data_init( &pd, "max_value( 1.0, x, 3.5, -2.0 ) + checked_sqrt( 4.0 )", user_var_x_cb, NULL, &x );
+	pd.registry = reg;
+	value = parser_parse( &pd );
+	if( pd.error || fabs( value - 5.5 ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+		printf("  parse: expected 5.5, got %f\n", value );
+		result = PARSER_FALSE;
+	}
+
+	// compiled programs call the function pointer directly
+	parser_data_init( &pd, "max_value( x, 1.5 ) + counted( x ) + pure_counted( 3.0 )", user_var_x_cb, NULL, &x );
+	pd.registry = reg;
+	native_calls = 0;
+	prog = parser_compile( &pd );
+	if( !prog || native_calls != 1 ){
+		printf("  expected pure_counted( 3.0 ) to be evaluated once at compile time\n");
+		result = PARSER_FALSE;
+	} else {
+		for( i=0; i<5; i++ ){
+			x = i;
+			value = parser_program_eval( prog, &x, &error );
+			if( error || fabs( value - ((x > 1.5 ? x : 1.5) + x + 3.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  x = %f: expected %f, got %f\n", x, (x > 1.5 ? x : 1.5) + x + 3.0, value );
+				result = PARSER_FALSE;
+			}
+		}
+		if( native_calls != 6 ){
+			printf("  expected one call of counted() per evaluation, got %d calls\n", native_calls-1 );
+			result = PARSER_FALSE;
+		}
+
+		binding.name   = "x";
+		binding.data   = xs;
+		binding.stride = 0;
+		binding.type   = PARSER_TYPE_DOUBLE;
+		parser_batch_init( &pb, prog, &binding, 1, NULL );
+		calls = native_calls;
+		parser_batch_eval( &pb, 4, out );
+		for( i=0; i<4; i++ ){
+			if( fabs( out[i] - ((xs[i] > 1.5 ? xs[i] : 1.5) + xs[i] + 3.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  batch row %d: expected %f, got %f\n", i, (xs[i] > 1.5 ? xs[i] : 1.5) + xs[i] + 3.0, out[i] );
+				result = PARSER_FALSE;
+			}
+		}
+		if( pb.error || native_calls != calls+4 ){
+			printf("  expected one call of counted() per batch row\n");
+			result = PARSER_FALSE;
+		}
+	}
+	parser_program_free( prog );
+
+	// rows that already failed make no further calls, in double and single
+	// precision, as when they are evaluated one at a time
+	parser_data_init( &pd, "counted( sqrt( x ) )", NULL, NULL, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  'counted( sqrt( x ) )' failed to compile: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		for( i=0; i<8; i++ )
+			failing[i] = i % 2 ? -1.0 - i : (double)i;
+		native_calls = 0;
+		for( i=0; i<8; i++ )
+			parser_program_eval_slots( prog, failing+i, NULL, &error );
+		calls = native_calls;
+		binding.name   = "x";
+		binding.data   = failing;
+		binding.stride = 0;
+		binding.type   = PARSER_TYPE_DOUBLE;
+		parser_batch_init( &pb, prog, &binding, 1, NULL );
+		for( i=0; i<2; i++ ){
+			native_calls = 0;
+			if( i == 0 )
+				parser_batch_eval( &pb, 8, failing_out );
+			else
+				parser_batch_eval_float( &pb, 8, failing_fout );
+			if( !pb.error || native_calls != calls ){
+				printf("  %s batch evaluation made %d calls of counted(), row by row evaluation %d\n", i == 0 ? "double" : "single precision", native_calls, calls );
+				result = PARSER_FALSE;
+			}
+		}
+	}
+	parser_program_free( prog );
+
+	// arity is checked at compile time and failed calls are reported at evaluation time
+	parser_data_init( &pd, "max_value()", NULL, NULL, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	if( prog || !pd.error ){
+		printf("  expected 'max_value()' to fail to compile\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+	parser_data_init( &pd, "checked_sqrt( -1.0 )", NULL, NULL, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	value = prog ? parser_program_eval( prog, NULL, &error ) : 0.0;
+	if( !prog || !error || value == value ){
+		printf("  expected 'checked_sqrt( -1.0 )' to fail to evaluate\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test common subexpression elimination within an expression and across the expressions of a set, checking that results are unchanged and that impure functions are still called once per occurrence
+*/
+void run_common_subexpression_tests(){
+	const char *set[] = { "exp( -(x-1)^2/(2*0.3^2) )", "0.5*exp( -(x-1)^2/(2*0.3^2) )*(x-1)", "(x-1)^2 + x", "x+" };
+	const char *gauss = "exp( -(x-1)^2/(2*0.3^2) ) + 0.25*exp( -(x-1)^2/(2*0.3^2) )*(1-x)";
+	double x = 0.75, value, expected, outputs[3], xs[3] = { 0.0, 0.75, 2.0 }, out[3], columns[3][3], *cols[3];
+	int i, j, k, result = 1;
+	const char *error;
+	parser_registry *reg;
+	parser_data pd;
+	parser_program *prog;
+	parser_binding binding;
+	parser_batch pb;
+	parser_pool *pool;
+
+	printf("Testing common subexpression elimination:\n");
+
+	// the repeated gaussian and x-1 are evaluated once
+	parser_data_init( &pd, gauss, user_var_x_cb, NULL, &x );
+	prog = parser_compile( &pd );
+	value = prog ? parser_program_eval( prog, &x, &error ) : 0.0;
+	expected = parse_expression_with_callbacks( gauss, user_var_x_cb, NULL, &x );
+	if( !prog || parser_program_num_eliminated( prog ) < 7 || fabs( value - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+		printf("  '%s': expected %f with at least 7 eliminated nodes, got %f with %d\n", gauss, expected, value, prog ? parser_program_num_eliminated( prog ) : 0 );
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// operands of commutative operations are matched in either order
+	parser_data_init( &pd, "x*2 + 2*x", user_var_x_cb, NULL, &x );
+	prog = parser_compile( &pd );
+	if( !prog || parser_program_num_nodes( prog ) != 4 || fabs( parser_program_eval( prog, &x, &error ) - 4.0*x ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+		printf("  expected 'x*2 + 2*x' to compile to 4 nodes\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// calls of impure functions are never merged
+	reg = parser_registry_new();
+	parser_registry_add( reg, "counted", native_counted, 1, 1, 0 );
+	parser_data_init( &pd, "counted( x ) + counted( x )", user_var_x_cb, NULL, &x );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	native_calls = 0;
+	value = prog ? parser_program_eval( prog, &x, &error ) : 0.0;
+	if( !prog || native_calls != 2 || fabs( value - 2.0*x ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+		printf("  expected 'counted( x ) + counted( x )' to call counted() twice, got %d calls\n", native_calls );
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+	parser_registry_free( reg );
+
+	// expressions compiled together share their common subexpressions
+	parser_data_init( &pd, "", user_var_x_cb, NULL, &x );
+	prog = parser_compile_set( &pd, set, 3 );
+	if( !prog || parser_program_num_outputs( prog ) != 3 || parser_program_num_eliminated( prog ) < 10 ){
+		printf("  expected the expression set to compile with at least 10 eliminated nodes\n");
+		result = PARSER_FALSE;
+	} else {
+		if( !parser_program_eval_set( prog, &x, outputs, &error ) )
+			result = PARSER_FALSE;
+		for( i=0; i<3; i++ ){
+			expected = parse_expression_with_callbacks( set[i], user_var_x_cb, NULL, &x );
+			if( fabs( outputs[i] - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  '%s': expected %f, got %f\n", set[i], expected, outputs[i] );
+				result = PARSER_FALSE;
+			}
+		}
+
+		// batch evaluation produces the first expression
+		binding.name   = "x";
+		binding.data   = xs;
+		binding.stride = 0;
+		binding.type   = PARSER_TYPE_DOUBLE;
+		parser_batch_init( &pb, prog, &binding, 1, NULL );
+		parser_batch_eval( &pb, 3, out );
+		for( i=0; i<3; i++ ){
+			expected = exp( -(xs[i]-1.0)*(xs[i]-1.0)/(2.0*0.3*0.3) );
+			if( pb.error || fabs( out[i] - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  batch row %d: expected %f, got %f\n", i, expected, out[i] );
+				result = PARSER_FALSE;
+			}
+		}
+
+		// batch evaluation of the whole set writes a column per expression,
+		// on the calling thread and on a pool
+		for( i=0; i<3; i++ )
+			cols[i] = columns[i];
+		pool = parser_pool_new( 2 );
+		for( k=0; k<2; k++ ){
+			if( !( k == 0 ? parser_batch_eval_set( &pb, 3, cols ) : parser_batch_eval_set_parallel( &pb, pool, 3, cols ) ) )
+				result = PARSER_FALSE;
+			for( i=0; i<3; i++ ){
+				x = xs[i];
+				parser_program_eval_set( prog, &x, outputs, &error );
+				for( j=0; j<3; j++ ){
+					if( columns[j][i] != outputs[j] ){
+						printf("  batch set row %d, expression %d: expected %f, got %f\n", i, j, outputs[j], columns[j][i] );
+						result = PARSER_FALSE;
+					}
+				}
+			}
+		}
+		parser_pool_free( pool );
+	}
+	parser_program_free( prog );
+
+	// a malformed expression fails the whole set
+	parser_data_init( &pd, "", user_var_x_cb, NULL, &x );
+	prog = parser_compile_set( &pd, set, 4 );
+	if( prog || !pd.error ){
+		printf("  expected a set containing 'x+' to fail to compile\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test programs translated to machine code with parser_program_jit() against the interpreter over a range of variable values, including domain errors, nan operands and native function calls. the parser_check macros cover the remaining operations.
+*/
+void run_jit_tests(){
+	const char *exprs[] = {
+		"sqrt( x ) + log( x ) - asin( x - 1.5 ) * acos( 1.5 - x )",
+		"(x < 1) + (x <= 1)*2 + (x > 1)*4 + (x >= 1)*8 + (x == 1)*16 + (x != 1)*32",
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		"!x + (x && x - 1) + (x || 0) - -x + fabs( -x )",
+#endif
+		"pow( x, 2.5 ) + atan2( x, 2 ) + floor( x ) + ceil( x ) + round( x ) + exp( -x )",
+		"max_value( x, 1, sqrt( x ) ) * checked_sqrt( x - 1.5 )",
+		"(x > 1 ? sqrt( x - 1 ) : -x) + (x < 0.5 || log( x ) > 0) - (x >= 0 && asin( x - 1 ) > 0)",
+		NULL
+	};
+	double xs[] = { 0.0, 0.5, 1.0, 1.5, 2.0, 2.5, -1.0 }, nan = sqrt( -1.0 ), x, a, b;
+	const char *ea, *eb;
+	int i, j, result = 1;
+	parser_registry *reg;
+	parser_program *jit, *interp;
+	parser_data pd;
+
+	printf("Testing machine code translation of compiled programs:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "max_value", native_max, 1, PARSER_MAX_ARGUMENT_COUNT, PARSER_FUNCTION_PURE );
+	parser_registry_add( reg, "checked_sqrt", native_checked_sqrt, 1, 1, PARSER_FUNCTION_PURE );
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], user_var_x_cb, NULL, &x );
+		pd.registry = reg;
+		pd.optimize = PARSER_FALSE;
+		interp = parser_compile( &pd );
+		parser_data_init( &pd, exprs[i], user_var_x_cb, NULL, &x );
+		pd.registry = reg;
+		pd.optimize = PARSER_FALSE;
+		jit = interp ? parser_compile( &pd ) : NULL;
+		if( !interp || !jit ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+		} else if( !parser_program_jit( jit ) ){
+			printf("  JIT not available on this platform\n");
+		} else {
+			for( j=0; j<(int)(sizeof(xs)/sizeof(double))+1; j++ ){
+				x = j < (int)(sizeof(xs)/sizeof(double)) ? xs[j] : nan;
+				a = parser_program_eval( interp, &x, &ea );
+				b = parser_program_eval( jit, &x, &eb );
+				if( (ea == NULL) != (eb == NULL) || (ea && strcmp( ea, eb ) != 0) || (a == a) != (b == b) || (a == a && fabs( a - b ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD) ){
+					printf("  '%s', x = %f: interpreter %f (%s), JIT %f (%s)\n", exprs[i], x, a, ea ? ea : "ok", b, eb ? eb : "ok" );
+					result = PARSER_FALSE;
+				}
+			}
+		}
+		parser_program_free( interp );
+		parser_program_free( jit );
+	}
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief evaluates an expression of 'x' with the parser, an optimized compiled program, its machine code translation and the batch evaluator, and checks that all of them give the expected value without error and call the native function 'counted' the expected number of times
+ @return PARSER_TRUE if every evaluation agrees with the expectation
+*/
+int check_short_circuit( const char *expr, double x, double expected, int calls ){
+	const char *modes[] = { "parsed", "compiled", "JIT", "batch" };
+	parser_registry *reg;
+	parser_program *prog = NULL;
+	parser_binding binding;
+	parser_batch pb;
+	parser_data pd;
+	const char *error;
+	double value;
+	int mode, result = 1;
+
+	reg = parser_registry_new();
+	parser_registry_add( reg, "counted", native_counted, 1, 1, 0 );
+	binding.name   = "x";
+	binding.data   = &x;
+	binding.stride = 0;
+	binding.type   = PARSER_TYPE_DOUBLE;
+	for( mode=0; mode<4; mode++ ){
+		parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+		pd.registry = reg;
+		error = NULL;
+		value = 0.0;
+		if( mode == 0 ){
+			native_calls = 0;
+			value = parser_parse( &pd );
+			error = pd.error;
+		} else {
+			prog = parser_compile( &pd );
+			if( !prog ){
+				printf("  '%s' failed to compile: %s\n", expr, pd.error );
+				result = PARSER_FALSE;
+				break;
+			}
+			if( mode == 2 && !parser_program_jit( prog ) ){
+				parser_program_free( prog );
+				continue;
+			}
+			native_calls = 0;
+			if( mode < 3 ){
+				value = parser_program_eval( prog, &x, &error );
+			} else {
+				parser_batch_init( &pb, prog, &binding, 1, NULL );
+				parser_batch_eval( &pb, 1, &value );
+				error = pb.error;
+			}
+			parser_program_free( prog );
+		}
+		if( error || fabs( value - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || native_calls != calls ){
+			printf("  '%s' (%s), x = %f: expected %f with %d calls, got %f (%s) with %d calls\n", expr, modes[mode], x, expected, calls, value, error ? error : "no error", native_calls );
+			result = PARSER_FALSE;
+		}
+	}
+	parser_registry_free( reg );
+	return result;
+}
+
+/**
+ @brief test short-circuit evaluation of && and || and the conditional operator: operands that are not needed must not be evaluated, so they neither call functions nor raise domain errors, with the parser, compiled programs, the JIT and the batch evaluator
+*/
+void run_short_circuit_tests(){
+	const char *expr = "x > 0 ? sqrt( x ) + counted( x ) : ( x < -500 || asin( x + 300 ) > 0 ) * log( -x )";
+	double x[1000], out[1000], expected, xv;
+	const char *error;
+	int simd, calls, result = 1;
+	size_t i, num_rows = 1000;
+	parser_registry *reg;
+	parser_program *prog;
+	parser_binding binding;
+	parser_batch pb;
+	parser_data pd;
+
+	printf("Testing short-circuit evaluation and conditional expressions:\n");
+	parser_check_boolean( &result, 1 ? 2 : 3 );
+	parser_check_boolean( &result, 0 ? 2 : 3 + 4 );
+	parser_check_boolean( &result, 0 || 1 ? 5 : 6 );
+	parser_check_boolean( &result, 1 ? 0 ? 1 : 2 : 3 );
+	parser_check_boolean( &result, 0 ? 1 : 0 ? 2 : 3 );
+	parser_check_boolean( &result, (2 < 1 ? 4 : 5) * 2 );
+
+	// both grammars, with the same errors
+	result &= check_parse_and_compile( "x > 0 ? sqrt( x ) : 0", -4.0, 0.0, NULL );
+	result &= check_parse_and_compile( "x > 0 ? sqrt( x ) : 0", 4.0, 2.0, NULL );
+	result &= check_parse_and_compile( "x < 0 || sqrt( x ) > 1", -1.0, 1.0, NULL );
+	result &= check_parse_and_compile( "x >= 0 && log( x ) < 0", -1.0, 0.0, NULL );
+	result &= check_parse_and_compile( "x ? 1 : unknown( x )", 1.0, 1.0, NULL );
+	result &= check_parse_and_compile( "1 + x ? 2 : 3 + 4", -1.0, 7.0, NULL );
+	result &= check_parse_and_compile( "x ? 1", 1.0, 0.0, "Expected ':' in conditional expression!" );
+	result &= check_parse_and_compile( "x : 1", 1.0, 0.0, "Failed to reach end of input expression, likely malformed input" );
+
+	// a subexpression of a branch is not shared with one evaluated on every path
+	result &= check_parse_and_compile( "(x > 1 ? x*x : 0) + x*x", 0.5, 0.25, NULL );
+	result &= check_parse_and_compile( "(x > 1 ? 0 : sqrt( x + 1 )) + (x > 1 ? sqrt( x + 1 ) : 0)", 3.0, 2.0, NULL );
+	result &= check_parse_and_compile( "(x > 0 && fabs( x - 1 ) > 0.5) + fabs( x - 1 )", -1.0, 2.0, NULL );
+
+	// skipped operands make no calls
+	result &= check_short_circuit( "x > 0 && counted( x ) > 1", -1.0, 0.0, 0 );
+	result &= check_short_circuit( "x > 0 && counted( x ) > 1", 2.0, 1.0, 1 );
+	result &= check_short_circuit( "x > 0 || counted( x ) < 0", 2.0, 1.0, 0 );
+	result &= check_short_circuit( "x > 0 ? counted( x ) : counted( -x ) + counted( 1 )", -3.0, 4.0, 2 );
+	result &= check_short_circuit( "(x > 0 ? counted( x ) : 0) + (x > 0 ? 0 : counted( x ))", 2.0, 2.0, 1 );
+	result &= check_short_circuit( expr, -1000.0, log( 1000.0 ), 0 );
+	result &= check_short_circuit( expr, -299.5, log( 299.5 ), 0 );
+
+	// batch rows only evaluate their own branch: whole chunks that skip
+	// a branch, chunks that mix both and rows that fail in the taken branch
+	for( i=0; i<num_rows; i++ )
+		x[i] = i < 300 ? -1000.0 - i : i < 700 ? (double)(i%7) - 3.0 : 0.25*(i%5);
+	x[500] = -300.5;
+	binding.name   = "x";
+	binding.data   = x;
+	binding.stride = 0;
+	binding.type   = PARSER_TYPE_DOUBLE;
+	reg = parser_registry_new();
+	parser_registry_add( reg, "counted", native_counted, 1, 1, 0 );
+	parser_data_init( &pd, expr, user_var_x_cb, NULL, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  '%s' failed to compile: %s\n", expr, pd.error );
+		result = PARSER_FALSE;
+	} else {
+		parser_batch_init( &pb, prog, &binding, 1, NULL );
+		for( simd=0; simd<2; simd++ ){
+			pb.simd = simd;
+			native_calls = 0;
+			if( parser_batch_eval( &pb, num_rows, out ) || !pb.error || strcmp( pb.error, "asin(x) undefined for |x| > 1!" ) != 0 ){
+				printf("  expected the asin() domain error of row 500, got %s\n", pb.error ? pb.error : "no error" );
+				result = PARSER_FALSE;
+			}
+			calls = native_calls;
+			native_calls = 0;
+			for( i=0; i<num_rows; i++ ){
+				xv = x[i];
+				expected = parser_program_eval( prog, &xv, &error );
+				if( (out[i] == out[i]) != (expected == expected) || fabs( out[i] - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+					printf("  row %d: expected %f, got %f\n", (int)i, expected, out[i] );
+					result = PARSER_FALSE;
+				}
+			}
+			if( calls != native_calls ){
+				printf("  batch evaluation made %d calls, row by row evaluation %d\n", calls, native_calls );
+				result = PARSER_FALSE;
+			}
+		}
+		parser_program_free( prog );
+	}
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test that batch evaluation over columns of variable values matches evaluating the program row by row, including strided columns, variables looked up through the callback and rows with domain errors
+*/
+void run_batch_tests(){
+	int simd, result = 1;
+	size_t i, num_rows = 1000;
+	double x[1000], yz[2000], out[1000], expected, xv = 0.0;
+	const char *error;
+	parser_data pd;
+	parser_program *prog;
+	parser_binding bindings[2];
+	parser_batch pb;
+
+	printf("Testing batch evaluation:\n");
+	for( i=0; i<num_rows; i++ ){
+		x[i]      = 0.01*i - 1.0;
+		yz[2*i]   = 0.5*i;
+		yz[2*i+1] = -1.0;
+	}
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = yz;
+	bindings[1].stride = 2*sizeof(double);
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+
+	// the variable 'a' is not bound and is looked up through the callback
+	parser_data_init( &pd, "x*y + sqrt( x ) - (x > y) + a*2.0", user_var_cb, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  compilation failed: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		parser_batch_init( &pb, prog, bindings, 2, NULL );
+		if( parser_batch_eval( &pb, num_rows, out ) || !pb.error ){
+			printf("  expected domain errors for x < 0\n");
+			result = PARSER_FALSE;
+		}
+		for( i=0; i<num_rows; i++ ){
+			expected = x[i] < 0.0 ? sqrt( -1.0 ) : x[i]*yz[2*i] + sqrt( x[i] ) - (x[i] > yz[2*i]) + 2.0;
+			if( (out[i] == out[i]) != (expected == expected) || fabs( out[i] - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+				printf("  row %d: expected %f, got %f\n", (int)i, expected, out[i] );
+				result = PARSER_FALSE;
+			}
+		}
+		parser_program_free( prog );
+	}
+
+	// compare against row by row evaluation, with and without the SIMD kernels
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	parser_data_init( &pd, "2.0*x^2 - 3.0*x + 1.0 > 0.5 || x == 0.25 && !(x != -x) || fabs( x ) <= 0.5", user_var_x_cb, NULL, NULL );
+#else
+	parser_data_init( &pd, "2.0*x^2 - 3.0*x + 1.0 + x/0.25 - fabs( x )*0.5", user_var_x_cb, NULL, NULL );
+#endif
+	prog = parser_compile( &pd );
+	if( prog ){
+		parser_batch_init( &pb, prog, bindings, 1, NULL );
+		for( simd=0; simd<2; simd++ ){
+			pb.simd = simd;
+			if( !parser_batch_eval( &pb, num_rows, out ) ){
+				printf("  batch evaluation failed: %s\n", pb.error );
+				result = PARSER_FALSE;
+			}
+			for( i=0; i<num_rows; i++ ){
+				xv = x[i];
+				expected = parser_program_eval( prog, &xv, &error );
+				if( fabs( out[i] - expected ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD ){
+					printf("  row %d: expected %f, got %f\n", (int)i, expected, out[i] );
+					result = PARSER_FALSE;
+				}
+			}
+		}
+		parser_program_free( prog );
+	} else {
+		result = PARSER_FALSE;
+	}
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test that parallel batch evaluation on thread pools of several sizes matches sequential batch evaluation exactly, including the reported error when rows in several tasks fail
+*/
+void run_parallel_batch_tests(){
+	const char *exprs[] = { "x*y + sqrt( x ) - y/(x + 1)", "log( y - 0.5 ) + x", NULL };
+	const int threads[] = { 1, 2, 3, 8 };
+	size_t r, num_rows = 100000 + 17;
+	double *x, *y, *expected, *out;
+	int i, j, ok, result = 1;
+	const char *error;
+	parser_binding bindings[2];
+	parser_data pd;
+	parser_program *prog;
+	parser_batch pb;
+	parser_pool *pool;
+
+	printf("Testing parallel batch evaluation:\n");
+	x        = malloc( num_rows*sizeof(double) );
+	y        = malloc( num_rows*sizeof(double) );
+	expected = malloc( num_rows*sizeof(double) );
+	out      = malloc( num_rows*sizeof(double) );
+	for( r=0; r<num_rows; r++ ){
+		x[r] = (double)(r % 1000)/100.0;
+		y[r] = (double)(r % 777)/300.0;
+	}
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = y;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], NULL, NULL, NULL );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		parser_batch_init( &pb, prog, bindings, 2, NULL );
+		parser_batch_eval( &pb, num_rows, expected );
+		error = pb.error;
+		for( j=0; j<(int)(sizeof(threads)/sizeof(int)); j++ ){
+			pool = parser_pool_new( threads[j] );
+			if( !pool ){
+				printf("  failed to create a pool of %d threads\n", threads[j] );
+				result = PARSER_FALSE;
+				continue;
+			}
+			ok = parser_batch_eval_parallel( &pb, pool, num_rows, out );
+			if( ok != (error == NULL) || (error ? !pb.error || strcmp( error, pb.error ) != 0 : pb.error != NULL) ){
+				printf("  '%s' with %d threads: expected error '%s', got '%s'\n", exprs[i], threads[j], error ? error : "", pb.error ? pb.error : "" );
+				result = PARSER_FALSE;
+			}
+			for( r=0; r<num_rows; r++ ){
+				if( memcmp( out+r, expected+r, sizeof(double) ) != 0 ){
+					printf("  '%s' with %d threads: row %lu differs, expected %f, got %f\n", exprs[i], threads[j], (unsigned long)r, expected[r], out[r] );
+					result = PARSER_FALSE;
+					break;
+				}
+			}
+			parser_pool_free( pool );
+		}
+		parser_program_free( prog );
+	}
+
+	free( x );
+	free( y );
+	free( expected );
+	free( out );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief FNV-1a hash of a program image skipping the four bytes at skip, as the image checksum is computed
+*/
+int image_hash( const unsigned char *data, size_t size, size_t skip ){
+	unsigned long hash = 2166136261UL;
+	size_t i;
+	for( i=0; i<size; i++ ){
+		if( i < skip || i >= skip+sizeof(int) )
+			hash = ( (hash ^ data[i])*16777619UL ) & 0xffffffffUL;
+	}
+	return (int)(hash & 0x7fffffffUL);
+}
+
+/**
+ @brief finds the node with fields (a, b, c) following a node with fields prev in an image, sets the field at index field of the node to value and updates the checksum, as a malicious image would
+ @return PARSER_TRUE if the node was found
+*/
+int tamper_image( unsigned char *image, size_t size, const int *prev, const int *node, int field, int value ){
+	int fields[6], checksum;
+	size_t i, skip;
+
+	memcpy( fields, prev, 3*sizeof(int) );
+	memcpy( fields+3, node, 3*sizeof(int) );
+	for( i=0; i+sizeof(fields)<=size; i += sizeof(int) ){
+		if( memcmp( image+i, fields, sizeof(fields) ) != 0 )
+			continue;
+		// the checksum is the header field matching the hash of the rest of the image
+		for( skip=0; skip<64; skip += sizeof(int) ){
+			memcpy( &checksum, image+skip, sizeof(int) );
+			if( checksum == image_hash( image, size, skip ) )
+				break;
+		}
+		if( skip == 64 )
+			return PARSER_FALSE;
+		memcpy( image+i+(3+field)*sizeof(int), &value, sizeof(int) );
+		checksum = image_hash( image, size, skip );
+		memcpy( image+skip, &checksum, sizeof(int) );
+		return PARSER_TRUE;
+	}
+	return PARSER_FALSE;
+}
+
+/**
+ @brief test saving compiled programs as binary images and loading them back in place, from memory and from a mapped file, and the rejection of corrupt images
+*/
+void run_image_tests(){
+	const char *exprs[] = {
+		"x*x + 2*x - sqrt( x )",
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		"x > 1 ? max_value( x, 2, 0.5 ) : user_func_2( x, 1 ) + checked_sqrt( x )",
+#else
+		"max_value( x, 2, 0.5 ) + user_func_2( x, 1 ) + checked_sqrt( x )",
+#endif
+		"(x > 0 && log( x ) < 1) + exp( -(x-1)^2/(2*0.3^2) ) + 0.5*exp( -(x-1)^2/(2*0.3^2) )",
+		"pow( 2, 10 )",
+		NULL
+	};
+	const double xs[] = { -1.0, 0.5, 2.0, 3.0 };
+	const char *error, *expected_error;
+	double x, expected, value;
+	unsigned char *buffer;
+	size_t size, offset, n;
+	int i, j, k, result = 1;
+	parser_registry *reg, *other;
+	parser_program *prog, *loaded;
+	parser_data pd;
+	void *mapping;
+	FILE *fp;
+
+	printf("Testing binary program images:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "max_value", native_max, 1, PARSER_MAX_ARGUMENT_COUNT, PARSER_FUNCTION_PURE );
+	parser_registry_add( reg, "checked_sqrt", native_checked_sqrt, 1, 1, PARSER_FUNCTION_PURE );
+
+	// every expression is saved after the previous one in a single buffer
+	buffer = malloc( 1<<16 );
+	for( offset=0, i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], user_var_x_cb, user_fnc_cb, &x );
+		pd.registry = reg;
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		n = parser_program_save( prog, NULL, 0 );
+		if( n % 8 != 0 || parser_program_save( prog, buffer+offset, n-1 ) != n || parser_program_save( prog, buffer+offset, (1<<16)-offset ) != n ){
+			printf("  '%s': inconsistent image size %lu\n", exprs[i], (unsigned long)n );
+			result = PARSER_FALSE;
+		}
+		offset += n;
+		parser_program_free( prog );
+	}
+	size = offset;
+
+	// a loaded program evaluates exactly as a compiled one, interpreted and translated
+	fp = fopen( "test_images.bin", "wb" );
+	if( !fp || fwrite( buffer, 1, size, fp ) != size ){
+		printf("  failed to write test_images.bin\n");
+		result = PARSER_FALSE;
+	}
+	if( fp )
+		fclose( fp );
+	mapping = parser_image_map( "test_images.bin", &n );
+	if( !mapping || n != size || memcmp( mapping, buffer, size ) != 0 ){
+		printf("  failed to map test_images.bin\n");
+		result = PARSER_FALSE;
+		parser_image_unmap( mapping, n );
+		mapping = NULL;
+	}
+	for( j=0; j<2; j++ ){
+		const unsigned char *images = j == 0 ? buffer : (const unsigned char*)mapping;
+		for( offset=0, i=0; images && exprs[i]; i++ ){
+			n = parser_program_image_size( images+offset, size-offset );
+			loaded = parser_program_load( images+offset, size-offset, user_var_x_cb, user_fnc_cb, reg, &error );
+			parser_data_init( &pd, exprs[i], user_var_x_cb, user_fnc_cb, &x );
+			pd.registry = reg;
+			prog = parser_compile( &pd );
+			if( !prog || !loaded || n == 0 || parser_program_num_nodes( loaded ) != parser_program_num_nodes( prog ) || parser_program_num_eliminated( loaded ) != parser_program_num_eliminated( prog ) ){
+				printf("  '%s': failed to load image: %s\n", exprs[i], !prog ? pd.error : error ? error : "wrong program" );
+				result = PARSER_FALSE;
+			}
+			for( k=0; prog && loaded && k<4; k++ ){
+				x = xs[k];
+				expected = parser_program_eval( prog, &x, &expected_error );
+				value = parser_program_eval( loaded, &x, &error );
+				if( memcmp( &value, &expected, sizeof(double) ) != 0 || error != expected_error ){
+					printf("  '%s': loaded program returned %f for x = %f, expected %f\n", exprs[i], value, x, expected );
+					result = PARSER_FALSE;
+				}
+				if( k == 0 )
+					parser_program_jit( loaded );
+			}
+			parser_program_free( loaded );
+			parser_program_free( prog );
+			offset += n;
+		}
+	}
+	parser_image_unmap( mapping, size );
+	remove( "test_images.bin" );
+
+	// corrupt and incompatible images are rejected
+	n = parser_program_image_size( buffer, size );
+	loaded = parser_program_load( buffer, n-8, user_var_x_cb, user_fnc_cb, reg, &error );
+	result &= !loaded && strcmp( error, "Invalid program image!" ) == 0;
+	buffer[n/2] ^= 1;
+	loaded = parser_program_load( buffer, size, user_var_x_cb, user_fnc_cb, reg, &error );
+	result &= !loaded && strcmp( error, "Program image checksum mismatch!" ) == 0;
+	buffer[n/2] ^= 1;
+	memcpy( buffer+size+4, buffer, n );
+	loaded = parser_program_load( buffer+size+4, n, user_var_x_cb, user_fnc_cb, reg, &error );
+	result &= !loaded && strcmp( error, "Program image is not aligned to 8 bytes!" ) == 0;
+
+	// native functions must be registered, with a suitable number of arguments
+	other = parser_registry_new();
+	parser_registry_add( other, "max_value", native_max, 1, 2, 0 );
+	parser_registry_add( other, "checked_sqrt", native_checked_sqrt, 1, 1, 0 );
+	loaded = parser_program_load( buffer+n, size-n, user_var_x_cb, user_fnc_cb, NULL, &error );
+	result &= !loaded && strcmp( error, "Program image calls native functions, but no registry was given!" ) == 0;
+	loaded = parser_program_load( buffer+n, size-n, user_var_x_cb, user_fnc_cb, other, &error );
+	result &= !loaded && strcmp( error, "Incorrect number of arguments to native function!" ) == 0;
+	parser_registry_free( other );
+	other = parser_registry_new();
+	loaded = parser_program_load( buffer+n, size-n, user_var_x_cb, user_fnc_cb, other, &error );
+	result &= !loaded && strcmp( error, "Program image calls a native function that is not registered!" ) == 0;
+	parser_registry_free( other );
+
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	// images with a valid checksum whose nodes read a jump as an operand, or
+	// whose jumps do not belong to a lazy operation, are rejected too. The
+	// nodes of 'x && y' are x, jump_false( x ) to the and, y and and( x, y )
+	parser_data_init( &pd, "x && y", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  'x && y' failed to compile: %s\n", pd.error );
+		result = PARSER_FALSE;
+	}
+	for( k=0; k<2 && prog; k++ ){
+		const int var_x[3] = { 0, 0, 0 }, jump[3] = { 0, 3, 3 }, var_y[3] = { 1, 0, 0 }, and_xy[3] = { 0, 2, 0 };
+		n = parser_program_save( prog, buffer, 1<<16 );
+		if( !( k == 0 ? tamper_image( buffer, n, var_y, and_xy, 1, 1 ) : tamper_image( buffer, n, var_x, jump, 2, 2 ) ) ){
+			printf("  failed to find the nodes of 'x && y' in its image\n");
+			result = PARSER_FALSE;
+			continue;
+		}
+		loaded = parser_program_load( buffer, n, NULL, NULL, NULL, &error );
+		if( loaded || strcmp( error, "Invalid program image!" ) != 0 ){
+			printf("  expected an image %s to be rejected\n", k == 0 ? "reading a jump as an operand" : "with a jump to a non-lazy operation" );
+			result = PARSER_FALSE;
+		}
+		parser_program_free( loaded );
+	}
+	parser_program_free( prog );
+#endif
+
+	parser_registry_free( reg );
+	free( buffer );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief expressions evaluated through the cache by native_cached()
+*/
+const char *cache_exprs[] = {
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	"x*x + 1", "sqrt( x ) - x/3", "x > 0.5 ? sin( x ) : cos( x )", "exp( -(x-1)^2/(2*0.3^2) )",
+	"atan2( x, 2 ) + floor( x*10 )", "(x+1)*(x+2)*(x+3)", "x < 0.25 || x > 0.75", "pow( x, 1.5 ) + fabs( x - 0.5 )"
+#else
+	"x*x + 1", "sqrt( x ) - x/3", "sin( x ) + cos( x )", "exp( -(x-1)^2/(2*0.3^2) )",
+	"atan2( x, 2 ) + floor( x*10 )", "(x+1)*(x+2)*(x+3)", "floor( x*4 ) - x", "pow( x, 1.5 ) + fabs( x - 0.5 )"
+#endif
+};
+
+/**
+ @brief native function evaluating cache_exprs[args[0]] for x = args[1] through the cache passed as the user data, so parallel batch evaluation uses the cache from every thread of the pool
+*/
+int native_cached( void *user_data, const int num_args, const double *args, double *value ){
+	double x = args[1];
+	*value = parse_expression_with_cache( (parser_cache*)user_data, cache_exprs[(int)args[0]], user_var_x_cb, NULL, &x );
+	return PARSER_TRUE;
+}
+
+/**
+ @brief test the cache of compiled programs: results, counters, evictions within the memory budget and sharing between threads
+*/
+void run_cache_tests(){
+	const int num_exprs = sizeof(cache_exprs)/sizeof(cache_exprs[0]);
+	size_t r, num_rows = 20000;
+	double x = 0.75, value, *rows, *xs, *expected, *out;
+	int i, result = 1;
+	char expr[64];
+	parser_cache_stats stats;
+	parser_binding bindings[2];
+	parser_registry *reg;
+	parser_cache *cache;
+	parser_program *prog;
+	parser_batch pb;
+	parser_pool *pool;
+	parser_data pd;
+
+	printf("Testing the cache of compiled programs:\n");
+	cache = parser_cache_new( 1<<20 );
+
+	// a hit sees the new variable values
+	value = parse_expression_with_cache( cache, "x*x + 2*x", user_var_x_cb, NULL, &x );
+	x = 2.0;
+	value += parse_expression_with_cache( cache, "x*x + 2*x", user_var_x_cb, NULL, &x );
+	parser_cache_get_stats( cache, &stats );
+	if( fabs( value - (0.75*0.75 + 1.5 + 8.0) ) > PARSER_BOOLEAN_EQUALITY_THRESHOLD || stats.hits != 1 || stats.misses != 1 || stats.entries != 1 || stats.bytes == 0 ){
+		printf("  expected one hit and one miss, got %f with %lu hits, %lu misses and %lu entries\n", value, stats.hits, stats.misses, (unsigned long)stats.entries );
+		result = PARSER_FALSE;
+	}
+
+	// programs capture the callbacks, so they are part of the key
+	value = parse_expression_with_cache( cache, "x*x + 2*x", user_var_cb, NULL, NULL );
+	parser_cache_get_stats( cache, &stats );
+	if( stats.misses != 2 || stats.entries != 2 ){
+		printf("  expected a miss for different callbacks, got %lu misses\n", stats.misses );
+		result = PARSER_FALSE;
+	}
+
+	// errors are those of the parser, expressions that do not compile are not cached
+	x = -1.0;
+	value = parse_expression_with_cache( cache, "sqrt( x )", user_var_x_cb, NULL, &x );
+	result &= value != value;
+	value = parse_expression_with_cache( cache, "1 +* x", user_var_x_cb, NULL, &x );
+	result &= value != value;
+	parser_cache_get_stats( cache, &stats );
+	if( stats.entries != 3 ){
+		printf("  expected 3 entries, got %lu\n", (unsigned long)stats.entries );
+		result = PARSER_FALSE;
+	}
+	parser_cache_free( cache );
+
+	// the least recently used programs are evicted to stay within the budget
+	cache = parser_cache_new( 1<<16 );
+	for( i=0; i<2000; i++ ){
+		sprintf( expr, "x*%d + %d", i, i%7 );
+		x = i;
+		value = parse_expression_with_cache( cache, expr, user_var_x_cb, NULL, &x );
+		value -= parse_expression_with_cache( cache, expr, user_var_x_cb, NULL, &x );
+		result &= value == 0.0;
+	}
+	parser_cache_get_stats( cache, &stats );
+	if( stats.hits != 2000 || stats.misses != 2000 || stats.evictions == 0 || stats.evictions != stats.misses - stats.entries || stats.bytes > 1<<16 ){
+		printf("  expected evictions within the budget, got %lu hits, %lu misses, %lu evictions, %lu entries and %lu bytes\n", stats.hits, stats.misses, stats.evictions, (unsigned long)stats.entries, (unsigned long)stats.bytes );
+		result = PARSER_FALSE;
+	}
+	parser_cache_free( cache );
+
+	// every thread of a pool evaluates through a cache small enough to evict
+	// programs that other threads are still evaluating
+	rows     = malloc( num_rows*sizeof(double) );
+	xs       = malloc( num_rows*sizeof(double) );
+	expected = malloc( num_rows*sizeof(double) );
+	out      = malloc( num_rows*sizeof(double) );
+	for( r=0; r<num_rows; r++ ){
+		rows[r] = (double)(r*7 % num_exprs);
+		xs[r] = (double)(r % 100)/100.0;
+		expected[r] = parse_expression_with_callbacks( cache_exprs[(int)rows[r]], user_var_x_cb, NULL, xs+r );
+	}
+	bindings[0].name = "i";
+	bindings[0].data = rows;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "x";
+	bindings[1].data = xs;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+	cache = parser_cache_new( 2048*PARSER_CACHE_SHARDS );
+	pool = parser_pool_new( 4 );
+	reg = parser_registry_new();
+	parser_registry_add( reg, "cached", native_cached, 2, 2, 0 );
+	parser_data_init( &pd, "cached( i, x )", NULL, NULL, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  'cached( i, x )' failed to compile: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		parser_batch_init( &pb, prog, bindings, 2, cache );
+		if( !pool || !parser_batch_eval_parallel( &pb, pool, num_rows, out ) ){
+			printf("  parallel evaluation through the cache failed\n");
+			result = PARSER_FALSE;
+		}
+		for( r=0; r<num_rows; r++ ){
+			if( memcmp( out+r, expected+r, sizeof(double) ) != 0 ){
+				printf("  row %lu: expected %f, got %f\n", (unsigned long)r, expected[r], out[r] );
+				result = PARSER_FALSE;
+				break;
+			}
+		}
+		parser_cache_get_stats( cache, &stats );
+		if( stats.hits + stats.misses != num_rows || stats.evictions == 0 ){
+			printf("  expected %lu lookups with evictions, got %lu hits, %lu misses and %lu evictions\n", (unsigned long)num_rows, stats.hits, stats.misses, stats.evictions );
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+	}
+	parser_registry_free( reg );
+	parser_pool_free( pool );
+	parser_cache_free( cache );
+	free( rows );
+	free( xs );
+	free( expected );
+	free( out );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test compiling programs into arenas, from a fixed buffer without allocating and from blocks allocated as the arena grows
+*/
+void run_arena_tests(){
+	const char *exprs[] = {
+		"x*x + 2*x - sqrt( x )",
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		"x > 1 ? max_value( x, 2, 0.5 ) : user_func_2( x, 1 ) + checked_sqrt( x )",
+#else
+		"max_value( x, 2, 0.5 ) + user_func_2( x, 1 ) + checked_sqrt( x )",
+#endif
+		"(x > 0 && log( x ) < 1) + exp( -(x-1)^2/(2*0.3^2) ) + 0.5*exp( -(x-1)^2/(2*0.3^2) )",
+		"pow( 2, 10 )",
+		"1 +* x",
+		NULL
+	};
+	const double xs[] = { -1.0, 0.5, 2.0, 3.0 };
+	double storage[2048], x, expected, value;
+	const char *error, *expected_error, *name;
+	size_t used, size;
+	int i, k, n, result = 1;
+	parser_registry *reg;
+	parser_program *prog, *heap, *progs[256];
+	parser_arena arena;
+	parser_data pd;
+	char expr[64];
+
+	printf("Testing compilation into arenas:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "max_value", native_max, 1, PARSER_MAX_ARGUMENT_COUNT, PARSER_FUNCTION_PURE );
+	parser_registry_add( reg, "checked_sqrt", native_checked_sqrt, 1, 1, PARSER_FUNCTION_PURE );
+
+	// programs from a fixed buffer evaluate as those from the heap, and are
+	// packed so that the scratch space of the compiler is reused
+	parser_arena_init( &arena, storage, sizeof(storage), 0 );
+	for( n=0, i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], user_var_x_cb, user_fnc_cb, &x );
+		pd.registry = reg;
+		heap = parser_compile( &pd );
+		parser_data_init( &pd, exprs[i], user_var_x_cb, user_fnc_cb, &x );
+		pd.registry = reg;
+		pd.arena = &arena;
+		used = parser_arena_used( &arena );
+		prog = parser_compile( &pd );
+		if( !heap ){
+			if( prog || parser_arena_used( &arena ) != used ){
+				printf("  '%s': failed compilation used the arena\n", exprs[i] );
+				result = PARSER_FALSE;
+			}
+			continue;
+		}
+		size = prog ? parser_arena_used( &arena ) - used : 0;
+		if( !prog || size < parser_program_size( prog ) || size > parser_program_size( prog ) + 3*PARSER_ARENA_ALIGNMENT || parser_program_size( prog ) > parser_program_size( heap ) ){
+			printf("  '%s': program does not fit its arena allocation\n", exprs[i] );
+			result = PARSER_FALSE;
+			parser_program_free( heap );
+			continue;
+		}
+		name = parser_program_variable_name( prog, 0 );
+		if( name && ( name < (const char*)storage || name >= (const char*)(storage+2048) ) ){
+			printf("  '%s': program is not in the buffer\n", exprs[i] );
+			result = PARSER_FALSE;
+		}
+		for( k=0; k<4; k++ ){
+			x = xs[k];
+			expected = parser_program_eval( heap, &x, &expected_error );
+			value = parser_program_eval( prog, &x, &error );
+			if( memcmp( &value, &expected, sizeof(double) ) != 0 || error != expected_error ){
+				printf("  '%s': arena program returned %f for x = %f, expected %f\n", exprs[i], value, x, expected );
+				result = PARSER_FALSE;
+			}
+		}
+		progs[n++] = prog;
+		parser_program_free( heap );
+	}
+
+	// a full buffer fails cleanly, leaving the programs compiled before
+	do {
+		used = parser_arena_used( &arena );
+		parser_data_init( &pd, "x*x + 1", user_var_x_cb, NULL, &x );
+		pd.arena = &arena;
+		prog = parser_compile( &pd );
+	} while( prog && n < 256 && ( progs[n++] = prog ) );
+	if( prog || !pd.error || strcmp( pd.error, "Out of memory while compiling expression!" ) != 0 || parser_arena_used( &arena ) != used ){
+		printf("  expected compilation to fail once the buffer is full\n" );
+		result = PARSER_FALSE;
+	}
+	x = 2.0;
+	result &= parser_program_eval( progs[0], &x, NULL ) == 2.0*2.0 + 2.0*2.0 - sqrt( 2.0 );
+	result &= parser_program_eval( progs[n-1], &x, NULL ) == 5.0;
+	parser_arena_reset( &arena );
+	result &= parser_arena_used( &arena ) == 0;
+
+	// an arena without a buffer grows in blocks, and is released at once
+	parser_arena_init( &arena, NULL, 0, 4096 );
+	for( i=0; i<2000; i++ ){
+		sprintf( expr, "x*%d + sin( x/%d ) + %d", i, i+1, i );
+		parser_data_init( &pd, expr, user_var_x_cb, NULL, &x );
+		pd.arena = &arena;
+		prog = parser_compile( &pd );
+		if( prog && i % 500 == 0 )
+			parser_program_jit( prog );
+		x = 0.5;
+		value = prog ? parser_program_eval( prog, &x, &error ) : 0.0;
+		if( !prog || fabs( value - ( 0.5*i + sin( 0.5/(i+1) ) + i ) ) > 1e-12 ){
+			printf("  '%s' compiled into a growing arena returned %f\n", expr, value );
+			result = PARSER_FALSE;
+			break;
+		}
+		if( i % 500 == 0 )
+			parser_program_free( prog );
+	}
+	result &= parser_arena_used( &arena ) > 0;
+	parser_arena_reset( &arena );
+	result &= parser_arena_used( &arena ) == 0;
+
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief native function returning the cube of its argument
+*/
+int native_cube( void *user_data, const int num_args, const double *args, double *value ){
+	*value = args[0]*args[0]*args[0];
+	return PARSER_TRUE;
+}
+
+/**
+ @brief derivative of native_cube()
+*/
+int native_cube_derivative( void *user_data, const int num_args, const double *args, double value, double *partials ){
+	partials[0] = 3.0*args[0]*args[0];
+	return PARSER_TRUE;
+}
+
+/**
+ @brief test reverse and forward mode differentiation of compiled programs against central finite differences, covering every built-in function, registered functions with and without derivatives, user functions and batch evaluation of gradients
+*/
+void run_differentiation_tests(){
+	const char *exprs[] = {
+		"x*y + sqrt( x ) - y/(x + 1) - -x",
+		"pow( x, y ) + x^2 - exp( -x*y ) + y^0",
+		"log( x )*sin( y ) + cos( x*y ) - tan( y/4 )",
+		"asin( x/4 ) + acos( y/4 ) + atan( x - y ) + atan2( y, x )",
+		"fabs( x - y )*floor( x ) + ceil( y ) + round( x*y ) + abs( x ) + fabs( y - x )",
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		"(x > y ? x*x : y*y*y) + (x < y || y*x > 0) + !x + (x == y && x != y)",
+#endif
+		"cube( x*y ) + x*user_func_0()",
+		NULL
+	};
+	const char *set[] = { "x*x*sin( x )", "exp( -x )/x + x*x" };
+	const double points[][2] = { { 1.3, 0.7 }, { 2.1, 2.9 } };
+	double slots[2], tangents[2], value, gradient[2], probe, fd, out[2], derivatives[2], h = 1e-6;
+	double xs[100], ys[100], values[100], dx[100], dy[100], *gradients[2];
+	const char *error;
+	int i, j, k, wrt[2], result = 1;
+	parser_registry *reg;
+	parser_program *prog;
+	parser_binding bindings[2];
+	parser_batch pb;
+	parser_data pd;
+
+	printf("Testing automatic differentiation:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "cube", native_cube, 1, 1, 0 );
+	parser_registry_add_derivative( reg, "cube", native_cube_derivative );
+	parser_registry_add( reg, "max_value", native_max, 1, PARSER_MAX_ARGUMENT_COUNT, PARSER_FUNCTION_PURE );
+
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], NULL, user_fnc_cb, NULL );
+		pd.registry = reg;
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		wrt[0] = parser_program_variable_slot( prog, "x" );
+		wrt[1] = parser_program_variable_slot( prog, "y" );
+
+		// the forward pass runs the machine code of translated programs
+		if( i % 2 )
+			parser_program_jit( prog );
+		for( k=0; k<2; k++ ){
+			slots[wrt[0]] = points[k][0];
+			slots[wrt[1]] = points[k][1];
+			if( !parser_program_eval_gradient( prog, slots, NULL, 0, wrt, 2, &value, gradient, &error ) || value != parser_program_eval_slots( prog, slots, NULL, &error ) ){
+				printf("  '%s' failed to evaluate its gradient: %s\n", exprs[i], error ? error : "" );
+				result = PARSER_FALSE;
+				continue;
+			}
+			for( j=0; j<2; j++ ){
+				// central finite difference
+				probe = slots[wrt[j]];
+				slots[wrt[j]] = probe + h;
+				fd = parser_program_eval_slots( prog, slots, NULL, &error );
+				slots[wrt[j]] = probe - h;
+				fd = ( fd - parser_program_eval_slots( prog, slots, NULL, &error ) )/(2.0*h);
+				slots[wrt[j]] = probe;
+				if( fabs( gradient[j] - fd ) > 1e-5*( 1.0 + fabs( fd ) ) ){
+					printf("  '%s' at (%f, %f): expected derivative %d to be %f, got %f\n", exprs[i], points[k][0], points[k][1], j, fd, gradient[j] );
+					result = PARSER_FALSE;
+				}
+
+				// forward mode along each variable gives the same derivatives
+				tangents[wrt[j]]   = 1.0;
+				tangents[wrt[1-j]] = 0.0;
+				if( !parser_program_eval_tangent( prog, slots, tangents, NULL, out, derivatives, &error ) || out[0] != value || fabs( derivatives[0] - gradient[j] ) > 1e-12*( 1.0 + fabs( gradient[j] ) ) ){
+					printf("  '%s' at (%f, %f): expected tangent %d to be %f, got %f\n", exprs[i], points[k][0], points[k][1], j, gradient[j], derivatives[0] );
+					result = PARSER_FALSE;
+				}
+			}
+		}
+		parser_program_free( prog );
+	}
+
+	// functions without a derivative fail once their derivative is needed
+	parser_data_init( &pd, "max_value( x, 1 ) + user_func_1( x )", NULL, user_fnc_cb, NULL );
+	pd.registry = reg;
+	prog = parser_compile( &pd );
+	slots[0] = 2.0;
+	tangents[0] = 1.0;
+	if( !prog || parser_program_eval_gradient( prog, slots, NULL, 0, wrt, 1, &value, gradient, &error ) || !error || strcmp( error, "Function has no derivative!" ) != 0 || value == value ||
+	    parser_program_eval_tangent( prog, slots, tangents, NULL, out, derivatives, &error ) || derivatives[0] == derivatives[0] ){
+		printf("  expected functions without a derivative to fail\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// the outputs of a set are differentiated one at a time in reverse mode,
+	// all at once in forward mode, and variables may come from the callback
+	parser_data_init( &pd, "", user_var_x_cb, NULL, &probe );
+	prog = parser_compile_set( &pd, set, 2 );
+	probe = 1.5;
+	wrt[0] = 0;
+	tangents[0] = 1.0;
+	for( j=0; j<2 && prog; j++ ){
+		if( !parser_program_eval_gradient( prog, NULL, &probe, j, wrt, 1, &value, gradient+j, &error ) )
+			result = PARSER_FALSE;
+	}
+	if( !prog || !parser_program_eval_tangent( prog, NULL, tangents, &probe, out, derivatives, &error ) || derivatives[0] != gradient[0] || derivatives[1] != gradient[1] ||
+	    parser_program_eval_gradient( prog, NULL, &probe, 2, wrt, 1, &value, gradient, &error ) ){
+		printf("  expected set derivatives to match between modes\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// batch gradients match row by row gradients, including rows that fail
+	for( i=0; i<100; i++ ){
+		xs[i] = 0.05*i - 1.0;
+		ys[i] = 0.02*i;
+	}
+	bindings[0].name   = "x";
+	bindings[0].data   = xs;
+	bindings[0].stride = 0;
+	bindings[0].type   = PARSER_TYPE_DOUBLE;
+	bindings[1].name   = "y";
+	bindings[1].data   = ys;
+	bindings[1].stride = 0;
+	bindings[1].type   = PARSER_TYPE_DOUBLE;
+	gradients[0] = dy;
+	gradients[1] = dx;
+	parser_data_init( &pd, exprs[0], NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  '%s' failed to compile: %s\n", exprs[0], pd.error );
+		result = PARSER_FALSE;
+	} else {
+		wrt[0] = parser_program_variable_slot( prog, "y" );
+		wrt[1] = parser_program_variable_slot( prog, "x" );
+		parser_batch_init( &pb, prog, bindings, 2, NULL );
+		if( parser_batch_eval_gradient( &pb, 100, 0, wrt, 2, values, gradients ) || !pb.error ){
+			printf("  expected batch gradient domain errors for x < 0\n");
+			result = PARSER_FALSE;
+		}
+		for( i=0; i<100; i++ ){
+			slots[parser_program_variable_slot( prog, "x" )] = xs[i];
+			slots[parser_program_variable_slot( prog, "y" )] = ys[i];
+			parser_program_eval_gradient( prog, slots, NULL, 0, wrt, 2, &value, gradient, &error );
+			if( memcmp( &value, values+i, sizeof(double) ) != 0 || memcmp( gradient, dy+i, sizeof(double) ) != 0 || memcmp( gradient+1, dx+i, sizeof(double) ) != 0 ){
+				printf("  batch gradient row %d differs\n", i );
+				result = PARSER_FALSE;
+			}
+		}
+		parser_program_free( prog );
+	}
+
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test interval evaluation by sampling the variables within their bounds, checking that every value is within the interval of the expression and that predicates decided for the whole block hold for every sample, along with known answers for filters
+*/
+void run_interval_tests(){
+	const char *exprs[] = {
+		"x*y + sqrt( x ) - y/(x + 1) - -x",
+		"pow( x, y ) + x^2 - exp( -x*y ) + x^-1 + y^3",
+		"log( x )*sin( y ) + cos( x*y ) - tan( y/4 )",
+		"asin( x/4 ) + acos( y/4 ) + atan( x - y ) + atan2( y, x ) + atan2( x - 1, y - 1 )",
+		"fabs( x - y )*floor( x ) + ceil( y ) + round( x*y ) + abs( x ) + fabs( y - x )",
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		"(x > y ? x*x : y*y*y) + (x < y || y*x > 0) + !x + (x == y && x != y) + (x <= 1) - (y >= 2)",
+		"x > 1 && log( x - 1 ) < 0.5 || y != 2",
+		"x/y > 0.5 && x - y >= -1 && !(y == 3)",
+#endif
+		"cube( x ) - cube( 2 ) + sin( x )*sin( x )",
+		"sin( x )", "cos( x )", "tan( x )", "atan2( y, x )", "pow( x, y )", "x^2", "x^-2", "x^3", "x^0.5",
+		"abs( x )", "round( x )", "x/y", "exp( x ) - log( x )", "asin( x ) - acos( x )",
+		NULL
+	};
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	const struct { const char *expr; double lo, hi; int expected; } filters[] = {
+		{ "x > 5 && x < 9", 6.0, 8.0, PARSER_PREDICATE_TRUE },
+		{ "x > 5 && x < 9", 0.0, 4.0, PARSER_PREDICATE_FALSE },
+		{ "x > 5 && x < 9", 4.0, 6.0, PARSER_PREDICATE_UNKNOWN },
+		{ "x < 0 || x >= 10", 0.0, 9.5, PARSER_PREDICATE_FALSE },
+		{ "x == 1", 1.0, 1.0 + 1e-12, PARSER_PREDICATE_TRUE },
+		{ "x != 1", 1.0 - 1e-12, 1.0, PARSER_PREDICATE_FALSE },
+		{ "x", -1e-12, 1e-12, PARSER_PREDICATE_FALSE },
+		{ "!x", 2.0, 3.0, PARSER_PREDICATE_FALSE },
+		{ "sqrt( x ) > 5", -1.0, 4.0, PARSER_PREDICATE_FALSE },
+		{ "sqrt( x ) >= 0", -1.0, 4.0, PARSER_PREDICATE_UNKNOWN },
+		{ "sqrt( x ) >= 0", 0.0, 4.0, PARSER_PREDICATE_TRUE },
+		{ "x > 2 && log( x - 2 ) > -100", 0.0, 1.0, PARSER_PREDICATE_FALSE },
+		{ "x < 2 || log( x - 2 ) > -100", 0.0, 1.0, PARSER_PREDICATE_TRUE },
+		{ "x > 0 ? 1 : sqrt( x )", 1.0, 2.0, PARSER_PREDICATE_TRUE },
+		{ "sin( x ) < 1.01 && cos( x ) > -1.01", -100.0, 100.0, PARSER_PREDICATE_TRUE },
+		{ "user_func_1( x ) > 0", 1.0, 2.0, PARSER_PREDICATE_UNKNOWN },
+		{ "x*0 == 1", -1e300, 1e300, PARSER_PREDICATE_FALSE },
+		{ NULL, 0.0, 0.0, 0 }
+	};
+#endif
+	double slots[2], value;
+	int i, j, k, s, n, may_fail[1], predicate, result = 1;
+	unsigned int seed = 12345;
+	parser_interval bounds[2], out[1];
+	const char *error;
+	parser_registry *reg;
+	parser_program *prog;
+	parser_data pd;
+
+	printf("Testing interval evaluation:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "cube", native_cube, 1, 1, PARSER_FUNCTION_PURE );
+
+	for( i=0; exprs[i]; i++ ){
+		parser_data_init( &pd, exprs[i], NULL, NULL, NULL );
+		pd.registry = reg;
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		n = parser_program_num_variables( prog );
+		for( k=0; k<200; k++ ){
+			// random blocks, from narrow to wide, around random centers
+			for( j=0; j<n; j++ ){
+				seed = seed*1103515245u + 12345u;
+				bounds[j].lo = ( (seed >> 8) % 2000 )/200.0 - 3.0;
+				seed = seed*1103515245u + 12345u;
+				bounds[j].hi = bounds[j].lo + ( (seed >> 8) % 1000 )/( k % 2 ? 100.0 : 1000.0 );
+			}
+			parser_program_eval_interval( prog, bounds, NULL, out, may_fail );
+			predicate = parser_program_eval_predicate( prog, bounds, NULL, 0 );
+			for( s=0; s<50; s++ ){
+				for( j=0; j<n; j++ ){
+					seed = seed*1103515245u + 12345u;
+					slots[j] = s == 0 ? bounds[j].lo : s == 1 ? bounds[j].hi : bounds[j].lo + ( bounds[j].hi - bounds[j].lo )*( (seed >> 8) % 10001 )/10000.0;
+				}
+				value = parser_program_eval_slots( prog, slots, NULL, &error );
+				if( ( error && !may_fail[0] ) || ( !error && value == value && ( value < out[0].lo || value > out[0].hi ) ) ||
+				    ( predicate == PARSER_PREDICATE_TRUE && ( error || !( fabs( value ) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ) ) ||
+				    ( predicate == PARSER_PREDICATE_FALSE && !error && fabs( value ) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ){
+					printf("  '%s' at (%g, %g) within [%g, %g] x [%g, %g]: value %g%s outside of [%g, %g]%s, predicate %d\n", exprs[i], slots[0], n > 1 ? slots[1] : 0.0,
+					       bounds[0].lo, bounds[0].hi, bounds[n-1].lo, bounds[n-1].hi, value, error ? " (failed)" : "", out[0].lo, out[0].hi, may_fail[0] ? " (may fail)" : "", predicate );
+					result = PARSER_FALSE;
+					k = 200;
+					break;
+				}
+			}
+		}
+		parser_program_free( prog );
+	}
+
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	for( i=0; filters[i].expr; i++ ){
+		parser_data_init( &pd, filters[i].expr, NULL, user_fnc_cb, NULL );
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", filters[i].expr, pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		bounds[0].lo = filters[i].lo;
+		bounds[0].hi = filters[i].hi;
+		predicate = parser_program_eval_predicate( prog, bounds, NULL, 0 );
+		if( predicate != filters[i].expected ){
+			printf("  '%s' over [%g, %g]: expected %d, got %d\n", filters[i].expr, filters[i].lo, filters[i].hi, filters[i].expected, predicate );
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+	}
+
+	// an empty block is false
+	parser_data_init( &pd, "x >= 0 || x < 0", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	bounds[0].lo = 1.0;
+	bounds[0].hi = 0.0;
+	if( !prog || parser_program_eval_predicate( prog, bounds, NULL, 0 ) != PARSER_PREDICATE_FALSE || parser_program_eval_predicate( prog, bounds, NULL, 1 ) != PARSER_PREDICATE_UNKNOWN ){
+		printf("  expected an empty block to be false\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+
+	// zero times an infinite bound is nan, which is false, so x*y == 0 is not
+	// true for every row of the block
+	parser_data_init( &pd, "x*y == 0", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	bounds[0].lo = HUGE_VAL;
+	bounds[0].hi = HUGE_VAL;
+	bounds[1].lo = 0.0;
+	bounds[1].hi = 0.0;
+	if( !prog || parser_program_eval_predicate( prog, bounds, NULL, 0 ) != PARSER_PREDICATE_UNKNOWN ){
+		printf("  expected 'x*y == 0' to be unknown for x = inf and y = 0\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+#endif
+
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
 /**
  @brief test function for the user-defined functions and variables
 */
@@ -281,14 +2233,467 @@ void test_user_functions_and_variables(){
 /**
  @brief runs a series of tests, printing the results to stdout.
 */
+/**
+ @brief test that batch predicates select exactly the rows whose batch evaluation is true, as bitmaps and selection vectors, and that the right operand of && is only evaluated for the rows selected by the left
+*/
+void run_batch_predicate_tests(){
+	const char *exprs[] = {
+		"x > 0.2 && counted( y ) < 300",
+		"x < -0.5 || sqrt( x ) > 0.9",
+		"x*y",
+		"!(x > 0) && y > 100 && fabs( x ) < 0.5",
+		"x > 5"
+	};
+	int e, simd, ok, expected_ok, calls, result = 1;
+	size_t i, num_rows = 1001, num_selected, num_expected, selection[1001];
+	double x[1001], y[1001], out[1001];
+	unsigned char bitmap[127];
+	parser_data pd;
+	parser_registry *reg;
+	parser_program *prog;
+	parser_binding bindings[2];
+	parser_batch pb;
+
+	printf("Testing batch predicates:\n");
+	for( i=0; i<num_rows; i++ ){
+		x[i] = 0.01*i - 1.0;
+		y[i] = 0.5*i;
+	}
+	bindings[0].name   = "x";
+	bindings[0].data   = x;
+	bindings[0].stride = 0;
+	bindings[0].type   = PARSER_TYPE_DOUBLE;
+	bindings[1].name   = "y";
+	bindings[1].data   = y;
+	bindings[1].stride = 0;
+	bindings[1].type   = PARSER_TYPE_DOUBLE;
+	reg = parser_registry_new();
+	parser_registry_add( reg, "counted", native_counted, 1, 1, 0 );
+
+	for( e=0; e<(int)(sizeof(exprs)/sizeof(exprs[0])); e++ ){
+		parser_data_init( &pd, exprs[e], user_var_cb, NULL, NULL );
+		pd.registry = reg;
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[e], pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		parser_batch_init( &pb, prog, bindings, 2, NULL );
+		for( simd=0; simd<2; simd++ ){
+			pb.simd = simd;
+			expected_ok = parser_batch_eval( &pb, num_rows, out );
+			num_expected = 0;
+			for( i=0; i<num_rows; i++ )
+				num_expected += out[i] == out[i] && fabs( out[i] ) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD;
+
+			// the byte after the bitmap must not be written
+			bitmap[126] = 0xA5;
+			native_calls = 0;
+			ok = parser_batch_eval_bitmap( &pb, num_rows, bitmap, &num_selected );
+			calls = native_calls;
+			if( ok != expected_ok || num_selected != num_expected || bitmap[126] != 0xA5 ){
+				printf("  '%s': bitmap selected %d rows, expected %d\n", exprs[e], (int)num_selected, (int)num_expected );
+				result = PARSER_FALSE;
+			}
+			for( i=0; i<num_rows; i++ ){
+				if( ( ( bitmap[i/8] >> (i%8) ) & 1 ) != ( out[i] == out[i] && fabs( out[i] ) >= PARSER_BOOLEAN_EQUALITY_THRESHOLD ) ){
+					printf("  '%s': wrong bitmap bit for row %d\n", exprs[e], (int)i );
+					result = PARSER_FALSE;
+					break;
+				}
+			}
+			for( i=0; i<num_rows && e == 0; i++ )
+				calls -= x[i] > 0.2;
+			if( calls != 0 ){
+				printf("  expected counted() to be called once per row with x > 0.2, got %d extra calls\n", calls );
+				result = PARSER_FALSE;
+			}
+
+			ok = parser_batch_eval_selection( &pb, num_rows, selection, &num_selected );
+			if( ok != expected_ok || num_selected != num_expected ){
+				printf("  '%s': selection has %d rows, expected %d\n", exprs[e], (int)num_selected, (int)num_expected );
+				result = PARSER_FALSE;
+			}
+			for( i=0; i<num_selected && i<num_expected; i++ ){
+				if( !( ( bitmap[selection[i]/8] >> (selection[i]%8) ) & 1 ) || ( i > 0 && selection[i] <= selection[i-1] ) ){
+					printf("  '%s': row %d should not be selected\n", exprs[e], (int)selection[i] );
+					result = PARSER_FALSE;
+					break;
+				}
+			}
+		}
+		parser_program_free( prog );
+	}
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test that batch reductions match aggregating the evaluated columns, that rows with errors are left out, that sums are compensated and that parallel reductions are identical whatever the number of threads
+*/
+void run_batch_reduction_tests(){
+	const char *set[] = { "x*y + 0.1", "log( y - 0.5 ) + x", "-x" };
+	const int threads[] = { 1, 2, 3, 8 };
+	size_t r, num_rows = 100000 + 17, count;
+	double *x, *y, *z, *cols[3], sum, min, max;
+	int k, j, ok, result = 1;
+	const char *error;
+	parser_binding bindings[3];
+	parser_reduction expected[3], out[3];
+	parser_data pd;
+	parser_program *prog;
+	parser_batch pb;
+	parser_pool *pool;
+
+	printf("Testing batch reductions:\n");
+	x = malloc( num_rows*sizeof(double) );
+	y = malloc( num_rows*sizeof(double) );
+	z = malloc( num_rows*sizeof(double) );
+	for( k=0; k<3; k++ )
+		cols[k] = malloc( num_rows*sizeof(double) );
+	for( r=0; r<num_rows; r++ ){
+		x[r] = (double)(r % 1000)/100.0;
+		y[r] = (double)(r % 777)/300.0;
+		z[r] = 1.0;
+	}
+	// ones between two values that cancel, which naive summation loses
+	z[0] = 1e16;
+	z[num_rows-1] = -1e16;
+	bindings[0].name = "x";
+	bindings[0].data = x;
+	bindings[0].stride = 0;
+	bindings[0].type = PARSER_TYPE_DOUBLE;
+	bindings[1].name = "y";
+	bindings[1].data = y;
+	bindings[1].stride = 0;
+	bindings[1].type = PARSER_TYPE_DOUBLE;
+	bindings[2].name = "z";
+	bindings[2].data = z;
+	bindings[2].stride = 0;
+	bindings[2].type = PARSER_TYPE_DOUBLE;
+
+	parser_data_init( &pd, "", NULL, NULL, NULL );
+	prog = parser_compile_set( &pd, set, 3 );
+	if( !prog ){
+		printf("  the expression set failed to compile: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		parser_batch_init( &pb, prog, bindings, 3, NULL );
+		parser_batch_eval_set( &pb, num_rows, cols );
+		error = pb.error;
+		ok = parser_batch_reduce( &pb, num_rows, expected );
+		if( ok || !error || !pb.error || strcmp( error, pb.error ) != 0 ){
+			printf("  expected the error '%s', got '%s'\n", error ? error : "", pb.error ? pb.error : "" );
+			result = PARSER_FALSE;
+		}
+		for( k=0; k<3; k++ ){
+			count = 0;
+			sum = 0.0;
+			min = HUGE_VAL;
+			max = -HUGE_VAL;
+			for( r=0; r<num_rows; r++ ){
+				if( cols[k][r] != cols[k][r] )
+					continue;
+				count++;
+				sum += cols[k][r];
+				min = cols[k][r] < min ? cols[k][r] : min;
+				max = cols[k][r] > max ? cols[k][r] : max;
+			}
+			if( expected[k].count != count || fabs( expected[k].sum - sum ) > 1e-9*fabs( sum ) || fabs( expected[k].mean - sum/count ) > 1e-9*fabs( sum/count ) || expected[k].min != min || expected[k].max != max ){
+				printf("  '%s': expected count %d sum %f min %f max %f, got count %d sum %f min %f max %f\n", set[k], (int)count, sum, min, max, (int)expected[k].count, expected[k].sum, expected[k].min, expected[k].max );
+				result = PARSER_FALSE;
+			}
+		}
+
+		for( j=0; j<(int)(sizeof(threads)/sizeof(int)); j++ ){
+			pool = parser_pool_new( threads[j] );
+			if( !pool ){
+				printf("  failed to create a pool of %d threads\n", threads[j] );
+				result = PARSER_FALSE;
+				continue;
+			}
+			ok = parser_batch_reduce_parallel( &pb, pool, num_rows, out );
+			if( ok || !pb.error || strcmp( error, pb.error ) != 0 || memcmp( out, expected, sizeof(expected) ) != 0 ){
+				printf("  reductions with %d threads differ from the serial reductions\n", threads[j] );
+				result = PARSER_FALSE;
+			}
+			parser_pool_free( pool );
+		}
+		parser_program_free( prog );
+	}
+
+	parser_data_init( &pd, "z", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  'z' failed to compile: %s\n", pd.error );
+		result = PARSER_FALSE;
+	} else {
+		parser_batch_init( &pb, prog, bindings, 3, NULL );
+		if( !parser_batch_reduce( &pb, num_rows, out ) || out[0].sum != (double)(num_rows-2) || out[0].count != num_rows ){
+			printf("  expected a compensated sum of %d, got %f\n", (int)(num_rows-2), out[0].sum );
+			result = PARSER_FALSE;
+		}
+		if( !parser_batch_reduce( &pb, 0, out ) || out[0].count != 0 || out[0].sum != 0.0 || out[0].mean == out[0].mean || out[0].min != HUGE_VAL || out[0].max != -HUGE_VAL ){
+			printf("  expected empty aggregates for no rows\n");
+			result = PARSER_FALSE;
+		}
+		parser_program_free( prog );
+	}
+
+	free( x );
+	free( y );
+	free( z );
+	for( k=0; k<3; k++ )
+		free( cols[k] );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief record of the table used by run_typed_column_tests()
+*/
+typedef struct {
+	int64_t id;
+	float   value;
+	uint8_t flag;
+} test_record;
+
+/**
+ @brief test that batch evaluation of typed columns, contiguous and strided through an array of records, gives exactly the results of the same values converted to columns of doubles, and that unknown column types are rejected
+*/
+void run_typed_column_tests(){
+	const char *expr = "x*f - i/7 + (flag ? sqrt( value ) : id) + y";
+	const char *names[] = { "x", "f", "i", "id", "value", "flag", "y" };
+	size_t r, num_rows = 1000;
+	double converted[7][1000], expected[1000], out[1000], dx[1000], dx_expected[1000], *gradients[1];
+	float f[1000];
+	int32_t i32[1000];
+	test_record records[1000];
+	int k, wrt, result = 1;
+	parser_binding bindings[7];
+	parser_data pd;
+	parser_program *prog;
+	parser_batch pb;
+
+	printf("Testing typed batch columns:\n");
+	for( r=0; r<num_rows; r++ ){
+		f[r]               = (float)r/3.0f - 100.0f;
+		i32[r]             = (int32_t)r*7919 - 3000000;
+		records[r].id      = (int64_t)r*1000000007 - 5;
+		records[r].value   = (float)r*0.25f;
+		records[r].flag    = (uint8_t)(r % 3 ? r % 251 : 0);
+		converted[0][r]    = 0.01*r;
+		converted[1][r]    = f[r];
+		converted[2][r]    = i32[r];
+		converted[3][r]    = (double)records[r].id;
+		converted[4][r]    = records[r].value;
+		converted[5][r]    = records[r].flag;
+		converted[6][r]    = 2.0;
+	}
+
+	parser_data_init( &pd, expr, NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	if( !prog ){
+		printf("  '%s' failed to compile: %s\n", expr, pd.error );
+		printf( "failed\n\n" );
+		return;
+	}
+	for( k=0; k<7; k++ ){
+		bindings[k].name   = names[k];
+		bindings[k].data   = converted[k];
+		bindings[k].stride = 0;
+		bindings[k].type   = PARSER_TYPE_DOUBLE;
+	}
+	wrt = parser_program_variable_slot( prog, "x" );
+	gradients[0] = dx_expected;
+	parser_batch_init( &pb, prog, bindings, 7, NULL );
+	parser_batch_eval( &pb, num_rows, expected );
+	parser_batch_eval_gradient( &pb, num_rows, 0, &wrt, 1, out, gradients );
+
+	// the same values in their own types, the record fields strided
+	bindings[1].data   = f;
+	bindings[1].type   = PARSER_TYPE_FLOAT;
+	bindings[2].data   = i32;
+	bindings[2].type   = PARSER_TYPE_INT32;
+	bindings[3].data   = &records[0].id;
+	bindings[3].type   = PARSER_TYPE_INT64;
+	bindings[3].stride = sizeof(test_record);
+	bindings[4].data   = &records[0].value;
+	bindings[4].type   = PARSER_TYPE_FLOAT;
+	bindings[4].stride = sizeof(test_record);
+	bindings[5].data   = &records[0].flag;
+	bindings[5].type   = PARSER_TYPE_UINT8;
+	bindings[5].stride = sizeof(test_record);
+	parser_batch_init( &pb, prog, bindings, 7, NULL );
+	if( !parser_batch_eval( &pb, num_rows, out ) || memcmp( out, expected, sizeof(out) ) != 0 ){
+		printf("  typed columns differ from columns of doubles\n");
+		result = PARSER_FALSE;
+	}
+	pb.simd = PARSER_FALSE;
+	if( !parser_batch_eval( &pb, num_rows, out ) || memcmp( out, expected, sizeof(out) ) != 0 ){
+		printf("  typed columns differ from columns of doubles without simd\n");
+		result = PARSER_FALSE;
+	}
+	gradients[0] = dx;
+	if( !parser_batch_eval_gradient( &pb, num_rows, 0, &wrt, 1, out, gradients ) || memcmp( out, expected, sizeof(out) ) != 0 || memcmp( dx, dx_expected, sizeof(dx) ) != 0 ){
+		printf("  gradients of typed columns differ from columns of doubles\n");
+		result = PARSER_FALSE;
+	}
+
+	bindings[2].type = 42;
+	if( parser_batch_eval( &pb, num_rows, out ) || !pb.error || strcmp( pb.error, "Unknown column type!" ) != 0 || out[0] == out[0] ){
+		printf("  expected an unknown column type to be rejected\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
+/**
+ @brief test single precision evaluation against double precision over the expressions of the interval tests: errors must be reported at the same points, continuous expressions must agree to float accuracy and discontinuous ones may only differ at a few points next to their discontinuities. Batch evaluation in single precision must match parser_program_eval_float() exactly.
+*/
+void run_float_tests(){
+	const struct { const char *expr; int continuous; } exprs[] = {
+		{ "x*y + sqrt( x ) - y/(x + 1) - -x", 1 },
+		{ "pow( x, y ) + x^2 - exp( -x*y ) + x^-1 + y^3", 1 },
+		{ "log( x )*sin( y ) + cos( x*y ) - tan( y/4 )", 1 },
+		{ "asin( x/4 ) + acos( y/4 ) + atan( x - y ) + atan2( y, x ) + atan2( x - 1, y - 1 )", 1 },
+		{ "fabs( x - y )*floor( x ) + ceil( y ) + round( x*y ) + abs( x ) + fabs( y - x )", 0 },
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+		{ "(x > y ? x*x : y*y*y) + (x < y || y*x > 0) + !x + (x == y && x != y) + (x <= 1) - (y >= 2)", 0 },
+		{ "x > 1 && log( x - 1 ) < 0.5 || y != 2", 0 },
+		{ "x/y > 0.5 && x - y >= -1 && !(y == 3)", 0 },
+#endif
+		{ "cube( x ) - cube( 2 ) + sin( x )*sin( x )", 1 },
+		{ "exp( x ) - log( x ) + asin( x ) - acos( x )", 1 },
+		{ NULL, 0 }
+	};
+	double slots[2], value, error;
+	float fslots[2], fvalue, x[101*101], y[101*101], out[101*101];
+	int i, k, r, num_rows = 101*101, num_large, result = 1;
+	const char *err, *ferr;
+	parser_binding bindings[2];
+	parser_registry *reg;
+	parser_program *prog;
+	parser_data pd;
+	parser_batch pb;
+
+	printf("Testing single precision evaluation:\n");
+	reg = parser_registry_new();
+	parser_registry_add( reg, "cube", native_cube, 1, 1, PARSER_FUNCTION_PURE );
+	for( r=0; r<num_rows; r++ ){
+		x[r] = (float)( -3.0 + 0.1*(r/101) );
+		y[r] = (float)( -3.0 + 0.1*(r%101) );
+	}
+	bindings[0].name   = "x";
+	bindings[0].data   = x;
+	bindings[0].stride = 0;
+	bindings[0].type   = PARSER_TYPE_FLOAT;
+	bindings[1].name   = "y";
+	bindings[1].data   = y;
+	bindings[1].stride = 0;
+	bindings[1].type   = PARSER_TYPE_FLOAT;
+
+	for( i=0; exprs[i].expr; i++ ){
+		parser_data_init( &pd, exprs[i].expr, NULL, NULL, NULL );
+		pd.registry = reg;
+		prog = parser_compile( &pd );
+		if( !prog ){
+			printf("  '%s' failed to compile: %s\n", exprs[i].expr, pd.error );
+			result = PARSER_FALSE;
+			continue;
+		}
+		num_large = 0;
+		for( r=0; r<num_rows; r++ ){
+			fslots[0] = x[r];
+			fslots[1] = y[r];
+			slots[0]  = x[r];
+			slots[1]  = y[r];
+			value  = parser_program_eval_slots( prog, slots, NULL, &err );
+			fvalue = parser_program_eval_float( prog, fslots, NULL, &ferr );
+			error  = fvalue == value || ( value != value && fvalue != fvalue ) ? 0.0 : fabs( fvalue - value )/( fabs( value ) > 1.0 ? fabs( value ) : 1.0 );
+			if( !err != !ferr || ( !err && exprs[i].continuous && !( error <= 2e-5 ) ) ){
+				printf("  '%s' at (%g, %g): expected %g%s, got %g%s\n", exprs[i].expr, slots[0], slots[1], value, err ? " (failed)" : "", fvalue, ferr ? " (failed)" : "" );
+				result = PARSER_FALSE;
+				break;
+			}
+			num_large += !err && !( error <= 2e-5 );
+		}
+		if( num_large > num_rows/100 ){
+			printf("  '%s' differs from double precision at %d points\n", exprs[i].expr, num_large );
+			result = PARSER_FALSE;
+		}
+
+		parser_batch_init( &pb, prog, bindings, 2, NULL );
+		for( k=0; k<2; k++ ){
+			pb.simd = k;
+			parser_batch_eval_float( &pb, num_rows, out );
+			for( r=0; r<num_rows; r++ ){
+				fslots[0] = x[r];
+				fslots[1] = y[r];
+				fvalue = parser_program_eval_float( prog, fslots, NULL, &ferr );
+				if( memcmp( &fvalue, out+r, sizeof(float) ) != 0 && ( fvalue == fvalue || out[r] == out[r] ) ){
+					printf("  '%s' at (%g, %g): batch evaluation gave %g, expected %g\n", exprs[i].expr, x[r], y[r], out[r], fvalue );
+					result = PARSER_FALSE;
+					break;
+				}
+			}
+		}
+		parser_program_free( prog );
+	}
+
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	// the boolean threshold scales with the precision
+	parser_data_init( &pd, "!x", NULL, NULL, NULL );
+	prog = parser_compile( &pd );
+	fslots[0] = 1e-6f;
+	slots[0]  = 1e-6;
+	if( !prog || parser_program_eval_float( prog, fslots, NULL, NULL ) != 1.0f || parser_program_eval_slots( prog, slots, NULL, NULL ) != 0.0 ){
+		printf("  expected 1e-6 to be false in single precision only\n");
+		result = PARSER_FALSE;
+	}
+	parser_program_free( prog );
+#endif
+	parser_registry_free( reg );
+	printf( "%s\n\n", result ? "passed" : "failed" );
+}
+
 int main( void ){
     
     run_bad_input_tests();
     
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
 	run_boolean_not_tests();
 	run_boolean_comparison_tests();
 	run_boolean_logical_tests();
 	run_boolean_compound_tests();
+#endif
+	run_builtin_tests();
+	run_tokenizer_tests();
+	run_literal_tests();
+	run_precedence_tests();
+	run_compiled_program_tests();
+	run_constant_folding_tests();
+	run_variable_slot_tests();
+	run_batch_tests();
+	run_parallel_batch_tests();
+	run_registry_tests();
+	run_common_subexpression_tests();
+	run_jit_tests();
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	run_short_circuit_tests();
+#endif
+	run_cache_tests();
+	run_image_tests();
+	run_arena_tests();
+	run_differentiation_tests();
+	run_interval_tests();
+#if !defined(PARSER_EXCLUDE_BOOLEAN_OPS)
+	run_batch_predicate_tests();
+#endif
+	run_batch_reduction_tests();
+	run_typed_column_tests();
+	run_float_tests();
 	test_user_functions_and_variables();	
 	return 0;
 }
\ No newline at end of file